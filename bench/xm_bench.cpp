@@ -0,0 +1,1669 @@
+// xm_bench [--format=csv|json] [--filter=substring] [--min-time=ms]
+//
+// Times the scalar building blocks and the batch kernels and prints one row per case:
+// name, working set (elements), ns per op, ops per second and, for the batch kernels,
+// the bytes read plus written per second. Build in Release; compare runs with a diff.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "xm/xm.h"
+#include "xm/animation.h"
+#include "xm/animation_file.h"
+#include "xm/batch_eigen.h"
+#include "xm/batch_quaternion.h"
+#include "xm/batch_transforms.h"
+#include "xm/bounds.h"
+#include "xm/dispatch.h"
+#include "xm/frustum.h"
+#include "xm/math_helpers.h"
+#include "xm/misc_helpers.h"
+#include "xm/quantized.h"
+#include "xm/snapshot_stream.h"
+#include "xm/thread_pool.h"
+#include "xm/transform_hierarchy.h"
+#include "xm/vector_expr.h"
+
+using namespace xm;
+
+namespace
+{
+	struct options
+	{
+		bool json = false;
+		std::string filter;
+		double min_time_ms = 20.0;
+	};
+
+	struct result
+	{
+		std::string name;
+		size_t elements;
+		double ns_per_op;
+		double bytes_per_op;
+	};
+
+#if defined(_MSC_VER)
+	const void* volatile escape_sink;
+
+	template <typename T>
+	inline void escape(const T& value)
+	{
+		escape_sink = &value;
+	}
+#else
+	// keeps value (and everything it depends on) alive without storing it anywhere
+	template <typename T>
+	inline void escape(const T& value)
+	{
+		asm volatile("" : : "r"(&value) : "memory");
+	}
+#endif
+
+	std::mt19937 rng(12345);
+
+	float random_float(float lo = -1.0f, float hi = 1.0f)
+	{
+		return std::uniform_real_distribution<float>(lo, hi)(rng);
+	}
+
+	template <uint8_t N, typename T>
+	vector<N, T> random_vector()
+	{
+		vector<N, T> res;
+		for (uint8_t i = 0; i < N; ++i) res[i] = T(random_float());
+		return res;
+	}
+
+	template <uint8_t N, typename T>
+	matrix<N, T> random_matrix()
+	{
+		matrix<N, T> res;
+		for (uint8_t i = 0; i < N; ++i) res[i] = random_vector<N, T>();
+		return res;
+	}
+
+	template <typename T>
+	quaternion<T> random_quaternion()
+	{
+		return normalize(quaternion<T>(T(random_float()), random_vector<3, T>()));
+	}
+
+	struct runner
+	{
+		options opts;
+		std::vector<result> results;
+
+		// op(count) performs count operations; the best of 5 calibrated runs is kept
+		void run(const std::string& name, size_t elements, double bytes_per_op, const std::function<void(size_t)>& op)
+		{
+			if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+			{
+				return;
+			}
+
+			using clock = std::chrono::steady_clock;
+			auto time = [&](size_t count)
+			{
+				auto start = clock::now();
+				op(count);
+				return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+			};
+
+			size_t count = std::max<size_t>(elements, 1);
+			op(count);
+			while (time(count) < opts.min_time_ms * 1e6 && count < (size_t(1) << 40))
+			{
+				count *= 2;
+			}
+
+			double best = 1e300;
+			for (int rep = 0; rep < 5; ++rep)
+			{
+				best = std::min(best, time(count) / double(count));
+			}
+			results.push_back({ name, elements, best, bytes_per_op });
+		}
+
+		void print() const
+		{
+			if (opts.json)
+			{
+				printf("{\n  \"simd_level\": \"%s\",\n  \"results\": [\n", to_string(active_simd_level()));
+				for (size_t i = 0; i < results.size(); ++i)
+				{
+					const result& r = results[i];
+					printf("    {\"name\": \"%s\", \"elements\": %zu, \"ns_per_op\": %.4f, \"ops_per_sec\": %.6g, \"bytes_per_sec\": %.6g}%s\n",
+						r.name.c_str(), r.elements, r.ns_per_op, 1e9 / r.ns_per_op, r.bytes_per_op * 1e9 / r.ns_per_op,
+						i + 1 < results.size() ? "," : "");
+				}
+				printf("  ]\n}\n");
+			}
+			else
+			{
+				printf("name,elements,ns_per_op,ops_per_sec,bytes_per_sec\n");
+				for (const result& r : results)
+				{
+					printf("%s,%zu,%.4f,%.6g,%.6g\n",
+						r.name.c_str(), r.elements, r.ns_per_op, 1e9 / r.ns_per_op, r.bytes_per_op * 1e9 / r.ns_per_op);
+				}
+			}
+		}
+	};
+
+	// inputs are cycled through a small table so nothing can be constant folded
+	constexpr size_t table_size = 256;
+
+	template <uint8_t N, typename T>
+	void bench_matrix(runner& r, const char* type)
+	{
+		std::vector<matrix<N, T>> a(table_size), b(table_size);
+		std::vector<vector<N, T>> v(table_size);
+		for (size_t i = 0; i < table_size; ++i)
+		{
+			a[i] = random_matrix<N, T>();
+			b[i] = random_matrix<N, T>();
+			v[i] = random_vector<N, T>();
+		}
+
+		std::string prefix = std::string(type) + std::to_string(N);
+		r.run(prefix + " operator*(mat;mat)", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<N, T> res = a[i % table_size] * b[(i + 1) % table_size];
+					escape(res);
+				}
+			});
+		r.run(prefix + " operator*(mat;vec)", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					vector<N, T> res = a[i % table_size] * v[i % table_size];
+					escape(res);
+				}
+			});
+		if constexpr (N == 4)
+		{
+			// the generic loop the SIMD overloads replace
+			r.run(prefix + " operator*(mat;mat) generic", 1, 0, [&](size_t count)
+				{
+					for (size_t i = 0; i < count; ++i)
+					{
+						matrix<N, T> res = xm::operator*<N, T>(a[i % table_size], b[(i + 1) % table_size]);
+						escape(res);
+					}
+				});
+		}
+		r.run(prefix + " determinant", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					T res = determinant(a[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " inverse", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<N, T> res = inverse(a[i % table_size]);
+					escape(res);
+				}
+			});
+		if constexpr (N == 4)
+		{
+			r.run(prefix + " inverse_affine", 1, 0, [&](size_t count)
+				{
+					for (size_t i = 0; i < count; ++i)
+					{
+						matrix<N, T> res = inverse_affine(a[i % table_size]);
+						escape(res);
+					}
+				});
+			r.run(prefix + " inverse_rigid", 1, 0, [&](size_t count)
+				{
+					for (size_t i = 0; i < count; ++i)
+					{
+						matrix<N, T> res = inverse_rigid(a[i % table_size]);
+						escape(res);
+					}
+				});
+		}
+	}
+
+	template <typename T>
+	void bench_affine(runner& r, const char* type)
+	{
+		std::vector<affine3<T>> a(table_size), b(table_size);
+		std::vector<vector<3, T>> v(table_size);
+		for (size_t i = 0; i < table_size; ++i)
+		{
+			a[i] = affine3_cast(random_matrix<4, T>());
+			b[i] = affine3_cast(random_matrix<4, T>());
+			v[i] = random_vector<3, T>();
+		}
+
+		std::string prefix = type;
+		r.run(prefix + " operator*(aff;aff)", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					affine3<T> res = a[i % table_size] * b[(i + 1) % table_size];
+					escape(res);
+				}
+			});
+		r.run(prefix + " inverse", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					affine3<T> res = inverse(a[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " transform_point", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					vector<3, T> res = transform_point(a[i % table_size], v[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " mat4_cast", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<4, T> res = mat4_cast(a[i % table_size]);
+					escape(res);
+				}
+			});
+	}
+
+	template <typename T>
+	void bench_quaternion(runner& r, const char* type)
+	{
+		std::vector<quaternion<T>> q(table_size);
+		std::vector<vector<3, T>> e(table_size);
+		for (size_t i = 0; i < table_size; ++i)
+		{
+			q[i] = random_quaternion<T>();
+			e[i] = random_vector<3, T>() * T(3);
+		}
+
+		std::string prefix = type;
+		r.run(prefix + " slerp", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					quaternion<T> res = slerp(q[i % table_size], q[(i + 7) % table_size], 0.3L);
+					escape(res);
+				}
+			});
+		r.run(prefix + " mat4_cast", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<4, T> res = mat4_cast(q[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " quat_from_euler_x", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					quaternion<T> res = quat_from_euler_x(e[i % table_size].x);
+					escape(res);
+				}
+			});
+
+		r.run(prefix + " sin + cos", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					T x = e[i % table_size].x;
+					T s = T(std::sin(x)), c = T(std::cos(x));
+					escape(s);
+					escape(c);
+				}
+			});
+		// the polynomial on whole packs, per value; single values take std::sin and std::cos
+		r.run(prefix + " sincos native pack", 1, 0, [&](size_t count)
+			{
+				using V = native_pack<T>;
+				alignas(64) T x[V::width];
+				for (size_t i = 0; i < count; i += V::width)
+				{
+					for (uint8_t k = 0; k < V::width; ++k) x[k] = e[(i + k) % table_size].x;
+					V s, c;
+					sincos(V::load(x), s, c);
+					escape(s);
+					escape(c);
+				}
+			});
+		// the composition the closed forms replace
+		r.run(prefix + " quat_from_euler_xyz by products", 1, 0, [&](size_t count)
+			{
+				auto axis = [](T radians, uint8_t k)
+				{
+					vector<3, T> v(T(0));
+					v[k] = T(std::sin(radians / 2));
+					return quaternion<T>(T(std::cos(radians / 2)), v);
+				};
+				for (size_t i = 0; i < count; ++i)
+				{
+					const vector<3, T>& a = e[i % table_size];
+					quaternion<T> res = normalize(axis(a.z, 2) * axis(a.y, 1) * axis(a.x, 0));
+					escape(res);
+				}
+			});
+		r.run(prefix + " eulRotZ * eulRotY * eulRotX", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					const vector<3, T>& a = e[i % table_size];
+					matrix<3, T> res = eulRotZ<3>(a.z) * eulRotY<3>(a.y) * eulRotX<3>(a.x);
+					escape(res);
+				}
+			});
+		r.run(prefix + " eulRotXYZ<3>", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<3, T> res = eulRotXYZ<3>(e[i % table_size]);
+					escape(res);
+				}
+			});
+
+		using euler_fn = quaternion<T>(*)(vector<3, T>);
+		const std::pair<const char*, euler_fn> orders[] = {
+			{ "xyz", &quat_from_euler_xyz<T> },
+			{ "xzy", &quat_from_euler_xzy<T> },
+			{ "yxz", &quat_from_euler_yxz<T> },
+			{ "yzx", &quat_from_euler_yzx<T> },
+			{ "zxy", &quat_from_euler_zxy<T> },
+			{ "zyx", &quat_from_euler_zyx<T> },
+		};
+		for (const auto& [order, fn] : orders)
+		{
+			r.run(prefix + " quat_from_euler_" + order, 1, 0, [&, fn = fn](size_t count)
+				{
+					for (size_t i = 0; i < count; ++i)
+					{
+						quaternion<T> res = fn(e[i % table_size]);
+						escape(res);
+					}
+				});
+		}
+	}
+
+	// The precision policies side by side: the functions on whole native packs, so each op
+	// is one pack, and the scalar normalize and slerp.
+	template <precision P, typename T>
+	void bench_precision(runner& r, const std::string& prefix, const char* policy)
+	{
+		using V = native_pack<T>;
+		std::vector<T> x(table_size + V::width), y(table_size + V::width);
+		for (size_t i = 0; i < x.size(); ++i)
+		{
+			x[i] = T(random_float());
+			y[i] = T(random_float());
+		}
+		std::vector<vector<3, T>> v(table_size);
+		std::vector<quaternion<T>> q(table_size);
+		for (size_t i = 0; i < table_size; ++i)
+		{
+			v[i] = random_vector<3, T>() * T(4);
+			q[i] = random_quaternion<T>();
+		}
+
+		std::string suffix = std::string("<") + policy + ">";
+		r.run(prefix + " rsqrt" + suffix, 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					V res = rsqrt<P>(V::loadu(&x[i % table_size]) * V::loadu(&x[i % table_size]) + V(T(0.25)));
+					escape(res);
+				}
+			});
+		r.run(prefix + " acos" + suffix, 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					V res = acos<P>(V::loadu(&x[i % table_size]));
+					escape(res);
+				}
+			});
+		r.run(prefix + " atan2" + suffix, 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					V res = atan2<P>(V::loadu(&y[i % table_size]), V::loadu(&x[i % table_size]));
+					escape(res);
+				}
+			});
+		r.run(prefix + " normalize vec3" + suffix, 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					vector<3, T> res = normalize<P>(v[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " slerp" + suffix, 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					quaternion<T> res = slerp<P>(q[i % table_size], q[(i + 7) % table_size], T(0.3));
+					escape(res);
+				}
+			});
+	}
+
+	template <typename T>
+	void bench_precision(runner& r, const char* type)
+	{
+		std::string prefix = std::string(type) + " precision";
+		bench_precision<precision::exact, T>(r, prefix, "exact");
+		bench_precision<precision::fast, T>(r, prefix, "fast");
+		bench_precision<precision::approx, T>(r, prefix, "approx");
+	}
+
+	template <typename T>
+	void bench_transforms(runner& r, const char* type)
+	{
+		std::vector<vector<3, T>> v(table_size);
+		std::vector<T> s(table_size);
+		for (size_t i = 0; i < table_size; ++i)
+		{
+			v[i] = normalize(random_vector<3, T>());
+			s[i] = T(random_float(0.5f, 1.5f));
+		}
+
+		std::string prefix = type;
+		r.run(prefix + " rodriguesMatrix<3>", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<3, T> res = rodriguesMatrix<3>(v[i % table_size], s[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " rodriguesMatrix<4>", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<4, T> res = rodriguesMatrix<4>(v[i % table_size], s[i % table_size]);
+					escape(res);
+				}
+			});
+		r.run(prefix + " lookAtRH", 1, 0, [&](size_t count)
+			{
+				vector<3, T> up(T(0), T(1), T(0));
+				for (size_t i = 0; i < count; ++i)
+				{
+					auto res = lookAtRH(v[(i + 3) % table_size], v[i % table_size], up);
+					escape(res);
+				}
+			});
+		r.run(prefix + " perspective", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					matrix<4, T> res = perspective(s[i % table_size], T(16) / T(9), T(0.1), T(1000));
+					escape(res);
+				}
+			});
+	}
+
+	// Working sets from L1 resident up to DRAM bound. Each batch case reports the bytes
+	// it reads and writes per element, so bytes_per_sec can be held against the
+	// machine's bandwidth at every level.
+	const size_t batch_sizes[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 22 };
+
+	template <typename T>
+	void bench_batch(runner& r, const char* type)
+	{
+		constexpr double vec3_bytes = 3 * sizeof(T);
+		for (size_t n : batch_sizes)
+		{
+			std::vector<vector<3, T>> in(n), out(n);
+			for (auto& p : in) p = random_vector<3, T>();
+			vector_stream<3, T> sa(n), sb(n), so(n);
+			copy(vector_span<3, const T>(in.data(), n), sa);
+			copy(vector_span<3, const T>(in.data(), n), sb);
+			std::vector<T> scalars(n);
+			matrix<4, T> m = random_matrix<4, T>();
+
+			vector_span<3, const T> span_in(in.data(), n);
+			vector_span<3, T> span_out(out.data(), n);
+			std::string prefix = std::string(type) + " batch ";
+
+			// count is rounded up to whole passes over the working set
+			auto passes = [n](size_t count) { return (count + n - 1) / n; };
+
+			r.run(prefix + "transform_points aos", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) transform_points(m, span_in, span_out);
+					escape(out[0]);
+				});
+			r.run(prefix + "transform_points aos dispatched", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::transform_points(m, span_in, span_out);
+					escape(out[0]);
+				});
+			r.run(prefix + "transform_points soa", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) transform_points(m, sa, so);
+					escape(so.lane(0)[0]);
+				});
+			r.run(prefix + "transform_points soa dispatched", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::transform_points(m, sa, so);
+					escape(so.lane(0)[0]);
+				});
+			r.run(prefix + "add soa", n, 3 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) add(sa, sb, so);
+					escape(so.lane(0)[0]);
+				});
+			r.run(prefix + "dot soa", n, 2 * vec3_bytes + sizeof(T), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) dot(sa, sb, scalars.data());
+					escape(scalars[0]);
+				});
+			r.run(prefix + "normalize soa", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) normalize(sa, so);
+					escape(so.lane(0)[0]);
+				});
+			r.run(prefix + "normalize aos dispatched", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::normalize(span_in, span_out);
+					escape(out[0]);
+				});
+			r.run(prefix + "normalize<fast> soa", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) normalize<precision::fast>(sa, so);
+					escape(so.lane(0)[0]);
+				});
+			r.run(prefix + "normalize<approx> soa", n, 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) normalize<precision::approx>(sa, so);
+					escape(so.lane(0)[0]);
+				});
+		}
+	}
+
+	// Instance matrices from separate translation, rotation and scale arrays: composed one
+	// by one through matrix_transforms.h, and with the fused compose_trs kernel.
+	template <typename T>
+	void bench_trs(runner& r, const char* type)
+	{
+		for (size_t n : { size_t(1) << 10, size_t(1) << 14, size_t(1) << 18 })
+		{
+			std::vector<vector<3, T>> t(n), s(n), axis(n);
+			std::vector<T> angle(n);
+			std::vector<quaternion<T>> q(n);
+			for (size_t i = 0; i < n; ++i)
+			{
+				t[i] = random_vector<3, T>();
+				s[i] = random_vector<3, T>() + vector<3, T>(T(2));
+				axis[i] = normalize(random_vector<3, T>());
+				angle[i] = T(random_float(-3.0f, 3.0f));
+				q[i] = quaternion<T>(T(cos(angle[i] / 2)), axis[i] * T(sin(angle[i] / 2)));
+			}
+			vector_stream<3, T> ts(n), ss(n);
+			vector_stream<4, T> qs(n);
+			copy(vector_span<3, const T>(t.data(), n), ts);
+			copy(vector_span<3, const T>(s.data(), n), ss);
+			copy(vector_span<4, const T>(&q[0].w, n, sizeof(quaternion<T>)), qs);
+			std::vector<matrix<4, T>> out(n);
+			std::vector<affine3<T>> out_affine(n);
+			compose_trs(ts, qs, ss, out.data());
+
+			constexpr double in_bytes = 10 * sizeof(T);
+			auto passes = [n](size_t count) { return (count + n - 1) / n; };
+			std::string prefix = std::string(type) + " trs ";
+			r.run(prefix + "translate(scale(rotate))", n, in_bytes + sizeof(matrix<4, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) out[i] = translate(scale(rotate(matrix<4, T>(1), axis[i], angle[i]), s[i]), t[i]);
+					}
+					escape(out[0]);
+				});
+			r.run(prefix + "compose_trs mat4", n, in_bytes + sizeof(matrix<4, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) compose_trs(ts, qs, ss, out.data());
+					escape(out[0]);
+				});
+			r.run(prefix + "compose_trs mat4 dispatched", n, in_bytes + sizeof(matrix<4, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::compose_trs(ts, qs, ss, out.data());
+					escape(out[0]);
+				});
+			r.run(prefix + "compose_trs affine3 dispatched", n, in_bytes + sizeof(affine3<T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::compose_trs(ts, qs, ss, out_affine.data());
+					escape(out_affine[0]);
+				});
+			r.run(prefix + "decompose mat4", n, sizeof(matrix<4, T>) + 16 * sizeof(T), [&](size_t count)
+				{
+					vector<3, T> ds, dt, dk;
+					vector<4, T> dp;
+					quaternion<T> dq;
+					T sum = T(0);
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i)
+						{
+							decompose(out[i], ds, dq, dt, dk, dp);
+							sum += dq.w + ds.x;
+						}
+					}
+					escape(sum);
+				});
+			r.run(prefix + "recompose mat4", n, 16 * sizeof(T) + sizeof(matrix<4, T>), [&](size_t count)
+				{
+					const vector<3, T> no_skew(T(0));
+					const vector<4, T> no_perspective(T(0), T(0), T(0), T(1));
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) out[i] = recompose(s[i], q[i], t[i], no_skew, no_perspective);
+					}
+					escape(out[0]);
+				});
+		}
+	}
+
+	// Arrays of quaternions: products, vectors rotated through q * v * conjugate(q) and
+	// through mat3_cast, and the SoA kernels of batch_quaternion.h.
+	template <typename T>
+	void bench_quaternion_batch(runner& r, const char* type)
+	{
+		for (size_t n : { size_t(1) << 10, size_t(1) << 18 })
+		{
+			std::vector<quaternion<T>> a(n), b(n), res(n);
+			std::vector<vector<3, T>> v(n), rotated(n);
+			std::vector<matrix<3, T>> m3(n);
+			for (size_t i = 0; i < n; ++i)
+			{
+				a[i] = random_quaternion<T>();
+				b[i] = random_quaternion<T>();
+				v[i] = random_vector<3, T>();
+			}
+			vector_stream<4, T> as(n), bs(n), qs(n);
+			vector_stream<3, T> vs(n), os(n);
+			copy(vector_span<4, const T>(&a[0].w, n, sizeof(quaternion<T>)), as);
+			copy(vector_span<4, const T>(&b[0].w, n, sizeof(quaternion<T>)), bs);
+			copy(vector_span<3, const T>(v.data(), n), vs);
+
+			constexpr double quat_bytes = 4 * sizeof(T), vec3_bytes = 3 * sizeof(T);
+			auto passes = [n](size_t count) { return (count + n - 1) / n; };
+			std::string prefix = std::string(type) + " quaternions ";
+			r.run(prefix + "multiply", n, 3 * quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) res[i] = a[i] * b[i];
+					}
+					escape(res[0]);
+				});
+			r.run(prefix + "multiply soa", n, 3 * quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) multiply_quaternions(as, bs, qs);
+					escape(qs.lane(0)[0]);
+				});
+			r.run(prefix + "multiply soa dispatched", n, 3 * quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::multiply_quaternions(as, bs, qs);
+					escape(qs.lane(0)[0]);
+				});
+			r.run(prefix + "rotate q * v * conjugate(q)", n, quat_bytes + 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) rotated[i] = (a[i] * quaternion<T>(T(0), v[i]) * conjugate(a[i])).m;
+					}
+					escape(rotated[0]);
+				});
+			r.run(prefix + "rotate mat3_cast(q) * v", n, quat_bytes + 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) rotated[i] = mat3_cast(a[i]) * v[i];
+					}
+					escape(rotated[0]);
+				});
+			r.run(prefix + "rotate", n, quat_bytes + 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) rotated[i] = rotate(a[i], v[i]);
+					}
+					escape(rotated[0]);
+				});
+			r.run(prefix + "rotate_vectors soa", n, quat_bytes + 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) rotate_vectors(as, vs, os);
+					escape(os.lane(0)[0]);
+				});
+			r.run(prefix + "rotate_vectors soa dispatched", n, quat_bytes + 2 * vec3_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::rotate_vectors(as, vs, os);
+					escape(os.lane(0)[0]);
+				});
+			r.run(prefix + "quat_from_euler_xyz", n, vec3_bytes + quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) res[i] = quat_from_euler_xyz(v[i]);
+					}
+					escape(res[0]);
+				});
+			r.run(prefix + "euler_to_quaternions soa", n, vec3_bytes + quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) euler_to_quaternions(vs, euler_order::xyz, qs);
+					escape(qs.lane(0)[0]);
+				});
+			r.run(prefix + "euler_to_quaternions soa dispatched", n, vec3_bytes + quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::euler_to_quaternions(vs, euler_order::xyz, qs);
+					escape(qs.lane(0)[0]);
+				});
+			r.run(prefix + "mat3_cast", n, quat_bytes + sizeof(matrix<3, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) m3[i] = mat3_cast(a[i]);
+					}
+					escape(m3[0]);
+				});
+			r.run(prefix + "mat3_cast soa dispatched", n, quat_bytes + sizeof(matrix<3, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::mat3_cast(as, m3.data());
+					escape(m3[0]);
+				});
+			r.run(prefix + "orthonormalize mat3", n, 2 * sizeof(matrix<3, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) m3[i] = orthonormalize(m3[i]);
+					}
+					escape(m3[0]);
+				});
+			r.run(prefix + "orthonormalize mat3 batch", n, 2 * sizeof(matrix<3, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) orthonormalize(m3.data(), n);
+					escape(m3[0]);
+				});
+			r.run(prefix + "orthonormalize mat3 batch dispatched", n, 2 * sizeof(matrix<3, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::orthonormalize(m3.data(), n);
+					escape(m3[0]);
+				});
+		}
+	}
+
+	// Symmetric eigen decomposition of covariance-like matrices and SVD of general ones,
+	// one matrix at a time with eigen.h and a pack at a time with batch_eigen.h.
+	template <typename T>
+	void bench_eigen(runner& r, const char* type)
+	{
+		for (size_t n : { size_t(1) << 10, size_t(1) << 16 })
+		{
+			std::vector<matrix<3, T>> a(n), s(n);
+			std::vector<quaternion<T>> u(n), v(n);
+			std::vector<vector<3, T>> values(n);
+			for (size_t i = 0; i < n; ++i)
+			{
+				a[i] = random_matrix<3, T>();
+				s[i] = a[i] * transpose(a[i]);
+			}
+			vector_stream<3, T> vs(n);
+			vector_stream<4, T> us(n), qs(n);
+
+			constexpr double mat_bytes = sizeof(matrix<3, T>), vec3_bytes = 3 * sizeof(T), quat_bytes = 4 * sizeof(T);
+			auto passes = [n](size_t count) { return (count + n - 1) / n; };
+			std::string prefix = std::string(type) + " eigen ";
+			r.run(prefix + "symmetric", n, mat_bytes + vec3_bytes + quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) eigen_symmetric(s[i], values[i], v[i]);
+					}
+					escape(v[0]);
+				});
+			r.run(prefix + "symmetric batch", n, mat_bytes + vec3_bytes + quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) eigen_symmetric(s.data(), n, vs, qs);
+					escape(qs.lane(0)[0]);
+				});
+			r.run(prefix + "symmetric batch dispatched", n, mat_bytes + vec3_bytes + quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::eigen_symmetric(s.data(), n, vs, qs);
+					escape(qs.lane(0)[0]);
+				});
+			r.run(prefix + "svd", n, mat_bytes + vec3_bytes + 2 * quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p)
+					{
+						for (size_t i = 0; i < n; ++i) svd(a[i], u[i], values[i], v[i]);
+					}
+					escape(u[0]);
+				});
+			r.run(prefix + "svd batch", n, mat_bytes + vec3_bytes + 2 * quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) svd(a.data(), n, us, vs, qs);
+					escape(us.lane(0)[0]);
+				});
+			r.run(prefix + "svd batch dispatched", n, mat_bytes + vec3_bytes + 2 * quat_bytes, [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) batch::svd(a.data(), n, us, vs, qs);
+					escape(us.lane(0)[0]);
+				});
+		}
+	}
+
+	// 2000 characters with 80 joints playing one 30 fps clip at different phases, one frame
+	// at 60 fps per pass: keys found by binary search and interpolated one joint at a time
+	// with quaternion.h, and with clip_sampler. Times are per joint.
+	template <typename T>
+	void bench_animation(runner& r, const char* type)
+	{
+		constexpr uint32_t characters = 2000, joints = 80, keys = 60;
+		constexpr size_t n = size_t(characters) * joints;
+		animation_clip<T> clip(joints);
+		std::vector<T> times(keys);
+		for (uint32_t k = 0; k < keys; ++k) times[k] = T(k) / T(30);
+		for (uint32_t j = 0; j < joints; ++j)
+		{
+			std::vector<vector<3, T>> t(keys), s(keys);
+			std::vector<quaternion<T>> q(keys);
+			for (uint32_t k = 0; k < keys; ++k)
+			{
+				t[k] = random_vector<3, T>();
+				s[k] = random_vector<3, T>() * T(0.1) + vector<3, T>(T(1));
+				q[k] = random_quaternion<T>();
+			}
+			clip.set_translations(j, times.data(), t.data(), keys);
+			clip.set_rotations(j, times.data(), q.data(), keys);
+			clip.set_scales(j, times.data(), s.data(), keys);
+		}
+		T duration = clip.duration();
+
+		std::vector<T> phase(characters);
+		for (T& p : phase) p = T(random_float(0.0f, 1.0f)) * duration;
+		std::vector<clip_sampler<T>> samplers(characters, clip_sampler<T>(clip));
+		std::vector<animation_pose<T>> poses(characters), other(characters);
+		std::vector<vector<3, T>> translations(n), scales(n);
+		std::vector<quaternion<T>> rotations(n);
+		T now(0);
+		auto time_of = [&](uint32_t c) { return T(fmod(now + phase[c], duration)); };
+
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		std::string prefix = std::string(type) + " animation 2000x80 ";
+		r.run(prefix + "binary search + slerp", n, 0, [&](size_t count)
+			{
+				using channel = typename animation_clip<T>::channel;
+				// keys k0 and k1 of track j around time, as indices into the channel's values
+				auto find = [](const channel& ch, uint32_t j, T time, uint32_t& k0, uint32_t& k1)
+				{
+					const auto& tr = ch.tracks[j];
+					const T* t = ch.times.data() + tr.first;
+					uint32_t k = uint32_t(std::upper_bound(t, t + tr.count, time) - t);
+					k0 = k == 0 ? 0 : k - 1;
+					k1 = k0 + 1 < tr.count ? k0 + 1 : k0;
+					T f = k1 == k0 ? T(0) : (time - t[k0]) / (t[k1] - t[k0]);
+					k0 += tr.first;
+					k1 += tr.first;
+					return f;
+				};
+				auto vec3 = [](const channel& ch, uint32_t k) { const T* v = ch.values.data() + size_t(k) * 3; return vector<3, T>(v[0], v[1], v[2]); };
+				auto quat = [](const channel& ch, uint32_t k) { const T* v = ch.values.data() + size_t(k) * 4; return quaternion<T>(v[0], v[1], v[2], v[3]); };
+
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					now += T(1) / T(60);
+					for (uint32_t c = 0; c < characters; ++c)
+					{
+						T time = time_of(c);
+						for (uint32_t j = 0; j < joints; ++j)
+						{
+							size_t i = size_t(c) * joints + j;
+							uint32_t k0, k1;
+							const channel& t = clip.channels[animation_clip<T>::translation];
+							T f = find(t, j, time, k0, k1);
+							translations[i] = vec3(t, k0) + (vec3(t, k1) - vec3(t, k0)) * f;
+
+							const channel& q = clip.channels[animation_clip<T>::rotation];
+							f = find(q, j, time, k0, k1);
+							rotations[i] = slerp(quat(q, k0), quat(q, k1), f);
+
+							const channel& s = clip.channels[animation_clip<T>::scale];
+							f = find(s, j, time, k0, k1);
+							scales[i] = vec3(s, k0) + (vec3(s, k1) - vec3(s, k0)) * f;
+						}
+					}
+				}
+				escape(rotations[0]);
+			});
+		r.run(prefix + "clip_sampler nlerp", n, 0, [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					now += T(1) / T(60);
+					for (uint32_t c = 0; c < characters; ++c) samplers[c].sample(time_of(c), poses[c]);
+				}
+				escape(poses[0].rotations.lane(0)[0]);
+			});
+		r.run(prefix + "clip_sampler slerp", n, 0, [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					now += T(1) / T(60);
+					for (uint32_t c = 0; c < characters; ++c) samplers[c].sample(time_of(c), poses[c], rotation_blend::slerp);
+				}
+				escape(poses[0].rotations.lane(0)[0]);
+			});
+		// The same clip stored in a file image: the keys are checked in place by open, where
+		// loading into an animation_clip copies every track.
+		animation_file_writer<T> writer;
+		writer.add_clip(0, clip);
+		std::vector<unsigned char> image = writer.finish();
+		animation_file<T> file;
+		file.open(image.data(), image.size());
+		std::vector<clip_sampler<T>> mapped(characters, clip_sampler<T>(file.clip(0)));
+		r.run(prefix + "clip_sampler nlerp from file", n, 0, [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					now += T(1) / T(60);
+					for (uint32_t c = 0; c < characters; ++c) mapped[c].sample(time_of(c), poses[c]);
+				}
+				escape(poses[0].rotations.lane(0)[0]);
+			});
+		r.run(std::string(type) + " animation clip load copy", joints, 0, [&](size_t count)
+			{
+				for (size_t p = (count + joints - 1) / joints; p > 0; --p)
+				{
+					animation_clip<T> copy(joints);
+					animation_clip_view<T> v = file.clip(0);
+					for (uint32_t j = 0; j < joints; ++j)
+					{
+						const animation_track& t = v.channels[0].tracks[j];
+						const animation_track& q = v.channels[1].tracks[j];
+						const animation_track& s = v.channels[2].tracks[j];
+						copy.set_translations(j, v.channels[0].times + t.first, reinterpret_cast<const vector<3, T>*>(v.channels[0].values) + t.first, t.count);
+						std::vector<quaternion<T>> rotations(q.count);
+						for (uint32_t k = 0; k < q.count; ++k)
+						{
+							const T* x = v.channels[1].values + size_t(q.first + k) * 4;
+							rotations[k] = quaternion<T>(x[0], x[1], x[2], x[3]);
+						}
+						copy.set_rotations(j, v.channels[1].times + q.first, rotations.data(), q.count);
+						copy.set_scales(j, v.channels[2].times + s.first, reinterpret_cast<const vector<3, T>*>(v.channels[2].values) + s.first, s.count);
+					}
+					escape(copy);
+				}
+			});
+		r.run(std::string(type) + " animation clip load in place", joints, 0, [&](size_t count)
+			{
+				for (size_t p = (count + joints - 1) / joints; p > 0; --p)
+				{
+					animation_file<T> f;
+					f.open(image.data(), image.size());
+					escape(f);
+				}
+			});
+
+		r.run(prefix + "clip_sampler nlerp + blend of 2", n, 0, [&](size_t count)
+			{
+				std::vector<clip_sampler<T>> second(characters, clip_sampler<T>(clip));
+				const T weights[2] = { T(0.7), T(0.3) };
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					now += T(1) / T(60);
+					for (uint32_t c = 0; c < characters; ++c)
+					{
+						samplers[c].sample(time_of(c), poses[c]);
+						second[c].sample(T(fmod(now * T(1.5), duration)), other[c]);
+						const animation_pose<T>* in[2] = { &poses[c], &other[c] };
+						blend_poses(in, weights, 2, poses[c]);
+					}
+				}
+				escape(poses[0].rotations.lane(0)[0]);
+			});
+	}
+
+	// Encode and decode between float arrays (AoS, as stored in a mesh or a pose) and the
+	// quantized.h types. bytes_per_sec counts the floats and the packed data.
+	void bench_quantized(runner& r)
+	{
+		constexpr size_t n = size_t(1) << 18;
+		std::vector<vector<3, float>> v(n), normals(n), decoded(n);
+		std::vector<quaternion<float>> q(n), decoded_q(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			v[i] = random_vector<3, float>() * 100.0f;
+			normals[i] = normalize(random_vector<3, float>() + vector<3, float>(0.01f));
+			q[i] = random_quaternion<float>();
+		}
+		std::vector<half_vector<3>> halves(n);
+		std::vector<snorm16_vector<3>> snorms(n);
+		std::vector<octahedral_normal> octahedral(n);
+		std::vector<quaternion32> q32(n);
+		std::vector<quaternion48> q48(n);
+
+		vector_span<3, const float> vs(v.data(), n), ns(normals.data(), n);
+		vector_span<3, float> out(decoded.data(), n);
+		vector_span<4, const float> qs(&q[0].w, n, sizeof(quaternion<float>));
+		vector_span<4, float> qout(&decoded_q[0].w, n, sizeof(quaternion<float>));
+
+		constexpr double vec3_bytes = 3 * sizeof(float), quat_bytes = 4 * sizeof(float);
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		auto bench = [&](const std::string& name, double bytes, auto encode, auto decode)
+			{
+				r.run("quantized encode " + name, n, bytes, [&](size_t count)
+					{
+						for (size_t p = passes(count); p > 0; --p) encode();
+					});
+				r.run("quantized decode " + name, n, bytes, [&](size_t count)
+					{
+						for (size_t p = passes(count); p > 0; --p) decode();
+						escape(decoded[0]);
+						escape(decoded_q[0]);
+					});
+			};
+		bench("vec3 half", vec3_bytes + sizeof(half_vector<3>),
+			[&] { encode_half(vs, halves.data()); escape(halves[0]); },
+			[&] { decode(halves.data(), n, out); });
+		bench("vec3 snorm16", vec3_bytes + sizeof(snorm16_vector<3>),
+			[&] { encode_snorm16(ns, snorms.data()); escape(snorms[0]); },
+			[&] { decode(snorms.data(), n, out); });
+		bench("normal octahedral", vec3_bytes + sizeof(octahedral_normal),
+			[&] { encode_octahedral(ns, octahedral.data()); escape(octahedral[0]); },
+			[&] { decode(octahedral.data(), n, out); });
+		bench("quaternion32", quat_bytes + sizeof(quaternion32),
+			[&] { encode_quaternion32(qs, q32.data()); escape(q32[0]); },
+			[&] { decode(q32.data(), n, qout); });
+		bench("quaternion48", quat_bytes + sizeof(quaternion48),
+			[&] { encode_quaternion48(qs, q48.data()); escape(q48[0]); },
+			[&] { decode(q48.data(), n, qout); });
+	}
+
+	// Replay capture of 100k objects, a third at rest and the rest moving and turning at
+	// constant rates, over 64 frames: encoding a frame, decoding the next frame as in
+	// playback and decoding random frames as in scrubbing. Times are per object;
+	// bytes_per_sec counts the compressed bytes (raw frames are 28 bytes per object).
+	void bench_snapshot(runner& r)
+	{
+		constexpr size_t n = 100000, frames = 64;
+		std::vector<vector<3, float>> positions(n), velocities(n);
+		std::vector<quaternion<float>> rotations(n), spins(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			positions[i] = random_vector<3, float>() * 500.0f;
+			rotations[i] = random_quaternion<float>();
+			bool moving = i % 3 != 0;
+			velocities[i] = moving ? random_vector<3, float>() * 0.1f : vector<3, float>(0.0f);
+			spins[i] = moving ? normalize(quaternion<float>(1.0f, random_vector<3, float>() * 0.01f)) : quaternion<float>(1.0f, vector<3, float>(0.0f));
+		}
+
+		vector_span<3, const float> ps(positions.data(), n);
+		vector_span<4, const float> qs(&rotations[0].w, n, sizeof(quaternion<float>));
+		std::vector<unsigned char> stream, chunk;
+		snapshot_encoder encoder(n);
+		for (size_t f = 0; f < frames; ++f)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				positions[i] = positions[i] + velocities[i];
+				rotations[i] = normalize(rotations[i] * spins[i]);
+			}
+			encoder.add_frame(ps, qs);
+			while (encoder.take_chunk(chunk)) stream.insert(stream.end(), chunk.begin(), chunk.end());
+		}
+		encoder.finish();
+		while (encoder.take_chunk(chunk)) stream.insert(stream.end(), chunk.begin(), chunk.end());
+
+		snapshot_decoder decoder;
+		decoder.open(stream.data(), stream.size());
+		vector_stream<3, float> decoded_positions(n);
+		vector_stream<4, float> decoded_rotations(n);
+
+		const double bytes = double(stream.size()) / double(n * frames);
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		r.run("snapshot encode frame", n, bytes, [&](size_t count)
+			{
+				snapshot_encoder e(n);
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					e.add_frame(ps, qs);
+					while (e.take_chunk(chunk)) {}
+				}
+				escape(chunk);
+			});
+		r.run("snapshot decode next frame", n, bytes, [&](size_t count)
+			{
+				uint64_t frame = 0;
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					decoder.decode(frame, decoded_positions, decoded_rotations);
+					frame = (frame + 1) % frames;
+				}
+				escape(decoded_positions.lane(0)[0]);
+			});
+		r.run("snapshot decode random frame", n, bytes, [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					decoder.decode(rng() % frames, decoded_positions, decoded_rotations);
+				}
+				escape(decoded_positions.lane(0)[0]);
+			});
+	}
+
+	// World matrix update of a 200k node hierarchy (random parents, 8 children on average)
+	// after moving 5% of the nodes and after moving all of them. Times are per node.
+	template <typename T>
+	void bench_hierarchy(runner& r, const char* type)
+	{
+		constexpr uint32_t n = 200000;
+		transform_hierarchy<T> h;
+		std::mt19937 rng(7);
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			uint32_t parent = i < 64 ? h.no_parent : uint32_t(rng() % (i / 8));
+			h.add(parent, random_vector<3, T>(), random_quaternion<T>(), vector<3, T>(T(1)));
+		}
+		h.update();
+
+		std::vector<uint32_t> moving(n / 20);
+		for (uint32_t& m : moving) m = uint32_t(rng() % n);
+
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		std::string prefix = std::string(type) + " hierarchy update ";
+		r.run(prefix + "5% moved", n, 0, [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					for (uint32_t m : moving) h.set_translation(m, h.translation(m) + vector<3, T>(T(1e-3)));
+					h.update();
+				}
+				escape(h.world_matrix(0));
+			});
+		r.run(prefix + "all moved", n, 0, [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					for (uint32_t m = 0; m < n; ++m) h.set_translation(m, h.translation(m) + vector<3, T>(T(1e-3)));
+					h.update();
+				}
+				escape(h.world_matrix(0));
+			});
+	}
+
+	// 500k bounds scattered around a camera, about a tenth of them visible
+	template <typename T>
+	void bench_culling(runner& r, const char* type)
+	{
+		constexpr size_t n = 500000;
+		frustum<T> f = extract_frustum(perspective(T(1.0), T(1.5), T(0.5), T(100)));
+		vector_stream<3, T> centers(n), min(n), max(n);
+		std::vector<T> radii(n);
+		std::vector<uint32_t> visible(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			vector<3, T> c = random_vector<3, T>() * T(60);
+			vector<3, T> e = (random_vector<3, T>() + vector<3, T>(T(1))) * T(2);
+			centers.set(i, c);
+			min.set(i, c - e);
+			max.set(i, c + e);
+			radii[i] = T(random_float(0.0f, 6.0f));
+		}
+
+		std::string prefix = std::string(type) + " cull ";
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		r.run(prefix + "spheres", n, 4 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(cull_spheres(f, centers, radii.data(), visible.data()));
+			});
+		r.run(prefix + "spheres dispatched", n, 4 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(batch::cull_spheres(f, centers, radii.data(), visible.data()));
+			});
+		r.run(prefix + "aabbs", n, 6 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(cull_aabbs(f, min, max, visible.data()));
+			});
+		r.run(prefix + "aabbs dispatched", n, 6 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(batch::cull_aabbs(f, min, max, visible.data()));
+			});
+	}
+
+	// 1, 2, 4, ... threads up to the hardware's count (which is always included)
+	std::vector<unsigned> thread_counts()
+	{
+		unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<unsigned> res;
+		for (unsigned t = 1; t < hardware; t *= 2) res.push_back(t);
+		res.push_back(hardware);
+		return res;
+	}
+
+	// Batch kernels and a hierarchy update on thread pools of
+	// growing size, for the scaling curve of each. Rows are named "<type> threads <n> ...";
+	// ns per op times n stays flat while the work scales. The large working sets end up
+	// bandwidth bound long before a big machine runs out of cores.
+	template <typename T>
+	void bench_threads(runner& r, const char* type)
+	{
+		constexpr size_t n = size_t(1) << 22;
+		std::vector<vector<3, T>> points(n);
+		for (auto& p : points) p = random_vector<3, T>() * T(60);
+		vector_stream<3, T> in(n), out(n), min(n), max(n), scales(n);
+		vector_stream<4, T> rotations(n);
+		copy(vector_span<3, const T>(points.data(), n), in);
+		for (size_t i = 0; i < n; ++i)
+		{
+			vector<3, T> e = (random_vector<3, T>() + vector<3, T>(T(1))) * T(2);
+			min.set(i, points[i] - e);
+			max.set(i, points[i] + e);
+			scales.set(i, vector<3, T>(T(1)));
+			quaternion<T> q = random_quaternion<T>();
+			rotations.set(i, vector<4, T>(q.w, q.m.x, q.m.y, q.m.z));
+		}
+		std::vector<matrix<4, T>> matrices(n);
+		std::vector<uint32_t> visible(n);
+		matrix<4, T> m = random_matrix<4, T>();
+		frustum<T> f = extract_frustum(perspective(T(1.0), T(1.5), T(0.5), T(100)));
+
+		constexpr uint32_t nodes = 200000;
+		transform_hierarchy<T> h;
+		std::mt19937 tree_rng(7);
+		for (uint32_t i = 0; i < nodes; ++i)
+		{
+			uint32_t parent = i < 64 ? h.no_parent : uint32_t(tree_rng() % (i / 8));
+			h.add(parent, random_vector<3, T>(), random_quaternion<T>(), vector<3, T>(T(1)));
+		}
+		h.update();
+
+		auto passes = [](size_t count, size_t size) { return (count + size - 1) / size; };
+		for (unsigned threads : thread_counts())
+		{
+			thread_pool pool(threads);
+			std::string prefix = std::string(type) + " threads " + std::to_string(threads) + " ";
+			r.run(prefix + "transform_points soa", n, 6 * sizeof(T), [&](size_t count)
+				{
+					for (size_t p = passes(count, n); p > 0; --p) batch::transform_points(pool, m, in, out);
+					escape(out.lane(0)[0]);
+				});
+			r.run(prefix + "compose_trs mat4", n, 10 * sizeof(T) + sizeof(matrix<4, T>), [&](size_t count)
+				{
+					for (size_t p = passes(count, n); p > 0; --p) batch::compose_trs(pool, in, rotations, scales, matrices.data());
+					escape(matrices[0]);
+				});
+			r.run(prefix + "cull aabbs", n, 6 * sizeof(T), [&](size_t count)
+				{
+					for (size_t p = passes(count, n); p > 0; --p) escape(batch::cull_aabbs(pool, f, min, max, visible.data()));
+				});
+			r.run(prefix + "hierarchy update all moved", nodes, 0, [&](size_t count)
+				{
+					for (size_t p = passes(count, nodes); p > 0; --p)
+					{
+						for (uint32_t i = 0; i < nodes; ++i) h.set_translation(i, h.translation(i) + vector<3, T>(T(1e-3)));
+						h.update(pool);
+					}
+					escape(h.world_matrix(0));
+				});
+		}
+	}
+
+	// Bounding volumes of 2^20 points in an elongated, rotated cloud, read as vec3, as the
+	// xyz of vec4 and as a vector_stream, against a plain loop over vec3 for the aabb;
+	// then on thread pools of growing size.
+	template <typename T>
+	void bench_bounds(runner& r, const char* type)
+	{
+		constexpr size_t n = size_t(1) << 20;
+		std::vector<vector<3, T>> points(n);
+		std::vector<vector<4, T>> points4(n);
+		matrix<3, T> rotation = mat3_cast(random_quaternion<T>());
+		for (size_t i = 0; i < n; ++i)
+		{
+			vector<3, T> v = random_vector<3, T>();
+			points[i] = rotation * vector<3, T>(v.x * T(10), v.y, v.z * T(0.1));
+			points4[i] = vector<4, T>(points[i].x, points[i].y, points[i].z, T(1));
+		}
+		vector_stream<3, T> stream(n);
+		copy(vector_span<3, const T>(points.data(), n), stream);
+		vector_span<3, const T> span3(points.data(), n), span4(&points4[0].x, n, sizeof(vector<4, T>));
+
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		std::string prefix = std::string(type) + " bounds ";
+		r.run(prefix + "aabb loop vec3", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					aabb<T> b{ points[0], points[0] };
+					for (const vector<3, T>& q : points)
+					{
+						for (uint8_t c = 0; c < 3; ++c)
+						{
+							b.min[c] = std::min(b.min[c], q[c]);
+							b.max[c] = std::max(b.max[c], q[c]);
+						}
+					}
+					escape(b);
+				}
+			});
+		r.run(prefix + "aabb vec3", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_aabb(span3));
+			});
+		r.run(prefix + "aabb vec4", n, 4 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_aabb(span4));
+			});
+		r.run(prefix + "aabb stream", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_aabb(stream));
+			});
+		r.run(prefix + "sphere vec3", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_sphere(span3));
+			});
+		r.run(prefix + "sphere stream", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_sphere(stream));
+			});
+		r.run(prefix + "obb vec3", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_obb(span3));
+			});
+		r.run(prefix + "obb stream", n, 3 * sizeof(T), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) escape(bounding_obb(stream));
+			});
+
+		for (unsigned threads : thread_counts())
+		{
+			thread_pool pool(threads);
+			std::string threaded = std::string(type) + " threads " + std::to_string(threads) + " bounds ";
+			r.run(threaded + "aabb vec3", n, 3 * sizeof(T), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) escape(bounding_aabb(span3, pool));
+				});
+			r.run(threaded + "sphere vec3", n, 3 * sizeof(T), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) escape(bounding_sphere(span3, pool));
+				});
+			r.run(threaded + "obb stream", n, 3 * sizeof(T), [&](size_t count)
+				{
+					for (size_t p = passes(count); p > 0; --p) escape(bounding_obb(stream, pool));
+				});
+		}
+	}
+
+#if defined(_MSC_VER)
+#define XM_BENCH_NOINLINE __declspec(noinline)
+#else
+#define XM_BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+	// The same chain through the operators of vector.h and through vector_expr.h. They are
+	// kept out of line so their code can be compared directly, e.g.
+	//	objdump -d -C --no-show-raw-insn xm_bench | grep -A40 "chain_lazy<3, float>"
+	template <uint8_t N, typename T>
+	XM_BENCH_NOINLINE void chain_operators(const vector<N, T>* a, const vector<N, T>* b, const vector<N, T>* c, T s, T t, vector<N, T>* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			out[i] = a[i] * s + b[i] * t - c[i];
+		}
+	}
+
+	template <uint8_t N, typename T>
+	XM_BENCH_NOINLINE void chain_lazy(const vector<N, T>* a, const vector<N, T>* b, const vector<N, T>* c, T s, T t, vector<N, T>* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			out[i] = lazy(a[i]) * s + lazy(b[i]) * t - c[i];
+		}
+	}
+
+	template <uint8_t N, typename T>
+	void bench_expr(runner& r, const char* type)
+	{
+		// L1 resident, so the rows differ by the arithmetic and temporaries only
+		constexpr size_t n = 512;
+		std::vector<vector<N, T>> a(n), b(n), c(n), out(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			a[i] = random_vector<N, T>();
+			b[i] = random_vector<N, T>();
+			c[i] = random_vector<N, T>();
+		}
+		T s = T(random_float()), t = T(random_float());
+
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		std::string prefix = std::string(type) + std::to_string(N) + " a*s + b*t - c ";
+		r.run(prefix + "operators", n, 4 * sizeof(vector<N, T>), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) chain_operators(a.data(), b.data(), c.data(), s, t, out.data(), n);
+				escape(out[0]);
+			});
+		r.run(prefix + "lazy", n, 4 * sizeof(vector<N, T>), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p) chain_lazy(a.data(), b.data(), c.data(), s, t, out.data(), n);
+				escape(out[0]);
+			});
+	}
+
+	// One 4x4 product behind a call boundary, so the argument copies and the zeroed
+	// temporary of each calling convention stay visible.
+	template <typename T>
+	XM_BENCH_NOINLINE matrix<4, T> product_by_value(matrix<4, T> a, matrix<4, T> b)
+	{
+		return a * b;
+	}
+
+	template <typename T>
+	XM_BENCH_NOINLINE matrix<4, T> product_by_reference(const matrix<4, T>& a, const matrix<4, T>& b)
+	{
+		return a * b;
+	}
+
+	template <typename T>
+	XM_BENCH_NOINLINE void product_into(matrix<4, T>& out, const matrix<4, T>& a, const matrix<4, T>& b)
+	{
+		mul_into(out, a, b);
+	}
+
+	template <typename T>
+	void bench_in_place(runner& r, const char* type, const char* quat_type)
+	{
+		// rotations, so the *= chains stay finite
+		std::vector<matrix<4, T>> a(table_size), b(table_size), c(table_size);
+		std::vector<quaternion<T>> qa(table_size), qb(table_size), qc(table_size);
+		for (size_t i = 0; i < table_size; ++i)
+		{
+			qa[i] = random_quaternion<T>();
+			qb[i] = random_quaternion<T>();
+			a[i] = mat4_cast(qa[i]);
+			b[i] = mat4_cast(qb[i]);
+		}
+
+		std::string prefix = std::string(type) + "4 ";
+		r.run(prefix + "a * b call by value", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i) c[i % table_size] = product_by_value(a[i % table_size], b[(i + 1) % table_size]);
+				escape(c[0]);
+			});
+		r.run(prefix + "a * b call by reference", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i) c[i % table_size] = product_by_reference(a[i % table_size], b[(i + 1) % table_size]);
+				escape(c[0]);
+			});
+		r.run(prefix + "mul_into call", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i) product_into(c[i % table_size], a[i % table_size], b[(i + 1) % table_size]);
+				escape(c[0]);
+			});
+		r.run(prefix + "acc = acc * b", 1, 0, [&](size_t count)
+			{
+				matrix<4, T> acc(T(1));
+				for (size_t i = 0; i < count; ++i) acc = acc * b[i % table_size];
+				escape(acc);
+			});
+		r.run(prefix + "acc *= b", 1, 0, [&](size_t count)
+			{
+				matrix<4, T> acc(T(1));
+				for (size_t i = 0; i < count; ++i) acc *= b[i % table_size];
+				escape(acc);
+			});
+
+		std::string qprefix = std::string(quat_type) + " ";
+		r.run(qprefix + "c = a * b", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i) qc[i % table_size] = qa[i % table_size] * qb[(i + 1) % table_size];
+				escape(qc[0]);
+			});
+		r.run(qprefix + "mul_into", 1, 0, [&](size_t count)
+			{
+				for (size_t i = 0; i < count; ++i) mul_into(qc[i % table_size], qa[i % table_size], qb[(i + 1) % table_size]);
+				escape(qc[0]);
+			});
+		r.run(qprefix + "acc *= b", 1, 0, [&](size_t count)
+			{
+				quaternion<T> acc(T(1), T(0), T(0), T(0));
+				for (size_t i = 0; i < count; ++i) acc *= qb[i % table_size];
+				escape(acc);
+			});
+
+		// a buffer per pass, as a frame's scratch matrices would be
+		constexpr size_t n = 4096;
+		auto passes = [](size_t count) { return (count + n - 1) / n; };
+		r.run(prefix + "buffer zero filled", n, sizeof(matrix<4, T>), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					std::vector<matrix<4, T>> buffer(n);
+					escape(buffer[n - 1]);
+				}
+			});
+		r.run(prefix + "buffer uninitialized_allocator", n, sizeof(matrix<4, T>), [&](size_t count)
+			{
+				for (size_t p = passes(count); p > 0; --p)
+				{
+					std::vector<matrix<4, T>, uninitialized_allocator<matrix<4, T>>> buffer(n);
+					escape(buffer[n - 1]);
+				}
+			});
+	}
+
+	options parse(int argc, char** argv)
+	{
+		options opts;
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* arg = argv[i];
+			if (strcmp(arg, "--format=json") == 0)
+			{
+				opts.json = true;
+			}
+			else if (strcmp(arg, "--format=csv") == 0)
+			{
+				opts.json = false;
+			}
+			else if (strncmp(arg, "--filter=", 9) == 0)
+			{
+				opts.filter = arg + 9;
+			}
+			else if (strncmp(arg, "--min-time=", 11) == 0)
+			{
+				opts.min_time_ms = atof(arg + 11);
+			}
+			else
+			{
+				fprintf(stderr, "usage: xm_bench [--format=csv|json] [--filter=substring] [--min-time=ms]\n");
+				exit(1);
+			}
+		}
+		return opts;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	runner r;
+	r.opts = parse(argc, argv);
+
+	bench_matrix<2, float>(r, "mat");
+	bench_matrix<3, float>(r, "mat");
+	bench_matrix<4, float>(r, "mat");
+	bench_matrix<2, double>(r, "dmat");
+	bench_matrix<3, double>(r, "dmat");
+	bench_matrix<4, double>(r, "dmat");
+
+	bench_affine<float>(r, "aff3");
+	bench_affine<double>(r, "daff3");
+
+	bench_quaternion<float>(r, "quat");
+	bench_quaternion<double>(r, "dquat");
+
+	bench_precision<float>(r, "float");
+	bench_precision<double>(r, "double");
+
+	bench_in_place<float>(r, "mat", "quat");
+	bench_in_place<double>(r, "dmat", "dquat");
+
+	bench_transforms<float>(r, "float");
+	bench_transforms<double>(r, "double");
+
+	bench_expr<3, float>(r, "vec");
+	bench_expr<4, float>(r, "vec");
+	bench_expr<3, double>(r, "dvec");
+	bench_expr<4, double>(r, "dvec");
+
+	bench_batch<float>(r, "float");
+	bench_batch<double>(r, "double");
+
+	bench_trs<float>(r, "float");
+	bench_trs<double>(r, "double");
+
+	bench_quaternion_batch<float>(r, "float");
+	bench_quaternion_batch<double>(r, "double");
+
+	bench_eigen<float>(r, "float");
+	bench_eigen<double>(r, "double");
+
+	bench_animation<float>(r, "float");
+
+	bench_quantized(r);
+	bench_snapshot(r);
+
+	bench_hierarchy<float>(r, "float");
+	bench_hierarchy<double>(r, "double");
+
+	bench_culling<float>(r, "float");
+	bench_culling<double>(r, "double");
+
+	bench_threads<float>(r, "float");
+	bench_threads<double>(r, "double");
+
+	bench_bounds<float>(r, "float");
+	bench_bounds<double>(r, "double");
+
+	r.print();
+	return 0;
+}
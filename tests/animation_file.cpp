@@ -0,0 +1,377 @@
+// Animation file images: what animation_file_writer writes must open and read back bit for
+// bit, and open must reject every image whose header, section table or arrays do not fit
+// the buffer, with the status that says why, before any view reads from it.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include "xm/xm.h"
+#include "xm/animation_file.h"
+
+using namespace xm;
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const char* what, const char* type)
+	{
+		if (!ok)
+		{
+			std::printf("FAIL %s %s\n", type, what);
+			++failures;
+		}
+	}
+
+	void check_status(file_status status, file_status expected, const char* what, const char* type)
+	{
+		if (status != expected)
+		{
+			std::printf("FAIL %s %s: %s, expected %s\n", type, what, to_string(status), to_string(expected));
+			++failures;
+		}
+	}
+
+	// a file image in 8 byte aligned storage, with access to its headers by offset
+	struct image
+	{
+		explicit image(const std::vector<unsigned char>& bytes) : size(bytes.size()), words((bytes.size() + 7) / 8 + 1, 0)
+		{
+			std::memcpy(words.data(), bytes.data(), bytes.size());
+		}
+
+		unsigned char* data() { return reinterpret_cast<unsigned char*>(words.data()); }
+
+		template <typename H>
+		H get(size_t offset) { H h; std::memcpy(&h, data() + offset, sizeof(h)); return h; }
+
+		template <typename H>
+		void set(size_t offset, const H& h) { std::memcpy(data() + offset, &h, sizeof(h)); }
+
+		file_format::file_header header() { return get<file_format::file_header>(0); }
+
+		size_t entry_offset(size_t i) { return sizeof(file_format::file_header) + i * sizeof(file_format::section_entry); }
+
+		file_format::section_entry entry(size_t i) { return get<file_format::section_entry>(entry_offset(i)); }
+
+		size_t size;
+		std::vector<uint64_t> words;
+	};
+
+	template <typename T>
+	file_status open(image& im, size_t size)
+	{
+		animation_file<T> file;
+		file_status status = file.open(im.data(), size);
+		if (status != file_status::ok && (file.is_open() || file.sections() != 0))
+		{
+			std::printf("FAIL open kept a view of a rejected image\n");
+			++failures;
+		}
+		return status;
+	}
+
+	template <typename T>
+	animation_clip<T> random_clip(uint32_t joints, std::mt19937& rng)
+	{
+		std::uniform_real_distribution<T> value(T(-10), T(10));
+		std::uniform_real_distribution<T> step(T(0.001), T(0.1));
+		animation_clip<T> clip(joints);
+		for (uint32_t j = 0; j < joints; ++j)
+		{
+			// every third joint has no keys in some channel and keeps the identity there
+			size_t keys[3] = { j % 3 == 1 ? 0u : 1 + rng() % 9, 1 + rng() % 9, j % 3 == 2 ? 0u : 1 + rng() % 9 };
+			std::vector<T> times[3];
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				T t = T(0);
+				for (size_t k = 0; k < keys[c]; ++k) times[c].push_back(t += step(rng));
+			}
+			std::vector<vector<3, T>> v3;
+			std::vector<quaternion<T>> q;
+			for (size_t k = 0; k < keys[0]; ++k) v3.push_back(vector<3, T>(value(rng), value(rng), value(rng)));
+			if (keys[0] != 0) clip.set_translations(j, times[0].data(), v3.data(), keys[0]);
+			for (size_t k = 0; k < keys[1]; ++k) q.push_back(normalize(quaternion<T>(value(rng), vector<3, T>(value(rng), value(rng), value(rng)))));
+			clip.set_rotations(j, times[1].data(), q.data(), keys[1]);
+			v3.clear();
+			for (size_t k = 0; k < keys[2]; ++k) v3.push_back(vector<3, T>(value(rng), value(rng), value(rng)));
+			if (keys[2] != 0) clip.set_scales(j, times[2].data(), v3.data(), keys[2]);
+		}
+		return clip;
+	}
+
+	template <typename T>
+	bool same_bytes(const T* a, const T* b, size_t count)
+	{
+		return count == 0 || std::memcmp(a, b, count * sizeof(T)) == 0;
+	}
+
+	// a clip (section 0, id 11) and a transform set (section 1, id 22)
+	template <typename T>
+	void test_type(const char* type)
+	{
+		using namespace file_format;
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<T> value(T(-100), T(100));
+		const uint32_t joints = 13;
+		const size_t transforms = 37;
+		animation_clip<T> clip = random_clip<T>(joints, rng);
+		vector_stream<3, T> translations(transforms), scales(transforms);
+		vector_stream<4, T> rotations(transforms);
+		for (uint8_t c = 0; c < 3; ++c)
+		{
+			for (size_t i = 0; i < transforms; ++i)
+			{
+				translations.lane(c)[i] = value(rng);
+				scales.lane(c)[i] = value(rng);
+			}
+		}
+		for (uint8_t c = 0; c < 4; ++c)
+		{
+			for (size_t i = 0; i < transforms; ++i) rotations.lane(c)[i] = value(rng);
+		}
+
+		animation_file_writer<T> writer;
+		writer.add_clip(11, clip);
+		writer.add_transform_set(22, translations, rotations, scales);
+		const std::vector<unsigned char> bytes = writer.finish();
+
+		// writer to reader
+		{
+			image im(bytes);
+			animation_file<T> file;
+			check_status(file.open(im.data(), im.size), file_status::ok, "round trip open", type);
+			check(file.is_open() && file.sections() == 2, "round trip sections", type);
+			check(file.find(section_kind::clip, 11) == 0 && file.find(section_kind::transform_set, 22) == 1, "round trip find", type);
+			check(file.find(section_kind::clip, 22) == animation_file<T>::npos, "round trip find of a missing id", type);
+			if (file.sections() == 2)
+			{
+				animation_clip_view<T> view = file.clip(0);
+				bool same = view.joints == joints;
+				for (uint8_t c = 0; c < 3 && same; ++c)
+				{
+					const typename animation_clip<T>::channel& ch = clip.channels[c];
+					same = same_bytes(view.channels[c].tracks, ch.tracks.data(), ch.tracks.size())
+						&& same_bytes(view.channels[c].times, ch.times.data(), ch.times.size())
+						&& same_bytes(view.channels[c].values, ch.values.data(), ch.values.size());
+				}
+				check(same, "round trip clip", type);
+
+				transform_set_view<T> set = file.transform_set(1);
+				same = set.size() == transforms;
+				for (uint8_t c = 0; c < 3 && same; ++c)
+				{
+					same = same_bytes(set.lanes[c], translations.lane(c), transforms) && same_bytes(set.lanes[7 + c], scales.lane(c), transforms);
+				}
+				for (uint8_t c = 0; c < 4 && same; ++c) same = same_bytes(set.lanes[3 + c], rotations.lane(c), transforms);
+				check(same, "round trip transform set", type);
+			}
+
+			// an empty file and a buffer longer than the image
+			check_status(open<T>(im, im.size + 5), file_status::ok, "buffer past the image", type);
+			image empty(animation_file_writer<T>().finish());
+			check_status(open<T>(empty, empty.size), file_status::ok, "empty file", type);
+		}
+
+		// truncated: shorter than the header or than the size it records
+		{
+			image im(bytes);
+			for (size_t size : { size_t(0), size_t(1), sizeof(file_header) - 1 })
+			{
+				check_status(open<T>(im, size), file_status::too_small, "truncated header", type);
+			}
+			check_status(open<T>(im, im.size - 1), file_status::too_small, "truncated image", type);
+			check_status(open<T>(im, im.entry(1).offset), file_status::too_small, "image cut before its last section", type);
+		}
+
+		// header fields
+		{
+			image im(bytes);
+			file_header h = im.header();
+			h.magic ^= 1;
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::bad_magic, "magic", type);
+
+			h = image(bytes).header();
+			h.byte_order = 0x04030201;
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::wrong_byte_order, "byte order", type);
+
+			h = image(bytes).header();
+			h.version_major = version_major + 1;
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::unsupported_version, "major version", type);
+
+			h = image(bytes).header();
+			h.version_minor = version_minor + 1;
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::ok, "later minor version", type);
+
+			h = image(bytes).header();
+			h.scalar_size = sizeof(T) == 4 ? 8 : 4;
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::wrong_scalar_type, "scalar size", type);
+
+			// oversized: the header records more than the buffer or the file holds
+			h = image(bytes).header();
+			h.file_size = im.size + 64;
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::too_small, "file size past the buffer", type);
+			h.file_size = ~uint64_t(0);
+			im.set(0, h);
+			check_status(open<T>(im, im.size), file_status::too_small, "file size 2^64 - 1", type);
+
+			for (uint32_t sections : { 3u, 1u << 20, ~0u })
+			{
+				h = image(bytes).header();
+				h.file_size = sizeof(file_header) + 2 * sizeof(section_entry);
+				h.section_count = sections;
+				im.set(0, h);
+				check_status(open<T>(im, im.size), file_status::out_of_bounds, "section table past the file", type);
+			}
+
+			image misaligned_buffer(std::vector<unsigned char>(bytes.size() + 4));
+			std::memcpy(misaligned_buffer.data() + 4, bytes.data(), bytes.size());
+			animation_file<T> file;
+			check_status(file.open(misaligned_buffer.data() + 4, bytes.size()), file_status::misaligned, "buffer not 8 byte aligned", type);
+		}
+
+		// section table
+		{
+			for (uint64_t offset : { uint64_t(bytes.size()), uint64_t(bytes.size() + 64), ~uint64_t(63) })
+			{
+				image im(bytes);
+				section_entry e = im.entry(1);
+				e.offset = offset;
+				im.set(im.entry_offset(1), e);
+				check_status(open<T>(im, im.size), file_status::out_of_bounds, "section offset past the file", type);
+			}
+			for (uint64_t size : { uint64_t(bytes.size()), ~uint64_t(0) })
+			{
+				image im(bytes);
+				section_entry e = im.entry(0);
+				e.size = size;
+				im.set(im.entry_offset(0), e);
+				check_status(open<T>(im, im.size), file_status::out_of_bounds, "section size past the file", type);
+			}
+			image im(bytes);
+			section_entry e = im.entry(0);
+			e.offset += 8;
+			im.set(im.entry_offset(0), e);
+			check_status(open<T>(im, im.size), file_status::misaligned, "section offset", type);
+
+			// sections of unknown kinds are skipped, and their contents not looked at
+			image unknown(bytes);
+			e = unknown.entry(0);
+			e.kind = 99;
+			unknown.set(unknown.entry_offset(0), e);
+			clip_header garbage{};
+			garbage.joints = ~uint64_t(0);
+			unknown.set(e.offset, garbage);
+			check_status(open<T>(unknown, unknown.size), file_status::ok, "unknown section kind", type);
+
+			for (size_t section : { size_t(0), size_t(1) })
+			{
+				image small(bytes);
+				e = small.entry(section);
+				e.size = section == 0 ? sizeof(clip_header) - 1 : sizeof(transform_set_header) - 1;
+				small.set(small.entry_offset(section), e);
+				check_status(open<T>(small, small.size), file_status::out_of_bounds, "section smaller than its header", type);
+			}
+		}
+
+		// clip header: counts and offsets out of range
+		{
+			image base(bytes);
+			const uint64_t at = base.entry(0).offset;
+			const uint64_t size = base.entry(0).size;
+			auto clip_status = [&](auto change)
+				{
+					image im(bytes);
+					clip_header h = im.get<clip_header>(at);
+					change(h);
+					im.set(at, h);
+					return open<T>(im, im.size);
+				};
+			for (uint64_t joints_count : { size, ~uint64_t(0) / sizeof(animation_track) + 1, ~uint64_t(0) })
+			{
+				check_status(clip_status([&](clip_header& h) { h.joints = joints_count; }), file_status::out_of_bounds, "clip joints", type);
+			}
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				check_status(clip_status([&](clip_header& h) { h.keys[c] = size; }), file_status::out_of_bounds, "clip keys", type);
+				check_status(clip_status([&](clip_header& h) { h.keys[c] = ~uint64_t(0); }), file_status::out_of_bounds, "clip keys 2^64 - 1", type);
+				check_status(clip_status([&](clip_header& h) { h.tracks[c] = (size + 63) / 64 * 64; }), file_status::out_of_bounds, "clip tracks offset", type);
+				check_status(clip_status([&](clip_header& h) { h.times[c] = ~uint64_t(63); }), file_status::out_of_bounds, "clip times offset", type);
+				check_status(clip_status([&](clip_header& h) { h.values[c] = h.values[c] + 64 * ((size - h.values[c]) / 64 + 1); }), file_status::out_of_bounds, "clip values offset", type);
+				check_status(clip_status([&](clip_header& h) { h.times[c] += 8; }), file_status::misaligned, "clip times offset", type);
+			}
+			// fewer keys than the tracks use
+			check_status(clip_status([&](clip_header& h) { h.keys[1] -= 1; }), file_status::bad_keys, "clip keys below the tracks", type);
+		}
+
+		// clip tracks and key times
+		{
+			image base(bytes);
+			const uint64_t at = base.entry(0).offset;
+			const clip_header h = base.get<clip_header>(at);
+			const uint64_t track = at + h.tracks[1] + 4 * sizeof(animation_track);
+			const animation_track t = base.get<animation_track>(track);
+
+			image im(bytes);
+			im.set(track, animation_track{ uint32_t(h.keys[1]), 1 });
+			check_status(open<T>(im, im.size), file_status::bad_keys, "track first past the keys", type);
+			im.set(track, animation_track{ t.first, ~0u });
+			check_status(open<T>(im, im.size), file_status::bad_keys, "track count past the keys", type);
+			im.set(track, animation_track{ ~0u, ~0u });
+			check_status(open<T>(im, im.size), file_status::bad_keys, "track first and count 2^32 - 1", type);
+
+			image unsorted(bytes);
+			const uint64_t times = at + h.times[1] + sizeof(T) * t.first;
+			unsorted.set(times + sizeof(T), unsorted.get<T>(times) - T(1));
+			check_status(open<T>(unsorted, unsorted.size), t.count > 1 ? file_status::bad_keys : file_status::ok, "unsorted key times", type);
+
+			image nan(bytes);
+			nan.set(times, std::numeric_limits<T>::quiet_NaN());
+			check_status(open<T>(nan, nan.size), file_status::bad_keys, "NaN key time", type);
+		}
+
+		// transform set header
+		{
+			image base(bytes);
+			const uint64_t at = base.entry(1).offset;
+			const uint64_t size = base.entry(1).size;
+			for (uint64_t count : { uint64_t(transforms + 16), size, ~uint64_t(0) })
+			{
+				image im(bytes);
+				transform_set_header h = im.get<transform_set_header>(at);
+				h.count = count;
+				im.set(at, h);
+				check_status(open<T>(im, im.size), file_status::out_of_bounds, "transform set count", type);
+			}
+			for (uint8_t c = 0; c < 10; ++c)
+			{
+				image im(bytes);
+				transform_set_header h = im.get<transform_set_header>(at);
+				uint64_t lane = h.lanes[c];
+				h.lanes[c] = (size + 63) / 64 * 64;
+				im.set(at, h);
+				check_status(open<T>(im, im.size), file_status::out_of_bounds, "transform set lane offset", type);
+				h.lanes[c] = lane + sizeof(T);
+				im.set(at, h);
+				check_status(open<T>(im, im.size), file_status::misaligned, "transform set lane offset", type);
+			}
+		}
+	}
+}
+
+int main()
+{
+	test_type<float>("float");
+	test_type<double>("double");
+	if (failures == 0) std::printf("animation_file: ok\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,134 @@
+// Batch culling into a visible buffer holding exactly one index per bound, with every
+// bound visible and sizes that are not a multiple of any pack width: the indices must
+// match intersects() and nothing may be written past the buffer. Run at every level
+// this cpu supports, through the inline kernels and xm::batch, serial and threaded.
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "xm/xm.h"
+#include "xm/dispatch.h"
+#include "xm/frustum.h"
+#include "xm/thread_pool.h"
+
+using namespace xm;
+
+namespace
+{
+	constexpr uint32_t guard = 0xdeadbeefu;
+	constexpr size_t guard_size = 64;
+	int failures = 0;
+
+	void check(bool ok, const char* what, const char* type, const char* level, size_t size)
+	{
+		if (!ok)
+		{
+			std::printf("FAIL %s %s %s size %zu\n", type, level, what, size);
+			++failures;
+		}
+	}
+
+	// visible with guard values after its size entries
+	struct guarded_indices
+	{
+		explicit guarded_indices(size_t size) : size(size), data(size + guard_size, guard) {}
+
+		uint32_t* get() { return data.data(); }
+
+		bool intact() const
+		{
+			for (size_t k = size; k < data.size(); ++k)
+			{
+				if (data[k] != guard) return false;
+			}
+			return true;
+		}
+
+		size_t size;
+		std::vector<uint32_t> data;
+	};
+
+	template <typename T>
+	void test_size(size_t size, std::mt19937& rng, thread_pool& pool, const char* type)
+	{
+		std::uniform_real_distribution<T> coord(T(-20), T(20));
+		frustum<T> f = extract_frustum(perspective(T(1.2), T(1.5), T(0.5), T(1000)));
+		for (int visible_only = 0; visible_only < 2; ++visible_only)
+		{
+			std::vector<vector<3, T>> centers(size), min(size), max(size);
+			std::vector<T> radii(size);
+			std::vector<uint32_t> expected_spheres, expected_aabbs;
+			for (size_t i = 0; i < size; ++i)
+			{
+				// visible_only puts every bound around the view direction, between the planes
+				vector<3, T> c = visible_only ? vector<3, T>(T(0), T(0), T(-10)) : vector<3, T>(coord(rng), coord(rng), coord(rng));
+				centers[i] = c;
+				radii[i] = T(0.5);
+				min[i] = c - vector<3, T>(T(0.5));
+				max[i] = c + vector<3, T>(T(0.5));
+				if (intersects(f, centers[i], radii[i])) expected_spheres.push_back(uint32_t(i));
+				if (intersects(f, min[i], max[i])) expected_aabbs.push_back(uint32_t(i));
+			}
+			if (visible_only)
+			{
+				check(expected_spheres.size() == size && expected_aabbs.size() == size, "setup", type, "", size);
+			}
+
+			vector_span<3, const T> c(centers.data(), size), lo(min.data(), size), hi(max.data(), size);
+			auto verify = [&](const char* level, const char* what, guarded_indices& out, size_t count, const std::vector<uint32_t>& expected)
+				{
+					bool ok = out.intact() && count == expected.size();
+					for (size_t k = 0; ok && k < count; ++k) ok = out.data[k] == expected[k];
+					check(ok, what, type, level, size);
+				};
+
+			{
+				guarded_indices s(size), a(size);
+				verify("inline", "cull_spheres", s, cull_spheres(f, c, radii.data(), s.get()), expected_spheres);
+				verify("inline", "cull_aabbs", a, cull_aabbs(f, lo, hi, a.get()), expected_aabbs);
+			}
+			auto run_level = [&](const char* level, const detail::batch_tables& tables)
+				{
+					const detail::batch_table<T>* kernels;
+					if constexpr (std::is_same_v<T, float>) kernels = &tables.f;
+					else kernels = &tables.d;
+					guarded_indices s(size), a(size);
+					verify(level, "cull_spheres", s, kernels->cull_spheres(f, detail::to_input(c), radii.data(), s.get()), expected_spheres);
+					verify(level, "cull_aabbs", a, kernels->cull_aabbs(f, detail::to_input(lo), detail::to_input(hi), a.get()), expected_aabbs);
+				};
+			simd_level supported = supported_simd_level();
+			run_level("scalar", detail::batch_tables_for<simd_level::scalar>());
+#if defined(XM_DISPATCH_X86)
+			if (supported >= simd_level::sse2) run_level("sse2", detail::batch_tables_for<simd_level::sse2>());
+			if (supported >= simd_level::avx2) run_level("avx2", detail::batch_tables_for<simd_level::avx2>());
+			if (supported >= simd_level::avx512) run_level("avx512", detail::batch_tables_for<simd_level::avx512>());
+#else
+			(void)supported;
+#endif
+			{
+				guarded_indices s(size), a(size);
+				verify("batch", "cull_spheres", s, batch::cull_spheres(f, c, radii.data(), s.get()), expected_spheres);
+				verify("batch", "cull_aabbs", a, batch::cull_aabbs(f, lo, hi, a.get()), expected_aabbs);
+			}
+			{
+				guarded_indices s(size), a(size);
+				verify("thread_pool", "cull_spheres", s, batch::cull_spheres(pool, f, c, radii.data(), s.get()), expected_spheres);
+				verify("thread_pool", "cull_aabbs", a, batch::cull_aabbs(pool, f, lo, hi, a.get()), expected_aabbs);
+			}
+		}
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(12);
+	thread_pool pool(4);
+	for (size_t size : { 1, 2, 3, 5, 7, 9, 15, 17, 31, 33, 63, 65, 100, 1001, 4099 })
+	{
+		test_size<float>(size, rng, pool, "float");
+		test_size<double>(size, rng, pool, "double");
+	}
+	if (failures == 0) std::printf("frustum_cull: ok\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,363 @@
+// Snapshot streams: positions on the position grid must decode bit for bit and rotations
+// to their grid point (or its negation) for every frame, in order and by random access,
+// and open must reject every stream whose chunk headers, frame offsets or block widths do
+// not match its bytes, with the status that says why, before decode reads from it.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include "xm/xm.h"
+#include "xm/snapshot_stream.h"
+
+using namespace xm;
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const char* what, const char* type)
+	{
+		if (!ok)
+		{
+			std::printf("FAIL %s %s\n", type, what);
+			++failures;
+		}
+	}
+
+	void check_status(file_status status, file_status expected, const char* what, const char* type)
+	{
+		if (status != expected)
+		{
+			std::printf("FAIL %s %s: %s, expected %s\n", type, what, to_string(status), to_string(expected));
+			++failures;
+		}
+	}
+
+	file_status open(const std::vector<unsigned char>& stream, size_t size)
+	{
+		snapshot_decoder decoder;
+		file_status status = decoder.open(stream.data(), size);
+		if (status != file_status::ok && (decoder.size() != 0 || decoder.frames() != 0))
+		{
+			std::printf("FAIL open kept chunks of a rejected stream\n");
+			++failures;
+		}
+		return status;
+	}
+
+	using snapshot_format::chunk_header;
+
+	chunk_header get_header(const std::vector<unsigned char>& stream, size_t at)
+	{
+		chunk_header h;
+		std::memcpy(&h, stream.data() + at, sizeof(h));
+		return h;
+	}
+
+	uint32_t get_offset(const std::vector<unsigned char>& stream, size_t at, uint32_t frame)
+	{
+		uint32_t offset;
+		std::memcpy(&offset, stream.data() + at + sizeof(chunk_header) + 4 * size_t(frame), 4);
+		return offset;
+	}
+
+	// the status of stream with the header of the chunk at at changed
+	template <typename F>
+	file_status with_header(std::vector<unsigned char> stream, size_t at, F&& change)
+	{
+		chunk_header h = get_header(stream, at);
+		change(h);
+		std::memcpy(stream.data() + at, &h, sizeof(h));
+		return open(stream, stream.size());
+	}
+
+	file_status with_offset(std::vector<unsigned char> stream, size_t at, uint32_t frame, uint32_t offset)
+	{
+		std::memcpy(stream.data() + at + sizeof(chunk_header) + 4 * size_t(frame), &offset, 4);
+		return open(stream, stream.size());
+	}
+
+	// One chunk of one frame for one object, written by hand: position x is stored with
+	// width bits, all ones, and every other component with width 0.
+	std::vector<unsigned char> one_value_chunk(uint8_t width)
+	{
+		const size_t frame_size = snapshot_format::components + 8 * size_t(width);
+		const size_t table = sizeof(chunk_header) + 2 * sizeof(uint32_t);
+		chunk_header h{};
+		h.magic = snapshot_format::magic;
+		h.byte_order = snapshot_format::byte_order_mark;
+		h.version_major = snapshot_format::version_major;
+		h.version_minor = snapshot_format::version_minor;
+		h.count = 1;
+		h.first_frame = 0;
+		h.frames = 1;
+		h.rotation_bits = 16;
+		h.position_step = 1.0;
+		h.size = (table + frame_size + 7) / 8 * 8;
+
+		std::vector<unsigned char> res(size_t(h.size), 0);
+		std::memcpy(res.data(), &h, sizeof(h));
+		const uint32_t offsets[2] = { uint32_t(table), uint32_t(table + frame_size) };
+		std::memcpy(res.data() + sizeof(h), offsets, sizeof(offsets));
+		res[table] = width;
+		if (width != 0)
+		{
+			uint64_t ones = width >= 32 ? 0xffffffffu : (uint64_t(1) << width) - 1;
+			std::memcpy(res.data() + table + 1, &ones, sizeof(ones));
+		}
+		return res;
+	}
+
+	// w, x, y, z with w^2 + x^2 + y^2 + z^2 = norm^2 exactly: the square of a quaternion
+	// whose squared length is norm
+	void grid_rotation(int64_t norm, std::mt19937& rng, int64_t q[4])
+	{
+		const int64_t limit = int64_t(std::sqrt(double(norm)));
+		for (;;)
+		{
+			int64_t m = int64_t(rng() % uint32_t(limit + 1)), n = int64_t(rng() % uint32_t(limit + 1)), p = int64_t(rng() % uint32_t(limit + 1));
+			int64_t rest = norm - m * m - n * n - p * p;
+			if (rest < 0) continue;
+			int64_t r = int64_t(std::llround(std::sqrt(double(rest))));
+			if (r * r != rest) continue;
+			q[0] = m * m - n * n - p * p - r * r;
+			q[1] = 2 * m * n;
+			q[2] = 2 * m * p;
+			q[3] = 2 * m * r;
+			for (uint8_t c = 0; c < 4; ++c)
+			{
+				if (rng() & 1) q[c] = -q[c];
+			}
+			return;
+		}
+	}
+
+	void test_validation(const std::vector<unsigned char>& stream, const std::vector<size_t>& starts, const char* type)
+	{
+		const size_t second = starts[1];
+		const chunk_header first_header = get_header(stream, 0);
+
+		// truncated: a chunk header or a chunk cut short
+		check_status(open(stream, 0), file_status::ok, "empty stream", type);
+		for (size_t size : { size_t(1), sizeof(chunk_header) - 1, second + 1, second + sizeof(chunk_header) - 1 })
+		{
+			check_status(open(stream, size), file_status::too_small, "truncated chunk header", type);
+		}
+		for (size_t size : { size_t(first_header.size - 8), stream.size() - 8, second + sizeof(chunk_header) })
+		{
+			check_status(open(stream, size), file_status::too_small, "truncated chunk", type);
+		}
+		check_status(open(stream, second), file_status::ok, "stream of the first chunk", type);
+
+		// header fields
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.magic ^= 1; }), file_status::bad_magic, "magic", type);
+		check_status(with_header(stream, second, [](chunk_header& h) { h.byte_order = 0x04030201; }), file_status::wrong_byte_order, "byte order", type);
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.version_major += 1; }), file_status::unsupported_version, "major version", type);
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.version_minor += 1; }), file_status::ok, "later minor version", type);
+
+		// oversized: the header records more than the stream holds
+		for (uint64_t size : { uint64_t(stream.size()) + 8, ~uint64_t(7) })
+		{
+			check_status(with_header(stream, 0, [&](chunk_header& h) { h.size = size; }), file_status::too_small, "chunk size past the stream", type);
+		}
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.size -= 4; }), file_status::misaligned, "chunk size not a multiple of 8", type);
+
+		// counts out of range
+		for (uint32_t frames : { 0xffffffffu, uint32_t(first_header.size / 4) })
+		{
+			check_status(with_header(stream, 0, [&](chunk_header& h) { h.frames = frames; }), file_status::out_of_bounds, "frame table past the chunk", type);
+		}
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.frames += 1; }), file_status::out_of_bounds, "frames past the table", type);
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.frames = 0; }), file_status::bad_frames, "chunk without frames", type);
+		check_status(with_header(stream, second, [](chunk_header& h) { h.first_frame += 1; }), file_status::bad_frames, "gap between chunks", type);
+		check_status(with_header(stream, 0, [](chunk_header& h) { h.first_frame = 1; }), file_status::bad_frames, "stream not starting at frame 0", type);
+		check_status(with_header(stream, second, [](chunk_header& h) { h.count += 1; }), file_status::bad_frames, "count changing between chunks", type);
+		for (uint32_t count : { first_header.count + 64, 0xffffffffu })
+		{
+			check_status(with_header(stream, 0, [&](chunk_header& h) { h.count = count; }), file_status::bad_frames, "count past the frames", type);
+		}
+		for (uint32_t bits : { 0u, 1u, 25u, 0xffffffffu })
+		{
+			check_status(with_header(stream, 0, [&](chunk_header& h) { h.rotation_bits = bits; }), file_status::bad_frames, "rotation bits", type);
+		}
+		for (double step : { 0.0, -1.0, std::numeric_limits<double>::quiet_NaN() })
+		{
+			check_status(with_header(stream, 0, [&](chunk_header& h) { h.position_step = step; }), file_status::bad_frames, "position step", type);
+		}
+
+		// frame offsets out of range
+		const uint32_t frames = first_header.frames;
+		const uint32_t begin = get_offset(stream, 0, 0), next = get_offset(stream, 0, 1);
+		check_status(with_offset(stream, 0, 0, begin + 8), file_status::out_of_bounds, "first frame offset", type);
+		check_status(with_offset(stream, 0, 0, 0), file_status::out_of_bounds, "first frame offset in the header", type);
+		check_status(with_offset(stream, 0, frames, uint32_t(first_header.size) + 8), file_status::out_of_bounds, "end offset past the chunk", type);
+		check_status(with_offset(stream, 0, frames, 0xffffffffu), file_status::out_of_bounds, "end offset 2^32 - 1", type);
+		check_status(with_offset(stream, 0, 1, begin - 1), file_status::out_of_bounds, "decreasing frame offsets", type);
+		check_status(with_offset(stream, 0, 1, next + 8), file_status::bad_frames, "frame longer than its widths", type);
+		check_status(with_offset(stream, 0, 1, next - 8), file_status::bad_frames, "frame shorter than its widths", type);
+
+		// widths: every one up to 32 decodes, 33 and up are rejected even when the frame is
+		// sized for them
+		for (uint8_t width : { uint8_t(0), uint8_t(1), uint8_t(31), uint8_t(32) })
+		{
+			std::vector<unsigned char> one = one_value_chunk(width);
+			snapshot_decoder decoder;
+			check_status(decoder.open(one.data(), one.size()), file_status::ok, "width up to 32", type);
+			if (decoder.frames() == 1)
+			{
+				vector_stream<3, double> p(1);
+				vector_stream<4, double> q(1);
+				decoder.decode(0, p, q);
+				// all ones of width bits, unzigzagged
+				uint32_t z = width == 0 ? 0u : width == 32 ? 0xffffffffu : (1u << width) - 1;
+				check(p.lane(0)[0] == double(int32_t(detail::unzigzag(z))), "decoded value of width up to 32", type);
+			}
+		}
+		for (uint8_t width : { uint8_t(33), uint8_t(64), uint8_t(255) })
+		{
+			std::vector<unsigned char> one = one_value_chunk(width);
+			check_status(open(one, one.size()), file_status::bad_frames, "width above 32", type);
+		}
+		std::vector<unsigned char> wide = stream;
+		wide[begin] = 33;
+		check_status(open(wide, wide.size()), file_status::bad_frames, "width above 32 in an encoded frame", type);
+	}
+
+	// Objects at rest, in steady motion, jumping and (for double, where 2^31 positions are
+	// exact) jumping across the whole int32_t range, so block widths go up to 32.
+	template <typename T>
+	void test_round_trip(const char* type)
+	{
+		constexpr size_t count = 100;
+		constexpr uint32_t frames = 27;
+		snapshot_settings settings;
+		settings.keyframe_interval = 8;
+		const double scale = double(detail::rotation_scale(settings.rotation_bits));
+		const int64_t range = sizeof(T) == 8 ? int64_t(2147483647) : int64_t(1) << 23;
+		std::mt19937 rng(5);
+
+		std::vector<int64_t> positions(frames * count * 3), rotations(frames * count * 4);
+		std::vector<int64_t> velocity(count * 3);
+		for (size_t i = 0; i < count * 3; ++i) velocity[i] = int64_t(rng() % 2001) - 1000;
+		for (uint32_t f = 0; f < frames; ++f)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				for (uint8_t c = 0; c < 3; ++c)
+				{
+					int64_t& p = positions[(f * count + i) * 3 + c];
+					int64_t last = f == 0 ? int64_t(rng() % 100001) - 50000 : positions[((f - 1) * count + i) * 3 + c];
+					switch (i % 4)
+					{
+					case 0: p = last; break;
+					case 1: p = last + velocity[i * 3 + c]; break;
+					case 2: p = last + int64_t(rng() % 65536) - 32768; break;
+					default: p = int64_t(uint64_t(rng()) * uint64_t(rng()) % uint64_t(2 * range + 1)) - range; break;
+					}
+				}
+				int64_t* q = &rotations[(f * count + i) * 4];
+				if (f != 0 && i % 3 == 0) std::memcpy(q, q - count * 4, 4 * sizeof(int64_t));
+				else grid_rotation(int64_t(scale), rng, q);
+			}
+		}
+
+		snapshot_encoder encoder(count, settings);
+		vector_stream<3, T> in_positions(count), out_positions(count);
+		vector_stream<4, T> in_rotations(count), out_rotations(count);
+		std::vector<unsigned char> stream, chunk;
+		std::vector<size_t> chunk_starts;
+		for (uint32_t f = 0; f < frames; ++f)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				for (uint8_t c = 0; c < 3; ++c) in_positions.lane(c)[i] = T(double(positions[(f * count + i) * 3 + c]) * settings.position_step);
+				for (uint8_t c = 0; c < 4; ++c) in_rotations.lane(c)[i] = T(double(rotations[(f * count + i) * 4 + c]) / scale);
+			}
+			encoder.add_frame(in_positions, in_rotations);
+			if (f + 1 == frames) encoder.finish();
+			while (encoder.take_chunk(chunk))
+			{
+				chunk_starts.push_back(stream.size());
+				stream.insert(stream.end(), chunk.begin(), chunk.end());
+			}
+		}
+		check(encoder.frames() == frames && chunk_starts.size() == 4, "encoder chunks", type);
+
+		snapshot_decoder decoder;
+		check_status(decoder.open(stream.data(), stream.size()), file_status::ok, "round trip open", type);
+		check(decoder.size() == count && decoder.frames() == frames, "round trip size and frames", type);
+		if (decoder.frames() != frames) return;
+
+		auto verify = [&](uint32_t f)
+			{
+				decoder.decode(f, out_positions, out_rotations);
+				bool positions_ok = true, rotations_ok = true;
+				for (size_t i = 0; i < count; ++i)
+				{
+					for (uint8_t c = 0; c < 3; ++c)
+					{
+						T expected = T(double(positions[(f * count + i) * 3 + c]) * settings.position_step);
+						positions_ok = positions_ok && std::memcmp(&out_positions.lane(c)[i], &expected, sizeof(T)) == 0;
+					}
+					// the same grid point, all four components on the same side
+					int64_t sign = 0;
+					for (uint8_t c = 0; c < 4; ++c)
+					{
+						int64_t expected = rotations[(f * count + i) * 4 + c];
+						int64_t decoded = std::llround(double(out_rotations.lane(c)[i]) * scale);
+						if (expected == 0)
+						{
+							rotations_ok = rotations_ok && decoded == 0;
+							continue;
+						}
+						int64_t s = decoded == expected ? 1 : decoded == -expected ? -1 : 0;
+						rotations_ok = rotations_ok && s != 0 && (sign == 0 || s == sign);
+						sign = s;
+					}
+				}
+				check(positions_ok, "round trip positions", type);
+				check(rotations_ok, "round trip rotations", type);
+				check(decoder.keyframe_of(f) == f / settings.keyframe_interval * settings.keyframe_interval, "keyframe_of", type);
+			};
+		for (uint32_t f = 0; f < frames; ++f) verify(f);
+		for (uint32_t f = frames; f-- > 0; ) verify(f);
+		for (int k = 0; k < 64; ++k) verify(uint32_t(rng() % frames));
+
+		// the widest blocks need all 32 bits
+		bool widest = false;
+		for (size_t at : chunk_starts)
+		{
+			const chunk_header h = get_header(stream, at);
+			const size_t blocks = snapshot_format::blocks(count);
+			for (uint32_t f = 0; f < h.frames; ++f)
+			{
+				const unsigned char* p = stream.data() + at + get_offset(stream, at, f);
+				for (uint8_t c = 0; c < snapshot_format::components; ++c)
+				{
+					for (size_t b = 0; b < blocks; ++b)
+					{
+						widest = widest || p[b] == 32;
+						p += 8 * size_t(p[b]);
+					}
+					p += blocks;
+				}
+			}
+		}
+		if (sizeof(T) == 8) check(widest, "blocks of width 32", type);
+
+		test_validation(stream, chunk_starts, type);
+	}
+
+}
+
+int main()
+{
+	test_round_trip<float>("float");
+	test_round_trip<double>("double");
+	if (failures == 0) std::printf("snapshot_stream: ok\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
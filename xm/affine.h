@@ -0,0 +1,394 @@
+#pragma once
+
+#include "simd.h"
+#include "vector.h"
+#include "matrix.h"
+
+namespace xm
+{
+	// Affine transform stored as the top three rows of its 4x4 matrix; the fourth row is
+	// implicitly 0, 0, 0, 1. Row i holds row i of the linear part in x, y, z and
+	// translation component i in w, so 12 values instead of 16 and every row is one
+	// register wide for float.
+	template <typename T>
+	struct affine3
+	{
+		static_assert(std::is_floating_point_v<scalar_t<T>>);
+
+		affine3() = default;
+
+		explicit affine3(uninitialized_t) noexcept : x(uninitialized), y(uninitialized), z(uninitialized) {}
+
+		constexpr affine3(T a) noexcept
+			: x(a, T(0), T(0), T(0)),
+			y(T(0), a, T(0), T(0)),
+			z(T(0), T(0), a, T(0)) {}
+
+		constexpr affine3(const vector<4, T>& x, const vector<4, T>& y, const vector<4, T>& z) noexcept : x(x), y(y), z(z) {}
+
+		constexpr affine3(const matrix<3, T>& linear, const vector<3, T>& translation) noexcept
+			: x(linear.a.x, linear.b.x, linear.c.x, translation.x),
+			y(linear.a.y, linear.b.y, linear.c.y, translation.y),
+			z(linear.a.z, linear.b.z, linear.c.z, translation.z) {}
+
+		constexpr vector<4, T>& operator[] (uint8_t i) noexcept
+		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : i == 1 ? y : z;
+			return *(&x + i);
+		}
+
+		constexpr const vector<4, T>& operator[] (uint8_t i) const noexcept
+		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : i == 1 ? y : z;
+			return *(&x + i);
+		}
+
+		vector<4, T> x;
+		vector<4, T> y;
+		vector<4, T> z;
+	};
+
+	template <typename T>
+	constexpr matrix<3, T> linear(const affine3<T>& m) noexcept
+	{
+		return matrix<3, T>(
+			vector<3, T>(m.x.x, m.y.x, m.z.x),
+			vector<3, T>(m.x.y, m.y.y, m.z.y),
+			vector<3, T>(m.x.z, m.y.z, m.z.z));
+	}
+
+	template <typename T>
+	constexpr vector<3, T> translation(const affine3<T>& m) noexcept
+	{
+		return vector<3, T>(m.x.w, m.y.w, m.z.w);
+	}
+
+	// Exact in both directions for affine matrices; affine3_cast drops the fourth row.
+	template <typename T>
+	constexpr matrix<4, T> mat4_cast(const affine3<T>& m) noexcept
+	{
+		return matrix<4, T>(
+			vector<4, T>(m.x.x, m.y.x, m.z.x, T(0)),
+			vector<4, T>(m.x.y, m.y.y, m.z.y, T(0)),
+			vector<4, T>(m.x.z, m.y.z, m.z.z, T(0)),
+			vector<4, T>(m.x.w, m.y.w, m.z.w, T(1)));
+	}
+
+	template <typename T>
+	constexpr affine3<T> affine3_cast(const matrix<4, T>& m) noexcept
+	{
+		return affine3<T>(
+			vector<4, T>(m.a.x, m.b.x, m.c.x, m.d.x),
+			vector<4, T>(m.a.y, m.b.y, m.c.y, m.d.y),
+			vector<4, T>(m.a.z, m.b.z, m.c.z, m.d.z));
+	}
+
+	// a * b: b is applied first
+	template <typename T>
+	constexpr affine3<T> operator*(const affine3<T>& a, const affine3<T>& b) noexcept
+	{
+		affine3<T> res;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			for (uint8_t j = 0; j < 4; ++j)
+			{
+				res[i][j] = a[i].x * b.x[j] + a[i].y * b.y[j] + a[i].z * b.z[j];
+			}
+			res[i].w += a[i].w;
+		}
+		return res;
+	}
+
+	// out = a * b, and out may be a or b
+	template <typename T>
+	constexpr void mul_into(affine3<T>& out, const affine3<T>& a, const affine3<T>& b) noexcept
+	{
+		out = a * b;
+	}
+
+	// a = a * b: b is applied first
+	template <typename T>
+	constexpr affine3<T>& operator*=(affine3<T>& a, const affine3<T>& b) noexcept
+	{
+		mul_into(a, a, b);
+		return a;
+	}
+
+	template <typename T>
+	constexpr vector<3, T> transform_point(const affine3<T>& m, const vector<3, T>& p) noexcept
+	{
+		return vector<3, T>(
+			m.x.x * p.x + m.x.y * p.y + m.x.z * p.z + m.x.w,
+			m.y.x * p.x + m.y.y * p.y + m.y.z * p.z + m.y.w,
+			m.z.x * p.x + m.z.y * p.y + m.z.z * p.z + m.z.w);
+	}
+
+	template <typename T>
+	constexpr vector<3, T> transform_vector(const affine3<T>& m, const vector<3, T>& v) noexcept
+	{
+		return vector<3, T>(
+			m.x.x * v.x + m.x.y * v.y + m.x.z * v.z,
+			m.y.x * v.x + m.y.y * v.y + m.y.z * v.z,
+			m.z.x * v.x + m.z.y * v.y + m.z.z * v.z);
+	}
+
+	// columns of the inverse linear part are the cross products of its rows
+	template <typename T>
+	constexpr affine3<T> inverse(const affine3<T>& m, T& det) noexcept
+	{
+		vector<3, T> u(m.x.x, m.x.y, m.x.z);
+		vector<3, T> v(m.y.x, m.y.y, m.y.z);
+		vector<3, T> w(m.z.x, m.z.y, m.z.z);
+		vector<3, T> t = translation(m);
+
+		vector<3, T> c0 = crossRH(v, w);
+		vector<3, T> c1 = crossRH(w, u);
+		vector<3, T> c2 = crossRH(u, v);
+
+		det = dot(u, c0);
+		T inv_det = T(1) / det;
+		c0 *= inv_det;
+		c1 *= inv_det;
+		c2 *= inv_det;
+
+		return affine3<T>(
+			vector<4, T>(c0.x, c1.x, c2.x, -(c0.x * t.x + c1.x * t.y + c2.x * t.z)),
+			vector<4, T>(c0.y, c1.y, c2.y, -(c0.y * t.x + c1.y * t.y + c2.y * t.z)),
+			vector<4, T>(c0.z, c1.z, c2.z, -(c0.z * t.x + c1.z * t.y + c2.z * t.z)));
+	}
+
+	template <typename T>
+	constexpr affine3<T> inverse(const affine3<T>& m) noexcept
+	{
+		T det = T(0);
+		return inverse(m, det);
+	}
+
+	// the linear part must be a rotation
+	template <typename T>
+	constexpr affine3<T> inverse_rigid(const affine3<T>& m) noexcept
+	{
+		vector<3, T> t = translation(m);
+		vector<3, T> c0(m.x.x, m.x.y, m.x.z);
+		vector<3, T> c1(m.y.x, m.y.y, m.y.z);
+		vector<3, T> c2(m.z.x, m.z.y, m.z.z);
+
+		return affine3<T>(
+			vector<4, T>(c0.x, c1.x, c2.x, -(c0.x * t.x + c1.x * t.y + c2.x * t.z)),
+			vector<4, T>(c0.y, c1.y, c2.y, -(c0.y * t.x + c1.y * t.y + c2.y * t.z)),
+			vector<4, T>(c0.z, c1.z, c2.z, -(c0.z * t.x + c1.z * t.y + c2.z * t.z)));
+	}
+
+#if XM_SSE2
+	// Every row of a float affine3 is one register: a product row is three broadcasts of
+	// a's row times b's rows, plus a's translation (9 multiplies against 16 for mat4).
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// b is held in registers and row i of a is read before row i of out is written,
+			// so out may be a or b
+			inline void simd_mul_into(affine3<float>& out, const affine3<float>& a, const affine3<float>& b)
+			{
+				const float* pa = &a.x.x;
+				const float* pb = &b.x.x;
+
+				__m128 b0 = _mm_loadu_ps(pb + 0);
+				__m128 b1 = _mm_loadu_ps(pb + 4);
+				__m128 b2 = _mm_loadu_ps(pb + 8);
+				__m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+				float* pr = &out.x.x;
+				for (int i = 0; i < 3; ++i)
+				{
+					__m128 row = _mm_loadu_ps(pa + 4 * i);
+					__m128 r = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+#if XM_FMA
+					r = _mm_fmadd_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1, r);
+					r = _mm_fmadd_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2, r);
+#else
+					r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+					r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+#endif
+					_mm_storeu_ps(pr + 4 * i, _mm_add_ps(r, _mm_and_ps(row, w_mask)));
+				}
+			}
+
+			// the three rows and 0, 0, 0, 1 transposed are the four columns of the mat4
+			inline matrix<4, float> simd_mat4_cast(const affine3<float>& m)
+			{
+				const float* p = &m.x.x;
+				__m128 r0 = _mm_loadu_ps(p + 0);
+				__m128 r1 = _mm_loadu_ps(p + 4);
+				__m128 r2 = _mm_loadu_ps(p + 8);
+				__m128 r3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+				matrix<4, float> res(uninitialized);
+				float* pr = &res.a.x;
+				_mm_storeu_ps(pr + 0, r0);
+				_mm_storeu_ps(pr + 4, r1);
+				_mm_storeu_ps(pr + 8, r2);
+				_mm_storeu_ps(pr + 12, r3);
+				return res;
+			}
+
+			inline affine3<float> simd_affine3_cast(const matrix<4, float>& m)
+			{
+				const float* p = &m.a.x;
+				__m128 c0 = _mm_loadu_ps(p + 0);
+				__m128 c1 = _mm_loadu_ps(p + 4);
+				__m128 c2 = _mm_loadu_ps(p + 8);
+				__m128 c3 = _mm_loadu_ps(p + 12);
+				_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+				affine3<float> res(uninitialized);
+				float* pr = &res.x.x;
+				_mm_storeu_ps(pr + 0, c0);
+				_mm_storeu_ps(pr + 4, c1);
+				_mm_storeu_ps(pr + 8, c2);
+				return res;
+			}
+
+			inline affine3<float> simd_inverse(const affine3<float>& m, float& det)
+			{
+				const float* p = &m.x.x;
+				__m128 u = _mm_loadu_ps(p + 0);
+				__m128 v = _mm_loadu_ps(p + 4);
+				__m128 w = _mm_loadu_ps(p + 8);
+				__m128 t = _mm_setr_ps(p[3], p[7], p[11], 0.0f);
+
+				// cross(a, b) = a.yzx * b.zxy - a.zxy * b.yzx; the translations in w cancel to 0
+				auto cross = [](__m128 a, __m128 b)
+				{
+					return _mm_sub_ps(
+						_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2))),
+						_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1))));
+				};
+				__m128 c0 = cross(v, w);
+				__m128 c1 = cross(w, u);
+				__m128 c2 = cross(u, v);
+
+				// dot(u, c0), u.w * 0 adds nothing
+				__m128 d = _mm_mul_ps(u, c0);
+				d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+				d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+				det = _mm_cvtss_f32(d);
+
+				__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), d);
+				c0 = _mm_mul_ps(c0, inv_det);
+				c1 = _mm_mul_ps(c1, inv_det);
+				c2 = _mm_mul_ps(c2, inv_det);
+
+				__m128 it = _mm_mul_ps(c0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)));
+				it = _mm_add_ps(it, _mm_mul_ps(c1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+				it = _mm_add_ps(it, _mm_mul_ps(c2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+				it = _mm_sub_ps(_mm_setzero_ps(), it);
+
+				_MM_TRANSPOSE4_PS(c0, c1, c2, it);
+
+				affine3<float> res(uninitialized);
+				float* pr = &res.x.x;
+				_mm_storeu_ps(pr + 0, c0);
+				_mm_storeu_ps(pr + 4, c1);
+				_mm_storeu_ps(pr + 8, c2);
+				return res;
+			}
+
+#if XM_AVX
+			inline void simd_mul_into(affine3<double>& out, const affine3<double>& a, const affine3<double>& b)
+			{
+				const double* pa = &a.x.x;
+				const double* pb = &b.x.x;
+
+				__m256d b0 = _mm256_loadu_pd(pb + 0);
+				__m256d b1 = _mm256_loadu_pd(pb + 4);
+				__m256d b2 = _mm256_loadu_pd(pb + 8);
+				__m256d w_mask = _mm256_castsi256_pd(_mm256_setr_epi64x(0, 0, 0, -1));
+
+				double* pr = &out.x.x;
+				for (int i = 0; i < 3; ++i)
+				{
+					const double* row = pa + 4 * i;
+					__m256d r = _mm256_mul_pd(_mm256_broadcast_sd(row + 0), b0);
+#if XM_FMA
+					r = _mm256_fmadd_pd(_mm256_broadcast_sd(row + 1), b1, r);
+					r = _mm256_fmadd_pd(_mm256_broadcast_sd(row + 2), b2, r);
+#else
+					r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_broadcast_sd(row + 1), b1));
+					r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_broadcast_sd(row + 2), b2));
+#endif
+					_mm256_storeu_pd(pr + 4 * i, _mm256_add_pd(r, _mm256_and_pd(_mm256_loadu_pd(row), w_mask)));
+				}
+			}
+#endif
+		}
+	}
+
+	// constant evaluation takes the generic versions above
+	inline namespace XM_SIMD_ABI
+	{
+		constexpr affine3<float> operator*(const affine3<float>& a, const affine3<float>& b) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::operator*<float>(a, b);
+			affine3<float> res(uninitialized);
+			detail::simd_mul_into(res, a, b);
+			return res;
+		}
+
+		constexpr void mul_into(affine3<float>& out, const affine3<float>& a, const affine3<float>& b) noexcept
+		{
+			if (detail::is_constant_evaluated())
+			{
+				out = xm::operator*<float>(a, b);
+				return;
+			}
+			detail::simd_mul_into(out, a, b);
+		}
+
+		constexpr matrix<4, float> mat4_cast(const affine3<float>& m) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::mat4_cast<float>(m);
+			return detail::simd_mat4_cast(m);
+		}
+
+		constexpr affine3<float> affine3_cast(const matrix<4, float>& m) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::affine3_cast<float>(m);
+			return detail::simd_affine3_cast(m);
+		}
+
+		constexpr affine3<float> inverse(const affine3<float>& m, float& det) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::inverse<float>(m, det);
+			return detail::simd_inverse(m, det);
+		}
+
+		constexpr affine3<float> inverse(const affine3<float>& m) noexcept
+		{
+			float det = 0.0f;
+			return inverse(m, det);
+		}
+
+#if XM_AVX
+		constexpr affine3<double> operator*(const affine3<double>& a, const affine3<double>& b) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::operator*<double>(a, b);
+			affine3<double> res(uninitialized);
+			detail::simd_mul_into(res, a, b);
+			return res;
+		}
+
+		constexpr void mul_into(affine3<double>& out, const affine3<double>& a, const affine3<double>& b) noexcept
+		{
+			if (detail::is_constant_evaluated())
+			{
+				out = xm::operator*<double>(a, b);
+				return;
+			}
+			detail::simd_mul_into(out, a, b);
+		}
+#endif
+	}
+#endif
+}
\ No newline at end of file
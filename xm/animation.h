@@ -0,0 +1,401 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "quaternion.h"
+#include "vector_stream.h"
+#include "batch_quaternion.h"
+#include "thread_pool.h"
+
+namespace xm
+{
+	// How clip_sampler interpolates rotations between keys: nlerp_quaternions, or the
+	// corrected slerp_quaternions of batch_quaternion.h (a little more work, constant
+	// angular speed).
+	enum class rotation_blend : uint8_t { nlerp, slerp };
+
+	// Keys [first, first + count) of one joint in one channel
+	struct animation_track
+	{
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	// Non-owning view of the keys of a clip, the form clip_sampler reads: an animation_clip
+	// or a clip stored in a file (animation_file.h), used in place. Channel 0 holds the
+	// translations, 1 the rotations and 2 the scales; values holds 3, 4 and 3 values per
+	// key, rotations as w, x, y, z.
+	template <typename T>
+	struct animation_clip_view
+	{
+		struct channel
+		{
+			const animation_track* tracks = nullptr;
+			const T* times = nullptr;
+			const T* values = nullptr;
+		};
+
+		size_t joints = 0;
+		channel channels[3];
+
+		// time of the last key of any track
+		T duration() const
+		{
+			T res(0);
+			for (const channel& c : channels)
+			{
+				for (size_t j = 0; j < joints; ++j)
+				{
+					const animation_track& t = c.tracks[j];
+					if (t.count != 0) res = std::max(res, c.times[t.first + t.count - 1]);
+				}
+			}
+			return res;
+		}
+	};
+
+	// Keyframed local transforms of a skeleton: for every joint a translation, a rotation
+	// and a scale track, each with its own increasing key times. A joint without keys in
+	// a track keeps the identity value there. The clip is immutable while sampled and can
+	// be shared by any number of clip_samplers.
+	template <typename T>
+	struct animation_clip
+	{
+		enum channel_index { translation, rotation, scale };
+		static constexpr uint8_t components[3] = { 3, 4, 3 };
+
+		using track = animation_track;
+
+		// all tracks of one channel, the keys of every track contiguous
+		struct channel
+		{
+			std::vector<track> tracks;
+			std::vector<T> times;
+			std::vector<T> values;
+		};
+
+		explicit animation_clip(size_t joints = 0)
+		{
+			for (channel& c : channels) c.tracks.resize(joints);
+		}
+
+		size_t joints() const
+		{
+			return channels[0].tracks.size();
+		}
+
+		T duration() const
+		{
+			return view().duration();
+		}
+
+		// valid until the clip is changed
+		animation_clip_view<T> view() const
+		{
+			animation_clip_view<T> res;
+			res.joints = joints();
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				res.channels[c] = { channels[c].tracks.data(), channels[c].times.data(), channels[c].values.data() };
+			}
+			return res;
+		}
+
+		// Each track is set once; times holds count increasing key times.
+		void set_translations(uint32_t joint, const T* times, const vector<3, T>* values, size_t count)
+		{
+			set_track(translation, joint, times, count, [&](size_t k, T* out) { for (uint8_t c = 0; c < 3; ++c) out[c] = values[k][c]; });
+		}
+
+		void set_rotations(uint32_t joint, const T* times, const quaternion<T>* values, size_t count)
+		{
+			set_track(rotation, joint, times, count, [&](size_t k, T* out)
+				{
+					out[0] = values[k].w;
+					for (uint8_t c = 0; c < 3; ++c) out[1 + c] = values[k].m[c];
+				});
+		}
+
+		void set_scales(uint32_t joint, const T* times, const vector<3, T>* values, size_t count)
+		{
+			set_track(scale, joint, times, count, [&](size_t k, T* out) { for (uint8_t c = 0; c < 3; ++c) out[c] = values[k][c]; });
+		}
+
+		channel channels[3];
+
+	private:
+		template <typename F>
+		void set_track(channel_index index, uint32_t joint, const T* times, size_t count, F&& value)
+		{
+			channel& c = channels[index];
+			assert(joint < joints() && c.tracks[joint].count == 0);
+			c.tracks[joint] = track{ uint32_t(c.times.size()), uint32_t(count) };
+			c.times.insert(c.times.end(), times, times + count);
+			size_t at = c.values.size();
+			c.values.resize(at + count * components[index]);
+			for (size_t k = 0; k < count; ++k)
+			{
+				assert(k == 0 || times[k - 1] <= times[k]);
+				value(k, c.values.data() + at + k * components[index]);
+			}
+		}
+	};
+
+	// Local transforms of every joint of a skeleton in SoA streams, the layout
+	// compose_trs and transform_hierarchy take: rotations hold w, x, y, z.
+	template <typename T>
+	struct animation_pose
+	{
+		size_t size() const
+		{
+			return translations.size();
+		}
+
+		// keeps the storage when shrinking, so a pose reused every frame never allocates
+		void resize(size_t joints)
+		{
+			translations.resize(joints);
+			rotations.resize(joints);
+			scales.resize(joints);
+		}
+
+		vector_stream<3, T> translations;
+		vector_stream<4, T> rotations;
+		vector_stream<3, T> scales;
+	};
+
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// out[i] = a[i] + (b[i] - a[i]) * t[i]
+			template <typename A, typename B, typename Out>
+			void lerp_lanes(const A& a, const B& b, const stream_value<A>* t, const Out& out)
+			{
+				using P = native_pack<stream_value<A>>;
+				for_each_pack<stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+					{
+						P f = load_scalars<P>(t + i, n);
+						for (uint8_t c = 0; c < A::components; ++c)
+						{
+							P x = a.template load<P>(c, i, n);
+							out.template store<P>(c, i, mul_add(b.template load<P>(c, i, n) - x, f, x), n);
+						}
+					});
+			}
+
+			// out = sum of weights[k] * in[k] / sum of weights, one component at a time
+			template <uint8_t N, typename T>
+			void blend_streams(const vector_stream<N, T>* const* in, const T* weights, size_t count, vector_stream<N, T>& out)
+			{
+				using P = native_pack<T>;
+				T total(0);
+				for (size_t k = 0; k < count; ++k) total += weights[k];
+				P inv_total(T(1) / total);
+				for_each_pack<T>(out.size(), [&](size_t i, uint8_t n)
+					{
+						for (uint8_t c = 0; c < N; ++c)
+						{
+							P acc = in[0]->template load<P>(c, i, n) * P(weights[0]);
+							for (size_t k = 1; k < count; ++k)
+							{
+								acc = mul_add(in[k]->template load<P>(c, i, n), P(weights[k]), acc);
+							}
+							out.template store<P>(c, i, acc * inv_total, n);
+						}
+					});
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// Weighted blend of count poses of the same skeleton, e.g. the samples of several clips:
+		// translations and scales are averaged with the weights, rotations summed along the
+		// shorter arc to the first pose and normalized (a weighted nlerp). The weights need
+		// not add up to 1 but must not add up to 0; up to 16 poses. out may be one of the
+		// poses and keeps its storage, so blending every frame allocates nothing.
+		template <typename T>
+		void blend_poses(const animation_pose<T>* const* poses, const T* weights, size_t count, animation_pose<T>& out)
+		{
+			using P = native_pack<T>;
+			assert(count != 0);
+			size_t joints = poses[0]->size();
+			for (size_t k = 1; k < count; ++k) assert(poses[k]->size() == joints);
+			out.resize(joints);
+
+			constexpr size_t max_inputs = 16;
+			assert(count <= max_inputs);
+			const vector_stream<3, T>* in[max_inputs];
+			for (size_t k = 0; k < count; ++k) in[k] = &poses[k]->translations;
+			detail::blend_streams(in, weights, count, out.translations);
+			for (size_t k = 0; k < count; ++k) in[k] = &poses[k]->scales;
+			detail::blend_streams(in, weights, count, out.scales);
+
+			detail::for_each_pack<T>(joints, [&](size_t i, uint8_t n)
+				{
+					const vector_stream<4, T>& first = poses[0]->rotations;
+					P q0[4], acc[4];
+					for (uint8_t c = 0; c < 4; ++c)
+					{
+						q0[c] = first.template load<P>(c, i, n);
+						acc[c] = q0[c] * P(weights[0]);
+					}
+					for (size_t k = 1; k < count; ++k)
+					{
+						const vector_stream<4, T>& r = poses[k]->rotations;
+						P q[4];
+						for (uint8_t c = 0; c < 4; ++c) q[c] = r.template load<P>(c, i, n);
+						P d = mul_add(q0[0], q[0], mul_add(q0[1], q[1], mul_add(q0[2], q[2], q0[3] * q[3])));
+						P w = select(d < P(T(0)), P(-weights[k]), P(weights[k]));
+						for (uint8_t c = 0; c < 4; ++c) acc[c] = mul_add(q[c], w, acc[c]);
+					}
+					P len2 = mul_add(acc[0], acc[0], mul_add(acc[1], acc[1], mul_add(acc[2], acc[2], acc[3] * acc[3])));
+					P inv_len = P(T(1)) / sqrt(len2);
+					for (uint8_t c = 0; c < 4; ++c) out.rotations.template store<P>(c, i, acc[c] * inv_len, n);
+				});
+		}
+
+		// Playback state of one clip for one character. Every track remembers the key it was
+		// last sampled at, so advancing time costs a step or two per track instead of a
+		// binary search; seeking backwards or far ahead falls back to one. Sampling gathers
+		// the two keys around the time for a block of joints into lanes and interpolates the
+		// whole block with the batch kernels, so it allocates nothing once the pose is sized.
+		template <typename T>
+		struct clip_sampler
+		{
+			using clip_type = animation_clip<T>;
+
+			// the keys must stay in place while the sampler is used
+			explicit clip_sampler(const animation_clip_view<T>& clip)
+				: clip(clip)
+			{
+				for (std::vector<uint32_t>& c : cursors) c.assign(clip.joints, 0);
+			}
+
+			explicit clip_sampler(const clip_type& clip)
+				: clip_sampler(clip.view())
+			{
+			}
+
+			// Pose at time, clamped to the keys of every track. Looping playback wraps time
+			// into 0..duration() first.
+			void sample(T time, animation_pose<T>& out, rotation_blend blend = rotation_blend::nlerp)
+			{
+				sample(time, out, blend, serial_for());
+			}
+
+			// the same with the joints of every channel split by parallel_for (see serial_for);
+			// worth it for skeletons of a few thousand joints
+			template <typename ParallelFor>
+			void sample(T time, animation_pose<T>& out, rotation_blend blend, ParallelFor&& parallel_for)
+			{
+				out.resize(clip.joints);
+				sample_channel<3>(clip_type::translation, time, out.translations, blend, parallel_for);
+				sample_channel<4>(clip_type::rotation, time, out.rotations, blend, parallel_for);
+				sample_channel<3>(clip_type::scale, time, out.scales, blend, parallel_for);
+			}
+
+		private:
+			// index of the last key at or before time, or 0 before the first key
+			static uint32_t seek(const T* times, uint32_t count, uint32_t& cursor, T time)
+			{
+				uint32_t k = cursor < count ? cursor : 0;
+				if (time >= times[k])
+				{
+					// forward playback moves at most a few keys per frame
+					for (uint8_t step = 0; step < 4; ++step)
+					{
+						if (k + 1 >= count || times[k + 1] > time)
+						{
+							return cursor = k;
+						}
+						++k;
+					}
+				}
+				k = uint32_t(std::upper_bound(times, times + count, time) - times);
+				return cursor = k == 0 ? 0 : k - 1;
+			}
+
+			template <uint8_t N, typename ParallelFor>
+			void sample_channel(typename clip_type::channel_index index, T time, vector_stream<N, T>& out, rotation_blend blend, ParallelFor& parallel_for)
+			{
+				constexpr size_t block = 64;
+				const typename animation_clip_view<T>::channel& ch = clip.channels[index];
+				uint32_t* cursor = cursors[index].data();
+				T identity[N] = {};
+				for (uint8_t c = 0; c < N; ++c) identity[c] = T(index == clip_type::scale || (N == 4 && c == 0));
+
+				// every part touches only the cursors and output lanes of its own joints
+				parallel_for(clip.joints, [&](size_t begin, size_t end)
+					{
+						alignas(64) T from[N][block], to[N][block], f[block];
+						for (size_t b = begin; b < end; b += block)
+						{
+							size_t n = end - b < block ? end - b : block;
+							for (size_t k = 0; k < n; ++k)
+							{
+								const animation_track& tr = ch.tracks[b + k];
+								if (tr.count == 0)
+								{
+									for (uint8_t c = 0; c < N; ++c)
+									{
+										from[c][k] = to[c][k] = identity[c];
+									}
+									f[k] = T(0);
+									continue;
+								}
+
+								const T* times = ch.times + tr.first;
+								uint32_t key = seek(times, tr.count, cursor[b + k], time);
+								uint32_t next = key + 1 < tr.count ? key + 1 : key;
+								T span = times[next] - times[key];
+								f[k] = span > T(0) ? std::min(std::max((time - times[key]) / span, T(0)), T(1)) : T(0);
+
+								const T* v0 = ch.values + size_t(tr.first + key) * N;
+								const T* v1 = ch.values + size_t(tr.first + next) * N;
+								for (uint8_t c = 0; c < N; ++c)
+								{
+									from[c][k] = v0[c];
+									to[c][k] = v1[c];
+								}
+							}
+
+							const T* a[N];
+							const T* c[N];
+							T* o[N];
+							for (uint8_t j = 0; j < N; ++j)
+							{
+								a[j] = from[j];
+								c[j] = to[j];
+								o[j] = out.lane(j) + b;
+							}
+							vector_lanes<N, const T> va(a, n), vb(c, n);
+							vector_lanes<N, T> vo(o, n);
+							if constexpr (N == 4)
+							{
+								if (blend == rotation_blend::slerp)
+								{
+									slerp_quaternions(va, vb, f, vo);
+								}
+								else
+								{
+									nlerp_quaternions(va, vb, f, vo);
+								}
+							}
+							else
+							{
+								detail::lerp_lanes(va, vb, f, vo);
+							}
+						}
+					});
+			}
+
+			animation_clip_view<T> clip;
+			std::vector<uint32_t> cursors[3];
+		};
+	}
+}
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "animation.h"
+#include "vector_stream.h"
+
+// Binary container for animation clips and static transform sets that is used in place:
+// map the file (or read it into any buffer), open() validates it once, and the clips and
+// transform sets are then views straight into the bytes, with no copy and no parsing.
+// Several processes mapping the same file share its pages.
+//
+// Layout, little endian, every offset in bytes and every array aligned to 64 bytes:
+//
+//	file_header
+//	section_entry[section_count]
+//	sections, each starting at its entry's offset (from the start of the file):
+//		clip:          clip_header, then per channel the tracks, times and values arrays
+//		               of animation_clip_view, at offsets from the start of the section
+//		transform set: transform_set_header, then ten lanes of count values: translation
+//		               x, y, z, rotation w, x, y, z and scale x, y, z
+//
+// Readers accept any minor version of their major version and skip sections of unknown
+// kinds, so later minor versions may only add section kinds and append to headers.
+
+namespace xm
+{
+	enum class file_status : uint8_t
+	{
+		ok,
+		misaligned,			// the buffer or an array in it breaks the alignment rules
+		too_small,			// shorter than the header or than the size it records
+		bad_magic,
+		wrong_byte_order,	// written big endian, or read on a big endian cpu
+		unsupported_version,
+		wrong_scalar_type,	// float file opened as double or the other way round
+		out_of_bounds,		// a section or array reaches past its end
+		bad_keys,			// a track's keys are out of range, unsorted or NaN
+		bad_frames,			// a snapshot chunk's frames do not match its header
+	};
+
+	inline const char* to_string(file_status status)
+	{
+		switch (status)
+		{
+		case file_status::ok: return "ok";
+		case file_status::misaligned: return "misaligned";
+		case file_status::too_small: return "too small";
+		case file_status::bad_magic: return "bad magic";
+		case file_status::wrong_byte_order: return "wrong byte order";
+		case file_status::unsupported_version: return "unsupported version";
+		case file_status::wrong_scalar_type: return "wrong scalar type";
+		case file_status::out_of_bounds: return "out of bounds";
+		case file_status::bad_keys: return "bad keys";
+		case file_status::bad_frames: return "bad frames";
+		}
+		return "unknown";
+	}
+
+	namespace file_format
+	{
+		constexpr uint32_t magic = 0x46414D58;	// "XMAF"
+		constexpr uint32_t byte_order_mark = 0x01020304;
+		constexpr uint16_t version_major = 1;
+		constexpr uint16_t version_minor = 0;
+		constexpr size_t alignment = 64;
+
+		enum class section_kind : uint32_t { clip = 1, transform_set = 2 };
+
+		struct file_header
+		{
+			uint32_t magic;
+			uint32_t byte_order;
+			uint16_t version_major;
+			uint16_t version_minor;
+			uint32_t scalar_size;	// 4 for float, 8 for double
+			uint64_t file_size;
+			uint32_t section_count;
+			uint32_t reserved;
+		};
+
+		struct section_entry
+		{
+			uint32_t kind;
+			uint32_t reserved;
+			uint64_t id;	// chosen by the writer, e.g. a hash of the clip's name
+			uint64_t offset;
+			uint64_t size;
+		};
+
+		// offsets from the start of the section; channels as in animation_clip_view
+		struct clip_header
+		{
+			uint64_t joints;
+			uint64_t keys[3];
+			uint64_t tracks[3];
+			uint64_t times[3];
+			uint64_t values[3];
+		};
+
+		struct transform_set_header
+		{
+			uint64_t count;
+			uint64_t lanes[10];
+		};
+
+		static_assert(sizeof(file_header) == 32 && sizeof(section_entry) == 32);
+		static_assert(sizeof(clip_header) == 104 && sizeof(transform_set_header) == 88);
+		static_assert(sizeof(animation_track) == 8);
+
+		constexpr uint8_t clip_components[3] = { 3, 4, 3 };
+
+		// whether count elements of size bytes at offset lie within size_limit bytes
+		inline bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t size_limit)
+		{
+			return offset <= size_limit && count <= (size_limit - offset) / size;
+		}
+	}
+
+	// Static local transforms, e.g. the placements of a level's instances, as SoA lanes
+	// that compose_trs and the batch kernels take directly.
+	template <typename T>
+	struct transform_set_view
+	{
+		size_t size() const
+		{
+			return count;
+		}
+
+		vector_lanes<3, const T> translations() const
+		{
+			return vector_lanes<3, const T>(lanes, count);
+		}
+
+		vector_lanes<4, const T> rotations() const
+		{
+			return vector_lanes<4, const T>(lanes + 3, count);
+		}
+
+		vector_lanes<3, const T> scales() const
+		{
+			return vector_lanes<3, const T>(lanes + 7, count);
+		}
+
+		const T* lanes[10] = {};
+		size_t count = 0;
+	};
+
+	// Read side: a validated view of a file image holding T = float or double values.
+	template <typename T>
+	struct animation_file
+	{
+		using section_kind = file_format::section_kind;
+		static constexpr size_t npos = ~size_t(0);
+
+		// Validates the whole image and keeps a view of it on success, so sampling never
+		// meets an out of range index. data must be 8 byte aligned (mmap and operator new
+		// are) and stay valid while the file and any view or sampler from it are used.
+		// Costs one pass over the key times, nothing over the values.
+		file_status open(const void* data, size_t size)
+		{
+			base = nullptr;
+			header = nullptr;
+			entries = nullptr;
+			file_status status = validate(static_cast<const unsigned char*>(data), size);
+			if (status == file_status::ok)
+			{
+				base = static_cast<const unsigned char*>(data);
+				header = reinterpret_cast<const file_format::file_header*>(base);
+				entries = reinterpret_cast<const file_format::section_entry*>(base + sizeof(file_format::file_header));
+			}
+			return status;
+		}
+
+		bool is_open() const
+		{
+			return base != nullptr;
+		}
+
+		size_t sections() const
+		{
+			return header ? header->section_count : 0;
+		}
+
+		section_kind kind(size_t i) const
+		{
+			return section_kind(entries[i].kind);
+		}
+
+		uint64_t id(size_t i) const
+		{
+			return entries[i].id;
+		}
+
+		// first section of the kind with the id, or npos
+		size_t find(section_kind k, uint64_t section_id) const
+		{
+			for (size_t i = 0; i < sections(); ++i)
+			{
+				if (kind(i) == k && id(i) == section_id) return i;
+			}
+			return npos;
+		}
+
+		// section i, which must be a clip
+		animation_clip_view<T> clip(size_t i) const
+		{
+			assert(kind(i) == section_kind::clip);
+			const unsigned char* section = base + entries[i].offset;
+			const auto* h = reinterpret_cast<const file_format::clip_header*>(section);
+			animation_clip_view<T> res;
+			res.joints = size_t(h->joints);
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				res.channels[c].tracks = reinterpret_cast<const animation_track*>(section + h->tracks[c]);
+				res.channels[c].times = reinterpret_cast<const T*>(section + h->times[c]);
+				res.channels[c].values = reinterpret_cast<const T*>(section + h->values[c]);
+			}
+			return res;
+		}
+
+		// section i, which must be a transform set
+		transform_set_view<T> transform_set(size_t i) const
+		{
+			assert(kind(i) == section_kind::transform_set);
+			const unsigned char* section = base + entries[i].offset;
+			const auto* h = reinterpret_cast<const file_format::transform_set_header*>(section);
+			transform_set_view<T> res;
+			res.count = size_t(h->count);
+			for (uint8_t c = 0; c < 10; ++c) res.lanes[c] = reinterpret_cast<const T*>(section + h->lanes[c]);
+			return res;
+		}
+
+	private:
+		static file_status validate(const unsigned char* data, size_t size)
+		{
+			using namespace file_format;
+			if (reinterpret_cast<uintptr_t>(data) % alignof(uint64_t) != 0) return file_status::misaligned;
+			if (size < sizeof(file_header)) return file_status::too_small;
+
+			const auto* h = reinterpret_cast<const file_header*>(data);
+			if (h->magic != magic) return file_status::bad_magic;
+			if (h->byte_order != byte_order_mark) return file_status::wrong_byte_order;
+			if (h->version_major != version_major) return file_status::unsupported_version;
+			if (h->scalar_size != sizeof(T)) return file_status::wrong_scalar_type;
+			if (h->file_size > size) return file_status::too_small;
+			if (!fits(sizeof(file_header), h->section_count, sizeof(section_entry), h->file_size)) return file_status::out_of_bounds;
+
+			const auto* e = reinterpret_cast<const section_entry*>(data + sizeof(file_header));
+			for (uint32_t i = 0; i < h->section_count; ++i)
+			{
+				if (e[i].offset % alignment != 0) return file_status::misaligned;
+				if (!fits(e[i].offset, e[i].size, 1, h->file_size)) return file_status::out_of_bounds;
+
+				file_status status = file_status::ok;
+				if (e[i].kind == uint32_t(section_kind::clip))
+				{
+					status = validate_clip(data + e[i].offset, e[i].size);
+				}
+				else if (e[i].kind == uint32_t(section_kind::transform_set))
+				{
+					status = validate_transform_set(data + e[i].offset, e[i].size);
+				}
+				if (status != file_status::ok) return status;
+			}
+			return file_status::ok;
+		}
+
+		// an array of count elements of size bytes at offset of a section of section_size bytes
+		static file_status check_array(uint64_t offset, uint64_t count, uint64_t size, uint64_t section_size)
+		{
+			if (offset % file_format::alignment != 0) return file_status::misaligned;
+			return file_format::fits(offset, count, size, section_size) ? file_status::ok : file_status::out_of_bounds;
+		}
+
+		static file_status validate_clip(const unsigned char* section, uint64_t size)
+		{
+			using namespace file_format;
+			if (size < sizeof(clip_header)) return file_status::out_of_bounds;
+			const auto* h = reinterpret_cast<const clip_header*>(section);
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				file_status status = check_array(h->tracks[c], h->joints, sizeof(animation_track), size);
+				if (status == file_status::ok) status = check_array(h->times[c], h->keys[c], sizeof(T), size);
+				if (status == file_status::ok) status = check_array(h->values[c], h->keys[c], clip_components[c] * sizeof(T), size);
+				if (status != file_status::ok) return status;
+
+				const auto* tracks = reinterpret_cast<const animation_track*>(section + h->tracks[c]);
+				const T* times = reinterpret_cast<const T*>(section + h->times[c]);
+				for (uint64_t j = 0; j < h->joints; ++j)
+				{
+					const animation_track& t = tracks[j];
+					if (uint64_t(t.first) + t.count > h->keys[c]) return file_status::bad_keys;
+					for (uint32_t k = 0; k < t.count; ++k)
+					{
+						// also rejects NaN
+						T time = times[t.first + k];
+						if (!(time == time) || (k != 0 && !(times[t.first + k - 1] <= time))) return file_status::bad_keys;
+					}
+				}
+			}
+			return file_status::ok;
+		}
+
+		static file_status validate_transform_set(const unsigned char* section, uint64_t size)
+		{
+			using namespace file_format;
+			if (size < sizeof(transform_set_header)) return file_status::out_of_bounds;
+			const auto* h = reinterpret_cast<const transform_set_header*>(section);
+			for (uint8_t c = 0; c < 10; ++c)
+			{
+				file_status status = check_array(h->lanes[c], h->count, sizeof(T), size);
+				if (status != file_status::ok) return status;
+			}
+			return file_status::ok;
+		}
+
+		const unsigned char* base = nullptr;
+		const file_format::file_header* header = nullptr;
+		const file_format::section_entry* entries = nullptr;
+	};
+
+	// Write side: collects sections and lays out the image. Values are written in the
+	// host's byte order, so files must be written on little endian machines (the reader
+	// rejects anything else).
+	template <typename T>
+	struct animation_file_writer
+	{
+		void add_clip(uint64_t id, const animation_clip<T>& clip)
+		{
+			using namespace file_format;
+			clip_header h{};
+			h.joints = clip.joints();
+			uint64_t at = align(sizeof(clip_header));
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				const typename animation_clip<T>::channel& ch = clip.channels[c];
+				h.keys[c] = ch.times.size();
+				h.tracks[c] = at;
+				at = align(at + ch.tracks.size() * sizeof(animation_track));
+				h.times[c] = at;
+				at = align(at + ch.times.size() * sizeof(T));
+				h.values[c] = at;
+				at = align(at + ch.values.size() * sizeof(T));
+			}
+
+			section& s = add(section_kind::clip, id, at);
+			std::memcpy(s.bytes.data(), &h, sizeof(h));
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				const typename animation_clip<T>::channel& ch = clip.channels[c];
+				copy(s, h.tracks[c], ch.tracks.data(), ch.tracks.size() * sizeof(animation_track));
+				copy(s, h.times[c], ch.times.data(), ch.times.size() * sizeof(T));
+				copy(s, h.values[c], ch.values.data(), ch.values.size() * sizeof(T));
+			}
+		}
+
+		// rotations hold w, x, y, z; all three hold the same number of transforms
+		void add_transform_set(uint64_t id, const vector_stream<3, T>& translations, const vector_stream<4, T>& rotations, const vector_stream<3, T>& scales)
+		{
+			using namespace file_format;
+			assert(rotations.size() == translations.size() && scales.size() == translations.size());
+			transform_set_header h{};
+			h.count = translations.size();
+			const T* lanes[10];
+			for (uint8_t c = 0; c < 3; ++c) lanes[c] = translations.lane(c);
+			for (uint8_t c = 0; c < 4; ++c) lanes[3 + c] = rotations.lane(c);
+			for (uint8_t c = 0; c < 3; ++c) lanes[7 + c] = scales.lane(c);
+
+			uint64_t at = align(sizeof(transform_set_header));
+			for (uint8_t c = 0; c < 10; ++c)
+			{
+				h.lanes[c] = at;
+				at = align(at + h.count * sizeof(T));
+			}
+
+			section& s = add(section_kind::transform_set, id, at);
+			std::memcpy(s.bytes.data(), &h, sizeof(h));
+			for (uint8_t c = 0; c < 10; ++c) copy(s, h.lanes[c], lanes[c], h.count * sizeof(T));
+		}
+
+		void add_transform_set(uint64_t id, const animation_pose<T>& pose)
+		{
+			add_transform_set(id, pose.translations, pose.rotations, pose.scales);
+		}
+
+		// the complete file image
+		std::vector<unsigned char> finish() const
+		{
+			using namespace file_format;
+			uint64_t at = align(sizeof(file_header) + sections.size() * sizeof(section_entry));
+			std::vector<section_entry> entries(sections.size());
+			for (size_t i = 0; i < sections.size(); ++i)
+			{
+				entries[i] = section_entry{ uint32_t(sections[i].kind), 0, sections[i].id, at, sections[i].bytes.size() };
+				at = align(at + sections[i].bytes.size());
+			}
+
+			file_header h{};
+			h.magic = magic;
+			h.byte_order = byte_order_mark;
+			h.version_major = version_major;
+			h.version_minor = version_minor;
+			h.scalar_size = sizeof(T);
+			h.file_size = at;
+			h.section_count = uint32_t(sections.size());
+
+			std::vector<unsigned char> res(size_t(at), 0);
+			std::memcpy(res.data(), &h, sizeof(h));
+			if (!entries.empty())
+			{
+				std::memcpy(res.data() + sizeof(h), entries.data(), entries.size() * sizeof(section_entry));
+			}
+			for (size_t i = 0; i < sections.size(); ++i)
+			{
+				if (!sections[i].bytes.empty())
+				{
+					std::memcpy(res.data() + entries[i].offset, sections[i].bytes.data(), sections[i].bytes.size());
+				}
+			}
+			return res;
+		}
+
+	private:
+		struct section
+		{
+			file_format::section_kind kind;
+			uint64_t id;
+			std::vector<unsigned char> bytes;
+		};
+
+		static uint64_t align(uint64_t offset)
+		{
+			return (offset + file_format::alignment - 1) / file_format::alignment * file_format::alignment;
+		}
+
+		section& add(file_format::section_kind kind, uint64_t id, uint64_t size)
+		{
+			sections.push_back(section{ kind, id, std::vector<unsigned char>(size_t(size), 0) });
+			return sections.back();
+		}
+
+		static void copy(section& s, uint64_t offset, const void* data, size_t bytes)
+		{
+			if (bytes != 0) std::memcpy(s.bytes.data() + offset, data, bytes);
+		}
+
+		std::vector<section> sections;
+	};
+}
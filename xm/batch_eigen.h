@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include "eigen.h"
+#include "batch_transforms.h"
+
+// eigen_symmetric and svd of eigen.h for arrays of 3x3 matrices, a whole pack of matrices per
+// Jacobi sweep. The quaternion outputs are streams with 4 components in the order w, x, y, z,
+// as in batch_quaternion.h.
+
+namespace xm
+{
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// the three columns of pack i of the matrices at base, matrix j stride bytes after
+			// matrix j - 1
+			template <typename P>
+			inline void load_matrices(const char* base, size_t count, size_t stride, size_t i, uint8_t n, P (&m)[3][3])
+			{
+				using T = typename P::value_type;
+				for (uint8_t c = 0; c < 3; ++c)
+				{
+					vector_span<3, const T> column(reinterpret_cast<const T*>(base + c * 3 * sizeof(T)), count, stride);
+					for (uint8_t r = 0; r < 3; ++r) m[c][r] = column.template load<P>(r, i, n);
+				}
+			}
+
+			template <typename P, typename Out>
+			inline void store_quaternion(Out& out, size_t i, const quaternion<P>& q, uint8_t n)
+			{
+				out.template store<P>(0, i, q.w, n);
+				out.template store<P>(1, i, q.m[0], n);
+				out.template store<P>(2, i, q.m[1], n);
+				out.template store<P>(3, i, q.m[2], n);
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// eigen_symmetric(s[i], values[i], vectors[i]) for count symmetric matrices, e.g. the
+		// covariances of many point clouds. values holds 3 components, vectors 4. Matrix i is
+		// stride bytes after matrix i - 1; only the lower triangle is read.
+		template <typename T, typename Values, typename Vectors>
+		detail::if_stream<Values> eigen_symmetric(const matrix<3, T>* s, size_t count, Values&& values, Vectors&& vectors,
+			size_t stride = sizeof(matrix<3, T>), unsigned sweeps = detail::jacobi_sweeps<T>)
+		{
+			using P = native_pack<T>;
+			static_assert(std::remove_reference_t<Values>::components == 3 && std::remove_reference_t<Vectors>::components == 4);
+			detail::prepare_output(values, count);
+			detail::prepare_output(vectors, count);
+
+			const char* base = reinterpret_cast<const char*>(s);
+			detail::for_each_pack<T>(count, [&](size_t i, uint8_t n)
+				{
+					P m[3][3];
+					detail::load_matrices(base, count, stride, i, n, m);
+					P sym[6] = { m[0][0], m[0][1], m[1][1], m[0][2], m[1][2], m[2][2] };
+
+					P res[3];
+					quaternion<P> q;
+					detail::eigen_symmetric(sym, res, q, sweeps);
+					for (uint8_t k = 0; k < 3; ++k) values.template store<P>(k, i, res[k], n);
+					detail::store_quaternion(vectors, i, q, n);
+				});
+		}
+
+		// svd(a[i], u[i], sigma[i], v[i]) for count matrices, e.g. the deformation gradients
+		// of a simulation or the covariances of shape matching. sigma holds 3 components, u
+		// and v 4. Matrix i is stride bytes after matrix i - 1.
+		template <typename T, typename U, typename Sigma, typename V>
+		detail::if_stream<Sigma> svd(const matrix<3, T>* a, size_t count, U&& u, Sigma&& sigma, V&& v,
+			size_t stride = sizeof(matrix<3, T>), unsigned sweeps = detail::jacobi_sweeps<T>)
+		{
+			using P = native_pack<T>;
+			static_assert(std::remove_reference_t<U>::components == 4 && std::remove_reference_t<Sigma>::components == 3
+				&& std::remove_reference_t<V>::components == 4);
+			detail::prepare_output(u, count);
+			detail::prepare_output(sigma, count);
+			detail::prepare_output(v, count);
+
+			const char* base = reinterpret_cast<const char*>(a);
+			detail::for_each_pack<T>(count, [&](size_t i, uint8_t n)
+				{
+					P m[3][3];
+					detail::load_matrices(base, count, stride, i, n, m);
+
+					P res[3];
+					quaternion<P> qu, qv;
+					detail::svd(m, qu, res, qv, sweeps);
+					detail::store_quaternion(u, i, qu, n);
+					for (uint8_t k = 0; k < 3; ++k) sigma.template store<P>(k, i, res[k], n);
+					detail::store_quaternion(v, i, qv, n);
+				});
+		}
+	}
+}
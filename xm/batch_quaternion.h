@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include "quaternion.h"
+#include "matrix_transforms.h"
+#include "batch_transforms.h"
+
+// Batch kernels for arrays of quaternions in SoA form. A quaternion operand is a stream with
+// 4 components in the order w, x, y, z: four lanes, or a vector_span over quaternion<T>
+// itself (vector_span<4, const T>(&q[0].w, n, sizeof(quaternion<T>))). normalize of
+// vector_stream.h already works on such streams.
+
+namespace xm
+{
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// one pack of nlerp_quaternions / slerp_quaternions
+			template <bool Correct, typename A, typename B, typename P, typename Out>
+			inline void nlerp_packed(const A& a, const B& b, P t, Out& out, size_t i, uint8_t n)
+			{
+				using T = typename P::value_type;
+				P q0[4], q1[4];
+				for (uint8_t c = 0; c < 4; ++c)
+				{
+					q0[c] = a.template load<P>(c, i, n);
+					q1[c] = b.template load<P>(c, i, n);
+				}
+				P d = mul_add(q0[0], q1[0], mul_add(q0[1], q1[1], mul_add(q0[2], q1[2], q0[3] * q1[3])));
+				P sign = select(d < P(T(0)), P(T(-1)), P(T(1)));
+
+				if constexpr (Correct)
+				{
+					// Kapoulkine, "Approximating slerp": fitted for |dot| in 0..1
+					P ca = d * sign;
+					P ka = mul_add(ca, mul_add(ca, mul_add(ca, P(T(-1.43519)), P(T(3.55645))), P(T(-3.2452))), P(T(1.0904)));
+					P kb = mul_add(ca, mul_add(ca, P(T(0.215638)), P(T(-1.06021))), P(T(0.848013)));
+					P h = t - P(T(0.5));
+					P k = mul_add(ka * h, h, kb);
+					t = mul_add(t * h * (t - P(T(1))), k, t);
+				}
+
+				P r[4];
+				P len2(T(0));
+				for (uint8_t c = 0; c < 4; ++c)
+				{
+					r[c] = mul_add(mul_add(q1[c], sign, -q0[c]), t, q0[c]);
+					len2 = mul_add(r[c], r[c], len2);
+				}
+				P inv_len = P(T(1)) / sqrt(len2);
+				for (uint8_t c = 0; c < 4; ++c)
+				{
+					out.template store<P>(c, i, r[c] * inv_len, n);
+				}
+			}
+
+			// one order of euler_to_quaternions
+			template <euler_order O, typename E, typename Out>
+			void euler_quaternions(const E& angles, Out&& out)
+			{
+				using P = native_pack<stream_value<E>>;
+				for_each_pack<stream_value<E>>(angles.size(), [&](size_t i, uint8_t n)
+					{
+						P w, x, y, z;
+						euler_quaternion<O>(angles.template load<P>(0, i, n), angles.template load<P>(1, i, n), angles.template load<P>(2, i, n), w, x, y, z);
+						out.template store<P>(0, i, w, n);
+						out.template store<P>(1, i, x, n);
+						out.template store<P>(2, i, y, n);
+						out.template store<P>(3, i, z, n);
+					});
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// out[i] = a[i] * b[i], the Hamilton product as operator*(quaternion, quaternion)
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> multiply_quaternions(const A& a, const B& b, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			static_assert(A::components == 4 && B::components == 4 && std::remove_reference_t<Out>::components == 4);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					P aw = a.template load<P>(0, i, n), ax = a.template load<P>(1, i, n), ay = a.template load<P>(2, i, n), az = a.template load<P>(3, i, n);
+					P bw = b.template load<P>(0, i, n), bx = b.template load<P>(1, i, n), by = b.template load<P>(2, i, n), bz = b.template load<P>(3, i, n);
+
+					P w = aw * bw - mul_add(ax, bx, mul_add(ay, by, az * bz));
+					P x = mul_add(aw, bx, mul_add(bw, ax, ay * bz - az * by));
+					P y = mul_add(aw, by, mul_add(bw, ay, az * bx - ax * bz));
+					P z = mul_add(aw, bz, mul_add(bw, az, ax * by - ay * bx));
+
+					out.template store<P>(0, i, w, n);
+					out.template store<P>(1, i, x, n);
+					out.template store<P>(2, i, y, n);
+					out.template store<P>(3, i, z, n);
+				});
+		}
+
+		// out[i] = rotate(q[i], v[i]) for unit quaternions: two cross products per vector
+		// instead of the two quaternion products of q * v * conjugate(q), and no matrix
+		template <typename Q, typename V, typename Out>
+		detail::if_stream<Q> rotate_vectors(const Q& q, const V& v, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<Q>>;
+			static_assert(Q::components == 4 && V::components == 3 && std::remove_reference_t<Out>::components == 3);
+			assert(v.size() >= q.size());
+			detail::prepare_output(out, q.size());
+			detail::for_each_pack<detail::stream_value<Q>>(q.size(), [&](size_t i, uint8_t n)
+				{
+					P w = q.template load<P>(0, i, n), ux = q.template load<P>(1, i, n), uy = q.template load<P>(2, i, n), uz = q.template load<P>(3, i, n);
+					P vx = v.template load<P>(0, i, n), vy = v.template load<P>(1, i, n), vz = v.template load<P>(2, i, n);
+
+					// t = 2 * cross(u, v)
+					P tx = uy * vz - uz * vy;
+					P ty = uz * vx - ux * vz;
+					P tz = ux * vy - uy * vx;
+					tx = tx + tx;
+					ty = ty + ty;
+					tz = tz + tz;
+
+					// v + w * t + cross(u, t)
+					out.template store<P>(0, i, mul_add(w, tx, vx + (uy * tz - uz * ty)), n);
+					out.template store<P>(1, i, mul_add(w, ty, vy + (uz * tx - ux * tz)), n);
+					out.template store<P>(2, i, mul_add(w, tz, vz + (ux * ty - uy * tx)), n);
+				});
+		}
+
+		// out[i] = quat_from_euler(angles[i], order), angles holding (x, y, z) in radians:
+		// the closed form of quaternion.h on whole packs, with the polynomial sincos
+		template <typename E, typename Out>
+		detail::if_stream<E> euler_to_quaternions(const E& angles, euler_order order, Out&& out)
+		{
+			static_assert(E::components == 3 && std::remove_reference_t<Out>::components == 4);
+			detail::prepare_output(out, angles.size());
+			switch (order)
+			{
+			case euler_order::xyz: detail::euler_quaternions<euler_order::xyz>(angles, out); break;
+			case euler_order::xzy: detail::euler_quaternions<euler_order::xzy>(angles, out); break;
+			case euler_order::yxz: detail::euler_quaternions<euler_order::yxz>(angles, out); break;
+			case euler_order::yzx: detail::euler_quaternions<euler_order::yzx>(angles, out); break;
+			case euler_order::zxy: detail::euler_quaternions<euler_order::zxy>(angles, out); break;
+			default: detail::euler_quaternions<euler_order::zyx>(angles, out); break;
+			}
+		}
+
+		// out[i] = normalize(lerp(a[i], b[i], t[i])) along the shorter arc: b[i] is negated
+		// where dot(a[i], b[i]) < 0. t holds a.size() factors.
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> nlerp_quaternions(const A& a, const B& b, const detail::stream_value<A>* t, Out&& out)
+		{
+			using T = detail::stream_value<A>;
+			using P = native_pack<T>;
+			static_assert(A::components == 4 && B::components == 4 && std::remove_reference_t<Out>::components == 4);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<T>(a.size(), [&](size_t i, uint8_t n)
+				{
+					detail::nlerp_packed<false>(a, b, detail::load_scalars<P>(t + i, n), out, i, n);
+				});
+		}
+
+		// As nlerp_quaternions with the factor corrected by a cubic in t whose coefficients
+		// depend on the angle, so the result stays within 0.001 radians of slerp at any
+		// angle, without acos and sin per element.
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> slerp_quaternions(const A& a, const B& b, const detail::stream_value<A>* t, Out&& out)
+		{
+			using T = detail::stream_value<A>;
+			using P = native_pack<T>;
+			static_assert(A::components == 4 && B::components == 4 && std::remove_reference_t<Out>::components == 4);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<T>(a.size(), [&](size_t i, uint8_t n)
+				{
+					detail::nlerp_packed<true>(a, b, detail::load_scalars<P>(t + i, n), out, i, n);
+				});
+		}
+
+		// Rotation matrices of unit quaternions, as mat3_cast(quaternion) for every element,
+		// transposed straight into out: matrix i is written stride bytes after matrix i - 1.
+		template <typename T, typename Q>
+		detail::if_stream<Q> mat3_cast(const Q& q, matrix<3, T>* out, size_t stride = sizeof(matrix<3, T>))
+		{
+			using P = native_pack<T>;
+			static_assert(Q::components == 4 && std::is_same_v<detail::stream_value<Q>, T>);
+
+			constexpr size_t column = 3 * sizeof(T);
+			char* base = reinterpret_cast<char*>(out);
+			detail::for_each_pack<T>(q.size(), [&](size_t i, uint8_t n)
+				{
+					P r[3][3];
+					detail::rotation_matrix(q.template load<P>(0, i, n), q.template load<P>(1, i, n),
+						q.template load<P>(2, i, n), q.template load<P>(3, i, n), r);
+
+					char* dst = base + i * stride;
+					for (uint8_t c = 0; c < 3; ++c)
+					{
+						detail::store_transposed(r[0][c], r[1][c], r[2][c], dst + c * column, stride, n);
+					}
+				});
+		}
+
+		// as above, rotation only mat4s as mat4_cast(quaternion)
+		template <typename T, typename Q>
+		detail::if_stream<Q> mat4_cast(const Q& q, matrix<4, T>* out, size_t stride = sizeof(matrix<4, T>))
+		{
+			using P = native_pack<T>;
+			static_assert(Q::components == 4 && std::is_same_v<detail::stream_value<Q>, T>);
+
+			constexpr size_t column = 4 * sizeof(T);
+			const P zero(T(0)), one(T(1));
+			char* base = reinterpret_cast<char*>(out);
+			detail::for_each_pack<T>(q.size(), [&](size_t i, uint8_t n)
+				{
+					P r[3][3];
+					detail::rotation_matrix(q.template load<P>(0, i, n), q.template load<P>(1, i, n),
+						q.template load<P>(2, i, n), q.template load<P>(3, i, n), r);
+
+					char* dst = base + i * stride;
+					for (uint8_t c = 0; c < 3; ++c)
+					{
+						detail::store_transposed(r[0][c], r[1][c], r[2][c], zero, dst + c * column, stride, n);
+					}
+					detail::store_transposed(zero, zero, zero, one, dst + 3 * column, stride, n);
+				});
+		}
+	}
+
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// orthonormalize of the upper 3x3 of count matrices in place, W at a time: column c
+			// of matrix i starts at base + i * stride + c * column bytes
+			template <typename T>
+			void orthonormalize_packed(char* base, size_t count, size_t stride, size_t column, unsigned iterations)
+			{
+				using P = native_pack<T>;
+				for_each_pack<T>(count, [&](size_t i, uint8_t n)
+					{
+						P c[3][3];
+						for (uint8_t j = 0; j < 3; ++j)
+						{
+							vector_span<3, T> col(reinterpret_cast<T*>(base + j * column), count, stride);
+							for (uint8_t k = 0; k < 3; ++k) c[j][k] = col.template load<P>(k, i, n);
+						}
+						for (unsigned it = 0; it < iterations; ++it)
+						{
+							orthonormalize_step(c);
+						}
+
+						char* dst = base + i * stride;
+						for (uint8_t j = 0; j < 3; ++j)
+						{
+							store_transposed(c[j][0], c[j][1], c[j][2], dst + j * column, stride, n);
+						}
+					});
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// orthonormalize(m[i], iterations) for count rotation matrices in place, e.g. to pull
+		// accumulated world rotations back to orthonormal once per frame. Matrix i is stride
+		// bytes after matrix i - 1; for mat4s only the upper 3x3 is written.
+		template <typename T>
+		void orthonormalize(matrix<3, T>* m, size_t count, size_t stride = sizeof(matrix<3, T>), unsigned iterations = 2)
+		{
+			detail::orthonormalize_packed<T>(reinterpret_cast<char*>(m), count, stride, 3 * sizeof(T), iterations);
+		}
+
+		template <typename T>
+		void orthonormalize(matrix<4, T>* m, size_t count, size_t stride = sizeof(matrix<4, T>), unsigned iterations = 2)
+		{
+			detail::orthonormalize_packed<T>(reinterpret_cast<char*>(m), count, stride, 4 * sizeof(T), iterations);
+		}
+	}
+}
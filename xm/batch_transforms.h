@@ -0,0 +1,410 @@
+#pragma once
+
+#include "matrix.h"
+#include "affine.h"
+#include "vector_stream.h"
+
+namespace xm
+{
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// Implicit homogeneous coordinate of the input: the input holds M - 1
+			// components and w is 0 or 1, or it holds all M and w is read from it.
+			enum class implicit_w { zero, one, none };
+
+			// out = m * in for every element, whole packs at a time. The matrix elements are
+			// broadcast once, then every output component is one multiply and M - 1 fmas.
+			template <implicit_w W, bool Divide, uint8_t M, typename T, typename In, typename Out>
+			void transform_packed(const matrix<M, T>& m, const In& in, Out& out)
+			{
+				using P = native_pack<T>;
+				constexpr uint8_t K = W == implicit_w::none ? M : M - 1;
+				constexpr uint8_t R = Out::components;
+
+				P col[M][R];
+				for (uint8_t k = 0; k < M; ++k)
+				{
+					for (uint8_t j = 0; j < R; ++j) col[k][j] = P(m[k][j]);
+				}
+				P homogeneous_w(K < M ? m[M - 1][M - 1] : T(0));
+
+				for_each_pack<T>(in.size(), [&](size_t i, uint8_t n)
+					{
+						P v[K];
+						for (uint8_t k = 0; k < K; ++k) v[k] = in.template load<P>(k, i, n);
+
+						P res[M];
+						for (uint8_t j = 0; j < R; ++j)
+						{
+							res[j] = W == implicit_w::one ? col[M - 1][j] : col[0][j] * v[0];
+							for (uint8_t k = W == implicit_w::one ? 0 : 1; k < K; ++k)
+							{
+								res[j] = mul_add(col[k][j], v[k], res[j]);
+							}
+						}
+
+						if constexpr (Divide)
+						{
+							// w is needed even when the output drops it
+							P w = W == implicit_w::one ? homogeneous_w : P(m[0][M - 1]) * v[0];
+							for (uint8_t k = W == implicit_w::one ? 0 : 1; k < K; ++k)
+							{
+								w = mul_add(P(m[k][M - 1]), v[k], w);
+							}
+							P inv_w = P(T(1)) / w;
+							for (uint8_t j = 0; j < M - 1; ++j) res[j] = res[j] * inv_w;
+						}
+
+						for (uint8_t j = 0; j < R; ++j) out.template store<P>(j, i, res[j], n);
+					});
+			}
+
+#if XM_SSE2
+			// Per-element path for float mat4 on AoS spans: x, y, z (and w) are broadcast
+			// and combined with whole matrix columns, so every element costs one
+			// multiply, two or three fmas and a single store, and the loop runs at
+			// memory speed on large arrays.
+			template <implicit_w W, bool Divide, typename In, typename Out>
+			void transform_aos(const matrix<4, float>& m, const In& in, const Out& out)
+			{
+				__m128 c0 = _mm_loadu_ps(&m.a.x);
+				__m128 c1 = _mm_loadu_ps(&m.b.x);
+				__m128 c2 = _mm_loadu_ps(&m.c.x);
+				__m128 c3 = _mm_loadu_ps(&m.d.x);
+
+				const char* src = in.base;
+				char* dst = out.base;
+				for (size_t i = 0, n = in.size(); i < n; ++i, src += in.stride, dst += out.stride)
+				{
+					const float* p = reinterpret_cast<const float*>(src);
+					__m128 res = W == implicit_w::one ? c3
+						: W == implicit_w::none ? _mm_mul_ps(c3, _mm_set1_ps(p[3]))
+						: _mm_setzero_ps();
+#if XM_FMA
+					res = _mm_fmadd_ps(c0, _mm_set1_ps(p[0]), res);
+					res = _mm_fmadd_ps(c1, _mm_set1_ps(p[1]), res);
+					res = _mm_fmadd_ps(c2, _mm_set1_ps(p[2]), res);
+#else
+					res = _mm_add_ps(res, _mm_mul_ps(c0, _mm_set1_ps(p[0])));
+					res = _mm_add_ps(res, _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+					res = _mm_add_ps(res, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+#endif
+					if constexpr (Divide)
+					{
+						res = _mm_div_ps(res, _mm_shuffle_ps(res, res, _MM_SHUFFLE(3, 3, 3, 3)));
+					}
+
+					float* q = reinterpret_cast<float*>(dst);
+					if constexpr (Out::components == 4)
+					{
+						_mm_storeu_ps(q, res);
+					}
+					else
+					{
+						_mm_storel_pi(reinterpret_cast<__m64*>(q), res);
+						_mm_store_ss(q + 2, _mm_movehl_ps(res, res));
+					}
+				}
+			}
+#endif
+
+			// Writes lane k of a, b, c, d as the four consecutive values at out + k * stride
+			// bytes, for the first count lanes: a 4 x W transpose straight into the output.
+			template <typename T, uint8_t W>
+			inline void store_transposed(pack<T, W> a, pack<T, W> b, pack<T, W> c, pack<T, W> d, char* out, size_t stride, uint8_t count)
+			{
+				alignas(64) T tmp[4][W];
+				a.store(tmp[0]);
+				b.store(tmp[1]);
+				c.store(tmp[2]);
+				d.store(tmp[3]);
+				for (uint8_t k = 0; k < count; ++k, out += stride)
+				{
+					T* p = reinterpret_cast<T*>(out);
+					p[0] = tmp[0][k];
+					p[1] = tmp[1][k];
+					p[2] = tmp[2][k];
+					p[3] = tmp[3][k];
+				}
+			}
+
+			// as above with three values per lane
+			template <typename T, uint8_t W>
+			inline void store_transposed(pack<T, W> a, pack<T, W> b, pack<T, W> c, char* out, size_t stride, uint8_t count)
+			{
+				alignas(64) T tmp[3][W];
+				a.store(tmp[0]);
+				b.store(tmp[1]);
+				c.store(tmp[2]);
+				for (uint8_t k = 0; k < count; ++k, out += stride)
+				{
+					T* p = reinterpret_cast<T*>(out);
+					p[0] = tmp[0][k];
+					p[1] = tmp[1][k];
+					p[2] = tmp[2][k];
+				}
+			}
+
+#if XM_SSE2
+			inline void store_transposed(pack<float, 4> a, pack<float, 4> b, pack<float, 4> c, char* out, size_t stride, uint8_t count)
+			{
+				__m128 r[4] = { a.v, b.v, c.v, _mm_setzero_ps() };
+				_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+				for (uint8_t k = 0; k < count; ++k, out += stride)
+				{
+					float* p = reinterpret_cast<float*>(out);
+					_mm_storel_pi(reinterpret_cast<__m64*>(p), r[k]);
+					_mm_store_ss(p + 2, _mm_movehl_ps(r[k], r[k]));
+				}
+			}
+
+			inline void store_transposed(pack<float, 4> a, pack<float, 4> b, pack<float, 4> c, pack<float, 4> d, char* out, size_t stride, uint8_t count)
+			{
+				__m128 r[4] = { a.v, b.v, c.v, d.v };
+				_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+				for (uint8_t k = 0; k < count; ++k, out += stride)
+				{
+					_mm_storeu_ps(reinterpret_cast<float*>(out), r[k]);
+				}
+			}
+#endif
+
+#if XM_AVX
+			// the in-lane transpose leaves lanes k and k + 4 in the two halves of r[k]
+			inline void store_transposed(pack<float, 8> a, pack<float, 8> b, pack<float, 8> c, pack<float, 8> d, char* out, size_t stride, uint8_t count)
+			{
+				__m256 ab_lo = _mm256_unpacklo_ps(a.v, b.v);
+				__m256 ab_hi = _mm256_unpackhi_ps(a.v, b.v);
+				__m256 cd_lo = _mm256_unpacklo_ps(c.v, d.v);
+				__m256 cd_hi = _mm256_unpackhi_ps(c.v, d.v);
+				__m256 r[4] = {
+					_mm256_shuffle_ps(ab_lo, cd_lo, _MM_SHUFFLE(1, 0, 1, 0)),
+					_mm256_shuffle_ps(ab_lo, cd_lo, _MM_SHUFFLE(3, 2, 3, 2)),
+					_mm256_shuffle_ps(ab_hi, cd_hi, _MM_SHUFFLE(1, 0, 1, 0)),
+					_mm256_shuffle_ps(ab_hi, cd_hi, _MM_SHUFFLE(3, 2, 3, 2)) };
+				for (uint8_t k = 0; k < count && k < 4; ++k)
+				{
+					_mm_storeu_ps(reinterpret_cast<float*>(out + k * stride), _mm256_castps256_ps128(r[k]));
+				}
+				for (uint8_t k = 4; k < count; ++k)
+				{
+					_mm_storeu_ps(reinterpret_cast<float*>(out + k * stride), _mm256_extractf128_ps(r[k - 4], 1));
+				}
+			}
+#endif
+
+#if XM_AVX512
+			// as above, lane k lands in quarter k / 4 of r[k % 4]
+			inline void store_transposed(pack<float, 16> a, pack<float, 16> b, pack<float, 16> c, pack<float, 16> d, char* out, size_t stride, uint8_t count)
+			{
+				__m512 ab_lo = _mm512_unpacklo_ps(a.v, b.v);
+				__m512 ab_hi = _mm512_unpackhi_ps(a.v, b.v);
+				__m512 cd_lo = _mm512_unpacklo_ps(c.v, d.v);
+				__m512 cd_hi = _mm512_unpackhi_ps(c.v, d.v);
+				__m512 r[4] = {
+					_mm512_shuffle_ps(ab_lo, cd_lo, _MM_SHUFFLE(1, 0, 1, 0)),
+					_mm512_shuffle_ps(ab_lo, cd_lo, _MM_SHUFFLE(3, 2, 3, 2)),
+					_mm512_shuffle_ps(ab_hi, cd_hi, _MM_SHUFFLE(1, 0, 1, 0)),
+					_mm512_shuffle_ps(ab_hi, cd_hi, _MM_SHUFFLE(3, 2, 3, 2)) };
+				if (count == 16)
+				{
+					for (uint8_t k = 0; k < 4; ++k)
+					{
+						_mm_storeu_ps(reinterpret_cast<float*>(out + k * stride), _mm512_castps512_ps128(r[k]));
+						_mm_storeu_ps(reinterpret_cast<float*>(out + (k + 4) * stride), _mm512_extractf32x4_ps(r[k], 1));
+						_mm_storeu_ps(reinterpret_cast<float*>(out + (k + 8) * stride), _mm512_extractf32x4_ps(r[k], 2));
+						_mm_storeu_ps(reinterpret_cast<float*>(out + (k + 12) * stride), _mm512_extractf32x4_ps(r[k], 3));
+					}
+					return;
+				}
+				// partial last pack
+				alignas(64) float tmp[4][16];
+				for (uint8_t j = 0; j < 4; ++j) _mm512_store_ps(tmp[j], r[j]);
+				for (uint8_t k = 0; k < count; ++k, out += stride)
+				{
+					_mm_storeu_ps(reinterpret_cast<float*>(out), _mm_load_ps(tmp[k % 4] + 4 * (k / 4)));
+				}
+			}
+#endif
+
+			// r[row][column] of the rotation matrices of the unit quaternions w, x, y, z, as
+			// mat3_cast(quaternion)
+			template <typename P>
+			inline void rotation_matrix(P w, P x, P y, P z, P (&r)[3][3])
+			{
+				using T = typename P::value_type;
+				const P one(T(1));
+				P x2 = x + x, y2 = y + y, z2 = z + z;
+				P xx = x * x2, yy = y * y2, zz = z * z2;
+				P xy = x * y2, xz = x * z2, yz = y * z2;
+				P wx = w * x2, wy = w * y2, wz = w * z2;
+
+				r[0][0] = one - (yy + zz);
+				r[1][0] = xy + wz;
+				r[2][0] = xz - wy;
+				r[0][1] = xy - wz;
+				r[1][1] = one - (xx + zz);
+				r[2][1] = yz + wx;
+				r[0][2] = xz + wy;
+				r[1][2] = yz - wx;
+				r[2][2] = one - (xx + yy);
+			}
+
+			// translate(scale(rotate, s), t) for every instance: the rotation comes from the
+			// unit quaternion in packs, is scaled column by column and the finished matrices are
+			// transposed into the output, W instances at a time. Affine writes the three rows
+			// of an affine3, otherwise the four columns of a mat4.
+			template <bool Affine, typename T, typename Pos, typename Rot, typename Scl>
+			void compose_trs_packed(const Pos& translation, const Rot& rotation, const Scl& scale, char* out, size_t stride)
+			{
+				using P = native_pack<T>;
+				static_assert(Pos::components == 3 && Rot::components == 4);
+				static_assert(Scl::components == 1 || Scl::components == 3);
+				assert(rotation.size() >= translation.size() && scale.size() >= translation.size());
+
+				constexpr size_t row = 4 * sizeof(T);
+				const P one(T(1)), zero(T(0));
+				for_each_pack<T>(translation.size(), [&](size_t i, uint8_t n)
+					{
+						P r[3][3];
+						rotation_matrix(rotation.template load<P>(0, i, n), rotation.template load<P>(1, i, n),
+							rotation.template load<P>(2, i, n), rotation.template load<P>(3, i, n), r);
+
+						P sx = scale.template load<P>(0, i, n), sy = sx, sz = sx;
+						if constexpr (Scl::components == 3)
+						{
+							sy = scale.template load<P>(1, i, n);
+							sz = scale.template load<P>(2, i, n);
+						}
+
+						// m<row><column> of rotate * scale
+						P m00 = r[0][0] * sx, m10 = r[1][0] * sx, m20 = r[2][0] * sx;
+						P m01 = r[0][1] * sy, m11 = r[1][1] * sy, m21 = r[2][1] * sy;
+						P m02 = r[0][2] * sz, m12 = r[1][2] * sz, m22 = r[2][2] * sz;
+
+						P tx = translation.template load<P>(0, i, n);
+						P ty = translation.template load<P>(1, i, n);
+						P tz = translation.template load<P>(2, i, n);
+
+						char* dst = out + i * stride;
+						if constexpr (Affine)
+						{
+							store_transposed(m00, m01, m02, tx, dst, stride, n);
+							store_transposed(m10, m11, m12, ty, dst + row, stride, n);
+							store_transposed(m20, m21, m22, tz, dst + 2 * row, stride, n);
+						}
+						else
+						{
+							store_transposed(m00, m10, m20, zero, dst, stride, n);
+							store_transposed(m01, m11, m21, zero, dst + row, stride, n);
+							store_transposed(m02, m12, m22, zero, dst + 2 * row, stride, n);
+							store_transposed(tx, ty, tz, one, dst + 3 * row, stride, n);
+						}
+					});
+			}
+
+			template <implicit_w W, bool Divide, uint8_t M, typename T, typename In, typename Out>
+			void transform_dispatch(const matrix<M, T>& m, const In& in, Out&& out)
+			{
+				using out_type = std::remove_cv_t<std::remove_reference_t<Out>>;
+				static_assert(std::is_same_v<stream_value<In>, T> && std::is_same_v<typename out_type::value_type, T>);
+				static_assert(In::components == (W == implicit_w::none ? M : M - 1));
+				static_assert(out_type::components == M || out_type::components == M - 1);
+
+				prepare_output(out, in.size());
+#if XM_SSE2
+				if constexpr (M == 4 && std::is_same_v<T, float>
+					&& std::is_same_v<In, vector_span<In::components, const float>>
+					&& std::is_same_v<out_type, vector_span<out_type::components, float>>)
+				{
+					transform_aos<W, Divide>(m, in, out);
+					return;
+				}
+				if constexpr (M == 4 && std::is_same_v<T, float>
+					&& std::is_same_v<In, vector_span<In::components, float>>
+					&& std::is_same_v<out_type, vector_span<out_type::components, float>>)
+				{
+					transform_aos<W, Divide>(m, vector_span<In::components, const float>(reinterpret_cast<const float*>(in.base), in.count, in.stride), out);
+					return;
+				}
+#endif
+				transform_packed<W, Divide>(m, in, out);
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// Batch transforms of every element of in into out. in and out may be any mix of
+		// vector_stream, vector_span and vector_lanes (out may alias in); a vector_stream
+		// output is resized to in.size(). For a matrix<M, T> the output holds M - 1 components
+		// (the homogeneous coordinate is dropped) or all M.
+
+		// Points: in holds M - 1 components with an implicit w = 1. With perspective_divide
+		// the result is divided by its w (M - 1 component output only, e.g. clip -> ndc).
+		template <uint8_t M, typename T, typename In, typename Out>
+		detail::if_stream<In> transform_points(const matrix<M, T>& m, const In& in, Out&& out, bool perspective_divide = false)
+		{
+			if (perspective_divide)
+			{
+				assert(std::remove_reference_t<Out>::components == M - 1);
+				detail::transform_dispatch<detail::implicit_w::one, true>(m, in, out);
+			}
+			else
+			{
+				detail::transform_dispatch<detail::implicit_w::one, false>(m, in, out);
+			}
+		}
+
+		// Directions: in holds M - 1 components with an implicit w = 0, so translation is ignored.
+		template <uint8_t M, typename T, typename In, typename Out>
+		detail::if_stream<In> transform_vectors(const matrix<M, T>& m, const In& in, Out&& out)
+		{
+			detail::transform_dispatch<detail::implicit_w::zero, false>(m, in, out);
+		}
+
+		// An affine3 transforms as its mat4; with a 3 component output the fourth row is
+		// never evaluated.
+		template <typename T, typename In, typename Out>
+		detail::if_stream<In> transform_points(const affine3<T>& m, const In& in, Out&& out)
+		{
+			transform_points(mat4_cast(m), in, out);
+		}
+
+		template <typename T, typename In, typename Out>
+		detail::if_stream<In> transform_vectors(const affine3<T>& m, const In& in, Out&& out)
+		{
+			transform_vectors(mat4_cast(m), in, out);
+		}
+
+		// Instance matrices translate(scale(rotate(matrix<4, T>(1), q), s), t) built in one
+		// pass from separate translation (3 components), rotation (4 components: the unit
+		// quaternion's w, x, y, z, so a span over quaternion<T> works) and scale inputs, and
+		// written straight to out, e.g. a mapped upload buffer. scale holds 3 components or 1
+		// for uniform scale. Instance i is written stride bytes after instance i - 1, so the
+		// matrices may be interleaved with other per-instance data.
+		template <typename T, typename Pos, typename Rot, typename Scl>
+		detail::if_stream<Pos> compose_trs(const Pos& translation, const Rot& rotation, const Scl& scale, matrix<4, T>* out, size_t stride = sizeof(matrix<4, T>))
+		{
+			static_assert(std::is_same_v<detail::stream_value<Pos>, T> && std::is_same_v<detail::stream_value<Rot>, T> && std::is_same_v<detail::stream_value<Scl>, T>);
+			detail::compose_trs_packed<false, T>(translation, rotation, scale, reinterpret_cast<char*>(out), stride);
+		}
+
+		// As above with the 3x4 affine3 layout, 12 values per instance.
+		template <typename T, typename Pos, typename Rot, typename Scl>
+		detail::if_stream<Pos> compose_trs(const Pos& translation, const Rot& rotation, const Scl& scale, affine3<T>* out, size_t stride = sizeof(affine3<T>))
+		{
+			static_assert(std::is_same_v<detail::stream_value<Pos>, T> && std::is_same_v<detail::stream_value<Rot>, T> && std::is_same_v<detail::stream_value<Scl>, T>);
+			detail::compose_trs_packed<true, T>(translation, rotation, scale, reinterpret_cast<char*>(out), stride);
+		}
+
+		// Full homogeneous vectors: in holds all M components.
+		template <uint8_t M, typename T, typename In, typename Out>
+		detail::if_stream<In> transform(const matrix<M, T>& m, const In& in, Out&& out)
+		{
+			detail::transform_dispatch<detail::implicit_w::none, false>(m, in, out);
+		}
+	}
+}
@@ -0,0 +1,641 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include "vector.h"
+#include "quaternion.h"
+#include "vector_stream.h"
+#include "thread_pool.h"
+#include "eigen.h"
+
+// Bounding volumes of point sets. The points are any stream with 3 components: a
+// vector_stream, vector_lanes, or a vector_span over vec3, the xyz of vec4 or a member of an
+// array of vertices. They are read in place, a pack at a time, in one or two passes. Each
+// builder also takes a parallel_for (see serial_for) that splits the points among threads;
+// the parts are merged at the end.
+
+namespace xm
+{
+	// Empty (min > max) for no points.
+	template <typename T>
+	struct aabb
+	{
+		vector<3, T> min;
+		vector<3, T> max;
+	};
+
+	template <typename T>
+	struct sphere
+	{
+		vector<3, T> center;
+		T radius;
+	};
+
+	// Box with its edges along the columns of mat3_cast(orientation), half_extents[i] on
+	// either side of the center along column i.
+	template <typename T>
+	struct obb
+	{
+		vector<3, T> center;
+		quaternion<T> orientation;
+		vector<3, T> half_extents;
+	};
+
+	template <typename T>
+	aabb<T> merge(const aabb<T>& a, const aabb<T>& b)
+	{
+		aabb<T> res;
+		for (uint8_t c = 0; c < 3; ++c)
+		{
+			res.min[c] = std::min(a.min[c], b.min[c]);
+			res.max[c] = std::max(a.max[c], b.max[c]);
+		}
+		return res;
+	}
+
+	// the smallest sphere enclosing a and b
+	template <typename T>
+	sphere<T> merge(const sphere<T>& a, const sphere<T>& b)
+	{
+		vector<3, T> d = b.center - a.center;
+		T distance = xm::sqrt(sumOfSquares(d));
+		if (distance + b.radius <= a.radius)
+		{
+			return a;
+		}
+		if (distance + a.radius <= b.radius)
+		{
+			return b;
+		}
+		T radius = (distance + a.radius + b.radius) * T(0.5);
+		return { a.center + d * ((radius - a.radius) / distance), radius };
+	}
+
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// Read-only views of the points, any part [begin, end) of which is another view
+			// of the same type. The passes below work on these.
+			template <typename T>
+			vector_span<3, const T> point_view(const vector_span<3, T>& s)
+			{
+				return vector_span<3, const T>(reinterpret_cast<const T*>(s.base), s.count, s.stride);
+			}
+
+			template <typename T>
+			vector_lanes<3, const T> point_view(const vector_lanes<3, T>& s)
+			{
+				const T* lanes[3] = { s.lane[0], s.lane[1], s.lane[2] };
+				return vector_lanes<3, const T>(lanes, s.count);
+			}
+
+			template <typename T>
+			vector_lanes<3, const T> point_view(const vector_stream<3, T>& s)
+			{
+				const T* lanes[3] = { s.lane(0), s.lane(1), s.lane(2) };
+				return vector_lanes<3, const T>(lanes, s.size());
+			}
+
+			template <typename T>
+			vector_span<3, const T> point_part(const vector_span<3, const T>& s, size_t begin, size_t end)
+			{
+				return vector_span<3, const T>(reinterpret_cast<const T*>(s.base + begin * s.stride), end - begin, s.stride);
+			}
+
+			template <typename T>
+			vector_lanes<3, const T> point_part(const vector_lanes<3, const T>& s, size_t begin, size_t end)
+			{
+				const T* lanes[3] = { s.lane[0] + begin, s.lane[1] + begin, s.lane[2] + begin };
+				return vector_lanes<3, const T>(lanes, end - begin);
+			}
+
+			template <typename T>
+			vector<3, T> point_at(const vector_span<3, const T>& s, size_t i)
+			{
+				const T* p = reinterpret_cast<const T*>(s.base + i * s.stride);
+				return vector<3, T>(p[0], p[1], p[2]);
+			}
+
+			template <typename T>
+			vector<3, T> point_at(const vector_lanes<3, const T>& s, size_t i)
+			{
+				return vector<3, T>(s.lane[0][i], s.lane[1][i], s.lane[2][i]);
+			}
+
+			// f(x, y, z) for every pack of points. The lanes past the end of the last pack
+			// hold fill, a point of the set, which changes no bound; the covariance pass
+			// takes its sums relative to it. A span is copied a tile at a time into lanes
+			// that stay in L1: the lane by lane gather of vector_span::load stalls every
+			// pack on store forwarding and costs several times the passes themselves. The
+			// loops are written out rather than going through for_each_pack so f inlines
+			// and the passes keep their state in registers.
+			template <typename P, typename View, typename F>
+			void for_each_point_pack(const View& points, const vector<3, typename P::value_type>& fill, F f)
+			{
+				using T = typename P::value_type;
+				constexpr uint8_t W = P::width;
+				size_t count = points.size();
+				if constexpr (std::is_same_v<View, vector_span<3, const T>>)
+				{
+					constexpr size_t tile_size = 32 * W;
+					alignas(64) T tile[3][tile_size];
+					for (size_t begin = 0; begin < count; begin += tile_size)
+					{
+						size_t n = std::min(tile_size, count - begin);
+						size_t padded = (n + W - 1) / W * W;
+						const char* p = points.base + begin * points.stride;
+						for (size_t j = 0; j < n; ++j, p += points.stride)
+						{
+							for (uint8_t c = 0; c < 3; ++c) tile[c][j] = reinterpret_cast<const T*>(p)[c];
+						}
+						for (size_t j = n; j < padded; ++j)
+						{
+							for (uint8_t c = 0; c < 3; ++c) tile[c][j] = fill[c];
+						}
+						for (size_t j = 0; j < padded; j += W) f(P::load(tile[0] + j), P::load(tile[1] + j), P::load(tile[2] + j));
+					}
+				}
+				else
+				{
+					size_t i = 0;
+					for (; i + W <= count; i += W)
+					{
+						f(points.template load<P>(0, i, W), points.template load<P>(1, i, W), points.template load<P>(2, i, W));
+					}
+					if (i < count)
+					{
+						uint8_t n = uint8_t(count - i);
+						alignas(64) T tmp[3][W];
+						for (uint8_t k = 0; k < 3; ++k)
+						{
+							points.template load<P>(k, i, n).store(tmp[k]);
+							for (uint8_t j = n; j < W; ++j) tmp[k][j] = fill[k];
+						}
+						f(P::load(tmp[0]), P::load(tmp[1]), P::load(tmp[2]));
+					}
+				}
+			}
+
+			template <typename P>
+			typename P::value_type lanes_min(P p)
+			{
+				alignas(64) typename P::value_type tmp[P::width];
+				p.store(tmp);
+				return *std::min_element(tmp, tmp + P::width);
+			}
+
+			template <typename P>
+			typename P::value_type lanes_max(P p)
+			{
+				alignas(64) typename P::value_type tmp[P::width];
+				p.store(tmp);
+				return *std::max_element(tmp, tmp + P::width);
+			}
+
+			template <typename T>
+			aabb<T> empty_aabb()
+			{
+				return { vector<3, T>(std::numeric_limits<T>::max()), vector<3, T>(std::numeric_limits<T>::lowest()) };
+			}
+
+			// Points S values apart in one array, e.g. vec3 or the xyz of vec4: read as
+			// whole packs of consecutive values, S packs to W points, so lane j of the k-th
+			// pack always holds component (k W + j) % S and min / max need no gather. The
+			// last full block ends before the final point's trailing S - 3 values.
+			template <uint8_t S, typename T>
+			aabb<T> aabb_interleaved(const T* p, size_t count)
+			{
+				using P = native_pack<T>;
+				constexpr uint8_t W = P::width;
+				P lo[S], hi[S];
+				for (uint8_t k = 0; k < S; ++k)
+				{
+					lo[k] = P(std::numeric_limits<T>::max());
+					hi[k] = P(std::numeric_limits<T>::lowest());
+				}
+
+				size_t i = 0;
+				for (; (i + W) * S + (S - 3) <= count * S; i += W)
+				{
+					const T* block = p + i * S;
+					for (uint8_t k = 0; k < S; ++k)
+					{
+						P v = P::loadu(block + k * W);
+						lo[k] = min(lo[k], v);
+						hi[k] = max(hi[k], v);
+					}
+				}
+
+				aabb<T> res = empty_aabb<T>();
+				alignas(64) T l[S * W], h[S * W];
+				for (uint8_t k = 0; k < S; ++k)
+				{
+					lo[k].store(l + k * W);
+					hi[k].store(h + k * W);
+				}
+				for (uint8_t j = 0; j < S * W; ++j)
+				{
+					uint8_t c = j % S;
+					if (c < 3)
+					{
+						res.min[c] = std::min(res.min[c], l[j]);
+						res.max[c] = std::max(res.max[c], h[j]);
+					}
+				}
+				for (; i < count; ++i)
+				{
+					for (uint8_t c = 0; c < 3; ++c)
+					{
+						res.min[c] = std::min(res.min[c], p[i * S + c]);
+						res.max[c] = std::max(res.max[c], p[i * S + c]);
+					}
+				}
+				return res;
+			}
+
+			template <typename View>
+			aabb<typename View::value_type> aabb_pass(const View& points)
+			{
+				using T = typename View::value_type;
+				using P = native_pack<T>;
+				if (points.size() == 0)
+				{
+					return empty_aabb<T>();
+				}
+				if constexpr (std::is_same_v<View, vector_span<3, const T>>)
+				{
+					if (points.stride == 3 * sizeof(T))
+					{
+						return aabb_interleaved<3>(reinterpret_cast<const T*>(points.base), points.size());
+					}
+					if (points.stride == 4 * sizeof(T))
+					{
+						return aabb_interleaved<4>(reinterpret_cast<const T*>(points.base), points.size());
+					}
+				}
+
+				vector<3, T> fill = point_at(points, 0);
+				P lo[3], hi[3];
+				for (uint8_t c = 0; c < 3; ++c) lo[c] = hi[c] = P(fill[c]);
+				for_each_point_pack<P>(points, fill, [&](P x, P y, P z)
+					{
+						lo[0] = min(lo[0], x);
+						lo[1] = min(lo[1], y);
+						lo[2] = min(lo[2], z);
+						hi[0] = max(hi[0], x);
+						hi[1] = max(hi[1], y);
+						hi[2] = max(hi[2], z);
+					});
+
+				aabb<T> res;
+				for (uint8_t c = 0; c < 3; ++c)
+				{
+					res.min[c] = lanes_min(lo[c]);
+					res.max[c] = lanes_max(hi[c]);
+				}
+				return res;
+			}
+
+			// the points of least and greatest x, y and z, in that order
+			template <typename T>
+			struct extreme_points
+			{
+				vector<3, T> p[6];
+
+				void merge(const extreme_points& o)
+				{
+					for (uint8_t a = 0; a < 3; ++a)
+					{
+						if (o.p[2 * a][a] < p[2 * a][a]) p[2 * a] = o.p[2 * a];
+						if (p[2 * a + 1][a] < o.p[2 * a + 1][a]) p[2 * a + 1] = o.p[2 * a + 1];
+					}
+				}
+			};
+
+			// The extreme points from the aabbs of blocks of points, the fast pass above:
+			// only the block holding each extreme is searched again for its point.
+			template <typename View>
+			extreme_points<typename View::value_type> extremes_pass(const View& points)
+			{
+				using T = typename View::value_type;
+				constexpr size_t block = 1024;
+				aabb<T> bounds = empty_aabb<T>();
+				size_t where[6] = {};
+				for (size_t begin = 0; begin < points.size(); begin += block)
+				{
+					aabb<T> b = aabb_pass(point_part(points, begin, std::min(begin + block, points.size())));
+					for (uint8_t a = 0; a < 3; ++a)
+					{
+						if (b.min[a] < bounds.min[a])
+						{
+							bounds.min[a] = b.min[a];
+							where[2 * a] = begin;
+						}
+						if (bounds.max[a] < b.max[a])
+						{
+							bounds.max[a] = b.max[a];
+							where[2 * a + 1] = begin;
+						}
+					}
+				}
+
+				extreme_points<T> res;
+				for (uint8_t k = 0; k < 6; ++k)
+				{
+					uint8_t a = k / 2;
+					T value = k % 2 ? bounds.max[a] : bounds.min[a];
+					size_t end = std::min(where[k] + block, points.size());
+					res.p[k] = point_at(points, where[k]);
+					for (size_t i = where[k]; i < end; ++i)
+					{
+						vector<3, T> p = point_at(points, i);
+						if (p[a] == value)
+						{
+							res.p[k] = p;
+							break;
+						}
+					}
+				}
+				return res;
+			}
+
+			// s grown to take in p: the far side of s stays where it is and the sphere moves
+			// towards p (Ritter). The radius is rounded up to reach p.
+			template <typename T>
+			void grow_sphere(sphere<T>& s, const vector<3, T>& p)
+			{
+				vector<3, T> d = p - s.center;
+				T distance = xm::sqrt(sumOfSquares(d));
+				if (distance <= s.radius)
+				{
+					return;
+				}
+				T radius = (s.radius + distance) * T(0.5);
+				s.center = s.center + d * ((radius - s.radius) / distance);
+				s.radius = std::max(radius, xm::sqrt(sumOfSquares(p - s.center)));
+			}
+
+			// Ritter's pass: the points outside s are found a pack at a time and s is grown
+			// for them one by one; past the first few packs nearly all are inside.
+			template <typename View>
+			void grow_pass(const View& points, const vector<3, typename View::value_type>& fill, sphere<typename View::value_type>& s)
+			{
+				using T = typename View::value_type;
+				using P = native_pack<T>;
+				for_each_point_pack<P>(points, fill, [&](P x, P y, P z)
+					{
+						P dx = x - P(s.center.x), dy = y - P(s.center.y), dz = z - P(s.center.z);
+						P d2 = mul_add(dx, dx, mul_add(dy, dy, dz * dz));
+						auto outside = P(s.radius * s.radius) < d2;
+						if (any(outside))
+						{
+							alignas(64) T lx[P::width], ly[P::width], lz[P::width];
+							x.store(lx);
+							y.store(ly);
+							z.store(lz);
+							for (uint8_t j = 0; j < P::width; ++j) grow_sphere(s, vector<3, T>(lx[j], ly[j], lz[j]));
+						}
+					});
+			}
+
+			// the sums of d and of its products, d = p - origin, over the points
+			struct point_moments
+			{
+				double count = 0;
+				double sum[3] = {};
+				double products[6] = {}; // xx, xy, yy, xz, yz, zz
+
+				void merge(const point_moments& o)
+				{
+					count += o.count;
+					for (uint8_t k = 0; k < 3; ++k) sum[k] += o.sum[k];
+					for (uint8_t k = 0; k < 6; ++k) products[k] += o.products[k];
+				}
+			};
+
+			// Packs of T sum up blocks of points and the blocks add up in double, so float
+			// sums over millions of points keep their precision.
+			template <typename View>
+			point_moments moments_pass(const View& points, const vector<3, typename View::value_type>& origin)
+			{
+				using T = typename View::value_type;
+				using P = native_pack<T>;
+				constexpr size_t block = 1024;
+
+				point_moments res;
+				for (size_t begin = 0; begin < points.size(); begin += block)
+				{
+					size_t end = std::min(begin + block, points.size());
+					P sum[3], products[6];
+					for (uint8_t k = 0; k < 3; ++k) sum[k] = P(T(0));
+					for (uint8_t k = 0; k < 6; ++k) products[k] = P(T(0));
+
+					for_each_point_pack<P>(point_part(points, begin, end), origin, [&](P x, P y, P z)
+						{
+							x = x - P(origin.x);
+							y = y - P(origin.y);
+							z = z - P(origin.z);
+							sum[0] = sum[0] + x;
+							sum[1] = sum[1] + y;
+							sum[2] = sum[2] + z;
+							products[0] = mul_add(x, x, products[0]);
+							products[1] = mul_add(x, y, products[1]);
+							products[2] = mul_add(y, y, products[2]);
+							products[3] = mul_add(x, z, products[3]);
+							products[4] = mul_add(y, z, products[4]);
+							products[5] = mul_add(z, z, products[5]);
+						});
+
+					alignas(64) T lanes[P::width];
+					for (uint8_t k = 0; k < 9; ++k)
+					{
+						(k < 3 ? sum[k] : products[k - 3]).store(lanes);
+						double total = 0;
+						for (uint8_t j = 0; j < P::width; ++j) total += double(lanes[j]);
+						(k < 3 ? res.sum[k] : res.products[k - 3]) += total;
+					}
+					res.count += double(end - begin);
+				}
+				return res;
+			}
+
+			// least and greatest dot(p - origin, axis[k]) over the points
+			template <typename View>
+			aabb<typename View::value_type> extents_pass(const View& points, const vector<3, typename View::value_type>& origin, const vector<3, typename View::value_type> (&axis)[3])
+			{
+				using T = typename View::value_type;
+				using P = native_pack<T>;
+				P lo[3], hi[3];
+				for (uint8_t k = 0; k < 3; ++k) lo[k] = hi[k] = P(T(0));
+				for_each_point_pack<P>(points, origin, [&](P x, P y, P z)
+					{
+						x = x - P(origin.x);
+						y = y - P(origin.y);
+						z = z - P(origin.z);
+						for (uint8_t k = 0; k < 3; ++k)
+						{
+							P t = mul_add(x, P(axis[k].x), mul_add(y, P(axis[k].y), z * P(axis[k].z)));
+							lo[k] = min(lo[k], t);
+							hi[k] = max(hi[k], t);
+						}
+					});
+
+				aabb<T> res;
+				for (uint8_t k = 0; k < 3; ++k)
+				{
+					res.min[k] = lanes_min(lo[k]);
+					res.max[k] = lanes_max(hi[k]);
+				}
+				return res;
+			}
+
+			// pass(part) for the parts of points parallel_for makes, merged into res
+			template <typename View, typename ParallelFor, typename R, typename Pass, typename Merge>
+			void parallel_pass(const View& points, ParallelFor& parallel_for, R& res, const Pass& pass, const Merge& merge)
+			{
+				std::mutex res_mutex;
+				parallel_for(points.size(), [&](size_t begin, size_t end)
+					{
+						R part = pass(point_part(points, begin, end));
+						std::lock_guard<std::mutex> lock(res_mutex);
+						merge(res, part);
+					});
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// The axis aligned box of the points: min / max of packs, and of whole packs of
+		// consecutive values for a vector_span over vec3 or vec4 arrays.
+		template <typename Points, typename ParallelFor, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Points, aabb<detail::stream_value<Points>>> bounding_aabb(const Points& points, ParallelFor&& parallel_for)
+		{
+			using T = detail::stream_value<Points>;
+			static_assert(Points::components == 3);
+			auto view = detail::point_view(points);
+			aabb<T> res = detail::empty_aabb<T>();
+			detail::parallel_pass(view, parallel_for, res, [](const auto& part) { return detail::aabb_pass(part); },
+				[](aabb<T>& a, const aabb<T>& b) { a = merge(a, b); });
+			return res;
+		}
+
+		template <typename Points>
+		detail::if_stream<Points, aabb<detail::stream_value<Points>>> bounding_aabb(const Points& points)
+		{
+			return bounding_aabb(points, serial_for());
+		}
+
+		// A sphere enclosing the points, typically within 5 to 20% of the smallest one
+		// (Ritter): the pair of points furthest apart in x, y or z spans the first sphere,
+		// which is then grown to take in every point outside. Split by parallel_for, each
+		// part grows its own copy and the results are merged, which widens the sphere a
+		// little. points must not be empty.
+		template <typename Points, typename ParallelFor, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Points, sphere<detail::stream_value<Points>>> bounding_sphere(const Points& points, ParallelFor&& parallel_for)
+		{
+			using T = detail::stream_value<Points>;
+			static_assert(Points::components == 3);
+			assert(points.size() > 0);
+			auto view = detail::point_view(points);
+			vector<3, T> fill = detail::point_at(view, 0);
+
+			detail::extreme_points<T> e;
+			for (vector<3, T>& p : e.p) p = fill;
+			detail::parallel_pass(view, parallel_for, e, [](const auto& part) { return detail::extremes_pass(part); },
+				[](detail::extreme_points<T>& a, const detail::extreme_points<T>& b) { a.merge(b); });
+
+			uint8_t widest = 0;
+			T widest_d2 = T(-1);
+			for (uint8_t a = 0; a < 3; ++a)
+			{
+				T d2 = sumOfSquares(e.p[2 * a + 1] - e.p[2 * a]);
+				if (d2 > widest_d2)
+				{
+					widest = a;
+					widest_d2 = d2;
+				}
+			}
+			sphere<T> initial{ (e.p[2 * widest] + e.p[2 * widest + 1]) * T(0.5), xm::sqrt(widest_d2) * T(0.5) };
+			for (const vector<3, T>& p : e.p) detail::grow_sphere(initial, p);
+
+			bool first = true;
+			sphere<T> res = initial;
+			detail::parallel_pass(view, parallel_for, res, [&](const auto& part)
+				{
+					sphere<T> s = initial;
+					detail::grow_pass(part, fill, s);
+					return s;
+				},
+				[&](sphere<T>& a, const sphere<T>& b)
+				{
+					a = first ? b : merge(a, b);
+					first = false;
+				});
+			return res;
+		}
+
+		template <typename Points>
+		detail::if_stream<Points, sphere<detail::stream_value<Points>>> bounding_sphere(const Points& points)
+		{
+			return bounding_sphere(points, serial_for());
+		}
+
+		// A box along the principal axes of the points: the eigenvectors of their covariance
+		// (eigen.h), largest spread first, fitted to the points' extent along each. Tight for
+		// elongated or flat sets; where the points spread evenly the axes are arbitrary and
+		// the aabb may be smaller. Two passes over the points. points must not be empty.
+		template <typename Points, typename ParallelFor, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Points, obb<detail::stream_value<Points>>> bounding_obb(const Points& points, ParallelFor&& parallel_for)
+		{
+			using T = detail::stream_value<Points>;
+			static_assert(Points::components == 3);
+			assert(points.size() > 0);
+			auto view = detail::point_view(points);
+			vector<3, T> origin = detail::point_at(view, 0);
+
+			detail::point_moments m;
+			detail::parallel_pass(view, parallel_for, m, [&](const auto& part) { return detail::moments_pass(part, origin); },
+				[](detail::point_moments& a, const detail::point_moments& b) { a.merge(b); });
+
+			double mean[3];
+			for (uint8_t k = 0; k < 3; ++k) mean[k] = m.sum[k] / m.count;
+			auto covariance = [&](uint8_t k, uint8_t i, uint8_t j) { return T(m.products[k] / m.count - mean[i] * mean[j]); };
+			matrix<3, T> c;
+			c[0][0] = covariance(0, 0, 0);
+			c[0][1] = c[1][0] = covariance(1, 0, 1);
+			c[1][1] = covariance(2, 1, 1);
+			c[0][2] = c[2][0] = covariance(3, 0, 2);
+			c[1][2] = c[2][1] = covariance(4, 1, 2);
+			c[2][2] = covariance(5, 2, 2);
+
+			obb<T> res;
+			vector<3, T> spread;
+			eigen_symmetric(c, spread, res.orientation);
+			matrix<3, T> r = mat3_cast(res.orientation);
+			const vector<3, T> axis[3] = { r[0], r[1], r[2] };
+
+			aabb<T> e{ vector<3, T>(T(0)), vector<3, T>(T(0)) };
+			detail::parallel_pass(view, parallel_for, e, [&](const auto& part) { return detail::extents_pass(part, origin, axis); },
+				[](aabb<T>& a, const aabb<T>& b) { a = merge(a, b); });
+
+			res.center = origin;
+			for (uint8_t k = 0; k < 3; ++k)
+			{
+				res.center = res.center + axis[k] * ((e.min[k] + e.max[k]) * T(0.5));
+				res.half_extents[k] = (e.max[k] - e.min[k]) * T(0.5);
+			}
+			return res;
+		}
+
+		template <typename Points>
+		detail::if_stream<Points, obb<detail::stream_value<Points>>> bounding_obb(const Points& points)
+		{
+			return bounding_obb(points, serial_for());
+		}
+	}
+}
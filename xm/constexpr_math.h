@@ -0,0 +1,154 @@
+#pragma once
+
+#include <limits>
+#include <type_traits>
+#include "pack.h"
+#include "constants.h"
+
+// sqrt, sin, cos and tan that can also be called in constant expressions. At run time
+// they are the usual std functions (or the pack overloads for pack T); only constant
+// evaluation takes the plain loops below, so a constexpr mat4 built from them may
+// differ from the same one built at run time in the last bit.
+
+namespace xm
+{
+	namespace detail
+	{
+		// false when the compiler can't tell, which leaves only the run time paths
+		constexpr bool is_constant_evaluated() noexcept
+		{
+#if defined(__cpp_lib_is_constant_evaluated)
+			return std::is_constant_evaluated();
+#elif (defined(__GNUC__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925)
+			return __builtin_is_constant_evaluated();
+#elif defined(__has_builtin)
+	#if __has_builtin(__builtin_is_constant_evaluated)
+			return __builtin_is_constant_evaluated();
+	#else
+			return false;
+	#endif
+#else
+			return false;
+#endif
+		}
+
+		// x scaled by powers of 4 into [1, 4), where six Newton steps from 1.5 reach
+		// double precision, then scaled back by the matching powers of 2
+		constexpr double sqrt_newton(double x) noexcept
+		{
+			if (x != x || x == 0 || x == std::numeric_limits<double>::infinity())
+			{
+				return x;
+			}
+			if (x < 0)
+			{
+				return std::numeric_limits<double>::quiet_NaN();
+			}
+
+			double scale = 1.0;
+			while (x >= 4.0)
+			{
+				x *= 0.25;
+				scale *= 2.0;
+			}
+			while (x < 1.0)
+			{
+				x *= 4.0;
+				scale *= 0.5;
+			}
+
+			double r = 1.5;
+			for (int i = 0; i < 6; ++i)
+			{
+				r = 0.5 * (r + x / r);
+			}
+			return r * scale;
+		}
+
+		// sin (quadrant 0) or cos (quadrant 1) of x: x is reduced by the nearest multiple
+		// of pi / 2 in two steps (Cody-Waite, the first part has 33 bits so k times it is
+		// exact) and the Taylor series of the quadrant's function is summed on
+		// [-pi / 4, pi / 4]. Accurate to a few ulp for |x| < 2^20.
+		constexpr double sin_cos_series(double x, long long quadrant) noexcept
+		{
+			if (x != x || x == std::numeric_limits<double>::infinity() || x == -std::numeric_limits<double>::infinity())
+			{
+				return std::numeric_limits<double>::quiet_NaN();
+			}
+
+			constexpr double half_pi_hi = 1.57079632673412561417;
+			constexpr double half_pi_lo = 6.07710050650619224932e-11;
+
+			double q = x * (2.0 / PI);
+			long long k = static_cast<long long>(q < 0 ? q - 0.5 : q + 0.5);
+			double r = (x - double(k) * half_pi_hi) - double(k) * half_pi_lo;
+			double r2 = r * r;
+
+			// odd quadrants swap sin and cos, quadrants 2 and 3 negate
+			long long n = (k + quadrant) & 3;
+			bool use_cos = (n & 1) != 0;
+
+			double term = use_cos ? 1.0 : r;
+			double sum = term;
+			for (int j = 1; j < 14; ++j)
+			{
+				int m = use_cos ? 2 * j - 1 : 2 * j;
+				term *= -r2 / double(m * (m + 1));
+				sum += term;
+			}
+			return n >= 2 ? -sum : sum;
+		}
+	}
+
+	template <typename T>
+	constexpr T constexpr_sqrt(T x) noexcept
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			if (detail::is_constant_evaluated())
+			{
+				return T(detail::sqrt_newton(double(x)));
+			}
+		}
+		return sqrt(x);
+	}
+
+	template <typename T>
+	constexpr T constexpr_sin(T radians) noexcept
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			if (detail::is_constant_evaluated())
+			{
+				return T(detail::sin_cos_series(double(radians), 0));
+			}
+		}
+		return sin(radians);
+	}
+
+	template <typename T>
+	constexpr T constexpr_cos(T radians) noexcept
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			if (detail::is_constant_evaluated())
+			{
+				return T(detail::sin_cos_series(double(radians), 1));
+			}
+		}
+		return cos(radians);
+	}
+
+	template <typename T>
+	constexpr T constexpr_tan(T radians) noexcept
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			if (detail::is_constant_evaluated())
+			{
+				return T(detail::sin_cos_series(double(radians), 0) / detail::sin_cos_series(double(radians), 1));
+			}
+		}
+		return tan(radians);
+	}
+}
@@ -0,0 +1,171 @@
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include "dispatch.h"
+
+#if defined(XM_DISPATCH_X86)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+namespace xm
+{
+	namespace detail
+	{
+		template <>
+		const batch_tables& batch_tables_for<simd_level::scalar>();
+
+#if defined(XM_DISPATCH_X86)
+		template <>
+		const batch_tables& batch_tables_for<simd_level::sse2>();
+
+		template <>
+		const batch_tables& batch_tables_for<simd_level::avx2>();
+
+		template <>
+		const batch_tables& batch_tables_for<simd_level::avx512>();
+#endif
+	}
+
+	namespace
+	{
+#if defined(XM_DISPATCH_X86)
+		struct cpuid_regs
+		{
+			uint32_t eax, ebx, ecx, edx;
+		};
+
+		cpuid_regs cpuid(uint32_t leaf, uint32_t subleaf)
+		{
+			cpuid_regs res;
+#if defined(_MSC_VER)
+			int regs[4];
+			__cpuidex(regs, int(leaf), int(subleaf));
+			res = { uint32_t(regs[0]), uint32_t(regs[1]), uint32_t(regs[2]), uint32_t(regs[3]) };
+#else
+			__cpuid_count(leaf, subleaf, res.eax, res.ebx, res.ecx, res.edx);
+#endif
+			return res;
+		}
+
+		// register state the os saves on context switches (XCR0)
+		uint64_t xgetbv0()
+		{
+#if defined(_MSC_VER)
+			return _xgetbv(0);
+#else
+			uint32_t lo, hi;
+			__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			return (uint64_t(hi) << 32) | lo;
+#endif
+		}
+
+		bool bit(uint32_t reg, int i)
+		{
+			return (reg >> i) & 1;
+		}
+
+		simd_level detect()
+		{
+			uint32_t max_leaf = cpuid(0, 0).eax;
+			cpuid_regs leaf1 = cpuid(1, 0);
+			if (!bit(leaf1.edx, 26))
+			{
+				return simd_level::scalar;
+			}
+
+			bool osxsave = bit(leaf1.ecx, 27);
+			uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+			bool ymm_state = (xcr0 & 0x6) == 0x6;
+			bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+			if (max_leaf < 7 || !ymm_state)
+			{
+				return simd_level::sse2;
+			}
+
+			cpuid_regs leaf7 = cpuid(7, 0);
+			bool avx2 = bit(leaf1.ecx, 28) && bit(leaf1.ecx, 12) && bit(leaf7.ebx, 5);
+			if (!avx2)
+			{
+				return simd_level::sse2;
+			}
+
+			// f, dq, cd, bw, vl: what msvc's /arch:AVX512 may use
+			bool avx512 = zmm_state && bit(leaf7.ebx, 16) && bit(leaf7.ebx, 17) && bit(leaf7.ebx, 28)
+				&& bit(leaf7.ebx, 30) && bit(leaf7.ebx, 31);
+			return avx512 ? simd_level::avx512 : simd_level::avx2;
+		}
+#else
+		simd_level detect()
+		{
+			return simd_level::scalar;
+		}
+#endif
+
+		simd_level choose()
+		{
+			simd_level supported = supported_simd_level();
+			const char* forced = std::getenv("XM_SIMD_LEVEL");
+			if (forced == nullptr)
+			{
+				return supported;
+			}
+
+			for (simd_level level : { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 })
+			{
+				if (strcmp(forced, to_string(level)) == 0 && level <= supported)
+				{
+					return level;
+				}
+			}
+			return supported;
+		}
+	}
+
+	simd_level supported_simd_level()
+	{
+		static const simd_level level = detect();
+		return level;
+	}
+
+	simd_level active_simd_level()
+	{
+		static const simd_level level = choose();
+		return level;
+	}
+
+	const char* to_string(simd_level level)
+	{
+		switch (level)
+		{
+		case simd_level::scalar: return "scalar";
+		case simd_level::sse2: return "sse2";
+		case simd_level::avx2: return "avx2";
+		case simd_level::avx512: return "avx512";
+		}
+		return "unknown";
+	}
+
+	namespace detail
+	{
+		const batch_tables& active_batch_tables()
+		{
+			static const batch_tables& tables = []() -> const batch_tables&
+			{
+				switch (active_simd_level())
+				{
+#if defined(XM_DISPATCH_X86)
+				case simd_level::avx512: return batch_tables_for<simd_level::avx512>();
+				case simd_level::avx2: return batch_tables_for<simd_level::avx2>();
+				case simd_level::sse2: return batch_tables_for<simd_level::sse2>();
+#endif
+				default: return batch_tables_for<simd_level::scalar>();
+				}
+			}();
+			return tables;
+		}
+	}
+}
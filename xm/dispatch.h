@@ -0,0 +1,764 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "matrix.h"
+#include "affine.h"
+#include "quaternion.h"
+#include "frustum.h"
+#include "eigen.h"
+#include "vector_stream.h"
+#include "thread_pool.h"
+
+namespace xm
+{
+	// Instruction set levels the batch kernels of the xm library are compiled for.
+	enum class simd_level : uint8_t
+	{
+		scalar,
+		sse2,
+		avx2,	// avx2 and fma
+		avx512,	// avx512 f, cd, bw, dq and vl
+	};
+
+	// best level this cpu and os support
+	simd_level supported_simd_level();
+
+	// Level the xm::batch functions run at, chosen once on first use: supported_simd_level(),
+	// or the XM_SIMD_LEVEL environment variable (scalar, sse2, avx2 or avx512) if that
+	// names a supported level.
+	simd_level active_simd_level();
+
+	const char* to_string(simd_level level);
+
+	namespace detail
+	{
+		enum class transform_mode : uint8_t { points, points_divide, vectors, full };
+		enum class trs_layout : uint8_t { mat4, affine3 };
+		enum class rotation_layout : uint8_t { mat3, mat4 };
+
+		// Type-erased batch operand: either lanes (base[c] points at the contiguous values of
+		// component c) or interleaved vectors (base[0] points at the first one and the
+		// following ones are stride bytes apart).
+		template <typename T>
+		struct lane_ref
+		{
+			T* base[4];
+			size_t stride;
+			size_t size;
+			uint8_t components;
+			bool interleaved;
+		};
+
+		template <typename T>
+		struct batch_table
+		{
+			void (*copy)(lane_ref<const T> a, lane_ref<T> out);
+			void (*add)(lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out);
+			void (*sub)(lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out);
+			void (*scale)(lane_ref<const T> a, T s, lane_ref<T> out);
+			void (*lerp)(lane_ref<const T> a, lane_ref<const T> b, T f, lane_ref<T> out);
+			void (*dot)(lane_ref<const T> a, lane_ref<const T> b, T* out);
+			void (*cross)(lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out);
+			void (*normalize)(lane_ref<const T> a, lane_ref<T> out);
+			void (*transform3)(const matrix<3, T>& m, lane_ref<const T> in, lane_ref<T> out, transform_mode mode);
+			void (*transform4)(const matrix<4, T>& m, lane_ref<const T> in, lane_ref<T> out, transform_mode mode);
+			void (*multiply_quaternions)(lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out);
+			void (*rotate_vectors)(lane_ref<const T> q, lane_ref<const T> v, lane_ref<T> out);
+			void (*euler_to_quaternions)(lane_ref<const T> angles, lane_ref<T> out, euler_order order);
+			void (*rotation_cast)(lane_ref<const T> q, T* out, size_t stride, rotation_layout layout);
+			void (*orthonormalize)(T* m, size_t count, size_t stride, rotation_layout layout, unsigned iterations);
+			void (*eigen_symmetric)(const T* s, size_t count, size_t stride, lane_ref<T> values, lane_ref<T> vectors, unsigned sweeps);
+			void (*svd)(const T* a, size_t count, size_t stride, lane_ref<T> u, lane_ref<T> sigma, lane_ref<T> v, unsigned sweeps);
+			void (*compose_trs)(lane_ref<const T> translation, lane_ref<const T> rotation, lane_ref<const T> scale, T* out, size_t stride, trs_layout layout);
+			size_t (*cull_spheres)(const frustum<T>& f, lane_ref<const T> centers, const T* radii, uint32_t* visible);
+			size_t (*cull_aabbs)(const frustum<T>& f, lane_ref<const T> min, lane_ref<const T> max, uint32_t* visible);
+		};
+
+		struct batch_tables
+		{
+			batch_table<float> f;
+			batch_table<double> d;
+		};
+
+		// defined by dispatch_<level>.cpp, each built with its own target flags
+		template <simd_level L>
+		const batch_tables& batch_tables_for();
+
+		const batch_tables& active_batch_tables();
+
+		template <typename T>
+		inline const batch_table<T>& batch_kernels()
+		{
+			static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>);
+			if constexpr (std::is_same_v<T, float>)
+			{
+				return active_batch_tables().f;
+			}
+			else
+			{
+				return active_batch_tables().d;
+			}
+		}
+
+		template <uint8_t N, typename T>
+		lane_ref<const T> to_input(const vector_stream<N, T>& s)
+		{
+			lane_ref<const T> res{};
+			for (uint8_t c = 0; c < N; ++c) res.base[c] = s.lane(c);
+			res.stride = sizeof(T);
+			res.size = s.size();
+			res.components = N;
+			return res;
+		}
+
+		template <uint8_t N, typename T>
+		lane_ref<const std::remove_const_t<T>> to_input(const vector_lanes<N, T>& s)
+		{
+			lane_ref<const std::remove_const_t<T>> res{};
+			for (uint8_t c = 0; c < N; ++c) res.base[c] = s.lane[c];
+			res.stride = sizeof(T);
+			res.size = s.size();
+			res.components = N;
+			return res;
+		}
+
+		template <uint8_t N, typename T>
+		lane_ref<const std::remove_const_t<T>> to_input(const vector_span<N, T>& s)
+		{
+			using value_type = std::remove_const_t<T>;
+			lane_ref<const value_type> res{};
+			res.base[0] = reinterpret_cast<const value_type*>(s.base);
+			res.stride = s.stride;
+			res.size = s.size();
+			res.components = N;
+			res.interleaved = true;
+			return res;
+		}
+
+		template <uint8_t N, typename T>
+		lane_ref<T> to_output(vector_stream<N, T>& s, size_t size)
+		{
+			s.resize(size);
+			lane_ref<T> res{};
+			for (uint8_t c = 0; c < N; ++c) res.base[c] = s.lane(c);
+			res.stride = sizeof(T);
+			res.size = size;
+			res.components = N;
+			return res;
+		}
+
+		template <uint8_t N, typename T>
+		lane_ref<T> to_output(const vector_lanes<N, T>& s, size_t size)
+		{
+			static_assert(!std::is_const_v<T>);
+			assert(s.size() >= size);
+			lane_ref<T> res{};
+			for (uint8_t c = 0; c < N; ++c) res.base[c] = s.lane[c];
+			res.stride = sizeof(T);
+			res.size = size;
+			res.components = N;
+			return res;
+		}
+
+		template <uint8_t N, typename T>
+		lane_ref<T> to_output(const vector_span<N, T>& s, size_t size)
+		{
+			static_assert(!std::is_const_v<T>);
+			assert(s.size() >= size);
+			lane_ref<T> res{};
+			res.base[0] = reinterpret_cast<T*>(s.base);
+			res.stride = s.stride;
+			res.size = size;
+			res.components = N;
+			res.interleaved = true;
+			return res;
+		}
+
+		template <typename T>
+		T* offset_bytes(T* p, size_t bytes)
+		{
+			using byte_type = std::conditional_t<std::is_const_v<T>, const char, char>;
+			return reinterpret_cast<T*>(reinterpret_cast<byte_type*>(p) + bytes);
+		}
+
+		// elements [begin, end) of r
+		template <typename T>
+		lane_ref<T> slice(lane_ref<T> r, size_t begin, size_t end)
+		{
+			if (r.interleaved)
+			{
+				r.base[0] = offset_bytes(r.base[0], begin * r.stride);
+			}
+			else
+			{
+				for (uint8_t c = 0; c < r.components; ++c) r.base[c] += begin;
+			}
+			r.size = end - begin;
+			return r;
+		}
+
+		// Culling split by parallel_for: cull(begin, end, out) writes the indices (relative
+		// to begin) of the visible bounds in [begin, end) to out and returns their count.
+		// Each part writes to visible + begin, then the parts are moved together in order.
+		template <typename ParallelFor, typename Cull>
+		size_t parallel_cull(ParallelFor& parallel_for, size_t size, uint32_t* visible, const Cull& cull)
+		{
+			std::mutex parts_mutex;
+			std::vector<std::pair<size_t, size_t>> parts;
+			parallel_for(size, [&](size_t begin, size_t end)
+				{
+					size_t count = cull(begin, end, visible + begin);
+					for (size_t k = 0; k < count; ++k) visible[begin + k] += uint32_t(begin);
+
+					std::lock_guard<std::mutex> lock(parts_mutex);
+					parts.emplace_back(begin, count);
+				});
+
+			std::sort(parts.begin(), parts.end());
+			size_t total = 0;
+			for (const std::pair<size_t, size_t>& p : parts)
+			{
+				if (p.first != total)
+				{
+					memmove(visible + total, visible + p.first, p.second * sizeof(uint32_t));
+				}
+				total += p.second;
+			}
+			return total;
+		}
+
+		template <typename T>
+		inline void batch_transform(const matrix<3, T>& m, lane_ref<const T> in, lane_ref<T> out, transform_mode mode)
+		{
+			batch_kernels<T>().transform3(m, in, out, mode);
+		}
+
+		template <typename T>
+		inline void batch_transform(const matrix<4, T>& m, lane_ref<const T> in, lane_ref<T> out, transform_mode mode)
+		{
+			batch_kernels<T>().transform4(m, in, out, mode);
+		}
+	}
+
+	// Runtime dispatched float and double versions of the kernels in vector_stream.h,
+	// batch_transforms.h, batch_quaternion.h and frustum.h, with the same arguments and
+	// semantics. They call the instantiation built for active_simd_level() in the xm
+	// library, so one binary uses AVX-512 where it can and still runs on SSE2-only machines.
+	// The header templates themselves compile for the including translation unit's flags
+	// as before.
+	namespace batch
+	{
+		template <typename A, typename Out>
+		detail::if_stream<A> copy(const A& a, Out&& out)
+		{
+			detail::batch_kernels<detail::stream_value<A>>().copy(detail::to_input(a), detail::to_output(out, a.size()));
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> add(const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::batch_kernels<detail::stream_value<A>>().add(detail::to_input(a), detail::to_input(b), detail::to_output(out, a.size()));
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> sub(const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::batch_kernels<detail::stream_value<A>>().sub(detail::to_input(a), detail::to_input(b), detail::to_output(out, a.size()));
+		}
+
+		template <typename A, typename Out>
+		detail::if_stream<A> scale(const A& a, detail::stream_value<A> s, Out&& out)
+		{
+			detail::batch_kernels<detail::stream_value<A>>().scale(detail::to_input(a), s, detail::to_output(out, a.size()));
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> lerp(const A& a, const B& b, detail::stream_value<A> f, Out&& out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::batch_kernels<detail::stream_value<A>>().lerp(detail::to_input(a), detail::to_input(b), f, detail::to_output(out, a.size()));
+		}
+
+		template <typename A, typename B>
+		detail::if_stream<A> dot(const A& a, const B& b, detail::stream_value<A>* out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::batch_kernels<detail::stream_value<A>>().dot(detail::to_input(a), detail::to_input(b), out);
+		}
+
+		template <typename A>
+		detail::if_stream<A> sumOfSquares(const A& a, detail::stream_value<A>* out)
+		{
+			batch::dot(a, a, out);
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> cross(const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == 3 && B::components == 3 && std::remove_reference_t<Out>::components == 3);
+			assert(b.size() >= a.size());
+			detail::batch_kernels<detail::stream_value<A>>().cross(detail::to_input(a), detail::to_input(b), detail::to_output(out, a.size()));
+		}
+
+		template <typename A, typename Out>
+		detail::if_stream<A> normalize(const A& a, Out&& out)
+		{
+			static_assert(A::components == std::remove_reference_t<Out>::components);
+			detail::batch_kernels<detail::stream_value<A>>().normalize(detail::to_input(a), detail::to_output(out, a.size()));
+		}
+
+		template <uint8_t M, typename T, typename In, typename Out>
+		detail::if_stream<In> transform_points(const matrix<M, T>& m, const In& in, Out&& out, bool perspective_divide = false)
+		{
+			static_assert(In::components == M - 1);
+			assert(!perspective_divide || std::remove_reference_t<Out>::components == M - 1);
+			detail::batch_transform(m, detail::to_input(in), detail::to_output(out, in.size()),
+				perspective_divide ? detail::transform_mode::points_divide : detail::transform_mode::points);
+		}
+
+		template <uint8_t M, typename T, typename In, typename Out>
+		detail::if_stream<In> transform_vectors(const matrix<M, T>& m, const In& in, Out&& out)
+		{
+			static_assert(In::components == M - 1);
+			detail::batch_transform(m, detail::to_input(in), detail::to_output(out, in.size()), detail::transform_mode::vectors);
+		}
+
+		template <uint8_t M, typename T, typename In, typename Out>
+		detail::if_stream<In> transform(const matrix<M, T>& m, const In& in, Out&& out)
+		{
+			static_assert(In::components == M);
+			detail::batch_transform(m, detail::to_input(in), detail::to_output(out, in.size()), detail::transform_mode::full);
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> multiply_quaternions(const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == 4 && B::components == 4 && std::remove_reference_t<Out>::components == 4);
+			assert(b.size() >= a.size());
+			detail::batch_kernels<detail::stream_value<A>>().multiply_quaternions(detail::to_input(a), detail::to_input(b), detail::to_output(out, a.size()));
+		}
+
+		template <typename Q, typename V, typename Out>
+		detail::if_stream<Q> rotate_vectors(const Q& q, const V& v, Out&& out)
+		{
+			static_assert(Q::components == 4 && V::components == 3 && std::remove_reference_t<Out>::components == 3);
+			assert(v.size() >= q.size());
+			detail::batch_kernels<detail::stream_value<Q>>().rotate_vectors(detail::to_input(q), detail::to_input(v), detail::to_output(out, q.size()));
+		}
+
+		template <typename E, typename Out>
+		detail::if_stream<E> euler_to_quaternions(const E& angles, euler_order order, Out&& out)
+		{
+			static_assert(E::components == 3 && std::remove_reference_t<Out>::components == 4);
+			detail::batch_kernels<detail::stream_value<E>>().euler_to_quaternions(detail::to_input(angles), detail::to_output(out, angles.size()), order);
+		}
+
+		template <typename T, typename Q>
+		detail::if_stream<Q> mat3_cast(const Q& q, matrix<3, T>* out, size_t stride = sizeof(matrix<3, T>))
+		{
+			static_assert(Q::components == 4);
+			detail::batch_kernels<T>().rotation_cast(detail::to_input(q), reinterpret_cast<T*>(out), stride, detail::rotation_layout::mat3);
+		}
+
+		template <typename T, typename Q>
+		detail::if_stream<Q> mat4_cast(const Q& q, matrix<4, T>* out, size_t stride = sizeof(matrix<4, T>))
+		{
+			static_assert(Q::components == 4);
+			detail::batch_kernels<T>().rotation_cast(detail::to_input(q), reinterpret_cast<T*>(out), stride, detail::rotation_layout::mat4);
+		}
+
+		template <typename T>
+		void orthonormalize(matrix<3, T>* m, size_t count, size_t stride = sizeof(matrix<3, T>), unsigned iterations = 2)
+		{
+			detail::batch_kernels<T>().orthonormalize(reinterpret_cast<T*>(m), count, stride, detail::rotation_layout::mat3, iterations);
+		}
+
+		template <typename T>
+		void orthonormalize(matrix<4, T>* m, size_t count, size_t stride = sizeof(matrix<4, T>), unsigned iterations = 2)
+		{
+			detail::batch_kernels<T>().orthonormalize(reinterpret_cast<T*>(m), count, stride, detail::rotation_layout::mat4, iterations);
+		}
+
+		template <typename T, typename Values, typename Vectors>
+		detail::if_stream<Values> eigen_symmetric(const matrix<3, T>* s, size_t count, Values&& values, Vectors&& vectors,
+			size_t stride = sizeof(matrix<3, T>), unsigned sweeps = detail::jacobi_sweeps<T>)
+		{
+			static_assert(std::remove_reference_t<Values>::components == 3 && std::remove_reference_t<Vectors>::components == 4);
+			detail::batch_kernels<T>().eigen_symmetric(reinterpret_cast<const T*>(s), count, stride,
+				detail::to_output(values, count), detail::to_output(vectors, count), sweeps);
+		}
+
+		template <typename T, typename U, typename Sigma, typename V>
+		detail::if_stream<Sigma> svd(const matrix<3, T>* a, size_t count, U&& u, Sigma&& sigma, V&& v,
+			size_t stride = sizeof(matrix<3, T>), unsigned sweeps = detail::jacobi_sweeps<T>)
+		{
+			static_assert(std::remove_reference_t<U>::components == 4 && std::remove_reference_t<Sigma>::components == 3
+				&& std::remove_reference_t<V>::components == 4);
+			detail::batch_kernels<T>().svd(reinterpret_cast<const T*>(a), count, stride,
+				detail::to_output(u, count), detail::to_output(sigma, count), detail::to_output(v, count), sweeps);
+		}
+
+		template <typename T, typename Pos, typename Rot, typename Scl>
+		detail::if_stream<Pos> compose_trs(const Pos& translation, const Rot& rotation, const Scl& scale, matrix<4, T>* out, size_t stride = sizeof(matrix<4, T>))
+		{
+			static_assert(Pos::components == 3 && Rot::components == 4 && (Scl::components == 1 || Scl::components == 3));
+			assert(rotation.size() >= translation.size() && scale.size() >= translation.size());
+			detail::batch_kernels<T>().compose_trs(detail::to_input(translation), detail::to_input(rotation), detail::to_input(scale),
+				reinterpret_cast<T*>(out), stride, detail::trs_layout::mat4);
+		}
+
+		template <typename T, typename Pos, typename Rot, typename Scl>
+		detail::if_stream<Pos> compose_trs(const Pos& translation, const Rot& rotation, const Scl& scale, affine3<T>* out, size_t stride = sizeof(affine3<T>))
+		{
+			static_assert(Pos::components == 3 && Rot::components == 4 && (Scl::components == 1 || Scl::components == 3));
+			assert(rotation.size() >= translation.size() && scale.size() >= translation.size());
+			detail::batch_kernels<T>().compose_trs(detail::to_input(translation), detail::to_input(rotation), detail::to_input(scale),
+				reinterpret_cast<T*>(out), stride, detail::trs_layout::affine3);
+		}
+
+		template <typename T, typename Centers>
+		detail::if_stream<Centers, size_t> cull_spheres(const frustum<T>& f, const Centers& centers, const T* radii, uint32_t* visible)
+		{
+			static_assert(Centers::components == 3);
+			return detail::batch_kernels<T>().cull_spheres(f, detail::to_input(centers), radii, visible);
+		}
+
+		template <typename T, typename Min, typename Max>
+		detail::if_stream<Min, size_t> cull_aabbs(const frustum<T>& f, const Min& min, const Max& max, uint32_t* visible)
+		{
+			static_assert(Min::components == 3 && Max::components == 3);
+			assert(max.size() >= min.size());
+			return detail::batch_kernels<T>().cull_aabbs(f, detail::to_input(min), detail::to_input(max), visible);
+		}
+
+		// The same functions split over threads: each takes a parallel_for first (a
+		// thread_pool, serial_for or any callable of that shape, see thread_pool.h) and runs
+		// the kernel on every part of the range it hands out. Output streams are sized
+		// before the split and every part touches only its own elements.
+
+		template <typename ParallelFor, typename A, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> copy(ParallelFor&& parallel_for, const A& a, Out&& out)
+		{
+			auto in = detail::to_input(a);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().copy(detail::slice(in, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename B, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> add(ParallelFor&& parallel_for, const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			auto ia = detail::to_input(a);
+			auto ib = detail::to_input(b);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().add(detail::slice(ia, begin, end), detail::slice(ib, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename B, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> sub(ParallelFor&& parallel_for, const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			auto ia = detail::to_input(a);
+			auto ib = detail::to_input(b);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().sub(detail::slice(ia, begin, end), detail::slice(ib, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> scale(ParallelFor&& parallel_for, const A& a, detail::stream_value<A> s, Out&& out)
+		{
+			auto in = detail::to_input(a);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().scale(detail::slice(in, begin, end), s, detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename B, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> lerp(ParallelFor&& parallel_for, const A& a, const B& b, detail::stream_value<A> f, Out&& out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			auto ia = detail::to_input(a);
+			auto ib = detail::to_input(b);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().lerp(detail::slice(ia, begin, end), detail::slice(ib, begin, end), f, detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename B, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> dot(ParallelFor&& parallel_for, const A& a, const B& b, detail::stream_value<A>* out)
+		{
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			auto ia = detail::to_input(a);
+			auto ib = detail::to_input(b);
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().dot(detail::slice(ia, begin, end), detail::slice(ib, begin, end), out + begin);
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> sumOfSquares(ParallelFor&& parallel_for, const A& a, detail::stream_value<A>* out)
+		{
+			batch::dot(parallel_for, a, a, out);
+		}
+
+		template <typename ParallelFor, typename A, typename B, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> cross(ParallelFor&& parallel_for, const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == 3 && B::components == 3 && std::remove_reference_t<Out>::components == 3);
+			assert(b.size() >= a.size());
+			auto ia = detail::to_input(a);
+			auto ib = detail::to_input(b);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().cross(detail::slice(ia, begin, end), detail::slice(ib, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> normalize(ParallelFor&& parallel_for, const A& a, Out&& out)
+		{
+			static_assert(A::components == std::remove_reference_t<Out>::components);
+			auto in = detail::to_input(a);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().normalize(detail::slice(in, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, uint8_t M, typename T, typename In, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<In> transform_points(ParallelFor&& parallel_for, const matrix<M, T>& m, const In& in, Out&& out, bool perspective_divide = false)
+		{
+			static_assert(In::components == M - 1);
+			assert(!perspective_divide || std::remove_reference_t<Out>::components == M - 1);
+			auto i = detail::to_input(in);
+			auto o = detail::to_output(out, in.size());
+			detail::transform_mode mode = perspective_divide ? detail::transform_mode::points_divide : detail::transform_mode::points;
+			parallel_for(in.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_transform(m, detail::slice(i, begin, end), detail::slice(o, begin, end), mode);
+				});
+		}
+
+		template <typename ParallelFor, uint8_t M, typename T, typename In, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<In> transform_vectors(ParallelFor&& parallel_for, const matrix<M, T>& m, const In& in, Out&& out)
+		{
+			static_assert(In::components == M - 1);
+			auto i = detail::to_input(in);
+			auto o = detail::to_output(out, in.size());
+			parallel_for(in.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_transform(m, detail::slice(i, begin, end), detail::slice(o, begin, end), detail::transform_mode::vectors);
+				});
+		}
+
+		template <typename ParallelFor, uint8_t M, typename T, typename In, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<In> transform(ParallelFor&& parallel_for, const matrix<M, T>& m, const In& in, Out&& out)
+		{
+			static_assert(In::components == M);
+			auto i = detail::to_input(in);
+			auto o = detail::to_output(out, in.size());
+			parallel_for(in.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_transform(m, detail::slice(i, begin, end), detail::slice(o, begin, end), detail::transform_mode::full);
+				});
+		}
+
+		template <typename ParallelFor, typename A, typename B, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<A> multiply_quaternions(ParallelFor&& parallel_for, const A& a, const B& b, Out&& out)
+		{
+			static_assert(A::components == 4 && B::components == 4 && std::remove_reference_t<Out>::components == 4);
+			assert(b.size() >= a.size());
+			auto ia = detail::to_input(a);
+			auto ib = detail::to_input(b);
+			auto o = detail::to_output(out, a.size());
+			parallel_for(a.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<A>>().multiply_quaternions(detail::slice(ia, begin, end), detail::slice(ib, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename Q, typename V, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Q> rotate_vectors(ParallelFor&& parallel_for, const Q& q, const V& v, Out&& out)
+		{
+			static_assert(Q::components == 4 && V::components == 3 && std::remove_reference_t<Out>::components == 3);
+			assert(v.size() >= q.size());
+			auto iq = detail::to_input(q);
+			auto iv = detail::to_input(v);
+			auto o = detail::to_output(out, q.size());
+			parallel_for(q.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<Q>>().rotate_vectors(detail::slice(iq, begin, end), detail::slice(iv, begin, end), detail::slice(o, begin, end));
+				});
+		}
+
+		template <typename ParallelFor, typename E, typename Out, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<E> euler_to_quaternions(ParallelFor&& parallel_for, const E& angles, euler_order order, Out&& out)
+		{
+			static_assert(E::components == 3 && std::remove_reference_t<Out>::components == 4);
+			auto in = detail::to_input(angles);
+			auto o = detail::to_output(out, angles.size());
+			parallel_for(angles.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<detail::stream_value<E>>().euler_to_quaternions(detail::slice(in, begin, end), detail::slice(o, begin, end), order);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Q, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Q> mat3_cast(ParallelFor&& parallel_for, const Q& q, matrix<3, T>* out, size_t stride = sizeof(matrix<3, T>))
+		{
+			static_assert(Q::components == 4);
+			auto iq = detail::to_input(q);
+			parallel_for(q.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().rotation_cast(detail::slice(iq, begin, end), detail::offset_bytes(reinterpret_cast<T*>(out), begin * stride), stride, detail::rotation_layout::mat3);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Q, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Q> mat4_cast(ParallelFor&& parallel_for, const Q& q, matrix<4, T>* out, size_t stride = sizeof(matrix<4, T>))
+		{
+			static_assert(Q::components == 4);
+			auto iq = detail::to_input(q);
+			parallel_for(q.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().rotation_cast(detail::slice(iq, begin, end), detail::offset_bytes(reinterpret_cast<T*>(out), begin * stride), stride, detail::rotation_layout::mat4);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename = detail::if_parallel_for<ParallelFor>>
+		void orthonormalize(ParallelFor&& parallel_for, matrix<3, T>* m, size_t count, size_t stride = sizeof(matrix<3, T>), unsigned iterations = 2)
+		{
+			parallel_for(count, [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().orthonormalize(detail::offset_bytes(reinterpret_cast<T*>(m), begin * stride), end - begin, stride, detail::rotation_layout::mat3, iterations);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename = detail::if_parallel_for<ParallelFor>>
+		void orthonormalize(ParallelFor&& parallel_for, matrix<4, T>* m, size_t count, size_t stride = sizeof(matrix<4, T>), unsigned iterations = 2)
+		{
+			parallel_for(count, [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().orthonormalize(detail::offset_bytes(reinterpret_cast<T*>(m), begin * stride), end - begin, stride, detail::rotation_layout::mat4, iterations);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Values, typename Vectors, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Values> eigen_symmetric(ParallelFor&& parallel_for, const matrix<3, T>* s, size_t count, Values&& values, Vectors&& vectors,
+			size_t stride = sizeof(matrix<3, T>), unsigned sweeps = detail::jacobi_sweeps<T>)
+		{
+			static_assert(std::remove_reference_t<Values>::components == 3 && std::remove_reference_t<Vectors>::components == 4);
+			auto ov = detail::to_output(values, count);
+			auto oq = detail::to_output(vectors, count);
+			parallel_for(count, [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().eigen_symmetric(detail::offset_bytes(reinterpret_cast<const T*>(s), begin * stride), end - begin, stride,
+						detail::slice(ov, begin, end), detail::slice(oq, begin, end), sweeps);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename U, typename Sigma, typename V, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Sigma> svd(ParallelFor&& parallel_for, const matrix<3, T>* a, size_t count, U&& u, Sigma&& sigma, V&& v,
+			size_t stride = sizeof(matrix<3, T>), unsigned sweeps = detail::jacobi_sweeps<T>)
+		{
+			static_assert(std::remove_reference_t<U>::components == 4 && std::remove_reference_t<Sigma>::components == 3
+				&& std::remove_reference_t<V>::components == 4);
+			auto ou = detail::to_output(u, count);
+			auto os = detail::to_output(sigma, count);
+			auto ov = detail::to_output(v, count);
+			parallel_for(count, [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().svd(detail::offset_bytes(reinterpret_cast<const T*>(a), begin * stride), end - begin, stride,
+						detail::slice(ou, begin, end), detail::slice(os, begin, end), detail::slice(ov, begin, end), sweeps);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Pos, typename Rot, typename Scl, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Pos> compose_trs(ParallelFor&& parallel_for, const Pos& translation, const Rot& rotation, const Scl& scale, matrix<4, T>* out, size_t stride = sizeof(matrix<4, T>))
+		{
+			static_assert(Pos::components == 3 && Rot::components == 4 && (Scl::components == 1 || Scl::components == 3));
+			assert(rotation.size() >= translation.size() && scale.size() >= translation.size());
+			auto it = detail::to_input(translation);
+			auto ir = detail::to_input(rotation);
+			auto is = detail::to_input(scale);
+			parallel_for(translation.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().compose_trs(detail::slice(it, begin, end), detail::slice(ir, begin, end), detail::slice(is, begin, end),
+						detail::offset_bytes(reinterpret_cast<T*>(out), begin * stride), stride, detail::trs_layout::mat4);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Pos, typename Rot, typename Scl, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Pos> compose_trs(ParallelFor&& parallel_for, const Pos& translation, const Rot& rotation, const Scl& scale, affine3<T>* out, size_t stride = sizeof(affine3<T>))
+		{
+			static_assert(Pos::components == 3 && Rot::components == 4 && (Scl::components == 1 || Scl::components == 3));
+			assert(rotation.size() >= translation.size() && scale.size() >= translation.size());
+			auto it = detail::to_input(translation);
+			auto ir = detail::to_input(rotation);
+			auto is = detail::to_input(scale);
+			parallel_for(translation.size(), [&](size_t begin, size_t end)
+				{
+					detail::batch_kernels<T>().compose_trs(detail::slice(it, begin, end), detail::slice(ir, begin, end), detail::slice(is, begin, end),
+						detail::offset_bytes(reinterpret_cast<T*>(out), begin * stride), stride, detail::trs_layout::affine3);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Centers, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Centers, size_t> cull_spheres(ParallelFor&& parallel_for, const frustum<T>& f, const Centers& centers, const T* radii, uint32_t* visible)
+		{
+			static_assert(Centers::components == 3);
+			auto ic = detail::to_input(centers);
+			return detail::parallel_cull(parallel_for, centers.size(), visible, [&](size_t begin, size_t end, uint32_t* out)
+				{
+					return detail::batch_kernels<T>().cull_spheres(f, detail::slice(ic, begin, end), radii + begin, out);
+				});
+		}
+
+		template <typename ParallelFor, typename T, typename Min, typename Max, typename = detail::if_parallel_for<ParallelFor>>
+		detail::if_stream<Min, size_t> cull_aabbs(ParallelFor&& parallel_for, const frustum<T>& f, const Min& min, const Max& max, uint32_t* visible)
+		{
+			static_assert(Min::components == 3 && Max::components == 3);
+			assert(max.size() >= min.size());
+			auto imin = detail::to_input(min);
+			auto imax = detail::to_input(max);
+			return detail::parallel_cull(parallel_for, min.size(), visible, [&](size_t begin, size_t end, uint32_t* out)
+				{
+					return detail::batch_kernels<T>().cull_aabbs(f, detail::slice(imin, begin, end), detail::slice(imax, begin, end), out);
+				});
+		}
+	}
+}
@@ -0,0 +1,7 @@
+// Batch kernels built with avx2 and fma (see CMakeLists.txt).
+#include "simd.h"
+
+static_assert(XM_AVX2 && XM_FMA && !XM_AVX512, "dispatch_avx2.cpp must be built for avx2 and fma without avx512");
+
+#define XM_DISPATCH_LEVEL avx2
+#include "dispatch_kernels.inl"
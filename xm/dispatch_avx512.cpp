@@ -0,0 +1,7 @@
+// Batch kernels built with avx512 f, cd, bw, dq and vl (see CMakeLists.txt).
+#include "simd.h"
+
+static_assert(XM_AVX512 && XM_FMA, "dispatch_avx512.cpp must be built for avx512");
+
+#define XM_DISPATCH_LEVEL avx512
+#include "dispatch_kernels.inl"
@@ -0,0 +1,290 @@
+// Fills the batch kernel tables of dispatch.h from the header templates. Included once by
+// every dispatch_<level>.cpp after it defines XM_DISPATCH_LEVEL, so the templates below
+// are instantiated for that file's target flags (inside its own XM_SIMD_ABI namespace).
+
+#include "dispatch.h"
+#include "batch_transforms.h"
+#include "batch_quaternion.h"
+#include "batch_eigen.h"
+#include "frustum.h"
+
+namespace xm
+{
+	namespace detail
+	{
+		namespace
+		{
+			template <uint8_t N, typename T, typename F>
+			void visit(lane_ref<T> r, F&& f)
+			{
+				if (r.interleaved)
+				{
+					f(vector_span<N, T>(r.base[0], r.size, r.stride));
+				}
+				else
+				{
+					f(vector_lanes<N, T>(r.base, r.size));
+				}
+			}
+
+			// calls f with a typed view of every operand, all with N components
+			template <uint8_t N, typename F>
+			void visit_all(F&& f)
+			{
+				f();
+			}
+
+			template <uint8_t N, typename F, typename T, typename... Ts>
+			void visit_all(F&& f, lane_ref<T> r, lane_ref<Ts>... rs)
+			{
+				visit<N>(r, [&](const auto& view)
+					{
+						visit_all<N>([&](const auto&... views) { f(view, views...); }, rs...);
+					});
+			}
+
+			template <typename F>
+			void visit_components(uint8_t components, F&& f)
+			{
+				switch (components)
+				{
+				case 2: f(std::integral_constant<uint8_t, 2>()); break;
+				case 3: f(std::integral_constant<uint8_t, 3>()); break;
+				case 4: f(std::integral_constant<uint8_t, 4>()); break;
+				default: assert(false && "batch operands have 2, 3 or 4 components");
+				}
+			}
+
+			template <uint8_t M, typename T>
+			void transform_kernel(const matrix<M, T>& m, lane_ref<const T> in, lane_ref<T> out, transform_mode mode)
+			{
+				auto with_output = [&](auto f)
+				{
+					if (out.components == M)
+					{
+						visit<M>(out, f);
+					}
+					else
+					{
+						visit<M - 1>(out, f);
+					}
+				};
+
+				switch (mode)
+				{
+				case transform_mode::points:
+				case transform_mode::points_divide:
+					visit<M - 1>(in, [&](const auto& vi)
+						{
+							with_output([&](const auto& vo) { xm::transform_points(m, vi, vo, mode == transform_mode::points_divide); });
+						});
+					break;
+				case transform_mode::vectors:
+					visit<M - 1>(in, [&](const auto& vi)
+						{
+							with_output([&](const auto& vo) { xm::transform_vectors(m, vi, vo); });
+						});
+					break;
+				case transform_mode::full:
+					visit<M>(in, [&](const auto& vi)
+						{
+							with_output([&](const auto& vo) { xm::transform(m, vi, vo); });
+						});
+					break;
+				}
+			}
+
+			template <typename T>
+			void compose_trs_kernel(lane_ref<const T> translation, lane_ref<const T> rotation, lane_ref<const T> scale, T* out, size_t stride, trs_layout layout)
+			{
+				char* dst = reinterpret_cast<char*>(out);
+				auto with_scale = [&](const auto& vt, const auto& vr, const auto& vs)
+				{
+					if (layout == trs_layout::affine3)
+					{
+						compose_trs_packed<true, T>(vt, vr, vs, dst, stride);
+					}
+					else
+					{
+						compose_trs_packed<false, T>(vt, vr, vs, dst, stride);
+					}
+				};
+
+				visit<3>(translation, [&](const auto& vt)
+					{
+						visit<4>(rotation, [&](const auto& vr)
+							{
+								if (scale.components == 1)
+								{
+									visit<1>(scale, [&](const auto& vs) { with_scale(vt, vr, vs); });
+								}
+								else
+								{
+									visit<3>(scale, [&](const auto& vs) { with_scale(vt, vr, vs); });
+								}
+							});
+					});
+			}
+
+			template <typename T>
+			batch_table<T> make_table()
+			{
+				batch_table<T> t;
+
+				t.copy = [](lane_ref<const T> a, lane_ref<T> out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([](const auto& va, const auto& vo) { xm::copy(va, vo); }, a, out);
+						});
+				};
+
+				t.add = [](lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([](const auto& va, const auto& vb, const auto& vo) { xm::add(va, vb, vo); }, a, b, out);
+						});
+				};
+
+				t.sub = [](lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([](const auto& va, const auto& vb, const auto& vo) { xm::sub(va, vb, vo); }, a, b, out);
+						});
+				};
+
+				t.scale = [](lane_ref<const T> a, T s, lane_ref<T> out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([&](const auto& va, const auto& vo) { xm::scale(va, s, vo); }, a, out);
+						});
+				};
+
+				t.lerp = [](lane_ref<const T> a, lane_ref<const T> b, T f, lane_ref<T> out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([&](const auto& va, const auto& vb, const auto& vo) { xm::lerp(va, vb, f, vo); }, a, b, out);
+						});
+				};
+
+				t.dot = [](lane_ref<const T> a, lane_ref<const T> b, T* out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([&](const auto& va, const auto& vb) { xm::dot(va, vb, out); }, a, b);
+						});
+				};
+
+				t.cross = [](lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out)
+				{
+					visit_all<3>([](const auto& va, const auto& vb, const auto& vo) { xm::cross(va, vb, vo); }, a, b, out);
+				};
+
+				t.normalize = [](lane_ref<const T> a, lane_ref<T> out)
+				{
+					visit_components(a.components, [&](auto n)
+						{
+							visit_all<decltype(n)::value>([](const auto& va, const auto& vo) { xm::normalize(va, vo); }, a, out);
+						});
+				};
+
+				t.transform3 = &transform_kernel<3, T>;
+				t.transform4 = &transform_kernel<4, T>;
+				t.multiply_quaternions = [](lane_ref<const T> a, lane_ref<const T> b, lane_ref<T> out)
+				{
+					visit_all<4>([](const auto& va, const auto& vb, const auto& vo) { xm::multiply_quaternions(va, vb, vo); }, a, b, out);
+				};
+
+				t.rotate_vectors = [](lane_ref<const T> q, lane_ref<const T> v, lane_ref<T> out)
+				{
+					visit<4>(q, [&](const auto& vq)
+						{
+							visit_all<3>([&](const auto& vv, const auto& vo) { xm::rotate_vectors(vq, vv, vo); }, v, out);
+						});
+				};
+
+				t.euler_to_quaternions = [](lane_ref<const T> angles, lane_ref<T> out, euler_order order)
+				{
+					visit<3>(angles, [&](const auto& va)
+						{
+							visit<4>(out, [&](const auto& vo) { xm::euler_to_quaternions(va, order, vo); });
+						});
+				};
+
+				t.rotation_cast = [](lane_ref<const T> q, T* out, size_t stride, rotation_layout layout)
+				{
+					visit<4>(q, [&](const auto& vq)
+						{
+							if (layout == rotation_layout::mat3)
+							{
+								xm::mat3_cast(vq, reinterpret_cast<matrix<3, T>*>(out), stride);
+							}
+							else
+							{
+								xm::mat4_cast(vq, reinterpret_cast<matrix<4, T>*>(out), stride);
+							}
+						});
+				};
+
+				t.orthonormalize = [](T* m, size_t count, size_t stride, rotation_layout layout, unsigned iterations)
+				{
+					if (layout == rotation_layout::mat3)
+					{
+						xm::orthonormalize(reinterpret_cast<matrix<3, T>*>(m), count, stride, iterations);
+					}
+					else
+					{
+						xm::orthonormalize(reinterpret_cast<matrix<4, T>*>(m), count, stride, iterations);
+					}
+				};
+
+				t.eigen_symmetric = [](const T* s, size_t count, size_t stride, lane_ref<T> values, lane_ref<T> vectors, unsigned sweeps)
+				{
+					auto m = reinterpret_cast<const matrix<3, T>*>(s);
+					visit<3>(values, [&](const auto& vv)
+						{
+							visit<4>(vectors, [&](const auto& vq) { xm::eigen_symmetric(m, count, vv, vq, stride, sweeps); });
+						});
+				};
+
+				t.svd = [](const T* a, size_t count, size_t stride, lane_ref<T> u, lane_ref<T> sigma, lane_ref<T> v, unsigned sweeps)
+				{
+					auto m = reinterpret_cast<const matrix<3, T>*>(a);
+					visit<3>(sigma, [&](const auto& vs)
+						{
+							visit_all<4>([&](const auto& vu, const auto& vv) { xm::svd(m, count, vu, vs, vv, stride, sweeps); }, u, v);
+						});
+				};
+
+				t.compose_trs = &compose_trs_kernel<T>;
+
+				t.cull_spheres = [](const frustum<T>& f, lane_ref<const T> centers, const T* radii, uint32_t* visible)
+				{
+					size_t count = 0;
+					visit<3>(centers, [&](const auto& vc) { count = xm::cull_spheres(f, vc, radii, visible); });
+					return count;
+				};
+
+				t.cull_aabbs = [](const frustum<T>& f, lane_ref<const T> min, lane_ref<const T> max, uint32_t* visible)
+				{
+					size_t count = 0;
+					visit_all<3>([&](const auto& vmin, const auto& vmax) { count = xm::cull_aabbs(f, vmin, vmax, visible); }, min, max);
+					return count;
+				};
+
+				return t;
+			}
+		}
+
+		template <>
+		const batch_tables& batch_tables_for<simd_level::XM_DISPATCH_LEVEL>()
+		{
+			static const batch_tables tables{ make_table<float>(), make_table<double>() };
+			return tables;
+		}
+	}
+}
@@ -0,0 +1,8 @@
+// Portable fallback of the batch kernels, built without intrinsics.
+#define XM_NO_SIMD
+#include "simd.h"
+
+static_assert(!XM_SSE2, "dispatch_scalar.cpp must be built with XM_NO_SIMD");
+
+#define XM_DISPATCH_LEVEL scalar
+#include "dispatch_kernels.inl"
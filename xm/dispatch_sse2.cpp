@@ -0,0 +1,7 @@
+// Batch kernels for x86 baseline machines, built with sse2 only (see CMakeLists.txt).
+#include "simd.h"
+
+static_assert(XM_SSE2 && !XM_AVX, "dispatch_sse2.cpp must be built for sse2 without avx");
+
+#define XM_DISPATCH_LEVEL sse2
+#include "dispatch_kernels.inl"
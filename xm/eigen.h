@@ -0,0 +1,313 @@
+#pragma once
+
+#include <limits>
+#include "matrix.h"
+#include "quaternion.h"
+#include "precision.h"
+
+// Eigen decomposition of symmetric 3x3 matrices and 3x3 SVD without a branch (McAdams et
+// al., "Computing the singular value decomposition of 3x3 matrices with minimal branching
+// and elementary floating point operations"): cyclic Jacobi with every rotation kept as a
+// quaternion, so the result is a unit quaternion rather than a matrix to re-orthonormalize.
+// The same code runs on float, double and packs of them (batch_eigen.h).
+
+namespace xm
+{
+	namespace detail
+	{
+		// Jacobi sweeps of 3 rotations each. Close eigenvalues hold the approximate
+		// rotations below at pi / 8 for a few sweeps; these reach rounding level for the
+		// eigenvectors of a^T a in the SVD, which squares the condition number.
+		template <typename T>
+		constexpr unsigned jacobi_sweeps = std::is_same_v<scalar_t<T>, double> ? 8 : 6;
+
+		template <typename T>
+		struct eigen_constants
+		{
+			// (3 + 2 sqrt 2) sh^2 < ch^2 when the rotation angle is below pi / 8
+			static constexpr T gamma = T(5.82842712474619009760);
+			// cos and sin of pi / 8, the rotation when it isn't
+			static constexpr T cos_pi_8 = T(0.92387953251128675613);
+			static constexpr T sin_pi_8 = T(0.38268343236508977173);
+		};
+
+		inline namespace XM_SIMD_ABI
+		{
+			// symmetric matrix as its lower triangle s11, s21, s22, s31, s32, s33
+			template <typename T>
+			using symmetric3 = T[6];
+
+			// Unit quaternion (ch, sh along the rotation axis) of the Jacobi rotation of the
+			// 2x2 block a11, a21, a22, with its angle approximated from the half angle's
+			// tangent: exact for small angles, so a sweep still squares the off-diagonal,
+			// and pi / 8 where the approximation would overshoot.
+			template <typename T>
+			inline void approximate_givens(T a11, T a21, T a22, T& ch, T& sh)
+			{
+				using K = eigen_constants<scalar_t<T>>;
+				ch = T(2) * (a11 - a22);
+				sh = a21;
+				T ch2 = ch * ch, sh2 = sh * sh;
+				auto small = T(K::gamma) * sh2 < ch2;
+				T w = rsqrt<precision::fast>(ch2 + sh2);
+				ch = select(small, w * ch, T(K::cos_pi_8));
+				sh = select(small, w * sh, T(K::sin_pi_8));
+			}
+
+			// x, or 0 where |x| is below threshold
+			template <typename T>
+			inline T flush_below(T x, T threshold)
+			{
+				return select(select(x < T(0), -x, x) < threshold, T(0), x);
+			}
+
+			// s = Q^T s Q for the rotation of the (X, Y) block about axis Z and v = v Q, then
+			// the entries are rotated so the next call works on the next block. Off-diagonals
+			// below threshold become 0: converged sweeps would otherwise keep shrinking them
+			// into denormals, which take a microcode assist per instruction.
+			template <uint8_t X, uint8_t Y, uint8_t Z, typename T>
+			inline void jacobi_conjugation(symmetric3<T>& s, quaternion<T>& v, T threshold)
+			{
+				T ch, sh;
+				approximate_givens(s[0], s[1], s[2], ch, sh);
+
+				// cos and sin of the full angle; 2 - |q|^2 takes out the few ulp the fast rsqrt
+				// leaves in |q|^2 as a division would
+				T ch2 = ch * ch, sh2 = sh * sh;
+				T inv_scale = T(2) - (ch2 + sh2);
+				T a = (ch2 - sh2) * inv_scale;
+				T b = T(2) * sh * ch * inv_scale;
+
+				T s11 = s[0], s21 = s[1], s22 = s[2], s31 = s[3], s32 = s[4], s33 = s[5];
+				T as11_bs21 = mul_add(a, s11, b * s21), as21_bs22 = mul_add(a, s21, b * s22);
+				T as21_bs11 = mul_add(a, s21, -b * s11), as22_bs21 = mul_add(a, s22, -b * s21);
+				T n11 = mul_add(a, as11_bs21, b * as21_bs22);
+				T n21 = mul_add(a, as21_bs11, b * as22_bs21);
+				T n22 = mul_add(a, as22_bs21, -b * as21_bs11);
+				T n31 = mul_add(a, s31, b * s32);
+				T n32 = mul_add(a, s32, -b * s31);
+
+				// v * (ch, sh e_Z)
+				T tx = v.m[X] * sh, ty = v.m[Y] * sh, tz = v.m[Z] * sh;
+				T sw = v.w * sh;
+				v.w = v.w * ch - tz;
+				v.m[X] = mul_add(v.m[X], ch, ty);
+				v.m[Y] = v.m[Y] * ch - tx;
+				v.m[Z] = mul_add(v.m[Z], ch, sw);
+
+				// (s22, s32, s33, s21, s31, s11) is the matrix with the axes cycled
+				s[0] = n22;
+				s[1] = flush_below(n32, threshold);
+				s[2] = s33;
+				s[3] = flush_below(n21, threshold);
+				s[4] = flush_below(n31, threshold);
+				s[5] = n11;
+			}
+
+			// v times the unnormalized quarter turn 1 + e_K: of the columns of its matrix, the
+			// one after K becomes the one before it and that one the negated first
+			template <uint8_t K, typename T>
+			inline void quarter_turn(quaternion<T>& v)
+			{
+				constexpr uint8_t K1 = (K + 1) % 3, K2 = (K + 2) % 3;
+				T w = v.w, mk = v.m[K], m1 = v.m[K1], m2 = v.m[K2];
+				v.w = w - mk;
+				v.m[K] = mk + w;
+				v.m[K1] = m1 + m2;
+				v.m[K2] = m2 - m1;
+			}
+
+			// swaps values I and J (and the columns of v) where value I is the smaller one
+			template <uint8_t I, uint8_t J, typename T>
+			inline void sort_descending(T (&values)[3], quaternion<T>& v)
+			{
+				constexpr uint8_t K = 3 - I - J;
+				auto swap = values[I] < values[J];
+				T vi = values[I];
+				values[I] = select(swap, values[J], vi);
+				values[J] = select(swap, vi, values[J]);
+
+				quaternion<T> turned = v;
+				quarter_turn<K>(turned);
+				v.w = select(swap, turned.w, v.w);
+				v.m[0] = select(swap, turned.m[0], v.m[0]);
+				v.m[1] = select(swap, turned.m[1], v.m[1]);
+				v.m[2] = select(swap, turned.m[2], v.m[2]);
+			}
+
+			// Eigenvalues in descending order and the unit quaternion whose matrix has the
+			// matching eigenvectors as columns. s is overwritten.
+			template <typename T>
+			inline void eigen_symmetric(symmetric3<T>& s, T (&values)[3], quaternion<T>& v, unsigned sweeps)
+			{
+				// epsilon^2 of the entries: far below what changes the result, while the products
+				// of the entries and angles left stay well above the denormals
+				constexpr scalar_t<T> eps = std::numeric_limits<scalar_t<T>>::epsilon();
+				T magnitude(T(0));
+				for (uint8_t i = 0; i < 6; ++i) magnitude = magnitude + select(s[i] < T(0), -s[i], s[i]);
+				T threshold = magnitude * T(eps * eps);
+
+				v = quaternion<T>(T(1), T(0), T(0), T(0));
+				for (unsigned i = 0; i < sweeps; ++i)
+				{
+					jacobi_conjugation<0, 1, 2>(s, v, threshold);
+					jacobi_conjugation<1, 2, 0>(s, v, threshold);
+					jacobi_conjugation<2, 0, 1>(s, v, threshold);
+				}
+				values[0] = s[0];
+				values[1] = s[2];
+				values[2] = s[5];
+
+				sort_descending<0, 1>(values, v);
+				sort_descending<0, 2>(values, v);
+				sort_descending<1, 2>(values, v);
+
+				// the quarter turns and the fast rsqrt leave v off unit length
+				T inv_len = rsqrt<precision::fast>(mul_add(v.w, v.w, mul_add(v.m[0], v.m[0], mul_add(v.m[1], v.m[1], v.m[2] * v.m[2]))));
+				v.w = v.w * inv_len;
+				v.m[0] = v.m[0] * inv_len;
+				v.m[1] = v.m[1] * inv_len;
+				v.m[2] = v.m[2] * inv_len;
+			}
+
+			// Unit quaternion (ch, sh along the rotation axis) of the Givens rotation that
+			// zeroes a2 against the pivot a1 and leaves the pivot positive
+			template <typename T>
+			inline void qr_givens(T a1, T a2, T& ch, T& sh)
+			{
+				// no rotation for a zero column (or one whose squares underflow)
+				T rho = xm::sqrt(mul_add(a1, a1, a2 * a2));
+				auto nonzero = rho > T(std::numeric_limits<scalar_t<T>>::min());
+				sh = select(nonzero, a2, T(0));
+				ch = select(nonzero, select(a1 < T(0), -a1, a1) + rho, T(1));
+
+				// tan of the half angle for a1 >= 0, of its complement otherwise
+				auto negative = select(nonzero, a1, T(0)) < T(0);
+				T t = ch;
+				ch = select(negative, sh, ch);
+				sh = select(negative, t, sh);
+				T w = rsqrt<precision::fast>(mul_add(ch, ch, sh * sh));
+				ch = ch * w;
+				sh = sh * w;
+			}
+
+			// a = U diag(sigma) V^T with a[column][row]; see svd below
+			template <typename T>
+			inline void svd(const T (&a)[3][3], quaternion<T>& u, T (&sigma)[3], quaternion<T>& v, unsigned sweeps)
+			{
+				// V diagonalizes a^T a, in descending order of the singular values squared
+				symmetric3<T> s;
+				s[0] = mul_add(a[0][0], a[0][0], mul_add(a[0][1], a[0][1], a[0][2] * a[0][2]));
+				s[1] = mul_add(a[0][0], a[1][0], mul_add(a[0][1], a[1][1], a[0][2] * a[1][2]));
+				s[2] = mul_add(a[1][0], a[1][0], mul_add(a[1][1], a[1][1], a[1][2] * a[1][2]));
+				s[3] = mul_add(a[0][0], a[2][0], mul_add(a[0][1], a[2][1], a[0][2] * a[2][2]));
+				s[4] = mul_add(a[1][0], a[2][0], mul_add(a[1][1], a[2][1], a[1][2] * a[2][2]));
+				s[5] = mul_add(a[2][0], a[2][0], mul_add(a[2][1], a[2][1], a[2][2] * a[2][2]));
+				T values[3];
+				eigen_symmetric(s, values, v, sweeps);
+
+				// r[row][column] of V
+				T x2 = v.m[0] + v.m[0], y2 = v.m[1] + v.m[1], z2 = v.m[2] + v.m[2];
+				T xx = v.m[0] * x2, yy = v.m[1] * y2, zz = v.m[2] * z2;
+				T xy = v.m[0] * y2, xz = v.m[0] * z2, yz = v.m[1] * z2;
+				T wx = v.w * x2, wy = v.w * y2, wz = v.w * z2;
+				T r[3][3];
+				r[0][0] = T(1) - (yy + zz);
+				r[1][0] = xy + wz;
+				r[2][0] = xz - wy;
+				r[0][1] = xy - wz;
+				r[1][1] = T(1) - (xx + zz);
+				r[2][1] = yz + wx;
+				r[0][2] = xz + wy;
+				r[1][2] = yz - wx;
+				r[2][2] = T(1) - (xx + yy);
+
+				// b[row][column] = a V, its columns orthogonal and sorted by length
+				T b[3][3];
+				for (uint8_t i = 0; i < 3; ++i)
+				{
+					for (uint8_t j = 0; j < 3; ++j)
+					{
+						b[i][j] = mul_add(a[0][i], r[0][j], mul_add(a[1][i], r[1][j], a[2][i] * r[2][j]));
+					}
+				}
+
+				// QR of b by three Givens rotations: about z zeroes b21, about -y b31, about x b32
+				T ch1, sh1, ch2, sh2, ch3, sh3;
+				qr_givens(b[0][0], b[1][0], ch1, sh1);
+				T c = T(1) - T(2) * sh1 * sh1, sn = T(2) * ch1 * sh1;
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					T b0 = b[0][j], b1 = b[1][j];
+					b[0][j] = mul_add(c, b0, sn * b1);
+					b[1][j] = mul_add(c, b1, -sn * b0);
+				}
+
+				qr_givens(b[0][0], b[2][0], ch2, sh2);
+				c = T(1) - T(2) * sh2 * sh2;
+				sn = T(2) * ch2 * sh2;
+				for (uint8_t j = 0; j < 3; ++j)
+				{
+					T b0 = b[0][j], b2 = b[2][j];
+					b[0][j] = mul_add(c, b0, sn * b2);
+					b[2][j] = mul_add(c, b2, -sn * b0);
+				}
+
+				qr_givens(b[1][1], b[2][1], ch3, sh3);
+				c = T(1) - T(2) * sh3 * sh3;
+				sn = T(2) * ch3 * sh3;
+				for (uint8_t j = 1; j < 3; ++j)
+				{
+					T b1 = b[1][j], b2 = b[2][j];
+					b[1][j] = mul_add(c, b1, sn * b2);
+					b[2][j] = mul_add(c, b2, -sn * b1);
+				}
+
+				// U = (ch1, sh1 e_z) (ch2, -sh2 e_y) (ch3, sh3 e_x)
+				T c12 = ch1 * ch2, s12 = sh1 * sh2, c1s2 = ch1 * sh2, s1c2 = sh1 * ch2;
+				u.w = mul_add(c12, ch3, -s12 * sh3);
+				u.m[0] = mul_add(c12, sh3, s12 * ch3);
+				u.m[1] = mul_add(s1c2, sh3, -c1s2 * ch3);
+				u.m[2] = mul_add(s1c2, ch3, c1s2 * sh3);
+
+				sigma[0] = b[0][0];
+				sigma[1] = b[1][1];
+				sigma[2] = b[2][2];
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// s = mat3_cast(vectors) * diagonal(values) * transpose(mat3_cast(vectors)) for a
+		// symmetric s (only its lower triangle is read), with the eigenvalues in descending
+		// order: column i of mat3_cast(vectors) is the unit eigenvector of values[i], and
+		// the columns form a rotation. The eigenvalues come out to a few ulp of the largest
+		// one in magnitude; with repeated eigenvalues any basis of their eigenspace may come.
+		template <typename T>
+		void eigen_symmetric(const matrix<3, T>& s, vector<3, T>& values, quaternion<T>& vectors, unsigned sweeps = detail::jacobi_sweeps<T>) noexcept
+		{
+			T sym[6] = { s[0][0], s[0][1], s[1][1], s[0][2], s[1][2], s[2][2] };
+			T res[3];
+			detail::eigen_symmetric(sym, res, vectors, sweeps);
+			values = vector<3, T>(res[0], res[1], res[2]);
+		}
+
+		// a = mat3_cast(u) * diagonal(sigma) * transpose(mat3_cast(v)) with u and v unit
+		// quaternions, so both factors are rotations, and |sigma| in descending order. A
+		// reflection (determinant(a) < 0) makes sigma.z negative rather than u or v improper.
+		// Rank deficient a give a zero sigma and some rotation for the null space.
+		template <typename T>
+		void svd(const matrix<3, T>& a, quaternion<T>& u, vector<3, T>& sigma, quaternion<T>& v, unsigned sweeps = detail::jacobi_sweeps<T>) noexcept
+		{
+			T m[3][3];
+			for (uint8_t c = 0; c < 3; ++c)
+			{
+				for (uint8_t r = 0; r < 3; ++r) m[c][r] = a[c][r];
+			}
+			T res[3];
+			detail::svd(m, u, res, v, sweeps);
+			sigma = vector<3, T>(res[0], res[1], res[2]);
+		}
+	}
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "vector.h"
+#include "matrix.h"
+#include "vector_stream.h"
+
+namespace xm
+{
+	// Depth range of clip space: -w..w as produced by every perspective* and orthographic*
+	// of matrix_transforms.h, or 0..w (Direct3D, Vulkan, Metal).
+	enum class clip_depth : uint8_t { negative_one_to_one, zero_to_one };
+
+	// Six planes facing inwards: xyz is the unit normal and w the offset, so p is on the
+	// inner side of a plane when dot(xyz, p) + w >= 0.
+	template <typename T>
+	struct frustum
+	{
+		enum { left, right, bottom, top, near, far };
+
+		vector<4, T> planes[6];
+	};
+
+	// Planes of the volume a view-projection matrix maps into clip space (Gribb & Hartmann),
+	// in the space the matrix transforms from: world space for projection * view. LH and RH
+	// matrices need no distinction, the handedness is part of the matrix; only the depth
+	// range of the projection must be given.
+	template <typename T>
+	frustum<T> extract_frustum(const matrix<4, T>& view_projection, clip_depth depth = clip_depth::negative_one_to_one)
+	{
+		const matrix<4, T>& m = view_projection;
+		vector<4, T> row[4];
+		for (uint8_t i = 0; i < 4; ++i)
+		{
+			row[i] = vector<4, T>(m.a[i], m.b[i], m.c[i], m.d[i]);
+		}
+
+		frustum<T> res;
+		res.planes[frustum<T>::left] = row[3] + row[0];
+		res.planes[frustum<T>::right] = row[3] - row[0];
+		res.planes[frustum<T>::bottom] = row[3] + row[1];
+		res.planes[frustum<T>::top] = row[3] - row[1];
+		res.planes[frustum<T>::near] = depth == clip_depth::zero_to_one ? row[2] : row[3] + row[2];
+		res.planes[frustum<T>::far] = row[3] - row[2];
+
+		for (vector<4, T>& p : res.planes)
+		{
+			p = p / sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+		}
+		return res;
+	}
+
+	// Conservative tests: false only if the bounds are entirely outside one of the planes.
+	template <typename T>
+	bool intersects(const frustum<T>& f, const vector<3, T>& center, T radius)
+	{
+		for (const vector<4, T>& p : f.planes)
+		{
+			if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// axis aligned box min..max: only its corner furthest along the normal is tested
+	template <typename T>
+	bool intersects(const frustum<T>& f, const vector<3, T>& min, const vector<3, T>& max)
+	{
+		for (const vector<4, T>& p : f.planes)
+		{
+			T x = p.x >= 0 ? max.x : min.x;
+			T y = p.y >= 0 ? max.y : min.y;
+			T z = p.z >= 0 ? max.z : min.z;
+			if (p.x * x + p.y * y + p.z * z + p.w < 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// Appends first + k for every set bit k of bits, in order, bits holding the n
+			// lanes of a pack that are in use. Branch free: each of those lanes is written
+			// and only the visible ones advance count, so no write goes past index first + n
+			// of an out holding one index per input.
+			template <uint8_t W>
+			inline void append_indices(uint32_t bits, uint32_t first, uint8_t n, uint32_t* out, size_t& count)
+			{
+				if (n == W)
+				{
+					for (uint8_t k = 0; k < W; ++k)
+					{
+						out[count] = first + k;
+						count += (bits >> k) & 1;
+					}
+				}
+				else
+				{
+					for (uint8_t k = 0; k < n; ++k)
+					{
+						out[count] = first + k;
+						count += (bits >> k) & 1;
+					}
+				}
+			}
+
+			template <typename P, typename T>
+			struct frustum_planes
+			{
+				frustum_planes(const frustum<T>& f)
+				{
+					for (uint8_t j = 0; j < 6; ++j)
+					{
+						for (uint8_t c = 0; c < 4; ++c) p[j][c] = P(f.planes[j][c]);
+						positive[j][0] = f.planes[j].x >= 0;
+						positive[j][1] = f.planes[j].y >= 0;
+						positive[j][2] = f.planes[j].z >= 0;
+					}
+				}
+
+				P p[6][4];
+				bool positive[6][3];
+			};
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// Batch culling: writes the indices of the bounds that pass the tests above to visible,
+		// in increasing order, and returns how many there are. visible must hold
+		// centers.size() (or min.size()) indices. A whole pack of bounds is tested against all
+		// six planes at once: 8 per instruction with AVX, 16 with AVX-512.
+
+		// spheres: centers has 3 components, radii holds centers.size() values
+		template <typename T, typename Centers>
+		detail::if_stream<Centers, size_t> cull_spheres(const frustum<T>& f, const Centers& centers, const T* radii, uint32_t* visible)
+		{
+			using P = native_pack<T>;
+			static_assert(Centers::components == 3 && std::is_same_v<detail::stream_value<Centers>, T>);
+
+			detail::frustum_planes<P, T> planes(f);
+			size_t count = 0;
+			detail::for_each_pack<T>(centers.size(), [&](size_t i, uint8_t n)
+				{
+					P x = centers.template load<P>(0, i, n);
+					P y = centers.template load<P>(1, i, n);
+					P z = centers.template load<P>(2, i, n);
+					P neg_r = P(T(0)) - detail::load_scalars<P>(radii + i, n);
+
+					auto in = mul_add(planes.p[0][0], x, mul_add(planes.p[0][1], y, mul_add(planes.p[0][2], z, planes.p[0][3]))) >= neg_r;
+					for (uint8_t j = 1; j < 6; ++j)
+					{
+						in = in & (mul_add(planes.p[j][0], x, mul_add(planes.p[j][1], y, mul_add(planes.p[j][2], z, planes.p[j][3]))) >= neg_r);
+					}
+
+					uint32_t bits = bitmask(in) & (n == P::width ? ~0u : (1u << n) - 1);
+					if (bits != 0)
+					{
+						detail::append_indices<P::width>(bits, uint32_t(i), n, visible, count);
+					}
+				});
+			return count;
+		}
+
+		// axis aligned boxes min[i]..max[i], both with 3 components
+		template <typename T, typename Min, typename Max>
+		detail::if_stream<Min, size_t> cull_aabbs(const frustum<T>& f, const Min& min, const Max& max, uint32_t* visible)
+		{
+			using P = native_pack<T>;
+			static_assert(Min::components == 3 && Max::components == 3 && std::is_same_v<detail::stream_value<Min>, T>);
+			assert(max.size() >= min.size());
+
+			detail::frustum_planes<P, T> planes(f);
+			size_t count = 0;
+			detail::for_each_pack<T>(min.size(), [&](size_t i, uint8_t n)
+				{
+					P lo[3], hi[3];
+					for (uint8_t c = 0; c < 3; ++c)
+					{
+						lo[c] = min.template load<P>(c, i, n);
+						hi[c] = max.template load<P>(c, i, n);
+					}
+
+					// the corner furthest along each normal; the choice is the same for every lane
+					auto corner = [&](uint8_t j, uint8_t c) { return planes.positive[j][c] ? hi[c] : lo[c]; };
+					auto in = mul_add(planes.p[0][0], corner(0, 0), mul_add(planes.p[0][1], corner(0, 1), mul_add(planes.p[0][2], corner(0, 2), planes.p[0][3]))) >= P(T(0));
+					for (uint8_t j = 1; j < 6; ++j)
+					{
+						in = in & (mul_add(planes.p[j][0], corner(j, 0), mul_add(planes.p[j][1], corner(j, 1), mul_add(planes.p[j][2], corner(j, 2), planes.p[j][3]))) >= P(T(0)));
+					}
+
+					uint32_t bits = bitmask(in) & (n == P::width ? ~0u : (1u << n) - 1);
+					if (bits != 0)
+					{
+						detail::append_indices<P::width>(bits, uint32_t(i), n, visible, count);
+					}
+				});
+			return count;
+		}
+	}
+}
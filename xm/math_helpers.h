@@ -1,6 +1,8 @@
 #pragma once
 
 #include "constants.h"
+#include "matrix.h"
+#include "quaternion.h"
 
 namespace xm
 {
@@ -22,169 +24,112 @@ namespace xm
 		return a + f * (b - a);
 	}
 
-	//TODO: completion 
-	template<typename T>
-	bool decompose(matrix<4, T> const& ModelMatrix, vector<3, T>& Scale, quaternion<T>& Orientation, vector<3, T>& Translation, vector<3, T>& Skew, vector<4, T>& Perspective)
+	// Splits m into m = P * T * R * K * S (Graphics Gems II, "Decomposing a matrix into simple
+	// transformations"), with m divided by m[3][3] first:
+	//	perspective	- the bottom row of P, which is the identity otherwise; (0, 0, 0, 1) for
+	//				  the affine matrices that usually come in, at no cost
+	//	translation	- T
+	//	orientation	- R as a unit quaternion
+	//	skew		- K, the unit upper triangular matrix with K[1][0] = skew.z (xy),
+	//				  K[2][0] = skew.y (xz) and K[2][1] = skew.x (yz)
+	//	scale		- S; a reflection turns into a negative scale on all three axes
+	// Gram-Schmidt on the columns of the upper 3x3 gives scale, skew and rotation; the
+	// perspective row is solved against the upper 3x3 rather than through a 4x4 inverse.
+	// Returns false, with the outputs unspecified, when m[3][3] is 0 or the upper 3x3 is
+	// singular. recompose is the inverse.
+	template <typename T>
+	bool decompose(const matrix<4, T>& m, vector<3, T>& scale, quaternion<T>& orientation, vector<3, T>& translation, vector<3, T>& skew, vector<4, T>& perspective)
 	{
-		mat<4, 4, T, Q> LocalMatrix(ModelMatrix);
-
-		// Normalize the matrix.
-		if (LocalMatrix[3][3] < 0.001f)
+		if (m[3][3] == T(0))
 		{
 			return false;
 		}
-
-		for (length_t i = 0; i < 4; ++i)
-			for (length_t j = 0; j < 4; ++j)
-				LocalMatrix[i][j] /= LocalMatrix[3][3];
-
-		// perspectiveMatrix is used to solve for perspective, but it also provides
-		// an easy way to test for singularity of the upper 3x3 component.
-		mat<4, 4, T, Q> PerspectiveMatrix(LocalMatrix);
-
-		for (length_t i = 0; i < 3; i++)
-			PerspectiveMatrix[i][3] = static_cast<T>(0);
-		PerspectiveMatrix[3][3] = static_cast<T>(1);
-
-		/// TODO: Fixme!
-		if (determinant(PerspectiveMatrix) < 0.001f)
-			return false;
-
-		// First, isolate perspective.  This is the messiest.
-		if (
-			LocalMatrix[0][3] < 0.001f ||
-			LocalMatrix[1][3] < 0.001f ||
-			LocalMatrix[2][3] < 0.001f)
+		// rotation, skew and the perspective xyz don't change under the uniform scale
+		// 1 / m[3][3]: only scale and translation are divided, off the critical path
+		T inv_w = T(1) / m[3][3];
+		vector<3, T> c0(m[0][0], m[0][1], m[0][2]);
+		vector<3, T> c1(m[1][0], m[1][1], m[1][2]);
+		vector<3, T> c2(m[2][0], m[2][1], m[2][2]);
+		translation = vector<3, T>(m[3][0], m[3][1], m[3][2]) * inv_w;
+
+		// the bottom row of m is p^T times the affine part, so p.xyz = L^-T * bottom with L
+		// the upper 3x3, and p.w makes the corner 1
+		vector<3, T> bottom(m[0][3], m[1][3], m[2][3]);
+		if (bottom.x != T(0) || bottom.y != T(0) || bottom.z != T(0))
 		{
-			// rightHandSide is the right hand side of the equation.
-			vector<4, T> RightHandSide;
-			RightHandSide[0] = LocalMatrix[0][3];
-			RightHandSide[1] = LocalMatrix[1][3];
-			RightHandSide[2] = LocalMatrix[2][3];
-			RightHandSide[3] = LocalMatrix[3][3];
-
-			// Solve the equation by inverting PerspectiveMatrix and multiplying
-			// rightHandSide by the inverse.  (This is the easiest way, not
-			// necessarily the best.)
-			matrix<4, T> InversePerspectiveMatrix = inverse(PerspectiveMatrix);  //   inverse(PerspectiveMatrix, inversePerspectiveMatrix);
-			matrix<4, T> TransposedInversePerspectiveMatrix = transpose(InversePerspectiveMatrix);//   transposeMatrix4(inversePerspectiveMatrix, transposedInversePerspectiveMatrix);
-
-			Perspective = TransposedInversePerspectiveMatrix * RightHandSide;
-			//  v4MulPointByMatrix(rightHandSide, transposedInversePerspectiveMatrix, perspectivePoint);
-
-			// Clear the perspective partition
-			LocalMatrix[0][3] = LocalMatrix[1][3] = LocalMatrix[2][3] = static_cast<T>(0);
-			LocalMatrix[3][3] = static_cast<T>(1);
+			T det = T(0);
+			matrix<3, T> inv_l = inverse(matrix<3, T>(c0, c1, c2), det);
+			if (det == T(0))
+			{
+				return false;
+			}
+			vector<3, T> p = transpose(inv_l) * bottom;
+			perspective = vector<4, T>(p.x, p.y, p.z, T(1) - dot(p, translation));
 		}
 		else
 		{
-			// No perspective.
-			Perspective = vec<4, T, Q>(0, 0, 0, 1);
+			perspective = vector<4, T>(T(0), T(0), T(0), T(1));
 		}
 
-		// Next take care of translation (easy).
-		Translation = vec<3, T, Q>(LocalMatrix[3]);
-		LocalMatrix[3] = vec<4, T, Q>(0, 0, 0, LocalMatrix[3].w);
-
-		vec<3, T, Q> Row[3], Pdum3;
-
-		// Now get scale and shear.
-		for (length_t i = 0; i < 3; ++i)
-			for (length_t j = 0; j < 3; ++j)
-				Row[i][j] = LocalMatrix[i][j];
-
-		// Compute X scale factor and normalize first row.
-		Scale.x = length(Row[0]);// v3Length(Row[0]);
-
-		Row[0] = detail::scale(Row[0], static_cast<T>(1));
-
-		// Compute XY shear factor and make 2nd row orthogonal to 1st.
-		Skew.z = dot(Row[0], Row[1]);
-		Row[1] = detail::combine(Row[1], Row[0], static_cast<T>(1), -Skew.z);
-
-		// Now, compute Y scale and normalize 2nd row.
-		Scale.y = length(Row[1]);
-		Row[1] = detail::scale(Row[1], static_cast<T>(1));
-		Skew.z /= Scale.y;
-
-		// Compute XZ and YZ shears, orthogonalize 3rd row.
-		Skew.y = glm::dot(Row[0], Row[2]);
-		Row[2] = detail::combine(Row[2], Row[0], static_cast<T>(1), -Skew.y);
-		Skew.x = glm::dot(Row[1], Row[2]);
-		Row[2] = detail::combine(Row[2], Row[1], static_cast<T>(1), -Skew.x);
-
-		// Next, get Z scale and normalize 3rd row.
-		Scale.z = length(Row[2]);
-		Row[2] = detail::scale(Row[2], static_cast<T>(1));
-		Skew.y /= Scale.z;
-		Skew.x /= Scale.z;
-
-		// At this point, the matrix (in rows[]) is orthonormal.
-		// Check for a coordinate system flip.  If the determinant
-		// is -1, then negate the matrix and the scaling factors.
-		Pdum3 = cross(Row[1], Row[2]); // v3Cross(row[1], row[2], Pdum3);
-		if (dot(Row[0], Pdum3) < 0)
+		// Gram-Schmidt on unnormalized columns u0 = c0, u1, u2: each projection needs one
+		// division by a squared length and the three roots are left for the end, where
+		// they are independent of each other
+		T d0 = dot(c0, c0);
+		if (d0 == T(0))
 		{
-			for (length_t i = 0; i < 3; i++)
-			{
-				Scale[i] *= static_cast<T>(-1);
-				Row[i] *= static_cast<T>(-1);
-			}
+			return false;
 		}
-
-		// Now, get the rotations out, as described in the gem.
-
-		// FIXME - Add the ability to return either quaternions (which are
-		// easier to recompose with) or Euler angles (rx, ry, rz), which
-		// are easier for authors to deal with. The latter will only be useful
-		// when we fix https://bugs.webkit.org/show_bug.cgi?id=23799, so I
-		// will leave the Euler angle code here for now.
-
-		// ret.rotateY = asin(-Row[0][2]);
-		// if (cos(ret.rotateY) != 0) {
-		//     ret.rotateX = atan2(Row[1][2], Row[2][2]);
-		//     ret.rotateZ = atan2(Row[0][1], Row[0][0]);
-		// } else {
-		//     ret.rotateX = atan2(-Row[2][0], Row[1][1]);
-		//     ret.rotateZ = 0;
-		// }
-
-		int i, j, k = 0;
-		T root, trace = Row[0].x + Row[1].y + Row[2].z;
-		if (trace > static_cast<T>(0))
+		T inv_d0 = T(1) / d0;
+		T k01 = dot(c0, c1) * inv_d0;
+		vector<3, T> u1 = c1 - c0 * k01;
+		T d1 = dot(u1, u1);
+		if (d1 == T(0))
 		{
-			root = sqrt(trace + static_cast<T>(1.0));
-			Orientation.w = static_cast<T>(0.5) * root;
-			root = static_cast<T>(0.5) / root;
-			Orientation.x = root * (Row[1].z - Row[2].y);
-			Orientation.y = root * (Row[2].x - Row[0].z);
-			Orientation.z = root * (Row[0].y - Row[1].x);
-		} // End if > 0
-		else
+			return false;
+		}
+		T inv_d1 = T(1) / d1;
+		T k02 = dot(c0, c2) * inv_d0;
+		vector<3, T> u2 = c2 - c0 * k02;
+		T k12 = dot(u1, u2) * inv_d1;
+		u2 = u2 - u1 * k12;
+		T d2 = dot(u2, u2);
+		if (d2 == T(0))
 		{
-			static int Next[3] = { 1, 2, 0 };
-			i = 0;
-			if (Row[1].y > Row[0].x) i = 1;
-			if (Row[2].z > Row[i][i]) i = 2;
-			j = Next[i];
-			k = Next[j];
-
-#           ifdef GLM_FORCE_QUAT_DATA_WXYZ
-			int off = 1;
-#           else
-			int off = 0;
-#           endif
-
-			root = sqrt(Row[i][i] - Row[j][j] - Row[k][k] + static_cast<T>(1.0));
+			return false;
+		}
 
-			Orientation[i + off] = static_cast<T>(0.5) * root;
-			root = static_cast<T>(0.5) / root;
-			Orientation[j + off] = root * (Row[i][j] + Row[j][i]);
-			Orientation[k + off] = root * (Row[i][k] + Row[k][i]);
-			Orientation.w = root * (Row[j][k] - Row[k][j]);
-		} // End if <= 0
+		// 1 / sqrt(d) = sqrt(d) / d reuses the reciprocals
+		vector<3, T> len(xm::sqrt(d0), xm::sqrt(d1), xm::sqrt(d2));
+		vector<3, T> inv_len(len.x * inv_d0, len.y * inv_d1, len.z / d2);
+		skew = vector<3, T>(k12 * len.y * inv_len.z, k02 * len.x * inv_len.z, k01 * len.x * inv_len.y);
 
+		// a left-handed basis is a reflection, folded into the scale
+		if (dot(c0, cross(u1, u2)) < T(0))
+		{
+			len = -len;
+			inv_len = -inv_len;
+		}
+		scale = len * inv_w;
+		orientation = quat_cast(matrix<3, T>(c0 * inv_len.x, u1 * inv_len.y, u2 * inv_len.z));
 		return true;
 	}
 
-}
\ No newline at end of file
+	// m = P * T * R * K * S from the parts decompose returns, built column by column
+	// without a matrix product.
+	template <typename T>
+	constexpr matrix<4, T> recompose(vector<3, T> scale, const quaternion<T>& orientation, vector<3, T> translation, vector<3, T> skew, vector<4, T> perspective) noexcept
+	{
+		matrix<3, T> r = mat3_cast(orientation);
+		vector<3, T> c0 = r[0] * scale.x;
+		vector<3, T> c1 = (r[1] + r[0] * skew.z) * scale.y;
+		vector<3, T> c2 = (r[2] + r[1] * skew.x + r[0] * skew.y) * scale.z;
+
+		// the bottom row of P times the affine part
+		vector<3, T> p(perspective.x, perspective.y, perspective.z);
+		return matrix<4, T>(
+			vector<4, T>(c0.x, c0.y, c0.z, dot(p, c0)),
+			vector<4, T>(c1.x, c1.y, c1.z, dot(p, c1)),
+			vector<4, T>(c2.x, c2.y, c2.z, dot(p, c2)),
+			vector<4, T>(translation.x, translation.y, translation.z, dot(p, translation) + perspective.w));
+	}
+}
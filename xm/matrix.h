@@ -1,6 +1,6 @@
 #pragma once
 
-#include <cstring>
+#include "simd.h"
 #include "vector.h"
 
 namespace xm
@@ -11,43 +11,32 @@ namespace xm
 	template <typename T>
 	struct matrix<2, T>
 	{
-		static_assert(std::is_floating_point_v<T>);
+		static_assert(std::is_floating_point_v<scalar_t<T>>);
 
-		matrix()
-		{
-			this->a.x = 0.0;
-			this->a.y = 0.0;
-			this->b.x = 0.0;
-			this->b.y = 0.0;
-		}
+		constexpr matrix() noexcept : a(), b() {}
 
-		matrix(T a)
-		{
-			this->a.x = a;
-			this->a.y = 0.0;
-			this->b.x = 0.0;
-			this->b.y = a;
-		}
+		explicit matrix(uninitialized_t) noexcept : a(uninitialized), b(uninitialized) {}
 
-		matrix(vector<2, T> a)
-		{
-			this->a = vector<T, 2>(a.x, 0.0);
-			this->b = vector<T, 2>(0.0, a.y);
-		}
+		constexpr matrix(T s) noexcept
+			: a(s, T(0)),
+			b(T(0), s) {}
 
-		matrix(vector<2, T> a, vector<2, T> b)
-		{
-			this->a = a;
-			this->b = b;
-		}
+		constexpr matrix(vector<2, T> diagonal) noexcept
+			: a(diagonal.x, T(0)),
+			b(T(0), diagonal.y) {}
+
+		constexpr matrix(vector<2, T> a, vector<2, T> b) noexcept : a(a), b(b) {}
 
-		vector<2, T>& operator[] (uint8_t i)
+		// constant evaluation can't index past a member, so it picks the column by name
+		constexpr vector<2, T>& operator[] (uint8_t i) noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? a : b;
 			return *(&a + i);
 		}
 
-		const vector<2, T>& operator[] (uint8_t i) const
+		constexpr const vector<2, T>& operator[] (uint8_t i) const noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? a : b;
 			return *(&a + i);
 		}
 
@@ -58,59 +47,33 @@ namespace xm
 	template <typename T>
 	struct matrix<3, T>
 	{
-		static_assert(std::is_floating_point_v<T>);
-
-		matrix()
-		{
-			this->a.x = 0.0;
-			this->a.y = 0.0;
-			this->a.z = 0.0;
+		static_assert(std::is_floating_point_v<scalar_t<T>>);
 
-			this->b.x = 0.0;
-			this->b.y = 0.0;
-			this->b.z = 0.0;
+		constexpr matrix() noexcept : a(), b(), c() {}
 
-			this->c.x = 0.0;
-			this->c.y = 0.0;
-			this->c.z = 0.0;
-		}
-
-		matrix(T a)
-		{
-			this->a.x = a;
-			this->a.y = 0.0;
-			this->a.z = 0.0;
+		explicit matrix(uninitialized_t) noexcept : a(uninitialized), b(uninitialized), c(uninitialized) {}
 
-			this->b.x = 0.0;
-			this->b.y = a;
-			this->b.z = 0.0;
+		constexpr matrix(T s) noexcept
+			: a(s, T(0), T(0)),
+			b(T(0), s, T(0)),
+			c(T(0), T(0), s) {}
 
-			this->c.x = 0.0;
-			this->c.y = 0.0;
-			this->c.z = a;
-		}
+		constexpr matrix(vector<3, T> diagonal) noexcept
+			: a(diagonal.x, T(0), T(0)),
+			b(T(0), diagonal.y, T(0)),
+			c(T(0), T(0), diagonal.z) {}
 
-		matrix(vector<3, T> a)
-		{
-			this->a = vector<T, 3>(a.x, 0.0, 0.0);
-			this->b = vector<T, 3>(0.0, a.y, 0.0);
-			this->c = vector<T, 3>(0.0, 0.0, a.z);
-		}
+		constexpr matrix(vector<3, T> a, vector<3, T> b, vector<3, T> c) noexcept : a(a), b(b), c(c) {}
 
-		matrix(vector<3, T> a, vector<3, T> b, vector<3, T> c)
-		{
-			this->a = a;
-			this->b = b;
-			this->c = c;
-		}
-
-		vector<3, T>& operator[] (uint8_t i)
+		constexpr vector<3, T>& operator[] (uint8_t i) noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? a : i == 1 ? b : c;
 			return *(&a + i);
 		}
 
-		const vector<3, T>& operator[] (uint8_t i) const
+		constexpr const vector<3, T>& operator[] (uint8_t i) const noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? a : i == 1 ? b : c;
 			return *(&a + i);
 		}
 
@@ -122,77 +85,53 @@ namespace xm
 	template <typename T>
 	struct matrix<4, T>
 	{
-		static_assert(std::is_floating_point_v<T>);
+		static_assert(std::is_floating_point_v<scalar_t<T>>);
 
-		matrix()
-		{
-			memset(&this->a.x, static_cast<int>(T(0.0)), 16 * sizeof(T));
-		}
+		constexpr matrix() noexcept : a(), b(), c(), d() {}
 
-		matrix(T a)
-		{
-			this->a.x = a;
-			this->a.y = 0.0;
-			this->a.z = 0.0;
-			this->a.w = 0.0;
-
-			this->b.x = 0.0;
-			this->b.y = a;
-			this->b.z = 0.0;
-			this->b.w = 0.0;
-
-			this->c.x = 0.0;
-			this->c.y = 0.0;
-			this->c.z = a;
-			this->c.w = 0.0;
-
-			this->d.x = 0.0;
-			this->d.y = 0.0;
-			this->d.z = 0.0;
-			this->d.w = a;
-		}
+		explicit matrix(uninitialized_t) noexcept : a(uninitialized), b(uninitialized), c(uninitialized), d(uninitialized) {}
 
-		matrix(vector<3, T> a)
-		{
-			this->a = vector<T, 4>(a.x, 0.0, 0.0, 0.0);
-			this->b = vector<T, 4>(0.0, a.y, 0.0, 0.0);
-			this->c = vector<T, 4>(0.0, 0.0, a.z, 0.0);
-			this->d = vector<T, 4>(0.0, 0.0, 0.0, 1.0);
-		}
-		matrix(vector<4, T> a)
-		{
-			this->a = vector<T, 4>(a.x, 0.0, 0.0, 0.0);
-			this->b = vector<T, 4>(0.0, a.y, 0.0, 0.0);
-			this->c = vector<T, 4>(0.0, 0.0, a.z, 0.0);
-			this->d = vector<T, 4>(0.0, 0.0, 0.0, a.w);
-		}
+		constexpr matrix(T s) noexcept
+			: a(s, T(0), T(0), T(0)),
+			b(T(0), s, T(0), T(0)),
+			c(T(0), T(0), s, T(0)),
+			d(T(0), T(0), T(0), s) {}
 
-		matrix(const vector<4, T>& a, const vector<4, T>& b, const vector<4, T>& c, const vector<4, T>& d)
-		{
-			this->a = a;
-			this->b = b;
-			this->c = c;
-			this->d = d;
-		}
+		constexpr matrix(vector<3, T> diagonal) noexcept
+			: a(diagonal.x, T(0), T(0), T(0)),
+			b(T(0), diagonal.y, T(0), T(0)),
+			c(T(0), T(0), diagonal.z, T(0)),
+			d(T(0), T(0), T(0), T(1)) {}
+
+		constexpr matrix(vector<4, T> diagonal) noexcept
+			: a(diagonal.x, T(0), T(0), T(0)),
+			b(T(0), diagonal.y, T(0), T(0)),
+			c(T(0), T(0), diagonal.z, T(0)),
+			d(T(0), T(0), T(0), diagonal.w) {}
+
+		constexpr matrix(const vector<4, T>& a, const vector<4, T>& b, const vector<4, T>& c, const vector<4, T>& d) noexcept
+			: a(a), b(b), c(c), d(d) {}
 
 		vector<4, T> a;
 		vector<4, T> b;
 		vector<4, T> c;
 		vector<4, T> d;
 
-		vector<4, T>& operator[] (uint8_t i)
+		constexpr vector<4, T>& operator[] (uint8_t i) noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? a : i == 1 ? b : i == 2 ? c : d;
 			return *(&a + i);
 		}
 
-		const vector<4, T>& operator[] (uint8_t i) const
+		constexpr const vector<4, T>& operator[] (uint8_t i) const noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? a : i == 1 ? b : i == 2 ? c : d;
 			return *(&a + i);
 		}
 	};
 
 	template <uint8_t N, typename T>
-	matrix<N, T> operator*(matrix<N, T> a, matrix<N, T> b)
+	constexpr matrix<N, T> operator*(const matrix<N, T>& a, const matrix<N, T>& b) noexcept
 	{
 		matrix<N, T> res;
 		for (int i = 0; i < N; ++i)
@@ -210,7 +149,7 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	vector<N, T> operator*(matrix<N, T> a, vector<N, T> b)
+	constexpr vector<N, T> operator*(const matrix<N, T>& a, const vector<N, T>& b) noexcept
 	{
 		vector<N, T> res;
 		for (int i = 0; i < N; ++i)
@@ -223,54 +162,548 @@ namespace xm
 		return res;
 	}
 
+	// out = a * b, and out may be a or b. The 4x4 float and double overloads below store
+	// the product straight into out instead of going through a temporary.
+	template <uint8_t N, typename T>
+	constexpr void mul_into(matrix<N, T>& out, const matrix<N, T>& a, const matrix<N, T>& b) noexcept
+	{
+		out = a * b;
+	}
+
+	template <uint8_t N, typename T>
+	constexpr void mul_into(vector<N, T>& out, const matrix<N, T>& a, const vector<N, T>& b) noexcept
+	{
+		out = a * b;
+	}
+
+	// a = a * b: b is applied first
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T>& operator*=(matrix<N, T>& a, const matrix<N, T>& b) noexcept
+	{
+		mul_into(a, a, b);
+		return a;
+	}
+
+#if XM_SSE2
+	// 4x4 float and double products, one result column per broadcast of b's column.
+	// Without XM_FMA the terms are multiplied and summed in the same order as the
+	// generic loop, so results are bit-identical to it (except for the sign of a zero).
+	// With XM_FMA the three additions are fused; each element then differs from the
+	// generic loop by at most 3 ulp of sum(|a[k][j] * b[i][k]|) and is usually closer
+	// to the exact result.
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			inline __m128 mul_column(__m128 a0, __m128 a1, __m128 a2, __m128 a3, const float* v)
+			{
+				__m128 res = _mm_mul_ps(a0, _mm_set1_ps(v[0]));
+#if XM_FMA
+				res = _mm_fmadd_ps(a1, _mm_set1_ps(v[1]), res);
+				res = _mm_fmadd_ps(a2, _mm_set1_ps(v[2]), res);
+				res = _mm_fmadd_ps(a3, _mm_set1_ps(v[3]), res);
+#else
+				res = _mm_add_ps(res, _mm_mul_ps(a1, _mm_set1_ps(v[1])));
+				res = _mm_add_ps(res, _mm_mul_ps(a2, _mm_set1_ps(v[2])));
+				res = _mm_add_ps(res, _mm_mul_ps(a3, _mm_set1_ps(v[3])));
+#endif
+				return res;
+			}
+
+#if XM_AVX
+			inline __m256d mul_column(__m256d a0, __m256d a1, __m256d a2, __m256d a3, const double* v)
+			{
+				__m256d res = _mm256_mul_pd(a0, _mm256_broadcast_sd(v + 0));
+#if XM_FMA
+				res = _mm256_fmadd_pd(a1, _mm256_broadcast_sd(v + 1), res);
+				res = _mm256_fmadd_pd(a2, _mm256_broadcast_sd(v + 2), res);
+				res = _mm256_fmadd_pd(a3, _mm256_broadcast_sd(v + 3), res);
+#else
+				res = _mm256_add_pd(res, _mm256_mul_pd(a1, _mm256_broadcast_sd(v + 1)));
+				res = _mm256_add_pd(res, _mm256_mul_pd(a2, _mm256_broadcast_sd(v + 2)));
+				res = _mm256_add_pd(res, _mm256_mul_pd(a3, _mm256_broadcast_sd(v + 3)));
+#endif
+				return res;
+			}
+#else
+			// a's columns split in two halves: lo = x,y and hi = z,w
+			inline void mul_column(const __m128d* lo, const __m128d* hi, const double* v, double* res)
+			{
+				__m128d s = _mm_set1_pd(v[0]);
+				__m128d r_lo = _mm_mul_pd(lo[0], s);
+				__m128d r_hi = _mm_mul_pd(hi[0], s);
+				for (int k = 1; k < 4; ++k)
+				{
+					s = _mm_set1_pd(v[k]);
+					r_lo = _mm_add_pd(r_lo, _mm_mul_pd(lo[k], s));
+					r_hi = _mm_add_pd(r_hi, _mm_mul_pd(hi[k], s));
+				}
+				_mm_storeu_pd(res + 0, r_lo);
+				_mm_storeu_pd(res + 2, r_hi);
+			}
+#endif
+
+			// out = a * b for a 4x4 a and a b of 1 (vector) or 4 columns. a is held in registers
+			// and column i of b is read before column i of out is written, so out may be a or b.
+			inline void simd_mul_into(float* out, const float* a, const float* b, int columns)
+			{
+				__m128 a0 = _mm_loadu_ps(a + 0);
+				__m128 a1 = _mm_loadu_ps(a + 4);
+				__m128 a2 = _mm_loadu_ps(a + 8);
+				__m128 a3 = _mm_loadu_ps(a + 12);
+				for (int i = 0; i < columns; ++i)
+				{
+					_mm_storeu_ps(out + 4 * i, mul_column(a0, a1, a2, a3, b + 4 * i));
+				}
+			}
+
+			inline void simd_mul_into(double* out, const double* a, const double* b, int columns)
+			{
+#if XM_AVX
+				__m256d a0 = _mm256_loadu_pd(a + 0);
+				__m256d a1 = _mm256_loadu_pd(a + 4);
+				__m256d a2 = _mm256_loadu_pd(a + 8);
+				__m256d a3 = _mm256_loadu_pd(a + 12);
+				for (int i = 0; i < columns; ++i)
+				{
+					_mm256_storeu_pd(out + 4 * i, mul_column(a0, a1, a2, a3, b + 4 * i));
+				}
+#else
+				__m128d lo[4], hi[4];
+				for (int k = 0; k < 4; ++k)
+				{
+					lo[k] = _mm_loadu_pd(a + 4 * k + 0);
+					hi[k] = _mm_loadu_pd(a + 4 * k + 2);
+				}
+				for (int i = 0; i < columns; ++i)
+				{
+					mul_column(lo, hi, b + 4 * i, out + 4 * i);
+				}
+#endif
+			}
+		}
+	}
+
+	// Intrinsics can't be evaluated in a constant expression, which takes the generic loops.
+	inline namespace XM_SIMD_ABI
+	{
+		constexpr matrix<4, float> operator*(const matrix<4, float>& a, const matrix<4, float>& b) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::operator*<4, float>(a, b);
+			matrix<4, float> res(uninitialized);
+			detail::simd_mul_into(&res.a.x, &a.a.x, &b.a.x, 4);
+			return res;
+		}
+
+		constexpr vector<4, float> operator*(const matrix<4, float>& a, const vector<4, float>& b) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::operator*<4, float>(a, b);
+			vector<4, float> res(uninitialized);
+			detail::simd_mul_into(&res.x, &a.a.x, &b.x, 1);
+			return res;
+		}
+
+		constexpr matrix<4, double> operator*(const matrix<4, double>& a, const matrix<4, double>& b) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::operator*<4, double>(a, b);
+			matrix<4, double> res(uninitialized);
+			detail::simd_mul_into(&res.a.x, &a.a.x, &b.a.x, 4);
+			return res;
+		}
+
+		constexpr vector<4, double> operator*(const matrix<4, double>& a, const vector<4, double>& b) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::operator*<4, double>(a, b);
+			vector<4, double> res(uninitialized);
+			detail::simd_mul_into(&res.x, &a.a.x, &b.x, 1);
+			return res;
+		}
+
+		constexpr void mul_into(matrix<4, float>& out, const matrix<4, float>& a, const matrix<4, float>& b) noexcept
+		{
+			if (detail::is_constant_evaluated())
+			{
+				out = xm::operator*<4, float>(a, b);
+				return;
+			}
+			detail::simd_mul_into(&out.a.x, &a.a.x, &b.a.x, 4);
+		}
+
+		constexpr void mul_into(matrix<4, double>& out, const matrix<4, double>& a, const matrix<4, double>& b) noexcept
+		{
+			if (detail::is_constant_evaluated())
+			{
+				out = xm::operator*<4, double>(a, b);
+				return;
+			}
+			detail::simd_mul_into(&out.a.x, &a.a.x, &b.a.x, 4);
+		}
+	}
+#endif
+
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> transpose(const matrix<N, T>& m) noexcept
+	{
+		matrix<N, T> res;
+		for (uint8_t i = 0; i < N; ++i)
+		{
+			for (uint8_t j = 0; j < N; ++j)
+			{
+				res[i][j] = m[j][i];
+			}
+		}
+		return res;
+	}
+
+	namespace detail
+	{
+		// The 2x2 determinants of the first two and of the last two columns. The determinant
+		// and the adjugate of a 4x4 matrix are both expanded along them, so inverse gets
+		// the determinant for free.
+		template <typename T>
+		struct minors4
+		{
+			constexpr minors4(const matrix<4, T>& m) noexcept
+				: s{
+					m.a.x * m.b.y - m.b.x * m.a.y,
+					m.a.x * m.b.z - m.b.x * m.a.z,
+					m.a.x * m.b.w - m.b.x * m.a.w,
+					m.a.y * m.b.z - m.b.y * m.a.z,
+					m.a.y * m.b.w - m.b.y * m.a.w,
+					m.a.z * m.b.w - m.b.z * m.a.w },
+				c{
+					m.c.x * m.d.y - m.d.x * m.c.y,
+					m.c.x * m.d.z - m.d.x * m.c.z,
+					m.c.x * m.d.w - m.d.x * m.c.w,
+					m.c.y * m.d.z - m.d.y * m.c.z,
+					m.c.y * m.d.w - m.d.y * m.c.w,
+					m.c.z * m.d.w - m.d.z * m.c.w } {}
+
+			constexpr T determinant() const noexcept
+			{
+				return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+			}
+
+			T s[6];
+			T c[6];
+		};
+	}
+
 	template <uint8_t N, typename T>
-	T determinant(matrix<N, T> m)
+	constexpr T determinant(const matrix<N, T>& m) noexcept
 	{
 		if constexpr (N == 2)
 		{
 			return m.a.x * m.b.y - m.a.y * m.b.x;
 		}
+		else if constexpr (N == 3)
+		{
+			return dot(m.a, crossRH(m.b, m.c));
+		}
+		else if constexpr (N == 4)
+		{
+			return detail::minors4<T>(m).determinant();
+		}
+	}
 
-		if constexpr (N == 3)
+	// Inverse and, through det, the determinant it divides by. A singular matrix gives
+	// det == 0 and a result of infinities and NaNs.
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> inverse(const matrix<N, T>& m, T& det) noexcept
+	{
+		if constexpr (N == 2)
+		{
+			det = determinant(m);
+			T inv_det = T(1) / det;
+			return matrix<2, T>(
+				vector<2, T>(m.b.y * inv_det, -m.a.y * inv_det),
+				vector<2, T>(-m.b.x * inv_det, m.a.x * inv_det));
+		}
+		else if constexpr (N == 3)
 		{
-			matrix<2, T> minor00{ {m.b.y, m.b.z}, {m.c.y, m.c.z} };
-			matrix<2, T> minor10{ {m.b.x, m.b.z}, {m.c.x, m.c.z} };
-			matrix<2, T> minor20{ {m.b.x, m.b.y}, {m.c.x, m.c.y} };
+			// rows of the inverse are the cross products of the columns
+			vector<3, T> r0 = crossRH(m.b, m.c);
+			vector<3, T> r1 = crossRH(m.c, m.a);
+			vector<3, T> r2 = crossRH(m.a, m.b);
+
+			det = dot(m.a, r0);
+			T inv_det = T(1) / det;
+			r0 *= inv_det;
+			r1 *= inv_det;
+			r2 *= inv_det;
+
+			return matrix<3, T>(
+				vector<3, T>(r0.x, r1.x, r2.x),
+				vector<3, T>(r0.y, r1.y, r2.y),
+				vector<3, T>(r0.z, r1.z, r2.z));
+		}
+		else if constexpr (N == 4)
+		{
+			detail::minors4<T> k(m);
+			const T* s = k.s;
+			const T* c = k.c;
+
+			det = k.determinant();
+			T inv_det = T(1) / det;
+
+			// column i of the result is row i of the adjugate of the transpose
+			return matrix<4, T>(
+				vector<4, T>(
+					(m.b.y * c[5] - m.b.z * c[4] + m.b.w * c[3]) * inv_det,
+					(-m.a.y * c[5] + m.a.z * c[4] - m.a.w * c[3]) * inv_det,
+					(m.d.y * s[5] - m.d.z * s[4] + m.d.w * s[3]) * inv_det,
+					(-m.c.y * s[5] + m.c.z * s[4] - m.c.w * s[3]) * inv_det),
+				vector<4, T>(
+					(-m.b.x * c[5] + m.b.z * c[2] - m.b.w * c[1]) * inv_det,
+					(m.a.x * c[5] - m.a.z * c[2] + m.a.w * c[1]) * inv_det,
+					(-m.d.x * s[5] + m.d.z * s[2] - m.d.w * s[1]) * inv_det,
+					(m.c.x * s[5] - m.c.z * s[2] + m.c.w * s[1]) * inv_det),
+				vector<4, T>(
+					(m.b.x * c[4] - m.b.y * c[2] + m.b.w * c[0]) * inv_det,
+					(-m.a.x * c[4] + m.a.y * c[2] - m.a.w * c[0]) * inv_det,
+					(m.d.x * s[4] - m.d.y * s[2] + m.d.w * s[0]) * inv_det,
+					(-m.c.x * s[4] + m.c.y * s[2] - m.c.w * s[0]) * inv_det),
+				vector<4, T>(
+					(-m.b.x * c[3] + m.b.y * c[1] - m.b.z * c[0]) * inv_det,
+					(m.a.x * c[3] - m.a.y * c[1] + m.a.z * c[0]) * inv_det,
+					(-m.d.x * s[3] + m.d.y * s[1] - m.d.z * s[0]) * inv_det,
+					(m.c.x * s[3] - m.c.y * s[1] + m.c.z * s[0]) * inv_det));
+		}
+	}
 
-			T det00 = determinant(minor00);
-			T det10 = determinant(minor10);
-			T det20 = determinant(minor20);
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> inverse(const matrix<N, T>& m) noexcept
+	{
+		T det = T(0);
+		return inverse(m, det);
+	}
 
-			return m.a.x * det00 - m.a.y * det10 + m.a.z * det20;
-		}
+	// m must be affine (last row 0, 0, 0, 1): only the upper 3x3 is inverted
+	template <typename T>
+	constexpr matrix<4, T> inverse_affine(const matrix<4, T>& m) noexcept
+	{
+		vector<3, T> a(m.a.x, m.a.y, m.a.z);
+		vector<3, T> b(m.b.x, m.b.y, m.b.z);
+		vector<3, T> c(m.c.x, m.c.y, m.c.z);
+		vector<3, T> t(m.d.x, m.d.y, m.d.z);
+
+		vector<3, T> r0 = crossRH(b, c);
+		vector<3, T> r1 = crossRH(c, a);
+		vector<3, T> r2 = crossRH(a, b);
+
+		T inv_det = T(1) / dot(a, r0);
+		r0 *= inv_det;
+		r1 *= inv_det;
+		r2 *= inv_det;
+
+		return matrix<4, T>(
+			vector<4, T>(r0.x, r1.x, r2.x, T(0)),
+			vector<4, T>(r0.y, r1.y, r2.y, T(0)),
+			vector<4, T>(r0.z, r1.z, r2.z, T(0)),
+			vector<4, T>(-dot(r0, t), -dot(r1, t), -dot(r2, t), T(1)));
+	}
 
-		if constexpr (N == 4)
+	// m must be a rotation followed by a translation: the inverse is the transposed
+	// rotation and the translation rotated back and negated
+	template <typename T>
+	constexpr matrix<4, T> inverse_rigid(const matrix<4, T>& m) noexcept
+	{
+		vector<3, T> r0(m.a.x, m.a.y, m.a.z);
+		vector<3, T> r1(m.b.x, m.b.y, m.b.z);
+		vector<3, T> r2(m.c.x, m.c.y, m.c.z);
+		vector<3, T> t(m.d.x, m.d.y, m.d.z);
+
+		return matrix<4, T>(
+			vector<4, T>(r0.x, r1.x, r2.x, T(0)),
+			vector<4, T>(r0.y, r1.y, r2.y, T(0)),
+			vector<4, T>(r0.z, r1.z, r2.z, T(0)),
+			vector<4, T>(-dot(r0, t), -dot(r1, t), -dot(r2, t), T(1)));
+	}
+
+#if XM_SSE2
+	// 4x4 float inverse by 2x2 blocks: with M = | A B | (A, B, C, D held one 2x2 block
+	//                                            | C D |  per register) every block of the
+	// adjugate is a 2x2 product, and |M| = |A||D| + |B||C| - tr(A#B D#C).
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
 		{
-			matrix<3, T> minor00{ {m.b.y, m.b.z, m.b.w},
-								  {m.c.y, m.c.z, m.c.w},
-								  {m.d.y, m.d.z, m.d.w} };
-			matrix<3, T> minor10{ {m.b.x, m.b.z, m.b.w},
-								  {m.c.x, m.c.z, m.c.w},
-								  {m.d.x, m.d.z, m.d.w} };
-			matrix<3, T> minor20{ {m.b.x, m.b.y, m.b.w},
-								  {m.c.x, m.c.y, m.c.w},
-								  {m.d.x, m.d.y, m.d.w} };
-			matrix<3, T> minor30{ {m.b.x, m.b.y, m.b.z},
-								  {m.c.x, m.c.y, m.c.z},
-								  {m.d.x, m.d.y, m.d.z} };
-
-			T det00 = determinant(minor00);
-			T det10 = determinant(minor10);
-			T det20 = determinant(minor20);
-			T det30 = determinant(minor30);
-
-			return m.a.x * det00
-				- m.a.y * det10
-				+ m.a.z * det20
-				- m.a.w * det30;
+			// the memory order of a matrix is column major; here each 2x2 block is read as
+			// (x0, y0, x1, y1) = | x0 x1 | and every product below is of that form
+			//                    | y0 y1 |
+			#define XM_SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+
+			// A * B
+			inline __m128 mat2_mul(__m128 a, __m128 b)
+			{
+				return _mm_add_ps(_mm_mul_ps(a, XM_SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(XM_SWIZZLE(a, 1, 0, 3, 2), XM_SWIZZLE(b, 2, 1, 2, 1)));
+			}
+
+			// adj(A) * B
+			inline __m128 mat2_adj_mul(__m128 a, __m128 b)
+			{
+				return _mm_sub_ps(_mm_mul_ps(XM_SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(XM_SWIZZLE(a, 1, 1, 2, 2), XM_SWIZZLE(b, 2, 3, 0, 1)));
+			}
+
+			// A * adj(B)
+			inline __m128 mat2_mul_adj(__m128 a, __m128 b)
+			{
+				return _mm_sub_ps(_mm_mul_ps(a, XM_SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(XM_SWIZZLE(a, 1, 0, 3, 2), XM_SWIZZLE(b, 2, 1, 2, 1)));
+			}
+
+			#undef XM_SWIZZLE
+
+			inline matrix<4, float> simd_inverse(const matrix<4, float>& m, float& det)
+			{
+				const float* p = &m.a.x;
+				__m128 c0 = _mm_loadu_ps(p + 0);
+				__m128 c1 = _mm_loadu_ps(p + 4);
+				__m128 c2 = _mm_loadu_ps(p + 8);
+				__m128 c3 = _mm_loadu_ps(p + 12);
+
+				// blocks of the transpose, whose inverse transposed is the one we want
+				__m128 a = _mm_movelh_ps(c0, c1);
+				__m128 b = _mm_movehl_ps(c1, c0);
+				__m128 c = _mm_movelh_ps(c2, c3);
+				__m128 d = _mm_movehl_ps(c3, c2);
+
+				// |A| |B| |C| |D|
+				__m128 det_sub = _mm_sub_ps(
+					_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+					_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+				__m128 det_a = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(0, 0, 0, 0));
+				__m128 det_b = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(1, 1, 1, 1));
+				__m128 det_c = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(2, 2, 2, 2));
+				__m128 det_d = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(3, 3, 3, 3));
+
+				__m128 d_c = mat2_adj_mul(d, c);
+				__m128 a_b = mat2_adj_mul(a, b);
+
+				__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+				__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+				__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+				__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+
+				// tr(A#B D#C), summed across the register
+				__m128 tr = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0)));
+				tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+				tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+
+				__m128 det_m = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+				det = _mm_cvtss_f32(det_m);
+
+				// the adjugate of each block is its swizzle with the off-diagonal negated
+				__m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_m);
+				x = _mm_mul_ps(x, inv_det);
+				y = _mm_mul_ps(y, inv_det);
+				z = _mm_mul_ps(z, inv_det);
+				w = _mm_mul_ps(w, inv_det);
+
+				matrix<4, float> res(uninitialized);
+				float* r = &res.a.x;
+				_mm_storeu_ps(r + 0, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+				_mm_storeu_ps(r + 4, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+				_mm_storeu_ps(r + 8, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+				_mm_storeu_ps(r + 12, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+				return res;
+			}
+
+			inline matrix<4, float> simd_inverse_affine(const matrix<4, float>& m)
+			{
+				const float* p = &m.a.x;
+				__m128 a = _mm_loadu_ps(p + 0);
+				__m128 b = _mm_loadu_ps(p + 4);
+				__m128 c = _mm_loadu_ps(p + 8);
+				__m128 t = _mm_loadu_ps(p + 12);
+
+				// cross(u, v) = u.yzx * v.zxy - u.zxy * v.yzx; w stays 0
+				auto cross = [](__m128 u, __m128 v)
+				{
+					return _mm_sub_ps(
+						_mm_mul_ps(_mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))),
+						_mm_mul_ps(_mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1))));
+				};
+				__m128 r0 = cross(b, c);
+				__m128 r1 = cross(c, a);
+				__m128 r2 = cross(a, b);
+
+				__m128 det = _mm_mul_ps(a, r0);
+				det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+				det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+				__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+				r0 = _mm_mul_ps(r0, inv_det);
+				r1 = _mm_mul_ps(r1, inv_det);
+				r2 = _mm_mul_ps(r2, inv_det);
+
+				__m128 r3 = _mm_setzero_ps();
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+				__m128 tr = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)));
+				tr = _mm_add_ps(tr, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+				tr = _mm_add_ps(tr, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+
+				matrix<4, float> res(uninitialized);
+				float* r = &res.a.x;
+				_mm_storeu_ps(r + 0, r0);
+				_mm_storeu_ps(r + 4, r1);
+				_mm_storeu_ps(r + 8, r2);
+				_mm_storeu_ps(r + 12, _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), tr));
+				return res;
+			}
+
+			inline matrix<4, float> simd_inverse_rigid(const matrix<4, float>& m)
+			{
+				const float* p = &m.a.x;
+				__m128 r0 = _mm_loadu_ps(p + 0);
+				__m128 r1 = _mm_loadu_ps(p + 4);
+				__m128 r2 = _mm_loadu_ps(p + 8);
+				__m128 t = _mm_loadu_ps(p + 12);
+
+				// w of the rotation columns is 0, so the transpose leaves w = 0 in the first three
+				// columns and the fourth column is all zero
+				__m128 r3 = _mm_setzero_ps();
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+				__m128 tr = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)));
+				tr = _mm_add_ps(tr, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+				tr = _mm_add_ps(tr, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+
+				matrix<4, float> res(uninitialized);
+				float* r = &res.a.x;
+				_mm_storeu_ps(r + 0, r0);
+				_mm_storeu_ps(r + 4, r1);
+				_mm_storeu_ps(r + 8, r2);
+				_mm_storeu_ps(r + 12, _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), tr));
+				return res;
+			}
 		}
 	}
 
+	inline namespace XM_SIMD_ABI
+	{
+		constexpr matrix<4, float> inverse(const matrix<4, float>& m, float& det) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::inverse<4, float>(m, det);
+			return detail::simd_inverse(m, det);
+		}
+
+		constexpr matrix<4, float> inverse(const matrix<4, float>& m) noexcept
+		{
+			float det = 0.0f;
+			return inverse(m, det);
+		}
 
+		constexpr matrix<4, float> inverse_affine(const matrix<4, float>& m) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::inverse_affine<float>(m);
+			return detail::simd_inverse_affine(m);
+		}
 
-}
\ No newline at end of file
+		constexpr matrix<4, float> inverse_rigid(const matrix<4, float>& m) noexcept
+		{
+			if (detail::is_constant_evaluated()) return xm::inverse_rigid<float>(m);
+			return detail::simd_inverse_rigid(m);
+		}
+	}
+#endif
+}
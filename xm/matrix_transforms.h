@@ -2,16 +2,18 @@
 
 #include <cmath>
 #include "matrix.h"
+#include "quaternion.h"
+#include "sincos.h"
 #include <tuple>
 
 
 namespace xm
 {
 	template <uint8_t N, typename T>
-	matrix<N, T> eulRotZ(T radians)
+	constexpr matrix<N, T> eulRotZ(T radians) noexcept
 	{
-		T cos_theta = cos(radians);
-		T sin_theta = sin(radians);
+		T sin_theta = T(0), cos_theta = T(0);
+		sincos(radians, sin_theta, cos_theta);
 		if constexpr (N == 4)
 		{
 			vector<4, T> a(cos_theta, sin_theta, 0.0, 0.0);
@@ -38,10 +40,10 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	matrix<N, T> eulRotX(T radians)
+	constexpr matrix<N, T> eulRotX(T radians) noexcept
 	{
-		T cos_theta = cos(radians);
-		T sin_theta = sin(radians);
+		T sin_theta = T(0), cos_theta = T(0);
+		sincos(radians, sin_theta, cos_theta);
 		if constexpr (N == 4)
 		{
 			vector<4, T> a(1.0, 0.0, 0.0, 0.0);
@@ -68,10 +70,10 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	matrix<N, T> eulRotY(T radians)
+	constexpr matrix<N, T> eulRotY(T radians) noexcept
 	{
-		T cos_theta = cos(radians);
-		T sin_theta = sin(radians);
+		T sin_theta = T(0), cos_theta = T(0);
+		sincos(radians, sin_theta, cos_theta);
 		if constexpr (N == 4)
 		{
 			vector<4, T> a(cos_theta, 0.0, -sin_theta, 0.0);
@@ -100,10 +102,10 @@ namespace xm
 
 	// axis must be unit vector
 	template <uint8_t N, typename T>
-	matrix<N, T> rodriguesMatrix(vector<3, T> axis, T radians)
+	constexpr matrix<N, T> rodriguesMatrix(vector<3, T> axis, T radians) noexcept
 	{
-		T s = sin(radians);
-		T c = cos(radians);
+		T s = T(0), c = T(0);
+		sincos(radians, s, c);
 		T ic = 1 - c;
 		if constexpr (N == 3)
 		{
@@ -167,11 +169,177 @@ namespace xm
 
 	}
 
+	namespace detail
+	{
+		// rotation matrix with the columns a, b, c (and w = 0, plus (0, 0, 0, 1) for N = 4)
+		template <uint8_t N, typename T>
+		constexpr matrix<N, T> rotation_from_columns(vector<3, T> a, vector<3, T> b, vector<3, T> c) noexcept
+		{
+			if constexpr (N == 3)
+			{
+				return matrix<3, T>(a, b, c);
+			}
+			else if constexpr (N == 4)
+			{
+				return matrix<4, T>(
+					vector<4, T>(a.x, a.y, a.z, T(0)),
+					vector<4, T>(b.x, b.y, b.z, T(0)),
+					vector<4, T>(c.x, c.y, c.z, T(0)),
+					vector<4, T>(T(0), T(0), T(0), T(1)));
+			}
+			else
+			{
+				static_assert(false && "N must be 3 or 4");
+			}
+		}
+
+		// One Newton-Schulz step c <- c (3 I - c^T c) / 2 towards the orthogonal polar factor
+		// of the 3x3 matrix with the columns c[0], c[1], c[2]. T is a scalar or a pack.
+		template <typename T>
+		constexpr void orthonormalize_step(T (&c)[3][3]) noexcept
+		{
+			// 3 / 2 I - c^T c / 2 from the dot products of the columns
+			T a[3][3] = {};
+			for (uint8_t i = 0; i < 3; ++i)
+			{
+				for (uint8_t j = i; j < 3; ++j)
+				{
+					T s = c[i][0] * c[j][0] + c[i][1] * c[j][1] + c[i][2] * c[j][2];
+					a[i][j] = s * T(-0.5);
+					a[j][i] = a[i][j];
+				}
+				a[i][i] = a[i][i] + T(1.5);
+			}
+
+			T res[3][3] = {};
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				for (uint8_t k = 0; k < 3; ++k)
+				{
+					res[j][k] = mul_add(c[2][k], a[2][j], mul_add(c[1][k], a[1][j], c[0][k] * a[0][j]));
+				}
+			}
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				for (uint8_t k = 0; k < 3; ++k) c[j][k] = res[j][k];
+			}
+		}
+
+		// Product of the three eulRot matrices in the given order, multiplied out: three
+		// sincos and a few dozen multiplies instead of two matrix products.
+		template <uint8_t N, euler_order O, typename T>
+		constexpr matrix<N, T> euler_matrix(vector<3, T> e) noexcept
+		{
+			T sx = T(0), cx = T(0), sy = T(0), cy = T(0), sz = T(0), cz = T(0);
+			sincos(e.x, sx, cx);
+			sincos(e.y, sy, cy);
+			sincos(e.z, sz, cz);
+
+			if constexpr (O == euler_order::xyz)
+			{
+				return rotation_from_columns<N>(
+					vector<3, T>(cy * cz, cy * sz, -sy),
+					vector<3, T>(sx * sy * cz - cx * sz, sx * sy * sz + cx * cz, sx * cy),
+					vector<3, T>(cx * sy * cz + sx * sz, cx * sy * sz - sx * cz, cx * cy));
+			}
+			else if constexpr (O == euler_order::xzy)
+			{
+				return rotation_from_columns<N>(
+					vector<3, T>(cy * cz, sz, -sy * cz),
+					vector<3, T>(sx * sy - cx * cy * sz, cx * cz, cx * sy * sz + sx * cy),
+					vector<3, T>(cx * sy + sx * cy * sz, -sx * cz, cx * cy - sx * sy * sz));
+			}
+			else if constexpr (O == euler_order::yxz)
+			{
+				return rotation_from_columns<N>(
+					vector<3, T>(cy * cz - sx * sy * sz, cy * sz + sx * sy * cz, -cx * sy),
+					vector<3, T>(-cx * sz, cx * cz, sx),
+					vector<3, T>(sy * cz + sx * cy * sz, sy * sz - sx * cy * cz, cx * cy));
+			}
+			else if constexpr (O == euler_order::yzx)
+			{
+				return rotation_from_columns<N>(
+					vector<3, T>(cy * cz, cx * cy * sz + sx * sy, sx * cy * sz - cx * sy),
+					vector<3, T>(-sz, cx * cz, sx * cz),
+					vector<3, T>(sy * cz, cx * sy * sz - sx * cy, cx * cy + sx * sy * sz));
+			}
+			else if constexpr (O == euler_order::zxy)
+			{
+				return rotation_from_columns<N>(
+					vector<3, T>(cy * cz + sx * sy * sz, cx * sz, sx * cy * sz - sy * cz),
+					vector<3, T>(sx * sy * cz - cy * sz, cx * cz, sy * sz + sx * cy * cz),
+					vector<3, T>(cx * sy, -sx, cx * cy));
+			}
+			else
+			{
+				return rotation_from_columns<N>(
+					vector<3, T>(cy * cz, cx * sz + sx * sy * cz, sx * sz - cx * sy * cz),
+					vector<3, T>(-cy * sz, cx * cz - sx * sy * sz, sx * cz + cx * sy * sz),
+					vector<3, T>(sy, -sx * cy, cx * cy));
+			}
+		}
+	}
+
+	// Rotation matrices from Euler angles e = (x, y, z) in radians, named by the order the
+	// rotations are applied in:
+	//	eulRotXYZ<N>(e) == eulRotZ<N>(e.z) * eulRotY<N>(e.y) * eulRotX<N>(e.x),
+	// the matrix of quat_from_euler_xyz(e)
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRotXYZ(vector<3, T> e) noexcept
+	{
+		return detail::euler_matrix<N, euler_order::xyz>(e);
+	}
+
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRotXZY(vector<3, T> e) noexcept
+	{
+		return detail::euler_matrix<N, euler_order::xzy>(e);
+	}
+
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRotYXZ(vector<3, T> e) noexcept
+	{
+		return detail::euler_matrix<N, euler_order::yxz>(e);
+	}
+
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRotYZX(vector<3, T> e) noexcept
+	{
+		return detail::euler_matrix<N, euler_order::yzx>(e);
+	}
+
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRotZXY(vector<3, T> e) noexcept
+	{
+		return detail::euler_matrix<N, euler_order::zxy>(e);
+	}
+
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRotZYX(vector<3, T> e) noexcept
+	{
+		return detail::euler_matrix<N, euler_order::zyx>(e);
+	}
+
+	// the order picked at run time
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> eulRot(vector<3, T> e, euler_order order) noexcept
+	{
+		switch (order)
+		{
+		case euler_order::xyz: return eulRotXYZ<N>(e);
+		case euler_order::xzy: return eulRotXZY<N>(e);
+		case euler_order::yxz: return eulRotYXZ<N>(e);
+		case euler_order::yzx: return eulRotYZX<N>(e);
+		case euler_order::zxy: return eulRotZXY<N>(e);
+		default: return eulRotZYX<N>(e);
+		}
+	}
+
 	// axis		- asix of rotation, must be unit vector
 	// rotated	- rotated vector
 	// radians	- angle in radians
 	template <uint8_t N, typename T>
-	matrix<N, T> rotate(const matrix<N, T>& rotated, vector<3, T> axis, T radians)
+	constexpr matrix<N, T> rotate(const matrix<N, T>& rotated, vector<3, T> axis, T radians) noexcept
 	{
 		if constexpr (N != 3 && N != 4)
 		{
@@ -182,7 +350,7 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	matrix<N, T> scale(const matrix<N, T>& scaled, vector<3, T> scale_vec)
+	constexpr matrix<N, T> scale(const matrix<N, T>& scaled, vector<3, T> scale_vec) noexcept
 	{
 		if constexpr (N == 3)
 		{
@@ -215,18 +383,45 @@ namespace xm
 	}
 
 	template <typename T>
-	matrix<4, T> translate(const matrix<4, T>& translated, vector<3, T> translation)
+	constexpr matrix<4, T> translate(const matrix<4, T>& translated, vector<3, T> translation) noexcept
 	{
 		vector<4, T> last_column(translated.d.x + translation.x, translated.d.y + translation.y, translated.d.z + translation.z, 1.0);
 		return matrix<4, T>(translated.a, translated.b, translated.c, last_column);
 	}
 
+	// Nearest rotation to a matrix that drifted off orthonormal through accumulated products
+	// or integration, i.e. its orthogonal polar factor, by Newton-Schulz steps
+	// m <- m (3 I - m^T m) / 2. A step takes an error e to about 1.5 e^2, so a drift of 1e-3
+	// needs 2 steps for float and 3 for double. Converges while the singular values stay
+	// in (0, sqrt 3); a reflection stays a reflection. For N = 4 only the upper 3x3 changes.
+	template <uint8_t N, typename T>
+	constexpr matrix<N, T> orthonormalize(const matrix<N, T>& m, unsigned iterations = 2) noexcept
+	{
+		static_assert(N == 3 || N == 4, "N must be 3 or 4");
+		T c[3][3] = {};
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			for (uint8_t k = 0; k < 3; ++k) c[j][k] = m[j][k];
+		}
+		for (unsigned it = 0; it < iterations; ++it)
+		{
+			detail::orthonormalize_step(c);
+		}
+
+		matrix<N, T> res = m;
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			for (uint8_t k = 0; k < 3; ++k) res[j][k] = c[j][k];
+		}
+		return res;
+	}
+
 	// eye_pos	-	view position
 	// look_dir	-	direction of view, must be unit 
 	// world_up -	world up vector, must be unit
 	// return	-	tuple [view matrix, right vector, up vector]
 	template <typename T>
-	std::tuple<matrix<4, T>, vector<3, T>, vector<3, T>> lookAtRH(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> world_up)
+	constexpr std::tuple<matrix<4, T>, vector<3, T>, vector<3, T>> lookAtRH(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> world_up) noexcept
 	{
 		vector<3, T> x = crossRH(world_up, -look_dir);
 		vector<3, T> y = crossRH(-look_dir, x);
@@ -246,7 +441,7 @@ namespace xm
 	// eye_right	-	view right direcion, must be unit
 	// return		-	tuple [view matrix, right vector, up vector]
 	template <typename T>
-	matrix<4, T> lookAtRH_EXT(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> eye_up, vector<3, T> eye_right)
+	constexpr matrix<4, T> lookAtRH_EXT(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> eye_up, vector<3, T> eye_right) noexcept
 	{
 		vector<3, T> x = eye_right;
 		vector<3, T> y = eye_up;
@@ -265,7 +460,7 @@ namespace xm
 	// world_up -	world up vector, must be unit
 	// return	-	tuple [view matrix, right vector, up vector]
 	template <typename T>
-	std::tuple<matrix<4, T>, vector<3, T>, vector<3, T>> lookAtLH(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> world_up)
+	constexpr std::tuple<matrix<4, T>, vector<3, T>, vector<3, T>> lookAtLH(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> world_up) noexcept
 	{
 		vector<3, T> x = crossLH(world_up, -look_dir);
 		vector<3, T> y = crossLH(-look_dir, x);
@@ -285,9 +480,9 @@ namespace xm
 	// eye_right	-	view right direcion, must be unit
 	// return		-	tuple [view matrix, right vector, up vector]
 	template <typename T>
-	matrix<4, T> lookAtLH_EXT(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> eye_up, vector<3, T> eye_right)
+	constexpr matrix<4, T> lookAtLH_EXT(vector<3, T> eye_pos, vector<3, T> look_dir, vector<3, T> eye_up, vector<3, T> eye_right) noexcept
 	{
-		lookAtRH_EXT(eye_pos, -look_dir, eye_up, eye_right);
+		return lookAtRH_EXT(eye_pos, -look_dir, eye_up, eye_right);
 	}
 
 	// eye_pos	-	view position
@@ -295,14 +490,14 @@ namespace xm
 	// world_up -	world up vector, must be unit
 	// return	-	tuple [view matrix, right vector, up vector]
 	template <typename T>
-	inline std::tuple<matrix<4, T>, vector<3, T>, vector<3, T>> lookAt(vector<3, T> eye_pos, vector<3, T> center, vector<3, T> world_up = vector<3, T>(0.0, 1.0, 0.0))
+	constexpr std::tuple<matrix<4, T>, vector<3, T>, vector<3, T>> lookAt(vector<3, T> eye_pos, vector<3, T> center, vector<3, T> world_up = vector<3, T>(0.0, 1.0, 0.0)) noexcept
 	{
 		vector<3, T> look_dir = center - eye_pos;
 		return lookAtRH(eye_pos, look_dir, world_up);
 	}
 
 	template <typename T>
-	matrix<4, T> perspectiveLH_EXT(T top, T bottom, T right, T left, T near, T far)
+	constexpr matrix<4, T> perspectiveLH_EXT(T top, T bottom, T right, T left, T near, T far) noexcept
 	{
 		T _2n = 2 * near;
 		T r_minus_l = right - left;
@@ -322,7 +517,7 @@ namespace xm
 	}
 
 	template <typename T>
-	inline matrix<4, T> perspectiveRH_EXT(T top, T bottom, T right, T left, T near, T far)
+	constexpr matrix<4, T> perspectiveRH_EXT(T top, T bottom, T right, T left, T near, T far) noexcept
 	{
 		T _2n = 2 * near;
 		T r_minus_l = right - left;
@@ -342,7 +537,7 @@ namespace xm
 	}
 
 	template <typename T>
-	matrix<4, T> perspectiveLH_STRIP(T top, T right, T near, T far)
+	constexpr matrix<4, T> perspectiveLH_STRIP(T top, T right, T near, T far) noexcept
 	{
 		T n_minus_f = near - far;
 		vector<4, T> a(near / right, 0.0, 0.0, 0.0);
@@ -354,7 +549,7 @@ namespace xm
 	}
 
 	template <typename T>
-	inline matrix<4, T> perspectiveRH_STRIP(T top, T right, T near, T far)
+	constexpr matrix<4, T> perspectiveRH_STRIP(T top, T right, T near, T far) noexcept
 	{
 		T n_minus_f = near - far;
 		vector<4, T> a(near / right, 0.0, 0.0, 0.0);
@@ -366,31 +561,31 @@ namespace xm
 	}
 
 	template <typename T>
-	matrix<4, T> perspectiveLH_FOV(T fov_vert_radians, T aspect, T near, T far)
+	constexpr matrix<4, T> perspectiveLH_FOV(T fov_vert_radians, T aspect, T near, T far) noexcept
 	{
-		T top = tan(fov_vert_radians / 2) * near;
+		T top = constexpr_tan(fov_vert_radians / 2) * near;
 		T right = top * aspect;
 
 		return perspectiveLH_STRIP(top, right, near, far);
 	}
 
 	template <typename T>
-	inline matrix<4, T> perspectiveRH_FOV(T fov_vert_radians, T aspect, T near, T far)
+	constexpr matrix<4, T> perspectiveRH_FOV(T fov_vert_radians, T aspect, T near, T far) noexcept
 	{
-		T top = tan(fov_vert_radians / 2) * near;
+		T top = constexpr_tan(fov_vert_radians / 2) * near;
 		T right = top * aspect;
 
 		return perspectiveRH_STRIP(top, right, near, far);
 	}
 
 	template <typename T>
-	inline matrix<4, T> perspective(T fov_vert_radians, T aspect, T near, T far)
+	constexpr matrix<4, T> perspective(T fov_vert_radians, T aspect, T near, T far) noexcept
 	{
 		return perspectiveRH_FOV(fov_vert_radians, aspect, near, far);
 	}
 
 	template <typename T>
-	matrix<4, T> orthographicLH_EXT(T top, T bottom, T right, T left, T near, T far)
+	constexpr matrix<4, T> orthographicLH_EXT(T top, T bottom, T right, T left, T near, T far) noexcept
 	{
 		T t_minus_b = top - bottom;
 		T n_minus_f = near - far;
@@ -409,7 +604,7 @@ namespace xm
 	}
 
 	template <typename T>
-	matrix<4, T> orthographicLH_STRIP(T top, T right, T near, T far)
+	constexpr matrix<4, T> orthographicLH_STRIP(T top, T right, T near, T far) noexcept
 	{
 		T n_minus_f = near - far;
 
@@ -422,7 +617,7 @@ namespace xm
 	}
 
 	template <typename T>
-	inline matrix<4, T> orthographicRH_EXT(T top, T bottom, T right, T left, T near, T far)
+	constexpr matrix<4, T> orthographicRH_EXT(T top, T bottom, T right, T left, T near, T far) noexcept
 	{
 		T t_minus_b = top - bottom;
 		T n_minus_f = near - far;
@@ -441,7 +636,7 @@ namespace xm
 	}
 
 	template <typename T>
-	inline matrix<4, T> orthographicRH_STRIP(T top, T right, T near, T far)
+	constexpr matrix<4, T> orthographicRH_STRIP(T top, T right, T near, T far) noexcept
 	{
 		T n_minus_f = near - far;
 
@@ -454,7 +649,7 @@ namespace xm
 	}
 
 	template <typename T>
-	inline matrix<4, T> orthographic(T top, T bottom, T right, T left, T near, T far)
+	constexpr matrix<4, T> orthographic(T top, T bottom, T right, T left, T near, T far) noexcept
 	{
 		return orthographicRH_EXT(top, bottom, right, left, near, far);
 	}
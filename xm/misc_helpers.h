@@ -1,5 +1,8 @@
 #pragma once
 
+#include <memory>
+#include <type_traits>
+#include <utility>
 #include "vector.h"
 #include "matrix.h"
 #include "quaternion.h"
@@ -17,4 +20,43 @@ namespace xm
 	{
 		return &(a[0].x);
 	}
-}
\ No newline at end of file
+
+	// Allocator that value-initializes (resize, the size constructor of std::vector) with
+	// uninitialized instead of a zero fill, for bulk buffers of vectors, matrices,
+	// quaternions and affine3 that are written before they are read:
+	//
+	//	std::vector<mat4, uninitialized_allocator<mat4>> world(count);
+	template <typename T>
+	struct uninitialized_allocator : std::allocator<T>
+	{
+		template <typename U>
+		struct rebind
+		{
+			using other = uninitialized_allocator<U>;
+		};
+
+		uninitialized_allocator() = default;
+
+		template <typename U>
+		uninitialized_allocator(const uninitialized_allocator<U>&) noexcept {}
+
+		template <typename U>
+		void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>)
+		{
+			if constexpr (std::is_constructible_v<U, uninitialized_t>)
+			{
+				::new (static_cast<void*>(p)) U(uninitialized);
+			}
+			else
+			{
+				::new (static_cast<void*>(p)) U;
+			}
+		}
+
+		template <typename U, typename... Args>
+		void construct(U* p, Args&&... args)
+		{
+			::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+		}
+	};
+}
@@ -0,0 +1,733 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include "simd.h"
+
+namespace xm
+{
+	// the pack overloads below would otherwise hide the scalar ones inside xm
+	using std::sqrt;
+	using std::sin;
+	using std::cos;
+	using std::tan;
+	using std::asin;
+	using std::acos;
+	using std::atan;
+	using std::atan2;
+
+	inline namespace XM_SIMD_ABI
+	{
+		// W lanes of T that are processed by one instruction where the target has
+		// registers that wide, and by a plain loop otherwise.
+		template <typename T, uint8_t W>
+		struct pack
+		{
+			using value_type = T;
+			static constexpr uint8_t width = W;
+
+			pack() = default;
+
+			pack(T a)
+			{
+				for (uint8_t i = 0; i < W; ++i) lane[i] = a;
+			}
+
+			static pack load(const T* p)
+			{
+				pack res;
+				for (uint8_t i = 0; i < W; ++i) res.lane[i] = p[i];
+				return res;
+			}
+
+			static pack loadu(const T* p)
+			{
+				return load(p);
+			}
+
+			void store(T* p) const
+			{
+				for (uint8_t i = 0; i < W; ++i) p[i] = lane[i];
+			}
+
+			void storeu(T* p) const
+			{
+				store(p);
+			}
+
+			T& operator[](uint8_t i)
+			{
+				return lane[i];
+			}
+
+			T operator[](uint8_t i) const
+			{
+				return lane[i];
+			}
+
+			alignas(W * sizeof(T)) T lane[W];
+		};
+
+		template <typename T, uint8_t W>
+		pack<T, W> operator+(pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] += b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> operator-(pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] -= b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> operator*(pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] *= b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> operator/(pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] /= b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> operator-(pack<T, W> a)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = -a.lane[i];
+			return a;
+		}
+
+		// a * b + c
+		template <typename T, uint8_t W>
+		pack<T, W> mul_add(pack<T, W> a, pack<T, W> b, pack<T, W> c)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = a.lane[i] * b.lane[i] + c.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> sqrt(pack<T, W> a)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = std::sqrt(a.lane[i]);
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> min(pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = b.lane[i] < a.lane[i] ? b.lane[i] : a.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack<T, W> max(pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = a.lane[i] < b.lane[i] ? b.lane[i] : a.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		inline pack<T, W>& operator+=(pack<T, W>& a, pack<T, W> b)
+		{
+			return a = a + b;
+		}
+
+		template <typename T, uint8_t W>
+		inline pack<T, W>& operator-=(pack<T, W>& a, pack<T, W> b)
+		{
+			return a = a - b;
+		}
+
+		template <typename T, uint8_t W>
+		inline pack<T, W>& operator*=(pack<T, W>& a, pack<T, W> b)
+		{
+			return a = a * b;
+		}
+
+		template <typename T, uint8_t W>
+		inline pack<T, W>& operator/=(pack<T, W>& a, pack<T, W> b)
+		{
+			return a = a / b;
+		}
+
+		// scalar on one side, e.g. 2 * p or p > 0.5
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator+(pack<T, W> a, typename pack<T, W>::value_type b) { return a + pack<T, W>(b); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator+(typename pack<T, W>::value_type a, pack<T, W> b) { return pack<T, W>(a) + b; }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator-(pack<T, W> a, typename pack<T, W>::value_type b) { return a - pack<T, W>(b); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator-(typename pack<T, W>::value_type a, pack<T, W> b) { return pack<T, W>(a) - b; }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator*(pack<T, W> a, typename pack<T, W>::value_type b) { return a * pack<T, W>(b); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator*(typename pack<T, W>::value_type a, pack<T, W> b) { return pack<T, W>(a) * b; }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator/(pack<T, W> a, typename pack<T, W>::value_type b) { return a / pack<T, W>(b); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> operator/(typename pack<T, W>::value_type a, pack<T, W> b) { return pack<T, W>(a) / b; }
+
+		// Per lane result of a comparison, consumed by select, any and all. The overloads
+		// below also take bool, so generic code can branch per lane with select instead of if.
+		template <typename T, uint8_t W>
+		struct pack_mask
+		{
+			bool lane[W];
+		};
+
+#define XM_PACK_COMPARE(op) \
+		template <typename T, uint8_t W> \
+		pack_mask<T, W> operator op(pack<T, W> a, pack<T, W> b) \
+		{ \
+			pack_mask<T, W> res; \
+			for (uint8_t i = 0; i < W; ++i) res.lane[i] = a.lane[i] op b.lane[i]; \
+			return res; \
+		} \
+		template <typename T, uint8_t W> \
+		inline auto operator op(pack<T, W> a, typename pack<T, W>::value_type b) { return a op pack<T, W>(b); } \
+		template <typename T, uint8_t W> \
+		inline auto operator op(typename pack<T, W>::value_type a, pack<T, W> b) { return pack<T, W>(a) op b; }
+
+		XM_PACK_COMPARE(<)
+		XM_PACK_COMPARE(<=)
+		XM_PACK_COMPARE(>)
+		XM_PACK_COMPARE(>=)
+		XM_PACK_COMPARE(==)
+		XM_PACK_COMPARE(!=)
+#undef XM_PACK_COMPARE
+
+		template <typename T, uint8_t W>
+		pack_mask<T, W> operator&(pack_mask<T, W> a, pack_mask<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = a.lane[i] && b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack_mask<T, W> operator|(pack_mask<T, W> a, pack_mask<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = a.lane[i] || b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		pack_mask<T, W> operator!(pack_mask<T, W> a)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = !a.lane[i];
+			return a;
+		}
+
+		// lane i of a where m is set, of b otherwise
+		template <typename T, uint8_t W>
+		pack<T, W> select(pack_mask<T, W> m, pack<T, W> a, pack<T, W> b)
+		{
+			for (uint8_t i = 0; i < W; ++i) a.lane[i] = m.lane[i] ? a.lane[i] : b.lane[i];
+			return a;
+		}
+
+		template <typename T, uint8_t W>
+		bool any(pack_mask<T, W> m)
+		{
+			bool res = false;
+			for (uint8_t i = 0; i < W; ++i) res = res || m.lane[i];
+			return res;
+		}
+
+		template <typename T, uint8_t W>
+		bool all(pack_mask<T, W> m)
+		{
+			bool res = true;
+			for (uint8_t i = 0; i < W; ++i) res = res && m.lane[i];
+			return res;
+		}
+
+		// lane i of m in bit i
+		template <typename T, uint8_t W>
+		uint32_t bitmask(pack_mask<T, W> m)
+		{
+			uint32_t res = 0;
+			for (uint8_t i = 0; i < W; ++i) res |= uint32_t(m.lane[i]) << i;
+			return res;
+		}
+
+		template <typename T>
+		constexpr std::enable_if_t<std::is_arithmetic_v<T>, T> select(bool m, T a, T b) noexcept
+		{
+			return m ? a : b;
+		}
+
+		// a * b + c, so the same polynomial code runs on scalars and packs
+		template <typename T>
+		constexpr std::enable_if_t<std::is_arithmetic_v<T>, T> mul_add(T a, T b, T c) noexcept
+		{
+			return a * b + c;
+		}
+
+		constexpr bool any(bool m) noexcept
+		{
+			return m;
+		}
+
+		constexpr bool all(bool m) noexcept
+		{
+			return m;
+		}
+
+		inline uint32_t bitmask(bool m)
+		{
+			return m;
+		}
+
+		// f applied to every lane, for the functions that have no vector instruction
+		template <typename T, uint8_t W, typename F>
+		pack<T, W> map_lanes(pack<T, W> a, F f)
+		{
+			alignas(64) T tmp[W];
+			a.storeu(tmp);
+			for (uint8_t i = 0; i < W; ++i) tmp[i] = f(tmp[i]);
+			return pack<T, W>::loadu(tmp);
+		}
+
+		template <typename T, uint8_t W>
+		inline pack<T, W> sin(pack<T, W> a) { return map_lanes(a, [](T x) { return std::sin(x); }); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> cos(pack<T, W> a) { return map_lanes(a, [](T x) { return std::cos(x); }); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> tan(pack<T, W> a) { return map_lanes(a, [](T x) { return std::tan(x); }); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> asin(pack<T, W> a) { return map_lanes(a, [](T x) { return std::asin(x); }); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> acos(pack<T, W> a) { return map_lanes(a, [](T x) { return std::acos(x); }); }
+		template <typename T, uint8_t W>
+		inline pack<T, W> atan(pack<T, W> a) { return map_lanes(a, [](T x) { return std::atan(x); }); }
+
+		template <typename T, uint8_t W>
+		pack<T, W> atan2(pack<T, W> y, pack<T, W> x)
+		{
+			alignas(64) T ty[W];
+			alignas(64) T tx[W];
+			y.storeu(ty);
+			x.storeu(tx);
+			for (uint8_t i = 0; i < W; ++i) ty[i] = std::atan2(ty[i], tx[i]);
+			return pack<T, W>::loadu(ty);
+		}
+
+		// widest pack the target handles in one register
+		template <typename T>
+		constexpr uint8_t native_width = XM_AVX512 ? 64 / sizeof(T) : XM_AVX ? 32 / sizeof(T) : 16 / sizeof(T);
+
+		template <typename T>
+		using native_pack = pack<T, native_width<T>>;
+
+#if XM_SSE2
+		template <>
+		struct pack<float, 4>
+		{
+			using value_type = float;
+			static constexpr uint8_t width = 4;
+
+			pack() = default;
+			pack(__m128 v) : v(v) {}
+			pack(float a) : v(_mm_set1_ps(a)) {}
+
+			static pack load(const float* p) { return _mm_load_ps(p); }
+			static pack loadu(const float* p) { return _mm_loadu_ps(p); }
+			void store(float* p) const { _mm_store_ps(p, v); }
+			void storeu(float* p) const { _mm_storeu_ps(p, v); }
+
+			float operator[](uint8_t i) const
+			{
+				alignas(16) float tmp[4];
+				_mm_store_ps(tmp, v);
+				return tmp[i];
+			}
+
+			__m128 v;
+		};
+
+		inline pack<float, 4> operator+(pack<float, 4> a, pack<float, 4> b) { return _mm_add_ps(a.v, b.v); }
+		inline pack<float, 4> operator-(pack<float, 4> a, pack<float, 4> b) { return _mm_sub_ps(a.v, b.v); }
+		inline pack<float, 4> operator*(pack<float, 4> a, pack<float, 4> b) { return _mm_mul_ps(a.v, b.v); }
+		inline pack<float, 4> operator/(pack<float, 4> a, pack<float, 4> b) { return _mm_div_ps(a.v, b.v); }
+		inline pack<float, 4> operator-(pack<float, 4> a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+		inline pack<float, 4> sqrt(pack<float, 4> a) { return _mm_sqrt_ps(a.v); }
+		inline pack<float, 4> min(pack<float, 4> a, pack<float, 4> b) { return _mm_min_ps(a.v, b.v); }
+		inline pack<float, 4> max(pack<float, 4> a, pack<float, 4> b) { return _mm_max_ps(a.v, b.v); }
+
+		inline pack<float, 4> mul_add(pack<float, 4> a, pack<float, 4> b, pack<float, 4> c)
+		{
+#if XM_FMA
+			return _mm_fmadd_ps(a.v, b.v, c.v);
+#else
+			return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v);
+#endif
+		}
+
+		template <>
+		struct pack_mask<float, 4>
+		{
+			pack_mask(__m128 v) : v(v) {}
+
+			__m128 v;
+		};
+
+		inline pack_mask<float, 4> operator<(pack<float, 4> a, pack<float, 4> b) { return _mm_cmplt_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator<=(pack<float, 4> a, pack<float, 4> b) { return _mm_cmple_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator>(pack<float, 4> a, pack<float, 4> b) { return _mm_cmpgt_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator>=(pack<float, 4> a, pack<float, 4> b) { return _mm_cmpge_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator==(pack<float, 4> a, pack<float, 4> b) { return _mm_cmpeq_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator!=(pack<float, 4> a, pack<float, 4> b) { return _mm_cmpneq_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator&(pack_mask<float, 4> a, pack_mask<float, 4> b) { return _mm_and_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator|(pack_mask<float, 4> a, pack_mask<float, 4> b) { return _mm_or_ps(a.v, b.v); }
+		inline pack_mask<float, 4> operator!(pack_mask<float, 4> a) { return _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+		inline pack<float, 4> select(pack_mask<float, 4> m, pack<float, 4> a, pack<float, 4> b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+		inline bool any(pack_mask<float, 4> m) { return _mm_movemask_ps(m.v) != 0; }
+		inline bool all(pack_mask<float, 4> m) { return _mm_movemask_ps(m.v) == 0xF; }
+		inline uint32_t bitmask(pack_mask<float, 4> m) { return uint32_t(_mm_movemask_ps(m.v)); }
+
+		template <>
+		struct pack<double, 2>
+		{
+			using value_type = double;
+			static constexpr uint8_t width = 2;
+
+			pack() = default;
+			pack(__m128d v) : v(v) {}
+			pack(double a) : v(_mm_set1_pd(a)) {}
+
+			static pack load(const double* p) { return _mm_load_pd(p); }
+			static pack loadu(const double* p) { return _mm_loadu_pd(p); }
+			void store(double* p) const { _mm_store_pd(p, v); }
+			void storeu(double* p) const { _mm_storeu_pd(p, v); }
+
+			double operator[](uint8_t i) const
+			{
+				alignas(16) double tmp[2];
+				_mm_store_pd(tmp, v);
+				return tmp[i];
+			}
+
+			__m128d v;
+		};
+
+		inline pack<double, 2> operator+(pack<double, 2> a, pack<double, 2> b) { return _mm_add_pd(a.v, b.v); }
+		inline pack<double, 2> operator-(pack<double, 2> a, pack<double, 2> b) { return _mm_sub_pd(a.v, b.v); }
+		inline pack<double, 2> operator*(pack<double, 2> a, pack<double, 2> b) { return _mm_mul_pd(a.v, b.v); }
+		inline pack<double, 2> operator/(pack<double, 2> a, pack<double, 2> b) { return _mm_div_pd(a.v, b.v); }
+		inline pack<double, 2> operator-(pack<double, 2> a) { return _mm_xor_pd(a.v, _mm_set1_pd(-0.0)); }
+		inline pack<double, 2> sqrt(pack<double, 2> a) { return _mm_sqrt_pd(a.v); }
+		inline pack<double, 2> min(pack<double, 2> a, pack<double, 2> b) { return _mm_min_pd(a.v, b.v); }
+		inline pack<double, 2> max(pack<double, 2> a, pack<double, 2> b) { return _mm_max_pd(a.v, b.v); }
+
+		inline pack<double, 2> mul_add(pack<double, 2> a, pack<double, 2> b, pack<double, 2> c)
+		{
+#if XM_FMA
+			return _mm_fmadd_pd(a.v, b.v, c.v);
+#else
+			return _mm_add_pd(_mm_mul_pd(a.v, b.v), c.v);
+#endif
+		}
+
+		template <>
+		struct pack_mask<double, 2>
+		{
+			pack_mask(__m128d v) : v(v) {}
+
+			__m128d v;
+		};
+
+		inline pack_mask<double, 2> operator<(pack<double, 2> a, pack<double, 2> b) { return _mm_cmplt_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator<=(pack<double, 2> a, pack<double, 2> b) { return _mm_cmple_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator>(pack<double, 2> a, pack<double, 2> b) { return _mm_cmpgt_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator>=(pack<double, 2> a, pack<double, 2> b) { return _mm_cmpge_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator==(pack<double, 2> a, pack<double, 2> b) { return _mm_cmpeq_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator!=(pack<double, 2> a, pack<double, 2> b) { return _mm_cmpneq_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator&(pack_mask<double, 2> a, pack_mask<double, 2> b) { return _mm_and_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator|(pack_mask<double, 2> a, pack_mask<double, 2> b) { return _mm_or_pd(a.v, b.v); }
+		inline pack_mask<double, 2> operator!(pack_mask<double, 2> a) { return _mm_xor_pd(a.v, _mm_castsi128_pd(_mm_set1_epi32(-1))); }
+		inline pack<double, 2> select(pack_mask<double, 2> m, pack<double, 2> a, pack<double, 2> b) { return _mm_or_pd(_mm_and_pd(m.v, a.v), _mm_andnot_pd(m.v, b.v)); }
+		inline bool any(pack_mask<double, 2> m) { return _mm_movemask_pd(m.v) != 0; }
+		inline bool all(pack_mask<double, 2> m) { return _mm_movemask_pd(m.v) == 0x3; }
+		inline uint32_t bitmask(pack_mask<double, 2> m) { return uint32_t(_mm_movemask_pd(m.v)); }
+#endif
+
+#if XM_AVX
+		template <>
+		struct pack<float, 8>
+		{
+			using value_type = float;
+			static constexpr uint8_t width = 8;
+
+			pack() = default;
+			pack(__m256 v) : v(v) {}
+			pack(float a) : v(_mm256_set1_ps(a)) {}
+
+			static pack load(const float* p) { return _mm256_load_ps(p); }
+			static pack loadu(const float* p) { return _mm256_loadu_ps(p); }
+			void store(float* p) const { _mm256_store_ps(p, v); }
+			void storeu(float* p) const { _mm256_storeu_ps(p, v); }
+
+			float operator[](uint8_t i) const
+			{
+				alignas(32) float tmp[8];
+				_mm256_store_ps(tmp, v);
+				return tmp[i];
+			}
+
+			__m256 v;
+		};
+
+		inline pack<float, 8> operator+(pack<float, 8> a, pack<float, 8> b) { return _mm256_add_ps(a.v, b.v); }
+		inline pack<float, 8> operator-(pack<float, 8> a, pack<float, 8> b) { return _mm256_sub_ps(a.v, b.v); }
+		inline pack<float, 8> operator*(pack<float, 8> a, pack<float, 8> b) { return _mm256_mul_ps(a.v, b.v); }
+		inline pack<float, 8> operator/(pack<float, 8> a, pack<float, 8> b) { return _mm256_div_ps(a.v, b.v); }
+		inline pack<float, 8> operator-(pack<float, 8> a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+		inline pack<float, 8> sqrt(pack<float, 8> a) { return _mm256_sqrt_ps(a.v); }
+		inline pack<float, 8> min(pack<float, 8> a, pack<float, 8> b) { return _mm256_min_ps(a.v, b.v); }
+		inline pack<float, 8> max(pack<float, 8> a, pack<float, 8> b) { return _mm256_max_ps(a.v, b.v); }
+
+		inline pack<float, 8> mul_add(pack<float, 8> a, pack<float, 8> b, pack<float, 8> c)
+		{
+#if XM_FMA
+			return _mm256_fmadd_ps(a.v, b.v, c.v);
+#else
+			return _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v);
+#endif
+		}
+
+		template <>
+		struct pack_mask<float, 8>
+		{
+			pack_mask(__m256 v) : v(v) {}
+
+			__m256 v;
+		};
+
+		inline pack_mask<float, 8> operator<(pack<float, 8> a, pack<float, 8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+		inline pack_mask<float, 8> operator<=(pack<float, 8> a, pack<float, 8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+		inline pack_mask<float, 8> operator>(pack<float, 8> a, pack<float, 8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+		inline pack_mask<float, 8> operator>=(pack<float, 8> a, pack<float, 8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+		inline pack_mask<float, 8> operator==(pack<float, 8> a, pack<float, 8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+		inline pack_mask<float, 8> operator!=(pack<float, 8> a, pack<float, 8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ); }
+		inline pack_mask<float, 8> operator&(pack_mask<float, 8> a, pack_mask<float, 8> b) { return _mm256_and_ps(a.v, b.v); }
+		inline pack_mask<float, 8> operator|(pack_mask<float, 8> a, pack_mask<float, 8> b) { return _mm256_or_ps(a.v, b.v); }
+		inline pack_mask<float, 8> operator!(pack_mask<float, 8> a) { return _mm256_xor_ps(a.v, _mm256_cmp_ps(a.v, a.v, _CMP_TRUE_UQ)); }
+		inline pack<float, 8> select(pack_mask<float, 8> m, pack<float, 8> a, pack<float, 8> b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+		inline bool any(pack_mask<float, 8> m) { return _mm256_movemask_ps(m.v) != 0; }
+		inline bool all(pack_mask<float, 8> m) { return _mm256_movemask_ps(m.v) == 0xFF; }
+		inline uint32_t bitmask(pack_mask<float, 8> m) { return uint32_t(_mm256_movemask_ps(m.v)); }
+
+		template <>
+		struct pack<double, 4>
+		{
+			using value_type = double;
+			static constexpr uint8_t width = 4;
+
+			pack() = default;
+			pack(__m256d v) : v(v) {}
+			pack(double a) : v(_mm256_set1_pd(a)) {}
+
+			static pack load(const double* p) { return _mm256_load_pd(p); }
+			static pack loadu(const double* p) { return _mm256_loadu_pd(p); }
+			void store(double* p) const { _mm256_store_pd(p, v); }
+			void storeu(double* p) const { _mm256_storeu_pd(p, v); }
+
+			double operator[](uint8_t i) const
+			{
+				alignas(32) double tmp[4];
+				_mm256_store_pd(tmp, v);
+				return tmp[i];
+			}
+
+			__m256d v;
+		};
+
+		inline pack<double, 4> operator+(pack<double, 4> a, pack<double, 4> b) { return _mm256_add_pd(a.v, b.v); }
+		inline pack<double, 4> operator-(pack<double, 4> a, pack<double, 4> b) { return _mm256_sub_pd(a.v, b.v); }
+		inline pack<double, 4> operator*(pack<double, 4> a, pack<double, 4> b) { return _mm256_mul_pd(a.v, b.v); }
+		inline pack<double, 4> operator/(pack<double, 4> a, pack<double, 4> b) { return _mm256_div_pd(a.v, b.v); }
+		inline pack<double, 4> operator-(pack<double, 4> a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+		inline pack<double, 4> sqrt(pack<double, 4> a) { return _mm256_sqrt_pd(a.v); }
+		inline pack<double, 4> min(pack<double, 4> a, pack<double, 4> b) { return _mm256_min_pd(a.v, b.v); }
+		inline pack<double, 4> max(pack<double, 4> a, pack<double, 4> b) { return _mm256_max_pd(a.v, b.v); }
+
+		inline pack<double, 4> mul_add(pack<double, 4> a, pack<double, 4> b, pack<double, 4> c)
+		{
+#if XM_FMA
+			return _mm256_fmadd_pd(a.v, b.v, c.v);
+#else
+			return _mm256_add_pd(_mm256_mul_pd(a.v, b.v), c.v);
+#endif
+		}
+
+		template <>
+		struct pack_mask<double, 4>
+		{
+			pack_mask(__m256d v) : v(v) {}
+
+			__m256d v;
+		};
+
+		inline pack_mask<double, 4> operator<(pack<double, 4> a, pack<double, 4> b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+		inline pack_mask<double, 4> operator<=(pack<double, 4> a, pack<double, 4> b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+		inline pack_mask<double, 4> operator>(pack<double, 4> a, pack<double, 4> b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+		inline pack_mask<double, 4> operator>=(pack<double, 4> a, pack<double, 4> b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ); }
+		inline pack_mask<double, 4> operator==(pack<double, 4> a, pack<double, 4> b) { return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); }
+		inline pack_mask<double, 4> operator!=(pack<double, 4> a, pack<double, 4> b) { return _mm256_cmp_pd(a.v, b.v, _CMP_NEQ_UQ); }
+		inline pack_mask<double, 4> operator&(pack_mask<double, 4> a, pack_mask<double, 4> b) { return _mm256_and_pd(a.v, b.v); }
+		inline pack_mask<double, 4> operator|(pack_mask<double, 4> a, pack_mask<double, 4> b) { return _mm256_or_pd(a.v, b.v); }
+		inline pack_mask<double, 4> operator!(pack_mask<double, 4> a) { return _mm256_xor_pd(a.v, _mm256_cmp_pd(a.v, a.v, _CMP_TRUE_UQ)); }
+		inline pack<double, 4> select(pack_mask<double, 4> m, pack<double, 4> a, pack<double, 4> b) { return _mm256_blendv_pd(b.v, a.v, m.v); }
+		inline bool any(pack_mask<double, 4> m) { return _mm256_movemask_pd(m.v) != 0; }
+		inline bool all(pack_mask<double, 4> m) { return _mm256_movemask_pd(m.v) == 0xF; }
+		inline uint32_t bitmask(pack_mask<double, 4> m) { return uint32_t(_mm256_movemask_pd(m.v)); }
+#endif
+
+#if XM_AVX512
+		template <>
+		struct pack<float, 16>
+		{
+			using value_type = float;
+			static constexpr uint8_t width = 16;
+
+			pack() = default;
+			pack(__m512 v) : v(v) {}
+			pack(float a) : v(_mm512_set1_ps(a)) {}
+
+			static pack load(const float* p) { return _mm512_load_ps(p); }
+			static pack loadu(const float* p) { return _mm512_loadu_ps(p); }
+			void store(float* p) const { _mm512_store_ps(p, v); }
+			void storeu(float* p) const { _mm512_storeu_ps(p, v); }
+
+			float operator[](uint8_t i) const
+			{
+				alignas(64) float tmp[16];
+				_mm512_store_ps(tmp, v);
+				return tmp[i];
+			}
+
+			__m512 v;
+		};
+
+		inline pack<float, 16> operator+(pack<float, 16> a, pack<float, 16> b) { return _mm512_add_ps(a.v, b.v); }
+		inline pack<float, 16> operator-(pack<float, 16> a, pack<float, 16> b) { return _mm512_sub_ps(a.v, b.v); }
+		inline pack<float, 16> operator*(pack<float, 16> a, pack<float, 16> b) { return _mm512_mul_ps(a.v, b.v); }
+		inline pack<float, 16> operator/(pack<float, 16> a, pack<float, 16> b) { return _mm512_div_ps(a.v, b.v); }
+		inline pack<float, 16> operator-(pack<float, 16> a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(int(0x80000000)))); }
+		inline pack<float, 16> sqrt(pack<float, 16> a) { return _mm512_sqrt_ps(a.v); }
+		inline pack<float, 16> min(pack<float, 16> a, pack<float, 16> b) { return _mm512_min_ps(a.v, b.v); }
+		inline pack<float, 16> max(pack<float, 16> a, pack<float, 16> b) { return _mm512_max_ps(a.v, b.v); }
+		inline pack<float, 16> mul_add(pack<float, 16> a, pack<float, 16> b, pack<float, 16> c) { return _mm512_fmadd_ps(a.v, b.v, c.v); }
+
+		template <>
+		struct pack_mask<float, 16>
+		{
+			pack_mask(__mmask16 v) : v(v) {}
+
+			__mmask16 v;
+		};
+
+		inline pack_mask<float, 16> operator<(pack<float, 16> a, pack<float, 16> b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+		inline pack_mask<float, 16> operator<=(pack<float, 16> a, pack<float, 16> b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+		inline pack_mask<float, 16> operator>(pack<float, 16> a, pack<float, 16> b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+		inline pack_mask<float, 16> operator>=(pack<float, 16> a, pack<float, 16> b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ); }
+		inline pack_mask<float, 16> operator==(pack<float, 16> a, pack<float, 16> b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ); }
+		inline pack_mask<float, 16> operator!=(pack<float, 16> a, pack<float, 16> b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_NEQ_UQ); }
+		inline pack_mask<float, 16> operator&(pack_mask<float, 16> a, pack_mask<float, 16> b) { return __mmask16(a.v & b.v); }
+		inline pack_mask<float, 16> operator|(pack_mask<float, 16> a, pack_mask<float, 16> b) { return __mmask16(a.v | b.v); }
+		inline pack_mask<float, 16> operator!(pack_mask<float, 16> a) { return __mmask16(~a.v); }
+		inline pack<float, 16> select(pack_mask<float, 16> m, pack<float, 16> a, pack<float, 16> b) { return _mm512_mask_blend_ps(m.v, b.v, a.v); }
+		inline bool any(pack_mask<float, 16> m) { return m.v != 0; }
+		inline bool all(pack_mask<float, 16> m) { return m.v == 0xFFFF; }
+		inline uint32_t bitmask(pack_mask<float, 16> m) { return m.v; }
+
+		template <>
+		struct pack<double, 8>
+		{
+			using value_type = double;
+			static constexpr uint8_t width = 8;
+
+			pack() = default;
+			pack(__m512d v) : v(v) {}
+			pack(double a) : v(_mm512_set1_pd(a)) {}
+
+			static pack load(const double* p) { return _mm512_load_pd(p); }
+			static pack loadu(const double* p) { return _mm512_loadu_pd(p); }
+			void store(double* p) const { _mm512_store_pd(p, v); }
+			void storeu(double* p) const { _mm512_storeu_pd(p, v); }
+
+			double operator[](uint8_t i) const
+			{
+				alignas(64) double tmp[8];
+				_mm512_store_pd(tmp, v);
+				return tmp[i];
+			}
+
+			__m512d v;
+		};
+
+		inline pack<double, 8> operator+(pack<double, 8> a, pack<double, 8> b) { return _mm512_add_pd(a.v, b.v); }
+		inline pack<double, 8> operator-(pack<double, 8> a, pack<double, 8> b) { return _mm512_sub_pd(a.v, b.v); }
+		inline pack<double, 8> operator*(pack<double, 8> a, pack<double, 8> b) { return _mm512_mul_pd(a.v, b.v); }
+		inline pack<double, 8> operator/(pack<double, 8> a, pack<double, 8> b) { return _mm512_div_pd(a.v, b.v); }
+		inline pack<double, 8> operator-(pack<double, 8> a) { return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a.v), _mm512_set1_epi64(int64_t(0x8000000000000000ull)))); }
+		inline pack<double, 8> sqrt(pack<double, 8> a) { return _mm512_sqrt_pd(a.v); }
+		inline pack<double, 8> min(pack<double, 8> a, pack<double, 8> b) { return _mm512_min_pd(a.v, b.v); }
+		inline pack<double, 8> max(pack<double, 8> a, pack<double, 8> b) { return _mm512_max_pd(a.v, b.v); }
+		inline pack<double, 8> mul_add(pack<double, 8> a, pack<double, 8> b, pack<double, 8> c) { return _mm512_fmadd_pd(a.v, b.v, c.v); }
+
+		template <>
+		struct pack_mask<double, 8>
+		{
+			pack_mask(__mmask8 v) : v(v) {}
+
+			__mmask8 v;
+		};
+
+		inline pack_mask<double, 8> operator<(pack<double, 8> a, pack<double, 8> b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ); }
+		inline pack_mask<double, 8> operator<=(pack<double, 8> a, pack<double, 8> b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ); }
+		inline pack_mask<double, 8> operator>(pack<double, 8> a, pack<double, 8> b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ); }
+		inline pack_mask<double, 8> operator>=(pack<double, 8> a, pack<double, 8> b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GE_OQ); }
+		inline pack_mask<double, 8> operator==(pack<double, 8> a, pack<double, 8> b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ); }
+		inline pack_mask<double, 8> operator!=(pack<double, 8> a, pack<double, 8> b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_NEQ_UQ); }
+		inline pack_mask<double, 8> operator&(pack_mask<double, 8> a, pack_mask<double, 8> b) { return __mmask8(a.v & b.v); }
+		inline pack_mask<double, 8> operator|(pack_mask<double, 8> a, pack_mask<double, 8> b) { return __mmask8(a.v | b.v); }
+		inline pack_mask<double, 8> operator!(pack_mask<double, 8> a) { return __mmask8(~a.v); }
+		inline pack<double, 8> select(pack_mask<double, 8> m, pack<double, 8> a, pack<double, 8> b) { return _mm512_mask_blend_pd(m.v, b.v, a.v); }
+		inline bool any(pack_mask<double, 8> m) { return m.v != 0; }
+		inline bool all(pack_mask<double, 8> m) { return m.v == 0xFF; }
+		inline uint32_t bitmask(pack_mask<double, 8> m) { return m.v; }
+#endif
+	}
+
+	// T of the generic templates is either a scalar or a pack of scalars
+	template <typename T>
+	struct pack_traits
+	{
+		using value_type = T;
+		static constexpr uint8_t width = 1;
+		static constexpr bool is_pack = false;
+	};
+
+	template <typename T, uint8_t W>
+	struct pack_traits<pack<T, W>>
+	{
+		using value_type = T;
+		static constexpr uint8_t width = W;
+		static constexpr bool is_pack = true;
+	};
+
+	template <typename T>
+	using scalar_t = typename pack_traits<T>::value_type;
+
+	template <typename T>
+	constexpr bool is_pack_v = pack_traits<T>::is_pack;
+}
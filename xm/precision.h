@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "pack.h"
+#include "constants.h"
+#include "sincos.h"
+
+namespace xm
+{
+	// Accuracy the functions taking a precision as their first template argument may give
+	// up for speed (normalize<precision::fast>(v), rsqrt<precision::approx>(x)...):
+	//	exact	the std functions, correctly rounded sqrt and division; the same results as
+	//		the overloads without a precision
+	//	fast	a few ulp of float or double, listed at each function
+	//	approx	about 12 bits for float and double alike: relative error below 2^-11, enough
+	//		for culling, particles and anything that ends up as a pixel
+	// The fast and approx paths are for finite arguments; zero, infinities and denormals
+	// give what is listed at each function rather than what exact gives. The speed they buy
+	// is on packs and the batch functions built on them; a single float or double gains
+	// little or nothing, since its selects turn into branches and libm is already quick.
+	enum class precision : uint8_t { exact, fast, approx };
+
+	namespace detail
+	{
+		// coefficients in ascending order for polynomial() of sincos.h
+		template <typename T>
+		struct precision_constants;
+
+		template <>
+		struct precision_constants<float>
+		{
+			// asin s = s + s z p(z), z = s^2 <= 1 / 4 (Cephes asinf)
+			static constexpr float asin_p[5] = { 1.6666752422e-1f, 7.4953002686e-2f, 4.5470025998e-2f, 2.4181311049e-2f, 4.2163199048e-2f };
+			// atan u = u + u z p(z), z = u^2, |u| <= tan(pi / 8) (Cephes atanf)
+			static constexpr float atan_p[4] = { -3.33329491539e-1f, 1.99777106478e-1f, -1.38776856032e-1f, 8.05374449538e-2f };
+			// acos a = sqrt(1 - a) p(a), 0 <= a <= 1 (Abramowitz and Stegun 4.4.45)
+			static constexpr float acos_approx[4] = { 1.5707288f, -0.2121144f, 0.0742610f, -0.0187293f };
+			// atan as above, fitted to a relative error of 7.5e-5
+			static constexpr float atan_approx[2] = { -0.33287015f, 0.17804508f };
+		};
+
+		template <>
+		struct precision_constants<double>
+		{
+			// asin s = s + s z p(z) / q(z), z = s^2 <= 1 / 4 (fdlibm)
+			static constexpr double asin_p[6] = { 1.66666666666666657415e-01, -3.25565818622400915405e-01, 2.01212532134862925881e-01,
+				-4.00555345006794114027e-02, 7.91534994289814532176e-04, 3.47933107596021167570e-05 };
+			static constexpr double asin_q[5] = { 1.0, -2.40339491173441421878e+00, 2.02094576023350569471e+00,
+				-6.88283971605453293030e-01, 7.70381505559019352791e-02 };
+			static constexpr double atan_p[11] = { -3.33333333333329318027e-01, 1.99999999998764832476e-01, -1.42857142725034663711e-01,
+				1.11111104054623557880e-01, -9.09088713343650656196e-02, 7.69187620504482999495e-02, -6.66107313738753120669e-02,
+				5.83357013379057348645e-02, -4.97687799461593236017e-02, 3.65315727442169155270e-02, -1.62858201153657823623e-02 };
+			static constexpr double acos_approx[4] = { 1.5707288, -0.2121144, 0.0742610, -0.0187293 };
+			static constexpr double atan_approx[2] = { -0.33287015110902896, 0.17804508440924025 };
+		};
+
+		constexpr double tan_pi_8 = 0.41421356237309504880;
+
+		// whether sqrt<P> and rsqrt<P> take sqrt and division
+		template <precision P, typename T>
+		constexpr bool exact_sqrt = P == precision::exact || (P == precision::fast && std::is_same_v<scalar_t<T>, double>);
+
+		// one Newton step towards 1 / sqrt(x): y (3 - x y^2) / 2 squares y's relative
+		// error (and multiplies it by 1.5)
+		template <typename T>
+		T rsqrt_newton(T x, T y) noexcept
+		{
+			T h = x * y * T(-0.5);
+			return y * mul_add(h, y, T(1.5));
+		}
+
+		inline namespace XM_SIMD_ABI
+		{
+			// the exponent halved and negated on the bits (relative error 3.4e-2), then two
+			// Newton steps; for the targets without an estimate instruction
+			inline float rsqrt_bits(float x) noexcept
+			{
+				uint32_t i;
+				std::memcpy(&i, &x, sizeof(i));
+				i = 0x5F3759DFu - (i >> 1);
+				float y;
+				std::memcpy(&y, &i, sizeof(y));
+				return rsqrt_newton(x, rsqrt_newton(x, y));
+			}
+
+			inline double rsqrt_bits(double x) noexcept
+			{
+				uint64_t i;
+				std::memcpy(&i, &x, sizeof(i));
+				i = 0x5FE6EB50C7B537A9ull - (i >> 1);
+				double y;
+				std::memcpy(&y, &i, sizeof(y));
+				return rsqrt_newton(x, rsqrt_newton(x, y));
+			}
+
+			// 1 / sqrt(x) to a relative error below 2^-11: the rsqrt instructions where there
+			// is one for the type, rsqrt_bits otherwise
+			inline float rsqrt_estimate(float x) noexcept
+			{
+#if XM_AVX512
+				__m128 v = _mm_set_ss(x);
+				return _mm_cvtss_f32(_mm_rsqrt14_ss(v, v));
+#elif XM_SSE2
+				return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+				return rsqrt_bits(x);
+#endif
+			}
+
+			inline double rsqrt_estimate(double x) noexcept
+			{
+#if XM_AVX512
+				__m128d v = _mm_set_sd(x);
+				return _mm_cvtsd_f64(_mm_rsqrt14_sd(v, v));
+#else
+				return rsqrt_bits(x);
+#endif
+			}
+
+			template <typename T, uint8_t W>
+			pack<T, W> rsqrt_estimate(pack<T, W> x) noexcept
+			{
+				return map_lanes(x, [](T v) { return rsqrt_estimate(v); });
+			}
+
+#if XM_SSE2
+			inline pack<float, 4> rsqrt_estimate(pack<float, 4> x) noexcept
+			{
+				return _mm_rsqrt_ps(x.v);
+			}
+
+			inline pack<double, 2> rsqrt_estimate(pack<double, 2> x) noexcept
+			{
+				__m128i i = _mm_sub_epi64(_mm_set1_epi64x(0x5FE6EB50C7B537A9ll), _mm_srli_epi64(_mm_castpd_si128(x.v), 1));
+				pack<double, 2> y = _mm_castsi128_pd(i);
+				return rsqrt_newton(x, rsqrt_newton(x, y));
+			}
+#endif
+
+#if XM_AVX
+			inline pack<float, 8> rsqrt_estimate(pack<float, 8> x) noexcept
+			{
+				return _mm256_rsqrt_ps(x.v);
+			}
+#endif
+
+#if XM_AVX2
+			inline pack<double, 4> rsqrt_estimate(pack<double, 4> x) noexcept
+			{
+				__m256i i = _mm256_sub_epi64(_mm256_set1_epi64x(0x5FE6EB50C7B537A9ll), _mm256_srli_epi64(_mm256_castpd_si256(x.v), 1));
+				pack<double, 4> y = _mm256_castsi256_pd(i);
+				return rsqrt_newton(x, rsqrt_newton(x, y));
+			}
+#endif
+
+#if XM_AVX512
+			inline pack<float, 16> rsqrt_estimate(pack<float, 16> x) noexcept
+			{
+				return _mm512_rsqrt14_ps(x.v);
+			}
+
+			inline pack<double, 8> rsqrt_estimate(pack<double, 8> x) noexcept
+			{
+				return _mm512_rsqrt14_pd(x.v);
+			}
+#endif
+		}
+
+		// asin s for 0 <= s <= 1 / 2, z = s^2
+		template <typename T>
+		T asin_small(T s, T z) noexcept
+		{
+			using K = precision_constants<scalar_t<T>>;
+			if constexpr (std::is_same_v<scalar_t<T>, double>)
+			{
+				return mul_add(s, z * polynomial(z, K::asin_p) / polynomial(z, K::asin_q), s);
+			}
+			else
+			{
+				return mul_add(s * z, polynomial(z, K::asin_p), s);
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// 1 / sqrt(x) for x > 0. fast is the estimate refined by one Newton step for float;
+		// double would need three, which measured slower than sqrt and a division, so fast
+		// double is exact. approx is the estimate alone. Largest error measured over 2^22
+		// arguments spread across the exponent range:
+		//	fast	float 3.8 ulp (2 ulp with AVX-512)
+		//	approx	relative 3.3e-4 for float with SSE and AVX, 6e-5 with AVX-512 and
+		//		4.7e-6 on the rsqrt_bits path (double before AVX-512, float without SIMD)
+		// fast and approx give NaN for 0 and infinity.
+		template <precision P, typename T>
+		T rsqrt(T x) noexcept
+		{
+			if constexpr (detail::exact_sqrt<P, T>)
+			{
+				return T(1) / xm::sqrt(x);
+			}
+			else
+			{
+				T y = detail::rsqrt_estimate(x);
+				if constexpr (P == precision::fast)
+				{
+					y = detail::rsqrt_newton(x, y);
+				}
+				return y;
+			}
+		}
+
+		// x times rsqrt<P>(x), which is quicker than sqrt where sqrt isn't pipelined; 0
+		// stays 0. Error as rsqrt<P> plus one rounding: fast float 3.9 ulp.
+		template <precision P, typename T>
+		T sqrt(T x) noexcept
+		{
+			if constexpr (detail::exact_sqrt<P, T>)
+			{
+				return xm::sqrt(x);
+			}
+			else
+			{
+				return select(x == T(0), x, x * rsqrt<P>(x));
+			}
+		}
+
+		// acos x for -1 <= x <= 1 without a call per lane: fast reduces to asin on
+		// [0, 1 / 2] (Cephes, fdlibm), approx is the Abramowitz and Stegun polynomial
+		// times sqrt<precision::approx>, whose factor keeps the error relative up to x = 1.
+		// Largest error measured over 2^22 arguments, half of them 2^-40 to 1 away from +-1:
+		//	fast	float 1.3 ulp, double 1.2 ulp
+		//	approx	relative 3.8e-4 with SSE and AVX (most of it the square root), 1.1e-4
+		//		with AVX-512, 5.3e-5 on the rsqrt_bits path; absolute 4.3e-4 at most
+		template <precision P, typename T>
+		T acos(T x) noexcept
+		{
+			if constexpr (P == precision::exact)
+			{
+				return xm::acos(x);
+			}
+			else if constexpr (P == precision::fast)
+			{
+				// |x| > 1 / 2: acos |x| = 2 asin sqrt((1 - |x|) / 2), otherwise acos x = pi / 2 - asin x
+				T a = select(x < T(0), -x, x);
+				auto large = a > T(0.5);
+				T z = select(large, mul_add(a, T(-0.5), T(0.5)), a * a);
+				T s = select(large, xm::sqrt(z), a);
+				T r = detail::asin_small(s, z);
+				T twice = r + r;
+				T res_large = select(x < T(0), T(PI) - twice, twice);
+				T res_small = T(HALF_PI) - select(x < T(0), -r, r);
+				return select(large, res_large, res_small);
+			}
+			else
+			{
+				T a = select(x < T(0), -x, x);
+				T r = sqrt<P>(T(1) - a) * detail::polynomial(a, detail::precision_constants<scalar_t<T>>::acos_approx);
+				return select(x < T(0), T(PI) - r, r);
+			}
+		}
+
+		// atan2 y / x without a call per lane: the smaller of |x| and |y| over the larger,
+		// moved into [-tan(pi / 8), tan(pi / 8)] by the atan addition formula, one polynomial
+		// and the octant put back. atan2(0, 0) is 0 and the sign of a zero y is not looked at.
+		// Largest error measured over 2^22 arguments, worst of the builds without SIMD and
+		// with SSE2, AVX2 (FMA) and AVX-512:
+		//	fast	float 2.9 ulp, double 2.5 ulp
+		//	approx	relative 7.5e-5
+		template <precision P, typename T>
+		T atan2(T y, T x) noexcept
+		{
+			if constexpr (P == precision::exact)
+			{
+				return xm::atan2(y, x);
+			}
+			else
+			{
+				using K = detail::precision_constants<scalar_t<T>>;
+				T ax = select(x < T(0), -x, x);
+				T ay = select(y < T(0), -y, y);
+				T hi = select(ax < ay, ay, ax), lo = select(ax < ay, ax, ay);
+
+				// lo / hi, or (lo - hi) / (lo + hi) = tan(atan(lo / hi) - pi / 4) above tan(pi / 8)
+				auto above = lo > hi * T(detail::tan_pi_8);
+				T u = select(above, lo - hi, lo) / select(above, lo + hi, hi);
+				T z = u * u;
+				T p;
+				if constexpr (P == precision::fast)
+				{
+					p = detail::polynomial(z, K::atan_p);
+				}
+				else
+				{
+					p = detail::polynomial(z, K::atan_approx);
+				}
+				T r = mul_add(u * z, p, u);
+
+				r = select(above, r + T(PI / 4), r);
+				r = select(ay > ax, T(HALF_PI) - r, r);
+				r = select(x < T(0), T(PI) - r, r);
+				r = select(y < T(0), -r, r);
+				return select(hi == T(0), T(0), r);
+			}
+		}
+	}
+}
@@ -0,0 +1,801 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "vector.h"
+#include "quaternion.h"
+#include "vector_stream.h"
+
+// Compact storage types for float data that needs less precision than it is computed with,
+// with scalar and batch conversions to and from vector<N, float> and quaternion<float>.
+// Worst case errors of a round trip (encode then decode, the angles measured over 10^6
+// random directions and rotations):
+//
+//	half_vector<N>       2N bytes  IEEE binary16, round to nearest even: relative 2^-11
+//	                               (4.9e-4) from 6.1e-5 to 65504, absolute 3e-8 below;
+//	                               65520 and more become infinity
+//	snorm16_vector<N>    2N bytes  [-1, 1] in 65535 steps: absolute 1.53e-5, clamped outside
+//	octahedral_normal    4 bytes   unit vectors on the octahedron, two snorm16: 6.5e-5 radians
+//	quaternion32         4 bytes   unit quaternions, smallest three: index of the largest
+//	                               component and the other three in 10 bits each: 1.9e-3 per
+//	                               component, 4.4e-3 radians of rotation
+//	quaternion48         6 bytes   as quaternion32 with 15 bits per component: 5.8e-5 per
+//	                               component, 1.4e-4 radians of rotation
+//
+// q and -q are the same rotation, so decoded quaternions may come back negated.
+
+namespace xm
+{
+	struct half
+	{
+		uint16_t bits;
+	};
+
+	template <uint8_t N>
+	struct half_vector
+	{
+		half v[N];
+	};
+
+	template <uint8_t N>
+	struct snorm16_vector
+	{
+		int16_t v[N];
+	};
+
+	struct octahedral_normal
+	{
+		int16_t u, v;
+	};
+
+	struct quaternion32
+	{
+		uint32_t bits;	// index << 30 | a << 20 | b << 10 | c
+	};
+
+	struct quaternion48
+	{
+		uint16_t bits[3];	// index bit 1 | a, index bit 0 | b, c
+	};
+
+	using hvec2 = half_vector<2>;
+	using hvec3 = half_vector<3>;
+	using hvec4 = half_vector<4>;
+
+	static_assert(sizeof(half_vector<3>) == 6 && sizeof(snorm16_vector<3>) == 6);
+	static_assert(sizeof(octahedral_normal) == 4 && sizeof(quaternion32) == 4 && sizeof(quaternion48) == 6);
+
+	// Bit exact binary16 conversions without hardware support (F. Giesen). Relies on float
+	// additions rounding to nearest even and denormals not being flushed to zero.
+	inline half to_half(float f)
+	{
+		uint32_t x;
+		std::memcpy(&x, &f, 4);
+		uint32_t sign = x & 0x80000000u;
+		x ^= sign;
+
+		uint16_t res;
+		if (x >= (127u + 16) << 23)
+		{
+			// infinity or NaN, NaN stays quiet
+			res = x > 255u << 23 ? 0x7E00 : 0x7C00;
+		}
+		else if (x < 113u << 23)
+		{
+			// zero or denormal half: a magic addend aligns the 10 mantissa bits at the bottom
+			const uint32_t magic_bits = ((127u - 15) + (23 - 10) + 1) << 23;
+			float magic, y;
+			std::memcpy(&magic, &magic_bits, 4);
+			std::memcpy(&y, &x, 4);
+			y += magic;
+			std::memcpy(&x, &y, 4);
+			res = uint16_t(x - magic_bits);
+		}
+		else
+		{
+			// rebias the exponent and round to nearest even
+			uint32_t odd = (x >> 13) & 1;
+			x += ((15u - 127) << 23) + 0xFFF + odd;
+			res = uint16_t(x >> 13);
+		}
+		return half{ uint16_t(res | (sign >> 16)) };
+	}
+
+	inline float to_float(half h)
+	{
+		const uint32_t shifted_exponent = 0x7C00u << 13;
+		uint32_t x = (h.bits & 0x7FFFu) << 13;
+		uint32_t exponent = x & shifted_exponent;
+		x += (127u - 15) << 23;
+
+		float res;
+		if (exponent == shifted_exponent)
+		{
+			// infinity or NaN
+			x += (128u - 16) << 23;
+			std::memcpy(&res, &x, 4);
+		}
+		else if (exponent == 0)
+		{
+			// zero or denormal: renormalize
+			x += 1u << 23;
+			const uint32_t magic_bits = 113u << 23;
+			float magic;
+			std::memcpy(&magic, &magic_bits, 4);
+			std::memcpy(&res, &x, 4);
+			res -= magic;
+		}
+		else
+		{
+			std::memcpy(&res, &x, 4);
+		}
+		uint32_t bits;
+		std::memcpy(&bits, &res, 4);
+		bits |= uint32_t(h.bits & 0x8000u) << 16;
+		std::memcpy(&res, &bits, 4);
+		return res;
+	}
+
+	namespace detail
+	{
+		// round half away from zero, for values well inside the int32_t range
+		inline int32_t round_to_int(float x)
+		{
+			return int32_t(x + (x < 0.0f ? -0.5f : 0.5f));
+		}
+
+		constexpr float snorm16_scale = 32767.0f;
+		constexpr float sqrt1_2 = 0.70710678118654752f;
+
+		inline int16_t to_snorm16(float x)
+		{
+			x = x < -1.0f ? -1.0f : x > 1.0f ? 1.0f : x;
+			return int16_t(round_to_int(x * snorm16_scale));
+		}
+
+		inline float from_snorm16(int16_t x)
+		{
+			float res = float(x) * (1.0f / snorm16_scale);
+			return res < -1.0f ? -1.0f : res;
+		}
+
+		// the smallest three components of a unit quaternion, [-1/sqrt(2), 1/sqrt(2)], in
+		// Bits bits each
+		template <uint8_t Bits>
+		inline uint32_t to_unorm_component(float x)
+		{
+			constexpr float max = float((1u << Bits) - 1);
+			float u = (x * sqrt1_2 + 0.5f) * max;
+			u = u < 0.0f ? 0.0f : u > max ? max : u;
+			return uint32_t(u + 0.5f);
+		}
+
+		template <uint8_t Bits>
+		inline float from_unorm_component(uint32_t u)
+		{
+			constexpr float max = float((1u << Bits) - 1);
+			return (float(u) * (2.0f / max) - 1.0f) * sqrt1_2;
+		}
+
+		inline uint32_t bits_of_quaternion32(float index, const float (&q)[3])
+		{
+			return uint32_t(index) << 30 | to_unorm_component<10>(q[0]) << 20 | to_unorm_component<10>(q[1]) << 10 | to_unorm_component<10>(q[2]);
+		}
+
+		inline void from_quaternion32(quaternion32 p, float& index, float (&q)[3])
+		{
+			index = float(p.bits >> 30);
+			q[0] = from_unorm_component<10>((p.bits >> 20) & 0x3FF);
+			q[1] = from_unorm_component<10>((p.bits >> 10) & 0x3FF);
+			q[2] = from_unorm_component<10>(p.bits & 0x3FF);
+		}
+
+		inline quaternion48 bits_of_quaternion48(float index, const float (&q)[3])
+		{
+			uint32_t i = uint32_t(index);
+			return quaternion48{ { uint16_t((i >> 1) << 15 | to_unorm_component<15>(q[0])),
+				uint16_t((i & 1) << 15 | to_unorm_component<15>(q[1])),
+				uint16_t(to_unorm_component<15>(q[2])) } };
+		}
+
+		inline void from_quaternion48(quaternion48 p, float& index, float (&q)[3])
+		{
+			index = float((p.bits[0] >> 15) << 1 | p.bits[1] >> 15);
+			q[0] = from_unorm_component<15>(p.bits[0] & 0x7FFF);
+			q[1] = from_unorm_component<15>(p.bits[1] & 0x7FFF);
+			q[2] = from_unorm_component<15>(p.bits[2] & 0x7FFF);
+		}
+
+		inline namespace XM_SIMD_ABI
+		{
+			// The encodings below are written once for V = float and V = pack<float, W>; every
+			// lane takes its own path through select.
+
+			template <typename V>
+			inline V abs_of(V x)
+			{
+				return select(x < V(0.0f), -x, x);
+			}
+
+			// unit vector -> point u, v in [-1, 1]^2 of the unfolded octahedron
+			template <typename V>
+			inline void octahedral_encode(V x, V y, V z, V& u, V& v)
+			{
+				V inv_l1 = V(1.0f) / (abs_of(x) + abs_of(y) + abs_of(z));
+				V px = x * inv_l1, py = y * inv_l1;
+				// the lower half folds over the diagonals
+				V fx = (V(1.0f) - abs_of(py)) * select(px < V(0.0f), V(-1.0f), V(1.0f));
+				V fy = (V(1.0f) - abs_of(px)) * select(py < V(0.0f), V(-1.0f), V(1.0f));
+				auto lower = z < V(0.0f);
+				u = select(lower, fx, px);
+				v = select(lower, fy, py);
+			}
+
+			template <typename V>
+			inline void octahedral_decode(V u, V v, V& x, V& y, V& z)
+			{
+				V nz = V(1.0f) - abs_of(u) - abs_of(v);
+				V t = select(nz < V(0.0f), -nz, V(0.0f));
+				V nx = u + select(u < V(0.0f), t, -t);
+				V ny = v + select(v < V(0.0f), t, -t);
+				V inv_len = V(1.0f) / sqrt(nx * nx + ny * ny + nz * nz);
+				x = nx * inv_len;
+				y = ny * inv_len;
+				z = nz * inv_len;
+			}
+
+			// w, x, y, z -> index of the largest magnitude component and the other three in
+			// order, negated if needed so the dropped one is positive
+			template <typename V>
+			inline void smallest_three_encode(V w, V x, V y, V z, V& index, V (&q)[3])
+			{
+				V largest = abs_of(w);
+				index = V(0.0f);
+				const V a[3] = { abs_of(x), abs_of(y), abs_of(z) };
+				for (uint8_t c = 0; c < 3; ++c)
+				{
+					auto bigger = a[c] > largest;
+					largest = select(bigger, a[c], largest);
+					index = select(bigger, V(float(c + 1)), index);
+				}
+
+				V dropped = select(index < V(0.5f), w, select(index < V(1.5f), x, select(index < V(2.5f), y, z)));
+				V sign = select(dropped < V(0.0f), V(-1.0f), V(1.0f));
+				q[0] = select(index < V(0.5f), x, w) * sign;
+				q[1] = select(index < V(1.5f), y, x) * sign;
+				q[2] = select(index < V(2.5f), z, y) * sign;
+			}
+
+			template <typename V>
+			inline void smallest_three_decode(V index, const V (&q)[3], V& w, V& x, V& y, V& z)
+			{
+				V rest = V(1.0f) - (q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+				V d = sqrt(select(rest < V(0.0f), V(0.0f), rest));
+				w = select(index < V(0.5f), d, q[0]);
+				x = select(index < V(0.5f), q[0], select(index < V(1.5f), d, q[1]));
+				y = select(index < V(1.5f), q[1], select(index < V(2.5f), d, q[2]));
+				z = select(index < V(2.5f), q[2], d);
+				V inv_len = V(1.0f) / sqrt(w * w + x * x + y * y + z * z);
+				w = w * inv_len;
+				x = x * inv_len;
+				y = y * inv_len;
+				z = z * inv_len;
+			}
+
+			// The integer steps of the batch encoders: truncate rounds toward zero as a cast to
+			// int32_t does but keeps a float, so that whole numbers can be shifted and added
+			// exactly in float arithmetic; store_or converts two packs that way and stores
+			// their bitwise or, store_int16 converts one and narrows it.
+			template <uint8_t W>
+			inline pack<float, W> truncate(pack<float, W> x)
+			{
+				for (uint8_t k = 0; k < W; ++k) x.lane[k] = float(int32_t(x.lane[k]));
+				return x;
+			}
+
+			template <uint8_t W>
+			inline void store_or(pack<float, W> a, pack<float, W> b, uint32_t* out)
+			{
+				for (uint8_t k = 0; k < W; ++k) out[k] = uint32_t(int32_t(a.lane[k])) | uint32_t(int32_t(b.lane[k]));
+			}
+
+			template <uint8_t W>
+			inline void store_int16(pack<float, W> x, int16_t* out)
+			{
+				for (uint8_t k = 0; k < W; ++k) out[k] = int16_t(int32_t(x.lane[k]));
+			}
+
+#if XM_SSE2
+			inline pack<float, 4> truncate(pack<float, 4> x)
+			{
+				return _mm_cvtepi32_ps(_mm_cvttps_epi32(x.v));
+			}
+
+			inline void store_or(pack<float, 4> a, pack<float, 4> b, uint32_t* out)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_or_si128(_mm_cvttps_epi32(a.v), _mm_cvttps_epi32(b.v)));
+			}
+
+			inline void store_int16(pack<float, 4> x, int16_t* out)
+			{
+				__m128i i = _mm_cvttps_epi32(x.v);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(i, i));
+			}
+#endif
+#if XM_AVX
+			inline pack<float, 8> truncate(pack<float, 8> x)
+			{
+				return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(x.v));
+			}
+
+			// the or on the float side: AVX has no 256 bit integer or
+			inline void store_or(pack<float, 8> a, pack<float, 8> b, uint32_t* out)
+			{
+				__m256 bits = _mm256_or_ps(_mm256_castsi256_ps(_mm256_cvttps_epi32(a.v)), _mm256_castsi256_ps(_mm256_cvttps_epi32(b.v)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_castps_si256(bits));
+			}
+
+			inline void store_int16(pack<float, 8> x, int16_t* out)
+			{
+				__m256i i = _mm256_cvttps_epi32(x.v);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extractf128_si256(i, 1)));
+			}
+#endif
+#if XM_AVX512
+			inline pack<float, 16> truncate(pack<float, 16> x)
+			{
+				return _mm512_cvtepi32_ps(_mm512_cvttps_epi32(x.v));
+			}
+
+			inline void store_or(pack<float, 16> a, pack<float, 16> b, uint32_t* out)
+			{
+				_mm512_storeu_si512(out, _mm512_or_si512(_mm512_cvttps_epi32(a.v), _mm512_cvttps_epi32(b.v)));
+			}
+
+			inline void store_int16(pack<float, 16> x, int16_t* out)
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(x.v)));
+			}
+#endif
+
+			// to_snorm16 before its cast: clamped, scaled and moved half a step away from zero
+			template <typename P>
+			inline P snorm16_unrounded(P x)
+			{
+				x = min(max(x, P(-1.0f)), P(1.0f)) * P(snorm16_scale);
+				return x + select(x < P(0.0f), P(-0.5f), P(0.5f));
+			}
+
+			// to_unorm_component of every lane, as a whole number
+			template <uint8_t Bits, typename P>
+			inline P unorm_component(P x)
+			{
+				const P top(float((1u << Bits) - 1));
+				P u = (x * P(sqrt1_2) + P(0.5f)) * top;
+				return truncate(min(max(u, P(0.0f)), top) + P(0.5f));
+			}
+
+			// bits_of_quaternion32 of every lane. The index and the first two components take
+			// 22 bits, which a float holds exactly, shifted up by 10; an index of 2 or 3 goes in
+			// as -2 or -1, which keeps the int32_t in range and gives the same bits.
+			template <typename P>
+			inline void store_quaternion32(P index, const P (&q)[3], uint32_t* out)
+			{
+				P i = select(index > P(1.5f), index - P(4.0f), index);
+				P high = ((i * P(1024.0f) + unorm_component<10>(q[0])) * P(1024.0f) + unorm_component<10>(q[1])) * P(1024.0f);
+				store_or(high, unorm_component<10>(q[2]), out);
+			}
+
+			// bits_of_quaternion48 of every lane: bits[0] and bits[1] as the low and high half
+			// of low, bits[2] in third. Index bit 0 becomes the sign of the int32_t of
+			// bits[1] shifted up by 16, so it goes in as -32768.
+			template <typename P>
+			inline void store_quaternion48(P index, const P (&q)[3], uint32_t* low, uint32_t* third)
+			{
+				auto upper = index > P(1.5f);
+				P odd = index - select(upper, P(2.0f), P(0.0f));
+				P first = select(upper, P(32768.0f), P(0.0f)) + unorm_component<15>(q[0]);
+				P second = select(odd > P(0.5f), P(-32768.0f), P(0.0f)) + unorm_component<15>(q[1]);
+				store_or(first, second * P(65536.0f), low);
+				store_or(unorm_component<15>(q[2]), P(0.0f), third);
+			}
+
+			// count floats <-> halves, both contiguous
+			inline void to_half(const float* in, half* out, size_t count)
+			{
+				size_t i = 0;
+#if XM_AVX512
+				for (; i + 16 <= count; i += 16)
+				{
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_cvtps_ph(_mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+				}
+#endif
+#if XM_F16C
+				for (; i + 8 <= count; i += 8)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+				}
+#endif
+				for (; i < count; ++i) out[i] = xm::to_half(in[i]);
+			}
+
+			inline void to_float(const half* in, float* out, size_t count)
+			{
+				size_t i = 0;
+#if XM_AVX512
+				for (; i + 16 <= count; i += 16)
+				{
+					_mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))));
+				}
+#endif
+#if XM_F16C
+				for (; i + 8 <= count; i += 8)
+				{
+					_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+				}
+#endif
+				for (; i < count; ++i) out[i] = xm::to_float(in[i]);
+			}
+
+			// count floats <-> snorm16, both contiguous; all but the copy of a last partial
+			// pack runs in packs
+			inline void to_snorm16(const float* in, int16_t* out, size_t count)
+			{
+				using P = native_pack<float>;
+				for_each_pack<float>(count, [&](size_t i, uint8_t n)
+					{
+						P x = snorm16_unrounded(load_scalars<P>(in + i, n));
+						if (n == P::width)
+						{
+							store_int16(x, out + i);
+							return;
+						}
+						alignas(64) int16_t tmp[P::width];
+						store_int16(x, tmp);
+						std::memcpy(out + i, tmp, n * sizeof(int16_t));
+					});
+			}
+
+			inline void from_snorm16(const int16_t* in, float* out, size_t count)
+			{
+				using P = native_pack<float>;
+				for_each_pack<float>(count, [&](size_t i, uint8_t n)
+					{
+						alignas(64) float tmp[P::width] = {};
+						for (uint8_t k = 0; k < n; ++k) tmp[k] = float(in[i + k]);
+						P x = max(P::load(tmp) * P(1.0f / snorm16_scale), P(-1.0f));
+						store_scalars(x, out + i, n);
+					});
+			}
+
+			constexpr size_t flat_block = 4096;
+
+			// Runs convert(flat, i, n) over in, with flat pointing at the N * n floats of
+			// vectors i to i + n: the input itself, flat_block vectors at a time, when it is
+			// a contiguous span of vector<N, float>, else a buffer filled a pack at a time.
+			template <typename In, typename F>
+			void with_flat_input(const In& in, F&& convert)
+			{
+				using P = native_pack<float>;
+				constexpr uint8_t N = In::components;
+				if constexpr (std::is_same_v<In, vector_span<N, const float>> || std::is_same_v<In, vector_span<N, float>>)
+				{
+					if (in.stride == N * sizeof(float))
+					{
+						const float* flat = reinterpret_cast<const float*>(in.base);
+						for (size_t i = 0; i < in.size(); i += flat_block)
+						{
+							convert(flat + i * N, i, std::min(in.size() - i, flat_block));
+						}
+						return;
+					}
+				}
+				for_each_pack<float>(in.size(), [&](size_t i, uint8_t n)
+					{
+						alignas(64) float tmp[P::width * N];
+						vector_span<N, float> buffer(tmp, n, N * sizeof(float));
+						for (uint8_t c = 0; c < N; ++c) buffer.template store<P>(c, 0, in.template load<P>(c, i, n), n);
+						convert(static_cast<const float*>(tmp), i, n);
+					});
+			}
+
+			// as above for an output that convert(flat, i, n) writes
+			template <typename Out, typename F>
+			void with_flat_output(Out& out, size_t count, F&& convert)
+			{
+				using P = native_pack<float>;
+				constexpr uint8_t N = Out::components;
+				if constexpr (std::is_same_v<Out, vector_span<N, float>>)
+				{
+					if (out.stride == N * sizeof(float))
+					{
+						float* flat = reinterpret_cast<float*>(out.base);
+						for (size_t i = 0; i < count; i += flat_block)
+						{
+							convert(flat + i * N, i, std::min(count - i, flat_block));
+						}
+						return;
+					}
+				}
+				for_each_pack<float>(count, [&](size_t i, uint8_t n)
+					{
+						alignas(64) float tmp[P::width * N];
+						convert(tmp, i, n);
+						vector_span<N, const float> buffer(tmp, n, N * sizeof(float));
+						for (uint8_t c = 0; c < N; ++c) out.template store<P>(c, i, buffer.template load<P>(c, 0, n), n);
+					});
+			}
+
+			// smallest three of the quaternions of in, a pack at a time: pack(i, n, index, q)
+			// for quaternions i to i + n
+			template <typename In, typename F>
+			void encode_smallest_three(const In& in, F&& pack)
+			{
+				using P = native_pack<float>;
+				static_assert(In::components == 4 && std::is_same_v<stream_value<In>, float>);
+				for_each_pack<float>(in.size(), [&](size_t i, uint8_t n)
+					{
+						P index, q[3];
+						smallest_three_encode(in.template load<P>(0, i, n), in.template load<P>(1, i, n),
+							in.template load<P>(2, i, n), in.template load<P>(3, i, n), index, q);
+						pack(i, n, index, q);
+					});
+			}
+
+			// the quaternions unpacked by unpack(i, index, q), count of them, into out
+			template <typename Out, typename F>
+			void decode_smallest_three(size_t count, Out& out, F&& unpack)
+			{
+				using P = native_pack<float>;
+				static_assert(Out::components == 4 && std::is_same_v<stream_value<Out>, float>);
+				prepare_output(out, count);
+				for_each_pack<float>(count, [&](size_t i, uint8_t n)
+					{
+						alignas(64) float ti[P::width] = {}, tq[3][P::width] = {};
+						for (uint8_t k = 0; k < n; ++k)
+						{
+							float rest[3];
+							unpack(i + k, ti[k], rest);
+							for (uint8_t c = 0; c < 3; ++c) tq[c][k] = rest[c];
+						}
+						const P q[3] = { P::load(tq[0]), P::load(tq[1]), P::load(tq[2]) };
+						P w, x, y, z;
+						smallest_three_decode(P::load(ti), q, w, x, y, z);
+						out.template store<P>(0, i, w, n);
+						out.template store<P>(1, i, x, n);
+						out.template store<P>(2, i, y, n);
+						out.template store<P>(3, i, z, n);
+					});
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		template <uint8_t N>
+		half_vector<N> encode_half(const vector<N, float>& v)
+		{
+			half_vector<N> res;
+			for (uint8_t c = 0; c < N; ++c) res.v[c] = to_half(v[c]);
+			return res;
+		}
+
+		template <uint8_t N>
+		vector<N, float> decode(const half_vector<N>& h)
+		{
+			vector<N, float> res;
+			for (uint8_t c = 0; c < N; ++c) res[c] = to_float(h.v[c]);
+			return res;
+		}
+
+		template <uint8_t N>
+		snorm16_vector<N> encode_snorm16(const vector<N, float>& v)
+		{
+			snorm16_vector<N> res;
+			for (uint8_t c = 0; c < N; ++c) res.v[c] = detail::to_snorm16(v[c]);
+			return res;
+		}
+
+		template <uint8_t N>
+		vector<N, float> decode(const snorm16_vector<N>& s)
+		{
+			vector<N, float> res;
+			for (uint8_t c = 0; c < N; ++c) res[c] = detail::from_snorm16(s.v[c]);
+			return res;
+		}
+
+		// n must have unit length
+		inline octahedral_normal encode_octahedral(const vector<3, float>& n)
+		{
+			float u, v;
+			detail::octahedral_encode(n.x, n.y, n.z, u, v);
+			return octahedral_normal{ detail::to_snorm16(u), detail::to_snorm16(v) };
+		}
+
+		inline vector<3, float> decode(octahedral_normal o)
+		{
+			vector<3, float> res;
+			detail::octahedral_decode(detail::from_snorm16(o.u), detail::from_snorm16(o.v), res.x, res.y, res.z);
+			return res;
+		}
+
+		// q must have unit length
+		inline quaternion32 encode_quaternion32(const quaternion<float>& q)
+		{
+			float index, rest[3];
+			detail::smallest_three_encode(q.w, q.m.x, q.m.y, q.m.z, index, rest);
+			return quaternion32{ detail::bits_of_quaternion32(index, rest) };
+		}
+
+		inline quaternion<float> decode(quaternion32 p)
+		{
+			float index, rest[3];
+			detail::from_quaternion32(p, index, rest);
+			quaternion<float> res;
+			detail::smallest_three_decode(index, rest, res.w, res.m.x, res.m.y, res.m.z);
+			return res;
+		}
+
+		inline quaternion48 encode_quaternion48(const quaternion<float>& q)
+		{
+			float index, rest[3];
+			detail::smallest_three_encode(q.w, q.m.x, q.m.y, q.m.z, index, rest);
+			return detail::bits_of_quaternion48(index, rest);
+		}
+
+		inline quaternion<float> decode(quaternion48 p)
+		{
+			float index, rest[3];
+			detail::from_quaternion48(p, index, rest);
+			quaternion<float> res;
+			detail::smallest_three_decode(index, rest, res.w, res.m.x, res.m.y, res.m.z);
+			return res;
+		}
+
+		// Batch conversions between float streams (any vector_stream, vector_span or
+		// vector_lanes, e.g. vector_span<3, const float>(positions, n) over an array of
+		// vec3) and arrays of the packed types. The input stream's size is the count; out
+		// must hold that many elements. Half conversions use F16C or AVX-512 where the
+		// target has them, the other encodings run in packs of native_width<float> lanes.
+
+		template <typename In>
+		detail::if_stream<In> encode_half(const In& in, half_vector<In::components>* out)
+		{
+			static_assert(std::is_same_v<detail::stream_value<In>, float>);
+			constexpr uint8_t N = In::components;
+			detail::with_flat_input(in, [&](const float* flat, size_t i, size_t n)
+				{
+					detail::to_half(flat, out[i].v, n * N);
+				});
+		}
+
+		template <uint8_t N, typename Out>
+		void decode(const half_vector<N>* in, size_t count, Out&& out)
+		{
+			static_assert(std::remove_reference_t<Out>::components == N);
+			detail::prepare_output(out, count);
+			detail::with_flat_output(out, count, [&](float* flat, size_t i, size_t n)
+				{
+					detail::to_float(in[i].v, flat, n * N);
+				});
+		}
+
+		template <typename In>
+		detail::if_stream<In> encode_snorm16(const In& in, snorm16_vector<In::components>* out)
+		{
+			static_assert(std::is_same_v<detail::stream_value<In>, float>);
+			constexpr uint8_t N = In::components;
+			detail::with_flat_input(in, [&](const float* flat, size_t i, size_t n)
+				{
+					detail::to_snorm16(flat, out[i].v, n * N);
+				});
+		}
+
+		template <uint8_t N, typename Out>
+		void decode(const snorm16_vector<N>* in, size_t count, Out&& out)
+		{
+			static_assert(std::remove_reference_t<Out>::components == N);
+			detail::prepare_output(out, count);
+			detail::with_flat_output(out, count, [&](float* flat, size_t i, size_t n)
+				{
+					detail::from_snorm16(in[i].v, flat, n * N);
+				});
+		}
+
+		// in holds unit vectors
+		template <typename In>
+		detail::if_stream<In> encode_octahedral(const In& in, octahedral_normal* out)
+		{
+			using P = native_pack<float>;
+			static_assert(In::components == 3 && std::is_same_v<detail::stream_value<In>, float>);
+			detail::for_each_pack<float>(in.size(), [&](size_t i, uint8_t n)
+				{
+					P u, v;
+					detail::octahedral_encode(in.template load<P>(0, i, n), in.template load<P>(1, i, n), in.template load<P>(2, i, n), u, v);
+					alignas(64) float tu[P::width], tv[P::width];
+					(min(max(u, P(-1.0f)), P(1.0f)) * P(detail::snorm16_scale)).store(tu);
+					(min(max(v, P(-1.0f)), P(1.0f)) * P(detail::snorm16_scale)).store(tv);
+					for (uint8_t k = 0; k < n; ++k)
+					{
+						out[i + k] = octahedral_normal{ int16_t(detail::round_to_int(tu[k])), int16_t(detail::round_to_int(tv[k])) };
+					}
+				});
+		}
+
+		template <typename Out>
+		void decode(const octahedral_normal* in, size_t count, Out&& out)
+		{
+			using P = native_pack<float>;
+			static_assert(std::remove_reference_t<Out>::components == 3);
+			detail::prepare_output(out, count);
+			detail::for_each_pack<float>(count, [&](size_t i, uint8_t n)
+				{
+					alignas(64) float tu[P::width] = {}, tv[P::width] = {};
+					for (uint8_t k = 0; k < n; ++k)
+					{
+						tu[k] = float(in[i + k].u);
+						tv[k] = float(in[i + k].v);
+					}
+					P u = max(P::load(tu) * P(1.0f / detail::snorm16_scale), P(-1.0f));
+					P v = max(P::load(tv) * P(1.0f / detail::snorm16_scale), P(-1.0f));
+					P x, y, z;
+					detail::octahedral_decode(u, v, x, y, z);
+					out.template store<P>(0, i, x, n);
+					out.template store<P>(1, i, y, n);
+					out.template store<P>(2, i, z, n);
+				});
+		}
+
+		// Quaternions as 4 component w, x, y, z streams (see batch_quaternion.h); in holds
+		// unit quaternions.
+		template <typename In>
+		detail::if_stream<In> encode_quaternion32(const In& in, quaternion32* out)
+		{
+			using P = native_pack<float>;
+			detail::encode_smallest_three(in, [&](size_t i, uint8_t n, P index, const P (&q)[3])
+				{
+					alignas(64) uint32_t bits[P::width];
+					detail::store_quaternion32(index, q, bits);
+					std::memcpy(out + i, bits, n * sizeof(quaternion32));
+				});
+		}
+
+		template <typename In>
+		detail::if_stream<In> encode_quaternion48(const In& in, quaternion48* out)
+		{
+			using P = native_pack<float>;
+			detail::encode_smallest_three(in, [&](size_t i, uint8_t n, P index, const P (&q)[3])
+				{
+					alignas(64) uint32_t low[P::width], third[P::width];
+					detail::store_quaternion48(index, q, low, third);
+					for (uint8_t k = 0; k < n; ++k)
+					{
+						std::memcpy(out[i + k].bits, &low[k], sizeof(uint32_t));
+						out[i + k].bits[2] = uint16_t(third[k]);
+					}
+				});
+		}
+
+		template <typename Out>
+		void decode(const quaternion32* in, size_t count, Out&& out)
+		{
+			detail::decode_smallest_three(count, out, [&](size_t i, float& index, float (&q)[3])
+				{
+					detail::from_quaternion32(in[i], index, q);
+				});
+		}
+
+		template <typename Out>
+		void decode(const quaternion48* in, size_t count, Out&& out)
+		{
+			detail::decode_smallest_three(count, out, [&](size_t i, float& index, float (&q)[3])
+				{
+					detail::from_quaternion48(in[i], index, q);
+				});
+		}
+	}
+}
@@ -3,105 +3,137 @@
 #include <cmath>
 #include "vector.h"
 #include "matrix.h"
+#include "sincos.h"
 
 namespace xm
 {
 	template <typename T>
 	struct quaternion
 	{
-		quaternion() = default;
-		quaternion(T w, T x, T y, T z) : w(w), m(x, y, z) {}
-		quaternion(T w, vector<3, T> m) : w(w), m(m) {}
+		constexpr quaternion() noexcept : w(0), m() {}
+		explicit quaternion(uninitialized_t) noexcept : m(uninitialized) {}
+		constexpr quaternion(T w, T x, T y, T z) noexcept : w(w), m(x, y, z) {}
+		constexpr quaternion(T w, vector<3, T> m) noexcept : w(w), m(m) {}
 
 		T w;
 		vector<3, T> m;
 	};
 
 	template <typename T>
-	quaternion<T> operator*(quaternion<T> a, quaternion<T> b)
+	constexpr quaternion<T> operator*(const quaternion<T>& a, const quaternion<T>& b) noexcept
 	{
-		quaternion<T> res;
-
-		res.w = a.w * b.w - dot(a.m, b.m);
-		res.m = a.w * b.m + b.w * a.m + cross(a.m, b.m);
-
-		return res;
+		return quaternion<T>(a.w * b.w - dot(a.m, b.m), a.w * b.m + b.w * a.m + cross(a.m, b.m));
 	}
 
+	// out = a * b; out may be a or b
 	template <typename T>
-	quaternion<T> operator*(quaternion<T> a, T v)
+	constexpr void mul_into(quaternion<T>& out, const quaternion<T>& a, const quaternion<T>& b) noexcept
 	{
-		quaternion<T> res;
+		T w = a.w * b.w - dot(a.m, b.m);
+		out.m = a.w * b.m + b.w * a.m + cross(a.m, b.m);
+		out.w = w;
+	}
 
-		res.w = a.w * v;
-		res.m = a.m * v;
+	// a = a * b: b is applied first
+	template <typename T>
+	constexpr quaternion<T>& operator*=(quaternion<T>& a, const quaternion<T>& b) noexcept
+	{
+		mul_into(a, a, b);
+		return a;
+	}
 
-		return res;
+	template <typename T>
+	constexpr quaternion<T> operator*(const quaternion<T>& a, T v) noexcept
+	{
+		return quaternion<T>(a.w * v, a.m * v);
 	}
 
 	template <typename T>
-	inline quaternion<T> operator*(T v, quaternion<T> a)
+	constexpr quaternion<T> operator*(T v, const quaternion<T>& a) noexcept
 	{
 		return operator*(a, v);
 	}
 
 	template <typename T>
-	quaternion<T> operator+(quaternion<T> a, quaternion<T> b)
+	constexpr quaternion<T> operator+(const quaternion<T>& a, const quaternion<T>& b) noexcept
 	{
 		return quaternion<T>(a.w + b.w, a.m + b.m);
 	}
 
 	template <typename T>
-	quaternion<T> operator-(quaternion<T> a, quaternion<T> b)
+	constexpr quaternion<T> operator-(const quaternion<T>& a, const quaternion<T>& b) noexcept
 	{
 		return quaternion<T>(a.w - b.w, a.m - b.m);
 	}
 
 	template <typename T>
-	quaternion<T> operator/(quaternion<T> a, T v)
+	constexpr quaternion<T> operator/(const quaternion<T>& a, T v) noexcept
 	{
-		quaternion<T> res;
-
-		res.w = a.w * v;
-		res.m = a.m * v;
-
-		return res;
+		return quaternion<T>(a.w / v, a.m / v);
 	}
 
 	template <typename T>
-	inline quaternion<T> operator/(T v, quaternion<T> a)
+	constexpr quaternion<T> operator/(T v, const quaternion<T>& a) noexcept
 	{
 		return operator/(a, v);
 	}
 
 	template <typename T>
-	T dot(quaternion<T> a, quaternion<T> b)
+	constexpr T dot(const quaternion<T>& a, const quaternion<T>& b) noexcept
 	{
-		T res = a.w * b.w;
-		res += dot(a.m, b.m);
-		return res;
+		return a.w * b.w + dot(a.m, b.m);
 	}
 
 	template <typename T>
-	inline quaternion<T> conjugate(quaternion<T> q)
+	constexpr quaternion<T> conjugate(const quaternion<T>& q) noexcept
 	{
 		return quaternion<T>(q.w, -q.m);
 	}
 
 	template <typename T>
-	T length(quaternion<T> q)
+	constexpr T length(const quaternion<T>& q) noexcept
 	{
-		return sqrt(q.w * q.w + dot(q.m, q.m));
+		return constexpr_sqrt(q.w * q.w + dot(q.m, q.m));
 	}
 
 	template <typename T>
-	quaternion<T> normalize(quaternion<T> q)
+	constexpr quaternion<T> normalize(const quaternion<T>& q) noexcept
 	{
 		return q / length(q);
 	}
 
+	inline namespace XM_SIMD_ABI
+	{
+		template <precision P, typename T>
+		T length(const quaternion<T>& q) noexcept
+		{
+			return sqrt<P>(q.w * q.w + dot(q.m, q.m));
+		}
+
+		template <precision P, typename T>
+		quaternion<T> normalize(const quaternion<T>& q) noexcept
+		{
+			if constexpr (P == precision::exact)
+			{
+				return xm::normalize(q);
+			}
+			else
+			{
+				return q * rsqrt<P>(q.w * q.w + dot(q.m, q.m));
+			}
+		}
+	}
+
+	// v rotated by the unit quaternion q, q * v * conjugate(q) reduced to two cross products
+	template <typename T>
+	constexpr vector<3, T> rotate(const quaternion<T>& q, vector<3, T> v) noexcept
+	{
+		vector<3, T> t = cross(q.m, v) * T(2);
+		return v + t * q.w + cross(q.m, t);
+	}
+
 	template <typename T>
-	matrix<3, T> mat3_cast(quaternion<T> a)
+	constexpr matrix<3, T> mat3_cast(const quaternion<T>& a) noexcept
 	{
 		T x_2 = a.m.x * a.m.x;
 		T y_2 = a.m.y * a.m.y;
@@ -124,7 +156,7 @@ namespace xm
 		vector<3, T> c2(
 			2 * xy - 2 * wz,
 			1 - 2 * x_2 - 2 * z_2,
-			2 * yz + 2 * wz
+			2 * yz + 2 * wx
 		);
 
 		vector<3, T> c3(
@@ -140,7 +172,7 @@ namespace xm
 
 
 	template <typename T>
-	matrix<4, T> mat4_cast(quaternion<T> a)
+	constexpr matrix<4, T> mat4_cast(const quaternion<T>& a) noexcept
 	{
 		T x_2 = a.m.x * a.m.x;
 		T y_2 = a.m.y * a.m.y;
@@ -164,7 +196,7 @@ namespace xm
 		vector<4, T> c2(
 			2 * xy - 2 * wz,
 			1 - 2 * x_2 - 2 * z_2,
-			2 * yz + 2 * wz,
+			2 * yz + 2 * wx,
 			0.0f
 		);
 
@@ -182,135 +214,265 @@ namespace xm
 		return res;
 	}
 
+	// Unit quaternion of a rotation matrix, the inverse of mat3_cast up to the sign of the
+	// result. The largest of 4w^2, 4x^2, 4y^2, 4z^2 is read off the diagonal and its root
+	// scales the other three sums or differences (Shepperd), so no component comes out of
+	// a cancellation. Scalar T only.
+	template <typename T>
+	constexpr quaternion<T> quat_cast(const matrix<3, T>& m) noexcept
+	{
+		T trace = m[0][0] + m[1][1] + m[2][2];
+		if (trace > T(0))
+		{
+			T s = T(2) * constexpr_sqrt(trace + T(1));	// 4w
+			T r = T(1) / s;
+			return quaternion<T>(T(0.25) * s, (m[1][2] - m[2][1]) * r, (m[2][0] - m[0][2]) * r, (m[0][1] - m[1][0]) * r);
+		}
+		if (m[0][0] >= m[1][1] && m[0][0] >= m[2][2])
+		{
+			T s = T(2) * constexpr_sqrt(T(1) + m[0][0] - m[1][1] - m[2][2]);	// 4x
+			T r = T(1) / s;
+			return quaternion<T>((m[1][2] - m[2][1]) * r, T(0.25) * s, (m[0][1] + m[1][0]) * r, (m[2][0] + m[0][2]) * r);
+		}
+		if (m[1][1] >= m[2][2])
+		{
+			T s = T(2) * constexpr_sqrt(T(1) + m[1][1] - m[0][0] - m[2][2]);	// 4y
+			T r = T(1) / s;
+			return quaternion<T>((m[2][0] - m[0][2]) * r, (m[0][1] + m[1][0]) * r, T(0.25) * s, (m[1][2] + m[2][1]) * r);
+		}
+		T s = T(2) * constexpr_sqrt(T(1) + m[2][2] - m[0][0] - m[1][1]);	// 4z
+		T r = T(1) / s;
+		return quaternion<T>((m[0][1] - m[1][0]) * r, (m[2][0] + m[0][2]) * r, (m[1][2] + m[2][1]) * r, T(0.25) * s);
+	}
+
+	// from the upper 3x3
 	template <typename T>
-	quaternion<T> lerp(quaternion<T> a, quaternion<T> b, long double t)
+	constexpr quaternion<T> quat_cast(const matrix<4, T>& m) noexcept
 	{
-		return (1 - t) * a + t * b;
+		return quat_cast(matrix<3, T>(
+			vector<3, T>(m[0][0], m[0][1], m[0][2]),
+			vector<3, T>(m[1][0], m[1][1], m[1][2]),
+			vector<3, T>(m[2][0], m[2][1], m[2][2])));
 	}
 
 	template <typename T>
-	quaternion<T> slerp(quaternion<T> q1, quaternion<T> q2, long double t)
+	constexpr quaternion<T> lerp(const quaternion<T>& a, const quaternion<T>& b, long double t) noexcept
 	{
+		return T(1 - t) * a + T(t) * b;
+	}
+
+	template <typename M, typename T>
+	constexpr quaternion<T> select(const M& m, const quaternion<T>& a, const quaternion<T>& b) noexcept
+	{
+		return quaternion<T>(select(m, a.w, b.w), select(m, a.m, b.m));
+	}
+
+	// For pack T every lane takes its own path: the lanes that are nearly parallel use
+	// the normalized lerp and are merged with select.
+	template <typename T>
+	quaternion<T> slerp(const quaternion<T>& q1, const quaternion<T>& q2, long double t)
+	{
+		// the shorter arc: q2 is negated where the quaternions are more than 90 degrees apart
 		T cos_theta = dot(q1, q2);
-		if (cos_theta < 0)
-		{
-			cos_theta = -cos_theta;
-		}
+		T sign = select(cos_theta < 0, T(-1), T(1));
+		cos_theta = cos_theta * sign;
+		quaternion<T> b2 = q2 * sign;
 
-		if (cos_theta > 0.995)
+		auto nearly_parallel = cos_theta > 0.995;
+		if (all(nearly_parallel))
 		{
-			return normalize(lerp(q1, q2, t));
+			return normalize(lerp(q1, b2, t));
 		}
 
-		long double theta = acos(cos_theta);
+		T theta = acos(cos_theta);
 		T sin_theta = sqrt(1 - cos_theta * cos_theta);
 
-		long double a = sin((1 - t) * theta) / sin_theta;
+		T a = sin(T(1 - t) * theta) / sin_theta;
 
-		long double b = sin(t * theta) / sin_theta;
+		T b = sin(T(t) * theta) / sin_theta;
 
-		quaternion<T> res = a * q1 + b * q2;
+		quaternion<T> res = a * q1 + b * b2;
 
-		return res;
+		if (!any(nearly_parallel))
+		{
+			return res;
+		}
+		return select(nearly_parallel, normalize(lerp(q1, b2, t)), res);
 	}
 
-	template <typename T>
-	quaternion<T> quat_from_euler_x(T radians)
+	inline namespace XM_SIMD_ABI
 	{
-		return quaternion<T>(
-			cos(radians / 2),
-			vector<3, T>(
-				sin(radians / 2),
-				T(0.0),
-				T(0.0)
-			)
-		);
+		// slerp with t in T rather than long double, for pack T one t per lane. fast and
+		// approx take acos<P> and rsqrt<P>, and one sincos of t theta gives both weights:
+		// sin((1 - t) theta) = sin theta cos(t theta) - cos theta sin(t theta). Against
+		// slerp in long double the components stay within 2.6e-7 (float) and 4.7e-16
+		// (double) for fast, 4.6e-4 and 7e-5 for approx. The gain is on packs: for a single
+		// float or double the selects become branches and fast and approx time like exact.
+		template <precision P, typename T>
+		quaternion<T> slerp(const quaternion<T>& q1, const quaternion<T>& q2, T t) noexcept
+		{
+			T cos_theta = dot(q1, q2);
+			T sign = select(cos_theta < T(0), T(-1), T(1));
+			cos_theta = cos_theta * sign;
+			quaternion<T> b2 = q2 * sign;
+
+			auto nearly_parallel = cos_theta > T(0.995);
+			T a, b;
+			if constexpr (P == precision::exact)
+			{
+				T theta = xm::acos(cos_theta);
+				T sin_theta = xm::sqrt(T(1) - cos_theta * cos_theta);
+				a = xm::sin((T(1) - t) * theta) / sin_theta;
+				b = xm::sin(t * theta) / sin_theta;
+			}
+			else
+			{
+				T theta = acos<P>(cos_theta);
+				T s, c;
+				sincos(t * theta, s, c);
+				b = s * rsqrt<P>(mul_add(-cos_theta, cos_theta, T(1)));
+				a = c - cos_theta * b;
+			}
+
+			quaternion<T> res = a * q1 + b * b2;
+			if (!any(nearly_parallel))
+			{
+				return res;
+			}
+			return select(nearly_parallel, normalize<P>((T(1) - t) * q1 + t * b2), res);
+		}
 	}
 
-	template <typename T>
-	quaternion<T> quat_from_euler_y(T radians)
+	// Order of the elementary rotations of an Euler angle triple (x, y, z): xyz rotates
+	// about x first, then y, then z, the quaternion qz * qy * qx.
+	enum class euler_order : uint8_t { xyz, xzy, yxz, yzx, zxy, zyx };
+
+	namespace detail
 	{
-		return quaternion<T>(
-			cos(radians / 2),
-			vector<3, T>(
-				T(0.0),
-				sin(radians / 2),
-				T(0.0)
-			)
-		);
+		// Closed form of the three half angle rotations multiplied out. Every order gives
+		//	w = cx cy cz +- sx sy sz	x = sx cy cz +- cx sy sz
+		//	y = cx sy cz +- sx cy sz	z = cx cy sz +- sx sy cz
+		// and differs only in the signs, so it costs three sincos and 16 multiplies instead
+		// of two quaternion products and a normalize. Works on packs as well.
+		template <euler_order O, typename T>
+		constexpr void euler_quaternion(T ex, T ey, T ez, T& w, T& x, T& y, T& z) noexcept
+		{
+			constexpr bool plus[6][4] = {
+				{ true, false, true, false },	// xyz
+				{ false, true, true, false },	// xzy
+				{ false, false, true, true },	// yxz
+				{ true, false, false, true },	// yzx
+				{ true, true, false, false },	// zxy
+				{ false, true, false, true },	// zyx
+			};
+			constexpr bool w_plus = plus[uint8_t(O)][0], x_plus = plus[uint8_t(O)][1];
+			constexpr bool y_plus = plus[uint8_t(O)][2], z_plus = plus[uint8_t(O)][3];
+
+			T sx = T(0), cx = T(0), sy = T(0), cy = T(0), sz = T(0), cz = T(0);
+			sincos(ex * T(0.5), sx, cx);
+			sincos(ey * T(0.5), sy, cy);
+			sincos(ez * T(0.5), sz, cz);
+
+			T cycz = cy * cz, sysz = sy * sz, sycz = sy * cz, cysz = cy * sz;
+			w = mul_add(cx, cycz, w_plus ? sx * sysz : -(sx * sysz));
+			x = mul_add(sx, cycz, x_plus ? cx * sysz : -(cx * sysz));
+			y = mul_add(cx, sycz, y_plus ? sx * cysz : -(sx * cysz));
+			z = mul_add(cx, cysz, z_plus ? sx * sycz : -(sx * sycz));
+		}
+
+		template <euler_order O, typename T>
+		constexpr quaternion<T> euler_quaternion(vector<3, T> e) noexcept
+		{
+			quaternion<T> res;
+			euler_quaternion<O>(e.x, e.y, e.z, res.w, res.m.x, res.m.y, res.m.z);
+			return res;
+		}
 	}
+
 	template <typename T>
-	quaternion<T> quat_from_euler_z(T radians)
+	constexpr quaternion<T> quat_from_euler_x(T radians) noexcept
 	{
-		return quaternion<T>(
-			cos(radians / 2),
-			vector<3, T>(
-				T(0.0),
-				T(0.0),
-				sin(radians / 2)
-			)
-		);
-
+		T s = T(0), c = T(0);
+		sincos(radians / 2, s, c);
+		return quaternion<T>(c, vector<3, T>(s, T(0.0), T(0.0)));
 	}
 
 	template <typename T>
-	quaternion<T> quat_from_euler_xyz(vector<3, T> e)
+	constexpr quaternion<T> quat_from_euler_y(T radians) noexcept
 	{
-		quaternion<T> qx = quat_from_euler_x(e.x);
-		quaternion<T> qy = quat_from_euler_y(e.y);
-		quaternion<T> qz = quat_from_euler_z(e.z);
-
-		return normalize(qz * qy * qx);
+		T s = T(0), c = T(0);
+		sincos(radians / 2, s, c);
+		return quaternion<T>(c, vector<3, T>(T(0.0), s, T(0.0)));
 	}
 
 	template <typename T>
-	quaternion<T> quat_from_euler_xzy(vector<3, T> e)
+	constexpr quaternion<T> quat_from_euler_z(T radians) noexcept
 	{
-		quaternion<T> qx = quat_from_euler_x(e.x);
-		quaternion<T> qy = quat_from_euler_y(e.y);
-		quaternion<T> qz = quat_from_euler_z(e.z);
-
-		return normalize(qy * qz * qx);
+		T s = T(0), c = T(0);
+		sincos(radians / 2, s, c);
+		return quaternion<T>(c, vector<3, T>(T(0.0), T(0.0), s));
 	}
 
+	// Unit quaternions from Euler angles e = (x, y, z) in radians, named by the order the
+	// rotations are applied in (see euler_order)
 	template <typename T>
-	quaternion<T> quat_from_euler_yxz(vector<3, T> e)
+	constexpr quaternion<T> quat_from_euler_xyz(vector<3, T> e) noexcept
 	{
-		quaternion<T> qx = quat_from_euler_x(e.x);
-		quaternion<T> qy = quat_from_euler_y(e.y);
-		quaternion<T> qz = quat_from_euler_z(e.z);
+		return detail::euler_quaternion<euler_order::xyz>(e);
+	}
 
-		return normalize(qz * qx * qy);
+	template <typename T>
+	constexpr quaternion<T> quat_from_euler_xzy(vector<3, T> e) noexcept
+	{
+		return detail::euler_quaternion<euler_order::xzy>(e);
 	}
 
 	template <typename T>
-	quaternion<T> quat_from_euler_yzx(vector<3, T> e)
+	constexpr quaternion<T> quat_from_euler_yxz(vector<3, T> e) noexcept
 	{
-		quaternion<T> qx = quat_from_euler_x(e.x);
-		quaternion<T> qy = quat_from_euler_y(e.y);
-		quaternion<T> qz = quat_from_euler_z(e.z);
+		return detail::euler_quaternion<euler_order::yxz>(e);
+	}
 
-		return normalize(qx * qz * qy);
+	template <typename T>
+	constexpr quaternion<T> quat_from_euler_yzx(vector<3, T> e) noexcept
+	{
+		return detail::euler_quaternion<euler_order::yzx>(e);
 	}
 
 	template <typename T>
-	quaternion<T> quat_from_euler_zxy(vector<3, T> e)
+	constexpr quaternion<T> quat_from_euler_zxy(vector<3, T> e) noexcept
 	{
-		quaternion<T> qx = quat_from_euler_x(e.x);
-		quaternion<T> qy = quat_from_euler_y(e.y);
-		quaternion<T> qz = quat_from_euler_z(e.z);
+		return detail::euler_quaternion<euler_order::zxy>(e);
+	}
 
-		return normalize(qy * qx * qz);
+	template <typename T>
+	constexpr quaternion<T> quat_from_euler_zyx(vector<3, T> e) noexcept
+	{
+		return detail::euler_quaternion<euler_order::zyx>(e);
 	}
 
+	// the order picked at run time, e.g. from a motion capture file's channel list
 	template <typename T>
-	quaternion<T> quat_from_euler_zyx(vector<3, T> e)
+	constexpr quaternion<T> quat_from_euler(vector<3, T> e, euler_order order) noexcept
 	{
-		quaternion<T> qx = quat_from_euler_x(e.x);
-		quaternion<T> qy = quat_from_euler_y(e.y);
-		quaternion<T> qz = quat_from_euler_z(e.z);
+		switch (order)
+		{
+		case euler_order::xyz: return quat_from_euler_xyz(e);
+		case euler_order::xzy: return quat_from_euler_xzy(e);
+		case euler_order::yxz: return quat_from_euler_yxz(e);
+		case euler_order::yzx: return quat_from_euler_yzx(e);
+		case euler_order::zxy: return quat_from_euler_zxy(e);
+		default: return quat_from_euler_zyx(e);
+		}
+	}
 
-		return normalize(qx * qy * qz);
+	// rotation by radians about axis, which must be a unit vector
+	template <typename T>
+	constexpr quaternion<T> quat_from_axis_angle(vector<3, T> axis, T radians) noexcept
+	{
+		T s = T(0), c = T(0);
+		sincos(radians / 2, s, c);
+		return quaternion<T>(c, axis * s);
 	}
 }
 
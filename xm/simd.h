@@ -0,0 +1,54 @@
+#pragma once
+
+// Instruction set detection for the intrinsic code paths.
+// Every XM_* macro is 0 or 1. Define XM_NO_SIMD before including any xm header
+// to compile only the generic scalar loops.
+
+#if !defined(XM_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define XM_SSE2 1
+#else
+	#define XM_SSE2 0
+#endif
+
+#if XM_SSE2 && defined(__AVX__)
+	#define XM_AVX 1
+#else
+	#define XM_AVX 0
+#endif
+
+#if XM_AVX && defined(__AVX2__)
+	#define XM_AVX2 1
+#else
+	#define XM_AVX2 0
+#endif
+
+// msvc has no __FMA__, but every /arch:AVX2 target has fma3
+#if XM_AVX && (defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__)))
+	#define XM_FMA 1
+#else
+	#define XM_FMA 0
+#endif
+
+// float <-> half conversions; msvc has no __F16C__, but every /arch:AVX2 target has f16c
+#if XM_AVX && (defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__)))
+	#define XM_F16C 1
+#else
+	#define XM_F16C 0
+#endif
+
+#if XM_AVX2 && defined(__AVX512F__)
+	#define XM_AVX512 1
+#else
+	#define XM_AVX512 0
+#endif
+
+#if XM_SSE2
+	#include <immintrin.h>
+#endif
+
+// Code that depends on the macros above is declared inside this inline namespace,
+// so translation units built for different instruction sets (see dispatch.h) can be
+// linked together without their inline functions and templates clashing.
+#define XM_SIMD_ABI_NAME(sse2, avx, avx2, fma, f16c, avx512) simd_##sse2##avx##avx2##fma##f16c##avx512
+#define XM_SIMD_ABI_EXPAND(...) XM_SIMD_ABI_NAME(__VA_ARGS__)
+#define XM_SIMD_ABI XM_SIMD_ABI_EXPAND(XM_SSE2, XM_AVX, XM_AVX2, XM_FMA, XM_F16C, XM_AVX512)
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <type_traits>
+#include "pack.h"
+#include "constexpr_math.h"
+
+namespace xm
+{
+	namespace detail
+	{
+		// pi / 2 in three parts (Cephes): the leading ones are short enough that k times
+		// them is exact for the k of the ranges documented at sincos
+		template <typename T>
+		struct sincos_constants;
+
+		template <>
+		struct sincos_constants<float>
+		{
+			// |x| up to which the pack path of sincos is accurate
+			static constexpr float max_argument = 8192.0f;
+			static constexpr float two_over_pi = 0.636619772367581343076f;
+			static constexpr float half_pi[3] = { 1.5703125f, 4.837512969970703125e-4f, 7.54978995489188216e-8f };
+			// adding and subtracting 1.5 * 2^23 rounds to the nearest integer
+			static constexpr float round_bias = 12582912.0f;
+			// sin r = r + r^3 s(r^2), cos r = 1 - r^2 / 2 + r^4 c(r^2), |r| <= pi / 4
+			static constexpr float s[3] = { -1.6666654611e-1f, 8.3321608736e-3f, -1.9515295891e-4f };
+			static constexpr float c[3] = { 4.166664568298827e-2f, -1.388731625493765e-3f, 2.443315711809948e-5f };
+		};
+
+		template <>
+		struct sincos_constants<double>
+		{
+			static constexpr double max_argument = 1073741824.0;	// 2^30
+			static constexpr double two_over_pi = 0.636619772367581343076;
+			static constexpr double half_pi[3] = { 1.57079625129699707031, 7.54978941586159635336e-8, 5.39030285815811905290e-15 };
+			static constexpr double round_bias = 6755399441055744.0;
+			static constexpr double s[6] = { -1.66666666666666307295e-1, 8.33333333332211858878e-3, -1.98412698295895385996e-4,
+				2.75573136213857245213e-6, -2.50507477628578072866e-8, 1.58962301576546568060e-10 };
+			static constexpr double c[6] = { 4.16666666666665929218e-2, -1.38888888888730564116e-3, 2.48015872888517045348e-5,
+				-2.75573141792967388112e-7, 2.08757008419747316778e-9, -1.13585365213876817300e-11 };
+		};
+
+		// p[0] + z p[1] + z^2 p[2] + ...
+		template <typename T, size_t N>
+		constexpr T polynomial(T z, const scalar_t<T> (&p)[N]) noexcept
+		{
+			T res = T(p[N - 1]);
+			for (size_t i = N - 1; i > 0; --i)
+			{
+				res = mul_add(res, z, T(p[i - 1]));
+			}
+			return res;
+		}
+	}
+
+	// Sine and cosine of x in one go. For packs of float and double without a branch or a
+	// table: x is reduced by the nearest multiple k of pi / 2 (Cody-Waite, three parts) and
+	// one polynomial pair on [-pi / 4, pi / 4] serves all four quadrants, every lane at once.
+	// A single float or double takes constexpr_sin and constexpr_cos instead (std::sin and
+	// std::cos at run time): on one value the quadrant selects become branches that
+	// mispredict, and the std functions measured faster and hold for any x.
+	//
+	// Largest error of the pack path against sin and cos in long double, measured over
+	// 2 * 10^7 arguments:
+	//	float:	1.6 ulp for |x| <= pi, absolute 9.3e-8 for |x| <= 8192
+	//	double:	1.6 ulp for |x| <= 2^20, absolute 1.8e-16 for |x| <= 2^30
+	// Those bounds (sincos_constants::max_argument) are hard limits: past them k times the
+	// parts of pi / 2 is no longer exact and the results are wrong, already off by 8e-3
+	// at 2^17 for float. NaN and infinities give NaN.
+	template <typename T>
+	constexpr void sincos(T x, T& s, T& c) noexcept
+	{
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			s = constexpr_sin(x);
+			c = constexpr_cos(x);
+		}
+		else
+		{
+			using S = scalar_t<T>;
+			using K = detail::sincos_constants<S>;
+
+			// k = round(x * 2 / pi), and n = k mod 4 picks the quadrant
+			T k = (x * T(K::two_over_pi) + T(K::round_bias)) - T(K::round_bias);
+			T n = k - T(4) * ((mul_add(k, T(0.25), T(-0.375)) + T(K::round_bias)) - T(K::round_bias));
+
+			T r = x - k * T(K::half_pi[0]);
+			r = r - k * T(K::half_pi[1]);
+			r = r - k * T(K::half_pi[2]);
+			T z = r * r;
+
+			T sin_r = mul_add(r * z, detail::polynomial(z, K::s), r);
+			T cos_r = mul_add(z * z, detail::polynomial(z, K::c), mul_add(z, T(-0.5), T(1)));
+
+			// quadrant 1: (cos r, -sin r), 2: (-sin r, -cos r), 3: (-cos r, sin r)
+			auto odd = (n == T(1)) | (n == T(3));
+			T sin_abs = select(odd, cos_r, sin_r);
+			T cos_abs = select(odd, sin_r, cos_r);
+			s = select(n >= T(2), -sin_abs, sin_abs);
+			c = select((n == T(1)) | (n == T(2)), -cos_abs, cos_abs);
+		}
+	}
+}
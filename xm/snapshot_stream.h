@@ -0,0 +1,543 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "animation_file.h"
+#include "vector_stream.h"
+
+// Compressed capture of count positions and rotations per frame, e.g. every object of a
+// simulation each tick for replays. Values are quantized to a fixed grid and every frame is
+// stored as the difference to a prediction from the frames before it (the previous value
+// moved on by the last change, so steady motion leaves only rounding noise), bit packed in
+// blocks of 64 values per component with the smallest width that holds the block's largest
+// difference; blocks of objects at rest or in steady motion cost one width byte. Every
+// keyframe_interval frames the prediction is zero instead, so any frame decodes from its
+// chunk's keyframe.
+//
+// The quantized values are exact, so there is no drift; decoded values are off by at most
+// half of position_step per position component and by 0.5 / (2^(rotation_bits - 1) - 1)
+// per rotation component before renormalization (1.5e-5 for 16 bits, 2.1e-5 measured after
+// it). Rotations may come back negated.
+//
+// The encoder emits self contained chunks of one keyframe and the frames after it; a stream
+// is the chunks in order, e.g. appended to a file as they complete. Layout of a chunk, little
+// endian, offsets from the start of the chunk, size a multiple of 8:
+//
+//	chunk_header
+//	uint32_t frame_offsets[frames + 1]
+//	frames: for the components position x, y, z, rotation w, x, y, z in turn, one width
+//	        byte per block, then the blocks, 8 bytes per bit of width; value k of a block is
+//	        at bit k * width of its 64 bit words
+//
+// Values are the zigzag coded differences of the quantized int32_t values to the prediction:
+// 0 in a keyframe, the previous value in the frame after it and previous + (previous -
+// the one before) in later frames, all modulo 2^32.
+
+namespace xm
+{
+	struct snapshot_settings
+	{
+		double position_step = 1.0 / 1024.0;	// grid spacing of the positions
+		uint8_t rotation_bits = 16;				// bits per quantized rotation component, 2 to 24
+		uint32_t keyframe_interval = 32;		// frames per chunk
+	};
+
+	namespace snapshot_format
+	{
+		constexpr uint32_t magic = 0x53534D58;	// "XMSS"
+		constexpr uint32_t byte_order_mark = 0x01020304;
+		constexpr uint16_t version_major = 1;
+		constexpr uint16_t version_minor = 0;
+		constexpr size_t block = 64;
+		constexpr uint8_t components = 7;
+
+		struct chunk_header
+		{
+			uint32_t magic;
+			uint32_t byte_order;
+			uint16_t version_major;
+			uint16_t version_minor;
+			uint32_t count;				// positions and rotations per frame
+			uint64_t first_frame;
+			uint32_t frames;
+			uint32_t rotation_bits;
+			double position_step;
+			uint64_t size;
+		};
+
+		static_assert(sizeof(chunk_header) == 48);
+
+		inline size_t blocks(size_t count)
+		{
+			return (count + block - 1) / block;
+		}
+	}
+
+	namespace detail
+	{
+		inline uint32_t zigzag(uint32_t delta)
+		{
+			return (delta << 1) ^ (0u - (delta >> 31));
+		}
+
+		inline uint32_t unzigzag(uint32_t z)
+		{
+			return (z >> 1) ^ (0u - (z & 1));
+		}
+
+		inline uint8_t bit_width(uint32_t v)
+		{
+			uint8_t w = 0;
+			for (; v != 0; v >>= 1) ++w;
+			return w;
+		}
+
+		// the value expected after previous and before, from order of them
+		inline uint32_t predict(int32_t previous, int32_t before, uint32_t order)
+		{
+			uint32_t p = uint32_t(previous), b = uint32_t(before);
+			return order == 0 ? 0u : order == 1 ? p : p + (p - b);
+		}
+
+		inline int32_t rotation_scale(uint8_t bits)
+		{
+			return int32_t((1u << (bits - 1)) - 1);
+		}
+
+		// n <= 64 values of width bits into 8 * width bytes at out
+		inline void pack_block(const uint32_t* values, size_t n, uint8_t width, unsigned char* out)
+		{
+			uint64_t words[33] = {};
+			for (size_t k = 0; k < n; ++k)
+			{
+				size_t bit = k * width;
+				size_t word = bit >> 6, shift = bit & 63;
+				words[word] |= uint64_t(values[k]) << shift;
+				if (shift + width > 64) words[word + 1] |= uint64_t(values[k]) >> (64 - shift);
+			}
+			std::memcpy(out, words, 8 * size_t(width));
+		}
+
+		// the inverse of pack_block, into 64 values at out (the ones past n are garbage);
+		// one unaligned 8 byte read per value from a padded copy, no branches
+		inline void unpack_block(const unsigned char* in, uint8_t width, uint32_t* out)
+		{
+			unsigned char bytes[8 * 32 + 8];
+			std::memcpy(bytes, in, 8 * size_t(width));
+			std::memset(bytes + 8 * size_t(width), 0, 8);
+			const uint64_t mask = (uint64_t(1) << width) - 1;
+			for (size_t k = 0; k < 64; ++k)
+			{
+				size_t bit = k * width;
+				uint64_t v;
+				std::memcpy(&v, bytes + (bit >> 3), 8);
+				out[k] = uint32_t(v >> (bit & 7) & mask);
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// Write side. Frames go in with add_frame; complete chunks come out of take_chunk.
+		struct snapshot_encoder
+		{
+			snapshot_encoder(size_t count, const snapshot_settings& settings = snapshot_settings())
+				: count(count), settings(settings)
+			{
+				assert(settings.position_step > 0.0 && settings.keyframe_interval > 0);
+				assert(settings.rotation_bits >= 2 && settings.rotation_bits <= 24);
+				for (uint8_t c = 0; c < snapshot_format::components; ++c)
+				{
+					current[c].assign(count, 0);
+					previous[c].assign(count, 0);
+					before_previous[c].assign(count, 0);
+				}
+			}
+
+			size_t size() const
+			{
+				return count;
+			}
+
+			// frames added so far
+			uint64_t frames() const
+			{
+				return next_frame;
+			}
+
+			// count positions and w, x, y, z rotations (any stream, see batch_quaternion.h)
+			template <typename Positions, typename Rotations>
+			detail::if_stream<Positions> add_frame(const Positions& positions, const Rotations& rotations)
+			{
+				static_assert(Positions::components == 3 && Rotations::components == 4);
+				assert(positions.size() >= count && rotations.size() >= count);
+				quantize(positions, rotations);
+
+				offsets.push_back(uint32_t(frame_bytes.size()));
+				for (uint8_t c = 0; c < snapshot_format::components; ++c)
+				{
+					encode_component(current[c].data(), previous[c].data(), before_previous[c].data(), std::min(chunk_frames, 2u));
+					before_previous[c].swap(previous[c]);
+					previous[c].swap(current[c]);
+				}
+
+				++next_frame;
+				if (++chunk_frames == settings.keyframe_interval) close_chunk();
+			}
+
+			// closes the chunk in progress, if it has any frame; call after the last frame
+			void finish()
+			{
+				if (chunk_frames != 0) close_chunk();
+			}
+
+			// moves the oldest complete chunk into chunk, if there is one
+			bool take_chunk(std::vector<unsigned char>& chunk)
+			{
+				if (ready.empty()) return false;
+				chunk.swap(ready.front());
+				ready.pop_front();
+				return true;
+			}
+
+		private:
+			template <typename Positions, typename Rotations>
+			void quantize(const Positions& positions, const Rotations& rotations)
+			{
+				using P = native_pack<detail::stream_value<Positions>>;
+				using S = detail::stream_value<Positions>;
+				const double inv_step = 1.0 / settings.position_step;
+				const double scale = detail::rotation_scale(settings.rotation_bits);
+				detail::for_each_pack<S>(count, [&](size_t i, uint8_t n)
+					{
+						alignas(64) S tmp[4][P::width];
+						for (uint8_t c = 0; c < 3; ++c) positions.template load<P>(c, i, n).store(tmp[c]);
+						for (uint8_t c = 0; c < 3; ++c)
+						{
+							for (uint8_t k = 0; k < n; ++k)
+							{
+								double q = std::round(double(tmp[c][k]) * inv_step);
+								current[c][i + k] = int32_t(std::min(std::max(q, -2147483647.0), 2147483647.0));
+							}
+						}
+
+						for (uint8_t c = 0; c < 4; ++c) rotations.template load<P>(c, i, n).store(tmp[c]);
+						for (uint8_t k = 0; k < n; ++k)
+						{
+							int32_t q[4];
+							int64_t dot = 0;
+							for (uint8_t c = 0; c < 4; ++c)
+							{
+								double v = std::min(std::max(double(tmp[c][k]), -1.0), 1.0);
+								q[c] = int32_t(std::round(v * scale));
+								dot += int64_t(q[c]) * previous[3 + c][i + k];
+							}
+							// q and -q are the same rotation: keep to the previous frame's side
+							for (uint8_t c = 0; c < 4; ++c) current[3 + c][i + k] = dot < 0 ? -q[c] : q[c];
+						}
+					});
+			}
+
+			// appends the width bytes and blocks of one component; order is the number of
+			// frames the prediction uses
+			void encode_component(const int32_t* values, const int32_t* previous_values, const int32_t* before, uint32_t order)
+			{
+				const size_t blocks = snapshot_format::blocks(count);
+				size_t widths = frame_bytes.size();
+				frame_bytes.resize(widths + blocks);
+				for (size_t b = 0; b < blocks; ++b)
+				{
+					size_t first = b * snapshot_format::block;
+					size_t n = std::min(snapshot_format::block, count - first);
+					uint32_t z[snapshot_format::block];
+					uint32_t any = 0;
+					for (size_t k = 0; k < n; ++k)
+					{
+						z[k] = detail::zigzag(uint32_t(values[first + k]) - detail::predict(previous_values[first + k], before[first + k], order));
+						any |= z[k];
+					}
+					uint8_t width = detail::bit_width(any);
+					frame_bytes[widths + b] = width;
+					size_t at = frame_bytes.size();
+					frame_bytes.resize(at + 8 * size_t(width));
+					if (width != 0) detail::pack_block(z, n, width, frame_bytes.data() + at);
+				}
+			}
+
+			void close_chunk()
+			{
+				using namespace snapshot_format;
+				offsets.push_back(uint32_t(frame_bytes.size()));
+				size_t table = sizeof(chunk_header) + offsets.size() * sizeof(uint32_t);
+				size_t size = (table + frame_bytes.size() + 7) / 8 * 8;
+
+				chunk_header h{};
+				h.magic = magic;
+				h.byte_order = byte_order_mark;
+				h.version_major = version_major;
+				h.version_minor = version_minor;
+				h.count = uint32_t(count);
+				h.first_frame = next_frame - chunk_frames;
+				h.frames = chunk_frames;
+				h.rotation_bits = settings.rotation_bits;
+				h.position_step = settings.position_step;
+				h.size = size;
+
+				std::vector<unsigned char> chunk(size, 0);
+				std::memcpy(chunk.data(), &h, sizeof(h));
+				for (uint32_t& offset : offsets) offset += uint32_t(table);
+				std::memcpy(chunk.data() + sizeof(h), offsets.data(), offsets.size() * sizeof(uint32_t));
+				if (!frame_bytes.empty()) std::memcpy(chunk.data() + table, frame_bytes.data(), frame_bytes.size());
+				ready.push_back(static_cast<std::vector<unsigned char>&&>(chunk));
+
+				offsets.clear();
+				frame_bytes.clear();
+				chunk_frames = 0;
+			}
+
+			size_t count;
+			snapshot_settings settings;
+			std::vector<int32_t> current[snapshot_format::components];
+			std::vector<int32_t> previous[snapshot_format::components];
+			std::vector<int32_t> before_previous[snapshot_format::components];
+			std::vector<uint32_t> offsets;
+			std::vector<unsigned char> frame_bytes;
+			std::deque<std::vector<unsigned char>> ready;
+			uint64_t next_frame = 0;
+			uint32_t chunk_frames = 0;
+		};
+
+		// Read side: a validated view of a stream of chunks with random access to its frames.
+		// Decoding a frame applies the frames from its chunk's keyframe on, or from the frame
+		// decoded last if that is earlier in the same chunk, so playback applies one frame
+		// per call and a jump costs at most keyframe_interval frames. The conversion back to
+		// floats and the renormalization of the rotations run in packs.
+		struct snapshot_decoder
+		{
+			// Validates every chunk and keeps a view of them on success. data needs no
+			// alignment and must stay valid while the decoder is used.
+			file_status open(const void* data, size_t size)
+			{
+				chunks.clear();
+				count = 0;
+				total_frames = 0;
+				state_chunk = npos;
+				file_status status = validate(static_cast<const unsigned char*>(data), size);
+				if (status != file_status::ok)
+				{
+					chunks.clear();
+					count = 0;
+					total_frames = 0;
+					return status;
+				}
+				for (uint8_t c = 0; c < snapshot_format::components; ++c)
+				{
+					values[c].assign(count, 0);
+					previous[c].assign(count, 0);
+				}
+				return file_status::ok;
+			}
+
+			// positions and rotations per frame
+			size_t size() const
+			{
+				return count;
+			}
+
+			uint64_t frames() const
+			{
+				return total_frames;
+			}
+
+			// the keyframe a frame decodes from
+			uint64_t keyframe_of(uint64_t frame) const
+			{
+				return chunks[find(frame)].first_frame;
+			}
+
+			// frame < frames() into size() positions and w, x, y, z rotations of unit length
+			template <typename Positions, typename Rotations>
+			void decode(uint64_t frame, Positions&& positions, Rotations&& rotations)
+			{
+				using T = detail::stream_value<Positions>;
+				using P = native_pack<T>;
+				static_assert(std::remove_reference_t<Positions>::components == 3 && std::remove_reference_t<Rotations>::components == 4);
+				assert(frame < total_frames);
+				seek(frame);
+
+				const chunk& ch = chunks[state_chunk];
+				detail::prepare_output(positions, count);
+				detail::prepare_output(rotations, count);
+				const T step = T(ch.position_step);
+				const T inv_scale = T(1) / T(detail::rotation_scale(uint8_t(ch.rotation_bits)));
+				detail::for_each_pack<T>(count, [&](size_t i, uint8_t n)
+					{
+						alignas(64) T tmp[snapshot_format::components][P::width] = {};
+						for (uint8_t c = 0; c < snapshot_format::components; ++c)
+						{
+							for (uint8_t k = 0; k < n; ++k) tmp[c][k] = T(values[c][i + k]);
+						}
+						for (uint8_t c = 0; c < 3; ++c) positions.template store<P>(c, i, P::load(tmp[c]) * step, n);
+
+						P q[4];
+						P len2(T(0));
+						for (uint8_t c = 0; c < 4; ++c)
+						{
+							q[c] = P::load(tmp[3 + c]) * inv_scale;
+							len2 = mul_add(q[c], q[c], len2);
+						}
+						// all zero only if written that way; decodes to the identity
+						auto zero = len2 == P(T(0));
+						q[0] = select(zero, P(T(1)), q[0]);
+						P inv_len = P(T(1)) / sqrt(select(zero, P(T(1)), len2));
+						for (uint8_t c = 0; c < 4; ++c) rotations.template store<P>(c, i, q[c] * inv_len, n);
+					});
+			}
+
+		private:
+			static constexpr size_t npos = ~size_t(0);
+
+			struct chunk
+			{
+				const unsigned char* data;
+				const unsigned char* offsets;	// frames + 1 uint32_t, unaligned
+				uint64_t first_frame;
+				uint32_t frames;
+				uint32_t rotation_bits;
+				double position_step;
+			};
+
+			size_t find(uint64_t frame) const
+			{
+				auto it = std::upper_bound(chunks.begin(), chunks.end(), frame, [](uint64_t f, const chunk& c) { return f < c.first_frame; });
+				return size_t(it - chunks.begin()) - 1;
+			}
+
+			static uint32_t offset(const chunk& c, uint32_t frame)
+			{
+				uint32_t res;
+				std::memcpy(&res, c.offsets + frame * sizeof(uint32_t), sizeof(res));
+				return res;
+			}
+
+			// brings values to frame
+			void seek(uint64_t frame)
+			{
+				size_t ci = find(frame);
+				uint32_t local = uint32_t(frame - chunks[ci].first_frame);
+				if (ci != state_chunk || local < state_frame)
+				{
+					apply(chunks[ci], 0);
+					state_chunk = ci;
+					state_frame = 0;
+				}
+				for (; state_frame < local; ) apply(chunks[ci], ++state_frame);
+			}
+
+			// moves values on to frame: the prediction plus the frame's differences
+			void apply(const chunk& ch, uint32_t frame)
+			{
+				const size_t blocks = snapshot_format::blocks(count);
+				const uint32_t order = std::min(frame, 2u);
+				const unsigned char* p = ch.data + offset(ch, frame);
+				for (uint8_t c = 0; c < snapshot_format::components; ++c)
+				{
+					const unsigned char* widths = p;
+					p += blocks;
+					int32_t* v = values[c].data();
+					int32_t* last = previous[c].data();
+					for (size_t b = 0; b < blocks; ++b)
+					{
+						size_t first = b * snapshot_format::block;
+						size_t n = std::min(snapshot_format::block, count - first);
+						uint8_t width = widths[b];
+						uint32_t z[snapshot_format::block] = {};
+						if (width != 0) detail::unpack_block(p, width, z);
+						p += 8 * size_t(width);
+
+						for (size_t k = 0; k < n; ++k)
+						{
+							size_t i = first + k;
+							uint32_t predicted = detail::predict(v[i], last[i], order);
+							last[i] = v[i];
+							v[i] = int32_t(predicted + detail::unzigzag(z[k]));
+						}
+					}
+				}
+			}
+
+			file_status validate(const unsigned char* data, size_t size)
+			{
+				using namespace snapshot_format;
+				size_t at = 0;
+				while (at < size)
+				{
+					chunk_header h;
+					if (size - at < sizeof(h)) return file_status::too_small;
+					std::memcpy(&h, data + at, sizeof(h));
+					if (h.magic != magic) return file_status::bad_magic;
+					if (h.byte_order != byte_order_mark) return file_status::wrong_byte_order;
+					if (h.version_major != version_major) return file_status::unsupported_version;
+					if (h.size > size - at) return file_status::too_small;
+					if (h.size % 8 != 0) return file_status::misaligned;
+					if (!file_format::fits(sizeof(h), uint64_t(h.frames) + 1, sizeof(uint32_t), h.size)) return file_status::out_of_bounds;
+
+					bool first = chunks.empty();
+					if (h.frames == 0 || h.first_frame != total_frames || (!first && h.count != count)) return file_status::bad_frames;
+					if (h.rotation_bits < 2 || h.rotation_bits > 24 || !(h.position_step > 0.0)) return file_status::bad_frames;
+					count = h.count;
+
+					chunk c{ data + at, data + at + sizeof(h), h.first_frame, h.frames, h.rotation_bits, h.position_step };
+					file_status status = validate_frames(c, h.size);
+					if (status != file_status::ok) return status;
+					chunks.push_back(c);
+					total_frames += h.frames;
+					at += size_t(h.size);
+				}
+				return file_status::ok;
+			}
+
+			// every frame lies within the chunk and has exactly the size its widths give
+			file_status validate_frames(const chunk& c, uint64_t chunk_size) const
+			{
+				const size_t blocks = snapshot_format::blocks(count);
+				uint64_t table_end = sizeof(snapshot_format::chunk_header) + (uint64_t(c.frames) + 1) * sizeof(uint32_t);
+				if (offset(c, 0) != table_end || offset(c, c.frames) > chunk_size) return file_status::out_of_bounds;
+				for (uint32_t f = 0; f < c.frames; ++f)
+				{
+					uint64_t begin = offset(c, f), end = offset(c, f + 1);
+					if (end < begin) return file_status::out_of_bounds;
+					uint64_t at = begin;
+					for (uint8_t k = 0; k < snapshot_format::components; ++k)
+					{
+						if (end - at < blocks) return file_status::bad_frames;
+						const unsigned char* widths = c.data + at;
+						at += blocks;
+						for (size_t b = 0; b < blocks; ++b)
+						{
+							if (widths[b] > 32) return file_status::bad_frames;
+							at += 8 * uint64_t(widths[b]);
+						}
+						if (at > end) return file_status::bad_frames;
+					}
+					if (at != end) return file_status::bad_frames;
+				}
+				return file_status::ok;
+			}
+
+			std::vector<chunk> chunks;
+			size_t count = 0;
+			uint64_t total_frames = 0;
+			std::vector<int32_t> values[snapshot_format::components];
+			std::vector<int32_t> previous[snapshot_format::components];
+			size_t state_chunk = npos;
+			uint32_t state_frame = 0;
+		};
+	}
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace xm
+{
+	// Runs body(begin, end) over [0, count) on the calling thread. Everything that can
+	// spread its work over threads (transform_hierarchy::update, clip_sampler::sample and
+	// the xm::batch overloads taking a parallel_for first) accepts any callable of this
+	// shape, so a thread_pool or the caller's own scheduler can split the range instead;
+	// it must not return before every part has run.
+	struct serial_for
+	{
+		template <typename F>
+		void operator()(size_t count, F&& body) const
+		{
+			if (count != 0)
+			{
+				body(size_t(0), count);
+			}
+		}
+	};
+
+	namespace detail
+	{
+		template <typename E, typename R = void>
+		using if_parallel_for = std::enable_if_t<std::is_invocable_v<E&, size_t, void (*)(size_t, size_t)>, R>;
+
+		// set while the thread runs a part of a thread_pool call
+		inline bool& inside_parallel_for()
+		{
+			static thread_local bool inside = false;
+			return inside;
+		}
+	}
+
+	// Fixed set of worker threads that run parallel_for calls. A call cuts [0, count) into
+	// chunks of grain items and deals them out as one contiguous run of chunks per thread,
+	// the calling thread included. Every thread takes chunks from the front of its own run;
+	// one that runs dry steals the back half of the largest run left, so uneven work evens
+	// out without a shared queue. Each run is a packed (begin, end) pair on its own cache
+	// line, updated with compare-exchange.
+	//
+	// Calls from several threads run one after another. A call made from inside a body
+	// runs serially on that thread. body must not throw.
+	struct thread_pool
+	{
+		static constexpr size_t cache_line = 64;
+
+		// Automatic grains are multiples of this many items: 64 bytes of float, so the
+		// chunks of any 64 byte aligned array whose elements are a multiple of 4 bytes
+		// (float and double lanes, vec3, mat4, indices...) begin on a cache line and no two
+		// threads write to the same line. It is also a multiple of every pack width.
+		static constexpr size_t grain_multiple = cache_line / sizeof(float);
+		static constexpr size_t min_grain = 16 * grain_multiple;
+		static constexpr size_t chunks_per_thread = 8;
+
+		// threads counts the calling thread: 0 means std::thread::hardware_concurrency(),
+		// 1 runs every call on the caller
+		explicit thread_pool(unsigned threads = 0)
+		{
+			if (threads == 0)
+			{
+				threads = std::thread::hardware_concurrency();
+			}
+			threads = threads == 0 ? 1 : threads;
+
+			runs.reset(new run[threads]);
+			workers.reserve(threads - 1);
+			for (unsigned t = 1; t < threads; ++t)
+			{
+				workers.emplace_back([this, t] { worker_main(t); });
+			}
+		}
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (std::thread& w : workers)
+			{
+				w.join();
+			}
+		}
+
+		// threads taking part in a call, the caller included
+		unsigned size() const
+		{
+			return unsigned(workers.size()) + 1;
+		}
+
+		// Items per chunk for count items: about chunks_per_thread chunks per thread, so
+		// stealing has something to balance, rounded up to a multiple of grain_multiple and
+		// at least min_grain. Calls too small for two chunks don't wake the workers at all.
+		size_t grain_for(size_t count) const
+		{
+			size_t target = count / (size_t(size()) * chunks_per_thread);
+			size_t grain = (target + grain_multiple - 1) / grain_multiple * grain_multiple;
+			return grain < min_grain ? min_grain : grain;
+		}
+
+		template <typename F>
+		void operator()(size_t count, F&& body)
+		{
+			parallel_for(count, grain_for(count), body);
+		}
+
+		// body(begin, end) for consecutive ranges of [0, count), each grain items long
+		// except the last
+		template <typename F>
+		void parallel_for(size_t count, size_t grain, F&& body)
+		{
+			if (count == 0)
+			{
+				return;
+			}
+			grain = grain == 0 ? 1 : grain;
+			if (count / grain >= UINT32_MAX)
+			{
+				grain = count / (UINT32_MAX - 1) + 1;
+			}
+
+			size_t chunks = (count + grain - 1) / grain;
+			if (chunks == 1 || workers.empty() || detail::inside_parallel_for())
+			{
+				body(size_t(0), count);
+				return;
+			}
+
+			using body_type = std::remove_reference_t<F>;
+			job j;
+			j.run = [](void* b, size_t begin, size_t end) { (*static_cast<body_type*>(b))(begin, end); };
+			j.body = const_cast<void*>(static_cast<const void*>(&body));
+			j.count = count;
+			j.grain = grain;
+			j.chunks = uint32_t(chunks);
+			execute(j);
+		}
+
+	private:
+		struct job
+		{
+			void (*run)(void* body, size_t begin, size_t end);
+			void* body;
+			size_t count;
+			size_t grain;
+			uint32_t chunks;
+		};
+
+		// chunks [begin, end) of the current call, begin in the low half
+		struct alignas(cache_line) run
+		{
+			std::atomic<uint64_t> range{ 0 };
+		};
+
+		static uint64_t pack_range(uint32_t begin, uint32_t end)
+		{
+			return uint64_t(begin) | uint64_t(end) << 32;
+		}
+
+		static uint32_t range_begin(uint64_t r)
+		{
+			return uint32_t(r);
+		}
+
+		static uint32_t range_end(uint64_t r)
+		{
+			return uint32_t(r >> 32);
+		}
+
+		void execute(const job& j)
+		{
+			std::lock_guard<std::mutex> one_call(call_mutex);
+
+			size_t n = size();
+			for (size_t t = 0; t < n; ++t)
+			{
+				runs[t].range.store(pack_range(uint32_t(j.chunks * t / n), uint32_t(j.chunks * (t + 1) / n)), std::memory_order_relaxed);
+			}
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				current = &j;
+				generation.fetch_add(1, std::memory_order_release);
+			}
+			wake.notify_all();
+
+			work(j, 0);
+
+			// every chunk is taken; wait for the workers still running theirs
+			std::unique_lock<std::mutex> lock(state_mutex);
+			current = nullptr;
+			idle.wait(lock, [this] { return busy == 0; });
+		}
+
+		void work(const job& j, size_t self)
+		{
+			bool& inside = detail::inside_parallel_for();
+			inside = true;
+
+			size_t n = size();
+			std::atomic<uint64_t>& own = runs[self].range;
+			for (;;)
+			{
+				// front of the own run; only thieves change it meanwhile, and they only lower end
+				uint64_t r = own.load(std::memory_order_acquire);
+				while (range_begin(r) < range_end(r))
+				{
+					uint32_t c = range_begin(r);
+					if (own.compare_exchange_weak(r, pack_range(c + 1, range_end(r)), std::memory_order_acq_rel, std::memory_order_acquire))
+					{
+						size_t begin = size_t(c) * j.grain;
+						size_t end = begin + j.grain < j.count ? begin + j.grain : j.count;
+						j.run(j.body, begin, end);
+						r = own.load(std::memory_order_acquire);
+					}
+				}
+
+				// back half of the largest run left; a consumed chunk never returns to any run,
+				// so a range that compares equal is still the one that was looked at
+				size_t victim = n;
+				uint32_t most = 0;
+				for (size_t k = 1; k < n; ++k)
+				{
+					size_t v = (self + k) % n;
+					uint64_t vr = runs[v].range.load(std::memory_order_relaxed);
+					uint32_t left = range_begin(vr) < range_end(vr) ? range_end(vr) - range_begin(vr) : 0;
+					if (left > most)
+					{
+						most = left;
+						victim = v;
+					}
+				}
+				if (victim == n)
+				{
+					break;
+				}
+
+				uint64_t vr = runs[victim].range.load(std::memory_order_acquire);
+				uint32_t b = range_begin(vr), e = range_end(vr);
+				if (b < e)
+				{
+					uint32_t mid = b + (e - b) / 2;
+					if (runs[victim].range.compare_exchange_strong(vr, pack_range(b, mid), std::memory_order_acq_rel, std::memory_order_relaxed))
+					{
+						// the own run is empty, so nobody else writes it
+						own.store(pack_range(mid, e), std::memory_order_release);
+					}
+				}
+			}
+
+			inside = false;
+		}
+
+		void worker_main(size_t self)
+		{
+			// polls a little before sleeping, as calls often come in bursts (one per
+			// hierarchy level, one per batch kernel of a frame)
+			constexpr int spin_rounds = 256;
+
+			uint64_t seen = 0;
+			for (;;)
+			{
+				for (int s = 0; s < spin_rounds && generation.load(std::memory_order_acquire) == seen; ++s)
+				{
+					std::this_thread::yield();
+				}
+
+				std::unique_lock<std::mutex> lock(state_mutex);
+				wake.wait(lock, [&] { return stop || generation.load(std::memory_order_relaxed) != seen; });
+				if (stop)
+				{
+					return;
+				}
+				seen = generation.load(std::memory_order_relaxed);
+				const job* j = current;
+				if (j == nullptr)
+				{
+					continue;
+				}
+
+				++busy;
+				lock.unlock();
+				work(*j, self);
+				lock.lock();
+				if (--busy == 0)
+				{
+					idle.notify_all();
+				}
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::unique_ptr<run[]> runs;
+
+		std::mutex call_mutex;
+		std::mutex state_mutex;
+		std::condition_variable wake;
+		std::condition_variable idle;
+		const job* current = nullptr;
+		std::atomic<uint64_t> generation{ 0 };
+		size_t busy = 0;
+		bool stop = false;
+	};
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "quaternion.h"
+#include "batch_transforms.h"
+#include "thread_pool.h"
+
+namespace xm
+{
+	inline namespace XM_SIMD_ABI
+	{
+		// Scene graph of local translation / rotation / scale transforms and their world
+		// matrices, world = world(parent) * translate(scale(rotate(q), s), t).
+		//
+		// Nodes are kept in breadth-first order (every level contiguous, parents before
+		// children) with the local TRS in SoA streams. Setting a local transform only marks
+		// the node; update() recomposes the local matrices of the marked nodes with the
+		// compose_trs kernel and then walks the levels top down, multiplying world matrices
+		// for exactly the nodes whose local transform or ancestor changed. The nodes of a
+		// level are independent, so each level is handed to the parallel_for in one call.
+		//
+		// Handles returned by add() stay valid; the internal order is rebuilt by the next
+		// update() after nodes were added.
+		template <typename T>
+		struct transform_hierarchy
+		{
+			using node = uint32_t;
+			static constexpr node no_parent = ~node(0);
+
+			size_t size() const
+			{
+				return parent_of.size();
+			}
+
+			// parent must be no_parent or an existing node
+			node add(node parent,
+				const vector<3, T>& translation = vector<3, T>(T(0)),
+				const quaternion<T>& rotation = quaternion<T>(T(1), T(0), T(0), T(0)),
+				const vector<3, T>& scale = vector<3, T>(T(1)))
+			{
+				assert(parent == no_parent || parent < size());
+				node id = node(size());
+				uint32_t i = uint32_t(size());
+
+				parent_of.push_back(parent);
+				index_of.push_back(i);
+				node_at.push_back(id);
+				parent_index.push_back(parent == no_parent ? no_parent : index_of[parent]);
+				local.emplace_back();
+				world.emplace_back();
+				local_dirty.push_back(0);
+				changed_in.push_back(0);
+
+				resize_streams(size());
+				set_local(id, translation, rotation, scale);
+				layout_valid = false;
+				return id;
+			}
+
+			void set_translation(node n, const vector<3, T>& t)
+			{
+				translations.set(index_of[n], t);
+				mark(index_of[n]);
+			}
+
+			void set_rotation(node n, const quaternion<T>& q)
+			{
+				rotations.set(index_of[n], vector<4, T>(q.w, q.m.x, q.m.y, q.m.z));
+				mark(index_of[n]);
+			}
+
+			void set_scale(node n, const vector<3, T>& s)
+			{
+				scales.set(index_of[n], s);
+				mark(index_of[n]);
+			}
+
+			void set_local(node n, const vector<3, T>& t, const quaternion<T>& q, const vector<3, T>& s)
+			{
+				uint32_t i = index_of[n];
+				translations.set(i, t);
+				rotations.set(i, vector<4, T>(q.w, q.m.x, q.m.y, q.m.z));
+				scales.set(i, s);
+				mark(i);
+			}
+
+			vector<3, T> translation(node n) const
+			{
+				return translations.get(index_of[n]);
+			}
+
+			quaternion<T> rotation(node n) const
+			{
+				vector<4, T> q = rotations.get(index_of[n]);
+				return quaternion<T>(q.x, q.y, q.z, q.w);
+			}
+
+			vector<3, T> scale(node n) const
+			{
+				return scales.get(index_of[n]);
+			}
+
+			node parent(node n) const
+			{
+				return parent_of[n];
+			}
+
+			// as of the last update()
+			const matrix<4, T>& local_matrix(node n) const
+			{
+				return local[index_of[n]];
+			}
+
+			const matrix<4, T>& world_matrix(node n) const
+			{
+				return world[index_of[n]];
+			}
+
+			// whether the last update() changed the world matrix of n, e.g. to upload only those
+			bool world_matrix_changed(node n) const
+			{
+				return changed_in[index_of[n]] == frame;
+			}
+
+			// World matrices in the internal breadth-first order; entry i belongs to node_at[i].
+			// Valid until the next add().
+			const matrix<4, T>* world_matrices() const
+			{
+				return world.data();
+			}
+
+			node node_in_order(size_t i) const
+			{
+				return node_at[i];
+			}
+
+			void update()
+			{
+				update(serial_for());
+			}
+
+			template <typename ParallelFor>
+			void update(ParallelFor&& parallel_for)
+			{
+				if (!layout_valid)
+				{
+					rebuild_layout();
+				}
+				++frame;
+
+				// in index order the marked nodes are grouped by level and gathered front to back;
+				// past a few percent of the nodes rereading the flags is cheaper than sorting
+				if (dirty.size() * 16 > size())
+				{
+					dirty.clear();
+					for (uint32_t i = 0; i < size(); ++i)
+					{
+						if (local_dirty[i]) dirty.push_back(i);
+					}
+				}
+				else
+				{
+					std::sort(dirty.begin(), dirty.end());
+				}
+
+				// local matrices of the marked nodes, composed in blocks: each block gathers
+				// its TRS into lanes, runs compose_trs and scatters the matrices back
+				parallel_for(dirty.size(), [this](size_t begin, size_t end)
+					{
+						constexpr size_t block = 64;
+						T lanes[10][block];
+						matrix<4, T> composed[block];
+						for (size_t b = begin; b < end; b += block)
+						{
+							size_t n = end - b < block ? end - b : block;
+							for (size_t k = 0; k < n; ++k)
+							{
+								uint32_t i = dirty[b + k];
+								for (uint8_t c = 0; c < 3; ++c) lanes[c][k] = translations.lane(c)[i];
+								for (uint8_t c = 0; c < 4; ++c) lanes[3 + c][k] = rotations.lane(c)[i];
+								for (uint8_t c = 0; c < 3; ++c) lanes[7 + c][k] = scales.lane(c)[i];
+							}
+							const T* t[3] = { lanes[0], lanes[1], lanes[2] };
+							const T* r[4] = { lanes[3], lanes[4], lanes[5], lanes[6] };
+							const T* s[3] = { lanes[7], lanes[8], lanes[9] };
+							compose_trs(vector_lanes<3, const T>(t, n), vector_lanes<4, const T>(r, n), vector_lanes<3, const T>(s, n), composed);
+							for (size_t k = 0; k < n; ++k)
+							{
+								local[dirty[b + k]] = composed[k];
+							}
+						}
+					});
+
+				// Levels top down. The nodes to update on a level are the children of the nodes
+				// updated on the level above (contiguous ranges in breadth-first order) and the
+				// marked nodes of the level, so untouched subtrees are never visited.
+				changed.clear();
+				size_t d = 0;
+				for (size_t l = 0; l + 1 < level_begin.size() && (d < dirty.size() || !changed.empty()); ++l)
+				{
+					next_changed.clear();
+					for (uint32_t i : changed)
+					{
+						for (uint32_t c = child_begin[i]; c < child_begin[i + 1]; ++c)
+						{
+							changed_in[c] = frame;
+							next_changed.push_back(c);
+						}
+					}
+					for (; d < dirty.size() && dirty[d] < level_begin[l + 1]; ++d)
+					{
+						if (changed_in[dirty[d]] != frame)
+						{
+							changed_in[dirty[d]] = frame;
+							next_changed.push_back(dirty[d]);
+						}
+					}
+
+					parallel_for(next_changed.size(), [this](size_t begin, size_t end)
+						{
+							for (size_t k = begin; k < end; ++k)
+							{
+								uint32_t i = next_changed[k];
+								uint32_t p = parent_index[i];
+								world[i] = p == no_parent ? local[i] : world[p] * local[i];
+							}
+						});
+					changed.swap(next_changed);
+				}
+
+				for (uint32_t i : dirty)
+				{
+					local_dirty[i] = 0;
+				}
+				dirty.clear();
+			}
+
+		private:
+			void mark(uint32_t i)
+			{
+				if (!local_dirty[i])
+				{
+					local_dirty[i] = 1;
+					dirty.push_back(i);
+				}
+			}
+
+			void resize_streams(size_t n)
+			{
+				translations.resize(n);
+				rotations.resize(n);
+				scales.resize(n);
+			}
+
+			// Breadth-first from the roots, children in handle order. Every node's children
+			// then follow each other, and the child ranges of consecutive nodes are adjacent.
+			void rebuild_layout()
+			{
+				size_t n = size();
+
+				// children by handle
+				std::vector<uint32_t> first(n + 1, 0);
+				for (node id = 0; id < n; ++id)
+				{
+					if (parent_of[id] != no_parent) ++first[parent_of[id] + 1];
+				}
+				for (size_t i = 0; i < n; ++i) first[i + 1] += first[i];
+				std::vector<node> children(first[n]);
+				std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+				std::vector<uint32_t> depth(n, 0);
+				for (node id = 0; id < n; ++id)
+				{
+					if (parent_of[id] != no_parent)
+					{
+						children[fill[parent_of[id]]++] = id;
+						depth[id] = depth[parent_of[id]] + 1;
+					}
+				}
+
+				std::vector<node> order;
+				order.reserve(n);
+				for (node id = 0; id < n; ++id)
+				{
+					if (parent_of[id] == no_parent) order.push_back(id);
+				}
+				child_begin.assign(n + 1, 0);
+				level_begin.assign(1, 0);
+				for (size_t i = 0; i < order.size(); ++i)
+				{
+					node id = order[i];
+					if (i > 0 && depth[id] != depth[order[i - 1]]) level_begin.push_back(uint32_t(i));
+					child_begin[i] = uint32_t(order.size());
+					order.insert(order.end(), children.begin() + first[id], children.begin() + first[id + 1]);
+				}
+				child_begin[n] = uint32_t(n);
+				level_begin.push_back(uint32_t(n));
+
+				std::vector<uint32_t> old_index(index_of);
+				std::vector<node> old_node_at(node_at);
+				for (uint32_t i = 0; i < n; ++i)
+				{
+					node_at[i] = order[i];
+					index_of[order[i]] = i;
+				}
+
+				vector_stream<3, T> t(n), s(n);
+				vector_stream<4, T> r(n);
+				std::vector<matrix<4, T>> l(n), w(n);
+				std::vector<uint8_t> ld(n);
+				std::vector<uint32_t> ci(n);
+				for (node id = 0; id < n; ++id)
+				{
+					uint32_t from = old_index[id], to = index_of[id];
+					t.set(to, translations.get(from));
+					r.set(to, rotations.get(from));
+					s.set(to, scales.get(from));
+					l[to] = local[from];
+					w[to] = world[from];
+					ld[to] = local_dirty[from];
+					ci[to] = changed_in[from];
+					parent_index[to] = parent_of[id] == no_parent ? no_parent : index_of[parent_of[id]];
+				}
+				translations = static_cast<vector_stream<3, T>&&>(t);
+				rotations = static_cast<vector_stream<4, T>&&>(r);
+				scales = static_cast<vector_stream<3, T>&&>(s);
+				local.swap(l);
+				world.swap(w);
+				local_dirty.swap(ld);
+				changed_in.swap(ci);
+				for (uint32_t& i : dirty) i = index_of[old_node_at[i]];
+
+				layout_valid = true;
+			}
+
+			// by handle
+			std::vector<node> parent_of;
+			std::vector<uint32_t> index_of;
+
+			// by index, breadth-first
+			std::vector<node> node_at;
+			std::vector<uint32_t> parent_index;
+			std::vector<uint32_t> child_begin;	// children of i are [child_begin[i], child_begin[i + 1])
+			std::vector<uint32_t> level_begin;
+			vector_stream<3, T> translations;
+			vector_stream<4, T> rotations;	// w, x, y, z
+			vector_stream<3, T> scales;
+			std::vector<matrix<4, T>> local;
+			std::vector<matrix<4, T>> world;
+			std::vector<uint8_t> local_dirty;
+			std::vector<uint32_t> changed_in;	// frame of the last world matrix update, 0 for none yet
+
+			std::vector<uint32_t> dirty;
+			std::vector<uint32_t> changed;
+			std::vector<uint32_t> next_changed;
+			uint32_t frame = 1;	// above changed_in 0, which no update() writes
+			bool layout_valid = true;
+		};
+	}
+}
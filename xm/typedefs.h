@@ -2,6 +2,7 @@
 #include "vector.h"
 #include "matrix.h"
 #include "quaternion.h"
+#include "affine.h"
 
 namespace xm
 {
@@ -31,4 +32,16 @@ namespace xm
 
 	using quat = quaternion<float>;
 	using dquat = quaternion<double>;
+
+	using aff3 = affine3<float>;
+	using daff3 = affine3<double>;
+
+	// lanes for T, e.g. vector<3, simd_float8> holds 8 vectors
+	using simd_float4 = pack<float, 4>;
+	using simd_float8 = pack<float, 8>;
+	using simd_float16 = pack<float, 16>;
+
+	using simd_double2 = pack<double, 2>;
+	using simd_double4 = pack<double, 4>;
+	using simd_double8 = pack<double, 8>;
 };
\ No newline at end of file
@@ -2,42 +2,47 @@
 
 #include <type_traits>
 #include "assert.h"
+#include "pack.h"
+#include "constexpr_math.h"
+#include "precision.h"
 
 namespace xm
 {
+	// Passed to the constructors of vector, matrix, quaternion and affine3 to skip the
+	// zero fill, for results and buffers that are completely written right after.
+	struct uninitialized_t
+	{
+		explicit uninitialized_t() = default;
+	};
+
+	constexpr uninitialized_t uninitialized{};
+
 	template <uint8_t N, typename T>
 	struct vector;
 
 	template<typename T>
 	struct vector<2, T>
 	{
-		static_assert(std::is_floating_point_v<T> || std::is_integral_v<T>);
+		static_assert(std::is_floating_point_v<scalar_t<T>> || std::is_integral_v<scalar_t<T>>);
 
-		vector(T x, T y)
-		{
-			this->x = x;
-			this->y = y;
-		}
+		constexpr vector(T x, T y) noexcept : x(x), y(y) {}
 
-		vector(T a)
-		{
-			this->x = a;
-			this->y = a;
-		}
+		constexpr vector(T a) noexcept : x(a), y(a) {}
 
-		vector()
-		{
-			this->x = 0;
-			this->y = 0;
-		}
+		constexpr vector() noexcept : x(0), y(0) {}
 
-		T& operator[](uint8_t i)
+		explicit vector(uninitialized_t) noexcept {}
+
+		// constant evaluation can't index past a member, so it picks the member by name
+		constexpr T& operator[](uint8_t i) noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : y;
 			return *(&x + i);
 		}
 
-		T operator[](uint8_t i) const
+		constexpr T operator[](uint8_t i) const noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : y;
 			return *(&x + i);
 		}
 
@@ -53,35 +58,24 @@ namespace xm
 	template<typename T>
 	struct vector<3, T>
 	{
-		static_assert(std::is_floating_point_v<T> || std::is_integral_v<T>);
-		vector(T x, T y, T z)
-		{
-			this->x = x;
-			this->y = y;
-			this->z = z;
-		}
+		static_assert(std::is_floating_point_v<scalar_t<T>> || std::is_integral_v<scalar_t<T>>);
+		constexpr vector(T x, T y, T z) noexcept : x(x), y(y), z(z) {}
 
-		vector(T a)
-		{
-			this->x = a;
-			this->y = a;
-			this->z = a;
-		}
+		constexpr vector(T a) noexcept : x(a), y(a), z(a) {}
 
-		vector()
-		{
-			this->x = 0;
-			this->y = 0;
-			this->z = 0;
-		}
+		constexpr vector() noexcept : x(0), y(0), z(0) {}
 
-		T& operator[](uint8_t i)
+		explicit vector(uninitialized_t) noexcept {}
+
+		constexpr T& operator[](uint8_t i) noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : i == 1 ? y : z;
 			return *(&x + i);
 		}
 
-		T operator[](uint8_t i) const
+		constexpr T operator[](uint8_t i) const noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : i == 1 ? y : z;
 			return *(&x + i);
 		}
 
@@ -96,38 +90,24 @@ namespace xm
 	template<typename T>
 	struct vector<4, T>
 	{
-		static_assert(std::is_floating_point_v<T> || std::is_integral_v<T>);
-		vector(T x, T y, T z, T w)
-		{
-			this->x = x;
-			this->y = y;
-			this->z = z;
-			this->w = w;
-		}
+		static_assert(std::is_floating_point_v<scalar_t<T>> || std::is_integral_v<scalar_t<T>>);
+		constexpr vector(T x, T y, T z, T w) noexcept : x(x), y(y), z(z), w(w) {}
 
-		vector(T a)
-		{
-			this->x = a;
-			this->y = a;
-			this->z = a;
-			this->w = a;
-		}
+		constexpr vector(T a) noexcept : x(a), y(a), z(a), w(a) {}
 
-		vector()
-		{
-			this->x = 0;
-			this->y = 0;
-			this->z = 0;
-			this->w = 0;
-		}
+		constexpr vector() noexcept : x(0), y(0), z(0), w(0) {}
 
-		T& operator[](uint8_t i)
+		explicit vector(uninitialized_t) noexcept {}
+
+		constexpr T& operator[](uint8_t i) noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : i == 1 ? y : i == 2 ? z : w;
 			return *(&x + i);
 		}
 
-		T operator[](uint8_t i) const
+		constexpr T operator[](uint8_t i) const noexcept
 		{
+			if (detail::is_constant_evaluated()) return i == 0 ? x : i == 1 ? y : i == 2 ? z : w;
 			return *(&x + i);
 		}
 
@@ -139,7 +119,7 @@ namespace xm
 	};
 
 	template <uint8_t N, typename T>
-	vector<N, T> operator*(vector<N, T> a, T v)
+	constexpr vector<N, T> operator*(vector<N, T> a, T v) noexcept
 	{
 		vector<N, T> res;
 		for (uint8_t i = 0; i < N; ++i)
@@ -150,13 +130,13 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	inline vector<N, T> operator*(T v, vector<N, T> a)
+	constexpr vector<N, T> operator*(T v, vector<N, T> a) noexcept
 	{
 		return operator*(a, v);
 	}
 
 	template <uint8_t N, typename T>
-	vector<N, T>& operator*=(vector<N, T>& a, T v)
+	constexpr vector<N, T>& operator*=(vector<N, T>& a, T v) noexcept
 	{
 		for (uint8_t i = 0; i < N; ++i)
 		{
@@ -166,14 +146,14 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	vector<N, T>& operator/=(vector<N, T>& a, T v)
+	constexpr vector<N, T>& operator/=(vector<N, T>& a, T v) noexcept
 	{
 		for (uint8_t i = 0; i < N; ++i) a[i] /= v;
 		return a;
 	}
 
 	template <uint8_t N, typename T>
-	vector<N, T> operator/(vector<N, T> a, T v)
+	constexpr vector<N, T> operator/(vector<N, T> a, T v) noexcept
 	{
 		vector<N, T> res;
 		for (uint8_t i = 0; i < N; ++i)
@@ -184,7 +164,7 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	vector<N, T> operator+(vector<N, T> a, vector<N, T> b)
+	constexpr vector<N, T> operator+(vector<N, T> a, vector<N, T> b) noexcept
 	{
 		vector<N, T> res;
 		for (uint8_t i = 0; i < N; ++i)
@@ -195,7 +175,7 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	vector<N, T> operator-(vector<N, T> a)
+	constexpr vector<N, T> operator-(vector<N, T> a) noexcept
 	{
 		for (uint8_t i = 0; i < N; ++i)
 		{
@@ -205,13 +185,13 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	inline vector<N, T> operator-(vector<N, T> a, vector<N, T> b)
+	constexpr vector<N, T> operator-(vector<N, T> a, vector<N, T> b) noexcept
 	{
 		return operator+(a, -b);
 	}
 
 	template <uint8_t N, typename T>
-	inline vector<N, T>& operator+=(vector<N, T>& a, vector<N, T> b)
+	constexpr vector<N, T>& operator+=(vector<N, T>& a, vector<N, T> b) noexcept
 	{
 		for (uint8_t i = 0; i < N; ++i)
 		{
@@ -221,7 +201,7 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	inline vector<N, T>& operator-=(vector<N, T>& a, vector<N, T> b)
+	constexpr vector<N, T>& operator-=(vector<N, T>& a, vector<N, T> b) noexcept
 	{
 		for (uint8_t i = 0; i < N; ++i)
 		{
@@ -231,7 +211,7 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	T dot(vector<N, T> a, vector<N, T> b)
+	constexpr T dot(vector<N, T> a, vector<N, T> b) noexcept
 	{
 		T res = T(0.0);
 
@@ -244,7 +224,7 @@ namespace xm
 	}
 
 	template <typename T>
-	vector<3, T> crossRH(vector<3, T> a, vector<3, T> b)
+	constexpr vector<3, T> crossRH(vector<3, T> a, vector<3, T> b) noexcept
 	{
 		vector<3, T> res;
 
@@ -256,25 +236,25 @@ namespace xm
 	}
 
 	template <typename T>
-	inline vector<3, T> crossLH(vector<3, T> a, vector<3, T> b)
+	constexpr vector<3, T> crossLH(vector<3, T> a, vector<3, T> b) noexcept
 	{
 		return -crossRH(a, b);
 	}
 
 	template <typename T>
-	inline vector<3, T> cross(vector<3, T> a, vector<3, T> b)
+	constexpr vector<3, T> cross(vector<3, T> a, vector<3, T> b) noexcept
 	{
 		return crossRH(a, b);
 	}
 
 	template <typename T>
-	T cross2D(vector<2, T> a, vector<2, T> b)
+	constexpr T cross2D(vector<2, T> a, vector<2, T> b) noexcept
 	{
 		return a.x * b.y - a.y * b.x;
 	}
 
 	template <uint8_t N, typename T>
-	inline T sumOfSquares(vector<N, T> a)
+	constexpr T sumOfSquares(vector<N, T> a) noexcept
 	{
 		T sum = 0.0;
 		for (uint8_t i = 0; i < N; ++i)
@@ -285,9 +265,38 @@ namespace xm
 	}
 
 	template <uint8_t N, typename T>
-	inline vector<N, T> normalize(vector<N, T> a)
+	constexpr vector<N, T> normalize(vector<N, T> a) noexcept
+	{
+		return a / constexpr_sqrt(sumOfSquares(a));
+	}
+
+	inline namespace XM_SIMD_ABI
 	{
-		return a / sqrt(sumOfSquares(a));
+		// a times rsqrt<P> of its squared length, normalize<precision::fast>(v); quicker than
+		// exact on packs and in the batch normalize, within noise of it for one vector
+		template <precision P, uint8_t N, typename T>
+		vector<N, T> normalize(vector<N, T> a) noexcept
+		{
+			if constexpr (P == precision::exact)
+			{
+				return xm::normalize(a);
+			}
+			else
+			{
+				return a * rsqrt<P>(sumOfSquares(a));
+			}
+		}
+	}
+
+	// component wise select; M is bool for scalar T and the pack's mask for pack T
+	template <typename M, uint8_t N, typename T>
+	constexpr vector<N, T> select(const M& m, vector<N, T> a, vector<N, T> b) noexcept
+	{
+		for (uint8_t i = 0; i < N; ++i)
+		{
+			a[i] = select(m, a[i], b[i]);
+		}
+		return a;
 	}
 
 }
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include "vector.h"
+
+// Opt-in expression templates for element-wise vector arithmetic. Wrapping an operand
+// in lazy() makes the operators below build a small expression object instead of a
+// vector, and the whole chain is evaluated in one pass, component by component, when
+// it is converted to vector<N, T>:
+//
+//	vec3 r = lazy(a) * s + lazy(b) * t - c;
+//
+// Only the operands reached through lazy() are fused; b * t above without it would
+// still build a temporary with the operators of vector.h.
+//
+// lazy() keeps a reference to its operand, so an expression must not outlive the
+// vectors it was built from; convert it (or call eval) within the same statement.
+
+namespace xm
+{
+	template <typename E, uint8_t N, typename T>
+	struct vector_expr
+	{
+		static constexpr uint8_t components = N;
+		using value_type = T;
+
+		const E& self() const
+		{
+			return static_cast<const E&>(*this);
+		}
+
+		operator vector<N, T>() const;
+	};
+
+	template <uint8_t N, typename T>
+	struct vector_ref : vector_expr<vector_ref<N, T>, N, T>
+	{
+		vector_ref(const vector<N, T>& v) : v(v) {}
+
+		T operator[](uint8_t i) const
+		{
+			return v[i];
+		}
+
+		const vector<N, T>& v;
+	};
+
+	template <typename A, typename B, typename Op, uint8_t N, typename T>
+	struct vector_binary : vector_expr<vector_binary<A, B, Op, N, T>, N, T>
+	{
+		vector_binary(const A& a, const B& b) : a(a), b(b) {}
+
+		T operator[](uint8_t i) const
+		{
+			return Op::apply(a[i], b[i]);
+		}
+
+		A a;
+		B b;
+	};
+
+	template <typename A, typename Op, uint8_t N, typename T>
+	struct vector_scalar : vector_expr<vector_scalar<A, Op, N, T>, N, T>
+	{
+		vector_scalar(const A& a, T s) : a(a), s(s) {}
+
+		T operator[](uint8_t i) const
+		{
+			return Op::apply(a[i], s);
+		}
+
+		A a;
+		T s;
+	};
+
+	template <typename A, uint8_t N, typename T>
+	struct vector_negate : vector_expr<vector_negate<A, N, T>, N, T>
+	{
+		vector_negate(const A& a) : a(a) {}
+
+		T operator[](uint8_t i) const
+		{
+			return -a[i];
+		}
+
+		A a;
+	};
+
+	namespace detail
+	{
+		struct expr_add { template <typename T> static T apply(T a, T b) { return a + b; } };
+		struct expr_sub { template <typename T> static T apply(T a, T b) { return a - b; } };
+		struct expr_mul { template <typename T> static T apply(T a, T b) { return a * b; } };
+		struct expr_div { template <typename T> static T apply(T a, T b) { return a / b; } };
+
+		// every component is built straight into the constructor, so the result is never
+		// zero-initialised first
+		template <typename E, uint8_t N, typename T, size_t... I>
+		vector<N, T> eval(const vector_expr<E, N, T>& e, std::index_sequence<I...>)
+		{
+			const E& x = e.self();
+			return vector<N, T>(x[I]...);
+		}
+	}
+
+	template <uint8_t N, typename T>
+	inline vector_ref<N, T> lazy(const vector<N, T>& v)
+	{
+		return vector_ref<N, T>(v);
+	}
+
+	template <typename E, uint8_t N, typename T>
+	inline vector<N, T> eval(const vector_expr<E, N, T>& e)
+	{
+		return detail::eval(e, std::make_index_sequence<N>());
+	}
+
+	template <typename E, uint8_t N, typename T>
+	inline vector_expr<E, N, T>::operator vector<N, T>() const
+	{
+		return eval(*this);
+	}
+
+	template <typename A, typename B, uint8_t N, typename T>
+	inline vector_binary<A, B, detail::expr_add, N, T> operator+(const vector_expr<A, N, T>& a, const vector_expr<B, N, T>& b)
+	{
+		return { a.self(), b.self() };
+	}
+
+	template <typename A, typename B, uint8_t N, typename T>
+	inline vector_binary<A, B, detail::expr_sub, N, T> operator-(const vector_expr<A, N, T>& a, const vector_expr<B, N, T>& b)
+	{
+		return { a.self(), b.self() };
+	}
+
+	// a plain vector on either side joins the expression as a reference
+	template <typename A, uint8_t N, typename T>
+	inline auto operator+(const vector_expr<A, N, T>& a, const vector<N, T>& b)
+	{
+		return a + lazy(b);
+	}
+
+	template <typename B, uint8_t N, typename T>
+	inline auto operator+(const vector<N, T>& a, const vector_expr<B, N, T>& b)
+	{
+		return lazy(a) + b;
+	}
+
+	template <typename A, uint8_t N, typename T>
+	inline auto operator-(const vector_expr<A, N, T>& a, const vector<N, T>& b)
+	{
+		return a - lazy(b);
+	}
+
+	template <typename B, uint8_t N, typename T>
+	inline auto operator-(const vector<N, T>& a, const vector_expr<B, N, T>& b)
+	{
+		return lazy(a) - b;
+	}
+
+	template <typename A, uint8_t N, typename T>
+	inline vector_scalar<A, detail::expr_mul, N, T> operator*(const vector_expr<A, N, T>& a, typename vector_expr<A, N, T>::value_type s)
+	{
+		return { a.self(), s };
+	}
+
+	template <typename A, uint8_t N, typename T>
+	inline vector_scalar<A, detail::expr_mul, N, T> operator*(typename vector_expr<A, N, T>::value_type s, const vector_expr<A, N, T>& a)
+	{
+		return { a.self(), s };
+	}
+
+	template <typename A, uint8_t N, typename T>
+	inline vector_scalar<A, detail::expr_div, N, T> operator/(const vector_expr<A, N, T>& a, typename vector_expr<A, N, T>::value_type s)
+	{
+		return { a.self(), s };
+	}
+
+	template <typename A, uint8_t N, typename T>
+	inline vector_negate<A, N, T> operator-(const vector_expr<A, N, T>& a)
+	{
+		return { a.self() };
+	}
+
+	template <typename A, uint8_t N, typename T>
+	vector<N, T>& operator+=(vector<N, T>& a, const vector_expr<A, N, T>& b)
+	{
+		const A& x = b.self();
+		for (uint8_t i = 0; i < N; ++i)
+		{
+			a[i] += x[i];
+		}
+		return a;
+	}
+
+	template <typename A, uint8_t N, typename T>
+	vector<N, T>& operator-=(vector<N, T>& a, const vector_expr<A, N, T>& b)
+	{
+		const A& x = b.self();
+		for (uint8_t i = 0; i < N; ++i)
+		{
+			a[i] -= x[i];
+		}
+		return a;
+	}
+
+	template <typename A, typename B, uint8_t N, typename T>
+	T dot(const vector_expr<A, N, T>& a, const vector_expr<B, N, T>& b)
+	{
+		const A& x = a.self();
+		const B& y = b.self();
+		T res = x[0] * y[0];
+		for (uint8_t i = 1; i < N; ++i)
+		{
+			res += x[i] * y[i];
+		}
+		return res;
+	}
+}
@@ -0,0 +1,552 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include "pack.h"
+#include "vector.h"
+
+namespace xm
+{
+	// Structure-of-arrays storage for vector<N, T>: one lane per component (x[], y[], ...)
+	// in a single 64 byte aligned allocation. Every lane is padded to a multiple of
+	// 64 bytes so the batch kernels below can run whole packs over the tail; the
+	// padding holds unspecified values.
+	template <uint8_t N, typename T>
+	struct vector_stream
+	{
+		static_assert(std::is_floating_point_v<T>);
+
+		using value_type = T;
+		static constexpr uint8_t components = N;
+		static constexpr size_t alignment = 64;
+		static constexpr size_t lane_padding = alignment / sizeof(T);
+
+		vector_stream() = default;
+
+		explicit vector_stream(size_t size)
+		{
+			resize(size);
+		}
+
+		vector_stream(const vector_stream& other)
+		{
+			*this = other;
+		}
+
+		vector_stream(vector_stream&& other) noexcept
+		{
+			*this = static_cast<vector_stream&&>(other);
+		}
+
+		~vector_stream()
+		{
+			release();
+		}
+
+		vector_stream& operator=(const vector_stream& other)
+		{
+			if (this != &other)
+			{
+				resize(0);
+				resize(other.count);
+				for (uint8_t c = 0; c < N; ++c)
+				{
+					memcpy(lane(c), other.lane(c), other.count * sizeof(T));
+				}
+			}
+			return *this;
+		}
+
+		vector_stream& operator=(vector_stream&& other) noexcept
+		{
+			if (this != &other)
+			{
+				release();
+				data = other.data;
+				count = other.count;
+				capacity = other.capacity;
+				other.data = nullptr;
+				other.count = 0;
+				other.capacity = 0;
+			}
+			return *this;
+		}
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		// lane length including padding
+		size_t padded_size() const
+		{
+			return capacity;
+		}
+
+		// keeps the first min(size(), size) vectors
+		void resize(size_t size)
+		{
+			size_t padded = (size + lane_padding - 1) / lane_padding * lane_padding;
+			if (padded > capacity)
+			{
+				T* grown = static_cast<T*>(::operator new(N * padded * sizeof(T), std::align_val_t(alignment)));
+				for (uint8_t c = 0; c < N; ++c)
+				{
+					if (count != 0)
+					{
+						memcpy(grown + c * padded, lane(c), count * sizeof(T));
+					}
+				}
+				release();
+				data = grown;
+				capacity = padded;
+			}
+			count = size;
+		}
+
+		T* lane(uint8_t component)
+		{
+			return data + component * capacity;
+		}
+
+		const T* lane(uint8_t component) const
+		{
+			return data + component * capacity;
+		}
+
+		vector<N, T> get(size_t i) const
+		{
+			vector<N, T> res;
+			for (uint8_t c = 0; c < N; ++c) res[c] = lane(c)[i];
+			return res;
+		}
+
+		void set(size_t i, const vector<N, T>& v)
+		{
+			for (uint8_t c = 0; c < N; ++c) lane(c)[i] = v[c];
+		}
+
+		// count is ignored: lanes are padded, so whole packs are always in bounds
+		template <typename P>
+		P load(uint8_t component, size_t i, uint8_t /*count*/) const
+		{
+			return P::load(lane(component) + i);
+		}
+
+		template <typename P>
+		void store(uint8_t component, size_t i, P p, uint8_t /*count*/)
+		{
+			p.store(lane(component) + i);
+		}
+
+	private:
+		void release()
+		{
+			if (data != nullptr)
+			{
+				::operator delete(data, std::align_val_t(alignment));
+				data = nullptr;
+			}
+			capacity = 0;
+		}
+
+		T* data = nullptr;
+		size_t count = 0;
+		size_t capacity = 0;
+	};
+
+	// Non-owning view of size vectors laid out stride bytes apart, e.g. an array of
+	// vec3, the xyz part of an array of vec4 or a member of an array of structs.
+	// The batch kernels read and write it in place (gathering each pack lane by lane),
+	// so existing AoS buffers can be fed to them without conversion.
+	// Use vector_span<N, const T> for read-only data.
+	template <uint8_t N, typename T>
+	struct vector_span
+	{
+		using value_type = std::remove_const_t<T>;
+		using element_type = std::conditional_t<std::is_const_v<T>, const vector<N, value_type>, vector<N, value_type>>;
+		using byte_type = std::conditional_t<std::is_const_v<T>, const char, char>;
+		static constexpr uint8_t components = N;
+
+		vector_span(T* first, size_t size, size_t stride)
+			: base(reinterpret_cast<byte_type*>(first)), count(size), stride(stride)
+		{
+		}
+
+		vector_span(element_type* first, size_t size, size_t stride = sizeof(vector<N, value_type>))
+			: base(reinterpret_cast<byte_type*>(first)), count(size), stride(stride)
+		{
+		}
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		element_type& operator[](size_t i) const
+		{
+			return *reinterpret_cast<element_type*>(base + i * stride);
+		}
+
+		template <typename P>
+		P load(uint8_t component, size_t i, uint8_t count) const
+		{
+			alignas(64) value_type tmp[P::width] = {};
+			byte_type* p = base + i * stride + component * sizeof(value_type);
+			for (uint8_t k = 0; k < count; ++k)
+			{
+				tmp[k] = *reinterpret_cast<const value_type*>(p + k * stride);
+			}
+			return P::load(tmp);
+		}
+
+		template <typename P>
+		void store(uint8_t component, size_t i, P v, uint8_t count) const
+		{
+			alignas(64) value_type tmp[P::width];
+			v.store(tmp);
+			byte_type* p = base + i * stride + component * sizeof(value_type);
+			for (uint8_t k = 0; k < count; ++k)
+			{
+				*reinterpret_cast<value_type*>(p + k * stride) = tmp[k];
+			}
+		}
+
+		byte_type* base;
+		size_t count;
+		size_t stride;
+	};
+
+	template <uint8_t N, typename T>
+	vector_span(vector<N, T>*, size_t) -> vector_span<N, T>;
+
+	template <uint8_t N, typename T>
+	vector_span(const vector<N, T>*, size_t) -> vector_span<N, const T>;
+
+	template <uint8_t N, typename T>
+	vector_span(vector<N, T>*, size_t, size_t) -> vector_span<N, T>;
+
+	template <uint8_t N, typename T>
+	vector_span(const vector<N, T>*, size_t, size_t) -> vector_span<N, const T>;
+
+	// Non-owning view of N caller-owned component arrays (x[], y[], ...) holding size
+	// values each. Unlike vector_stream it needs no alignment or padding; a partial last
+	// pack is read and written through a temporary.
+	template <uint8_t N, typename T>
+	struct vector_lanes
+	{
+		using value_type = std::remove_const_t<T>;
+		static constexpr uint8_t components = N;
+
+		vector_lanes(T* const* lanes, size_t size)
+			: count(size)
+		{
+			for (uint8_t c = 0; c < N; ++c) lane[c] = lanes[c];
+		}
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		template <typename P>
+		P load(uint8_t component, size_t i, uint8_t count) const
+		{
+			if (count == P::width)
+			{
+				return P::loadu(lane[component] + i);
+			}
+			alignas(64) value_type tmp[P::width] = {};
+			for (uint8_t k = 0; k < count; ++k) tmp[k] = lane[component][i + k];
+			return P::load(tmp);
+		}
+
+		template <typename P>
+		void store(uint8_t component, size_t i, P v, uint8_t count) const
+		{
+			if (count == P::width)
+			{
+				v.storeu(lane[component] + i);
+				return;
+			}
+			alignas(64) value_type tmp[P::width];
+			v.store(tmp);
+			for (uint8_t k = 0; k < count; ++k) lane[component][i + k] = tmp[k];
+		}
+
+		T* lane[N];
+		size_t count;
+	};
+
+	namespace detail
+	{
+		template <typename S>
+		struct is_stream : std::false_type {};
+
+		template <uint8_t N, typename T>
+		struct is_stream<vector_stream<N, T>> : std::true_type {};
+
+		template <uint8_t N, typename T>
+		struct is_stream<vector_span<N, T>> : std::true_type {};
+
+		template <uint8_t N, typename T>
+		struct is_stream<vector_lanes<N, T>> : std::true_type {};
+
+		template <typename S, typename R = void>
+		using if_stream = std::enable_if_t<is_stream<std::remove_cv_t<std::remove_reference_t<S>>>::value, R>;
+
+		template <typename S>
+		using stream_value = typename std::remove_reference_t<S>::value_type;
+
+		template <uint8_t N, typename T>
+		inline void prepare_output(vector_stream<N, T>& out, size_t size)
+		{
+			out.resize(size);
+		}
+
+		template <uint8_t N, typename T>
+		inline void prepare_output([[maybe_unused]] const vector_span<N, T>& out, [[maybe_unused]] size_t size)
+		{
+			assert(out.size() >= size);
+		}
+
+		template <uint8_t N, typename T>
+		inline void prepare_output([[maybe_unused]] const vector_lanes<N, T>& out, [[maybe_unused]] size_t size)
+		{
+			assert(out.size() >= size);
+		}
+	}
+
+	namespace detail
+	{
+		inline namespace XM_SIMD_ABI
+		{
+			// calls f(i, count) for every pack of native width, the last one possibly partial
+			template <typename T, typename F>
+			inline void for_each_pack(size_t size, F f)
+			{
+				constexpr uint8_t W = native_width<T>;
+				size_t i = 0;
+				for (; i + W <= size; i += W)
+				{
+					f(i, W);
+				}
+				if (i < size)
+				{
+					f(i, uint8_t(size - i));
+				}
+			}
+
+			template <typename P, typename T>
+			inline P load_scalars(const T* in, uint8_t count)
+			{
+				if (count == P::width)
+				{
+					return P::loadu(in);
+				}
+				alignas(64) T tmp[P::width] = {};
+				for (uint8_t k = 0; k < count; ++k) tmp[k] = in[k];
+				return P::load(tmp);
+			}
+
+			template <typename P, typename T>
+			inline void store_scalars(P p, T* out, uint8_t count)
+			{
+				if (count == P::width)
+				{
+					p.storeu(out);
+					return;
+				}
+				alignas(64) T tmp[P::width];
+				p.store(tmp);
+				for (uint8_t k = 0; k < count; ++k) out[k] = tmp[k];
+			}
+		}
+	}
+
+	inline namespace XM_SIMD_ABI
+	{
+		// Batch kernels. Inputs and outputs may be any mix of vector_stream, vector_span and
+		// vector_lanes; a vector_stream output is resized to the input size, the views must
+		// be at least that large. Outputs may alias inputs element for element.
+
+		template <typename A, typename Out>
+		detail::if_stream<A> copy(const A& a, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						out.template store<P>(c, i, a.template load<P>(c, i, n), n);
+					}
+				});
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> add(const A& a, const B& b, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						out.template store<P>(c, i, a.template load<P>(c, i, n) + b.template load<P>(c, i, n), n);
+					}
+				});
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> sub(const A& a, const B& b, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						out.template store<P>(c, i, a.template load<P>(c, i, n) - b.template load<P>(c, i, n), n);
+					}
+				});
+		}
+
+		template <typename A, typename Out>
+		detail::if_stream<A> scale(const A& a, detail::stream_value<A> s, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			detail::prepare_output(out, a.size());
+			P ps(s);
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						out.template store<P>(c, i, a.template load<P>(c, i, n) * ps, n);
+					}
+				});
+		}
+
+		// a + f * (b - a), as xm::lerp
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> lerp(const A& a, const B& b, detail::stream_value<A> f, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			P pf(f);
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						P pa = a.template load<P>(c, i, n);
+						out.template store<P>(c, i, mul_add(pf, b.template load<P>(c, i, n) - pa, pa), n);
+					}
+				});
+		}
+
+		// out[i] = dot(a[i], b[i]); out must hold a.size() values
+		template <typename A, typename B>
+		detail::if_stream<A> dot(const A& a, const B& b, detail::stream_value<A>* out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			static_assert(A::components == B::components);
+			assert(b.size() >= a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					P res = a.template load<P>(0, i, n) * b.template load<P>(0, i, n);
+					for (uint8_t c = 1; c < A::components; ++c)
+					{
+						res = mul_add(a.template load<P>(c, i, n), b.template load<P>(c, i, n), res);
+					}
+					detail::store_scalars(res, out + i, n);
+				});
+		}
+
+		// out[i] = sumOfSquares(a[i]); out must hold a.size() values
+		template <typename A>
+		detail::if_stream<A> sumOfSquares(const A& a, detail::stream_value<A>* out)
+		{
+			dot(a, a, out);
+		}
+
+		template <typename A, typename B, typename Out>
+		detail::if_stream<A> cross(const A& a, const B& b, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			static_assert(A::components == 3 && B::components == 3);
+			assert(b.size() >= a.size());
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					P ax = a.template load<P>(0, i, n), ay = a.template load<P>(1, i, n), az = a.template load<P>(2, i, n);
+					P bx = b.template load<P>(0, i, n), by = b.template load<P>(1, i, n), bz = b.template load<P>(2, i, n);
+
+					out.template store<P>(0, i, ay * bz - az * by, n);
+					out.template store<P>(1, i, az * bx - ax * bz, n);
+					out.template store<P>(2, i, ax * by - ay * bx, n);
+				});
+		}
+
+		template <typename A, typename Out>
+		detail::if_stream<A> normalize(const A& a, Out&& out)
+		{
+			using P = native_pack<detail::stream_value<A>>;
+			detail::prepare_output(out, a.size());
+			detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+				{
+					P v[A::components];
+					P sum = P(0);
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						v[c] = a.template load<P>(c, i, n);
+						sum = mul_add(v[c], v[c], sum);
+					}
+					P len = sqrt(sum);
+					for (uint8_t c = 0; c < A::components; ++c)
+					{
+						out.template store<P>(c, i, v[c] / len, n);
+					}
+				});
+		}
+
+		// normalize<precision::fast>(a, out): every element times rsqrt<Precision> of its
+		// squared length instead of divided by the square root
+		template <precision Precision, typename A, typename Out>
+		detail::if_stream<A> normalize(const A& a, Out&& out)
+		{
+			if constexpr (Precision == precision::exact)
+			{
+				normalize(a, std::forward<Out>(out));
+			}
+			else
+			{
+				using P = native_pack<detail::stream_value<A>>;
+				detail::prepare_output(out, a.size());
+				detail::for_each_pack<detail::stream_value<A>>(a.size(), [&](size_t i, uint8_t n)
+					{
+						P v[A::components];
+						P sum = P(0);
+						for (uint8_t c = 0; c < A::components; ++c)
+						{
+							v[c] = a.template load<P>(c, i, n);
+							sum = mul_add(v[c], v[c], sum);
+						}
+						P inv_len = rsqrt<Precision>(sum);
+						for (uint8_t c = 0; c < A::components; ++c)
+						{
+							out.template store<P>(c, i, v[c] * inv_len, n);
+						}
+					});
+			}
+		}
+	}
+}